@@ -0,0 +1,134 @@
+#include "ReplayHost.h"
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/queue.h>
+#include <deque>
+#include <vector>
+
+HostSerial Serial;
+bool hostLogEnabled = false;
+
+static uint64_t nowMicros = 0;
+static std::deque<twai_message_t> receiveQueue;
+static HostTransmitObserver transmitObserver = nullptr;
+
+void hostSetMicros(uint64_t newMicros)
+{
+    nowMicros = newMicros;
+}
+
+uint64_t hostGetMicros()
+{
+    return nowMicros;
+}
+
+void hostQueueReceive(const twai_message_t *message)
+{
+    receiveQueue.push_back(*message);
+}
+
+void hostSetTransmitObserver(HostTransmitObserver observer)
+{
+    transmitObserver = observer;
+}
+
+unsigned long millis()
+{
+    return (unsigned long)(uint32_t)(nowMicros / 1000);
+}
+
+unsigned long micros()
+{
+    return (unsigned long)(uint32_t)nowMicros;
+}
+
+int64_t esp_timer_get_time()
+{
+    return (int64_t)nowMicros;
+}
+
+void esp_restart()
+{
+    receiveQueue.clear();
+    throw HostRestart();
+}
+
+struct HostQueue
+{
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    std::deque<std::vector<uint8_t>> items;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+    return new HostQueue{length, itemSize, {}};
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait)
+{
+    if (queue->items.size() >= queue->length)
+        return pdFALSE;
+
+    const uint8_t *bytes = (const uint8_t *)item;
+    queue->items.emplace_back(bytes, bytes + queue->itemSize);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticksToWait)
+{
+    if (queue->items.empty())
+        return pdFALSE;
+
+    memcpy(item, queue->items.front().data(), queue->itemSize);
+    queue->items.pop_front();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return queue->items.size();
+}
+
+esp_err_t twai_driver_install(const twai_general_config_t *general, const twai_timing_config_t *timing,
+                              const twai_filter_config_t *filter)
+{
+    return ESP_OK;
+}
+
+esp_err_t twai_start()
+{
+    return ESP_OK;
+}
+
+esp_err_t twai_transmit(const twai_message_t *message, TickType_t ticksToWait)
+{
+    // O barramento do host nunca enche: todo frame sai no instante em que foi enviado
+    if (transmitObserver != nullptr)
+        transmitObserver(nowMicros, message);
+    return ESP_OK;
+}
+
+esp_err_t twai_clear_transmit_queue()
+{
+    // Sem fila no host: não há o que descartar
+    return ESP_OK;
+}
+
+esp_err_t twai_receive(twai_message_t *message, TickType_t ticksToWait)
+{
+    if (receiveQueue.empty())
+        return ESP_ERR_TIMEOUT;
+
+    *message = receiveQueue.front();
+    receiveQueue.pop_front();
+    return ESP_OK;
+}
+
+esp_err_t twai_get_status_info(twai_status_info_t *status)
+{
+    memset(status, 0, sizeof(twai_status_info_t));
+    status->state = TWAI_STATE_RUNNING;
+    status->msgs_to_rx = receiveQueue.size();
+    return ESP_OK;
+}
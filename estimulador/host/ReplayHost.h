@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+#include <driver/twai.h>
+
+/**
+ * Ambiente do host para a reprodução: relógio virtual e driver TWAI sem barramento.
+ * O tempo só anda por `hostSetMicros`; nada depende do relógio da máquina.
+ */
+
+// Relógio virtual em us desde o boot. millis() e micros() derivam dele.
+void hostSetMicros(uint64_t nowMicros);
+uint64_t hostGetMicros();
+
+// Entrega um frame à fila de recepção do driver
+void hostQueueReceive(const twai_message_t *message);
+
+// Chamado a cada twai_transmit com o frame enviado
+typedef void (*HostTransmitObserver)(uint64_t nowMicros, const twai_message_t *message);
+void hostSetTransmitObserver(HostTransmitObserver observer);
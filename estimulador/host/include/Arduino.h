@@ -0,0 +1,48 @@
+#pragma once
+/**
+ * Substituto mínimo do Arduino.h para compilar o firmware no host (env native_replay).
+ * O relógio é virtual: só anda quando a reprodução chama `hostSetMicros`.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+
+using std::max;
+using std::min;
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_TIMEOUT 0x107
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+
+unsigned long millis();
+unsigned long micros();
+
+// Pinos sem efeito no host: a saída da reprodução é a largura publicada pelo modulador
+#define LOW 0
+#define OUTPUT 0x03
+inline void pinMode(uint8_t pin, uint8_t mode) {}
+inline void digitalWrite(uint8_t pin, uint8_t value) {}
+
+// Lança HostRestart; a reprodução captura e executa setup() de novo, como o ESP-32 faria
+[[noreturn]] void esp_restart();
+
+struct HostRestart
+{
+};
+
+// Saída serial descartada; o firmware escreve nela apenas com TWAI_CAPTURE
+struct HostSerial
+{
+    void begin(unsigned long baud) {}
+    int availableForWrite() { return 0; }
+    size_t write(const uint8_t *buffer, size_t length) { return length; }
+};
+
+extern HostSerial Serial;
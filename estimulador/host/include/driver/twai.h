@@ -0,0 +1,91 @@
+#pragma once
+/**
+ * Driver TWAI do host: a fila de recepção é preenchida pela reprodução do log
+ * e cada transmissão é entregue a ela (ver host/ReplayHost.h).
+ */
+#include <stdint.h>
+#include "../freertos/FreeRTOS.h"
+
+typedef int esp_err_t;
+typedef int gpio_num_t;
+
+#define GPIO_NUM_4 4
+#define GPIO_NUM_5 5
+#define GPIO_NUM_16 16
+#define GPIO_NUM_17 17
+
+typedef enum
+{
+    TWAI_MODE_NORMAL,
+    TWAI_MODE_NO_ACK,
+    TWAI_MODE_LISTEN_ONLY
+} twai_mode_t;
+
+typedef enum
+{
+    TWAI_STATE_STOPPED,
+    TWAI_STATE_RUNNING,
+    TWAI_STATE_BUS_OFF,
+    TWAI_STATE_RECOVERING
+} twai_state_t;
+
+typedef struct
+{
+    twai_mode_t mode;
+    gpio_num_t tx_io;
+    gpio_num_t rx_io;
+    uint32_t tx_queue_len;
+    uint32_t rx_queue_len;
+} twai_general_config_t;
+
+typedef struct
+{
+    uint32_t bitrate;
+} twai_timing_config_t;
+
+typedef struct
+{
+    uint32_t acceptance_code;
+    uint32_t acceptance_mask;
+    bool single_filter;
+} twai_filter_config_t;
+
+typedef struct
+{
+    twai_state_t state;
+    uint32_t msgs_to_tx;
+    uint32_t msgs_to_rx;
+    uint32_t tx_error_counter;
+    uint32_t rx_error_counter;
+    uint32_t tx_failed_count;
+    uint32_t rx_missed_count;
+    uint32_t rx_overrun_count;
+    uint32_t arb_lost_count;
+    uint32_t bus_error_count;
+} twai_status_info_t;
+
+typedef struct
+{
+    uint32_t flags;
+    uint32_t identifier;
+    uint8_t data_length_code;
+    uint8_t data[8];
+} twai_message_t;
+
+#define TWAI_MSG_FLAG_NONE 0
+#define TWAI_MSG_FLAG_SELF 0x08
+
+#define TWAI_GENERAL_CONFIG_DEFAULT(tx, rx, mode) {mode, tx, rx, 5, 5}
+#define TWAI_TIMING_CONFIG_125KBITS() {125000}
+#define TWAI_TIMING_CONFIG_250KBITS() {250000}
+#define TWAI_TIMING_CONFIG_500KBITS() {500000}
+#define TWAI_TIMING_CONFIG_1MBITS() {1000000}
+#define TWAI_FILTER_CONFIG_ACCEPT_ALL() {0, 0xFFFFFFFF, true}
+
+esp_err_t twai_driver_install(const twai_general_config_t *general, const twai_timing_config_t *timing,
+                              const twai_filter_config_t *filter);
+esp_err_t twai_start();
+esp_err_t twai_transmit(const twai_message_t *message, TickType_t ticksToWait);
+esp_err_t twai_clear_transmit_queue();
+esp_err_t twai_receive(twai_message_t *message, TickType_t ticksToWait);
+esp_err_t twai_get_status_info(twai_status_info_t *status);
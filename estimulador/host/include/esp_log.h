@@ -0,0 +1,18 @@
+#pragma once
+#include <stdio.h>
+
+// Mensagens de log vão para stderr quando a reprodução roda com --verbose
+extern bool hostLogEnabled;
+unsigned long micros();
+
+#define HOST_LOG(letter, tag, format, ...)                                                                    \
+    do                                                                                                       \
+    {                                                                                                        \
+        if (hostLogEnabled)                                                                                  \
+            fprintf(stderr, letter " (%lu) %s: " format "\n", micros(), tag, ##__VA_ARGS__);                 \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG("W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG("I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) HOST_LOG("D", tag, format, ##__VA_ARGS__)
@@ -0,0 +1,307 @@
+/**
+ * Reprodução determinística de uma captura do barramento (env Capture_serial) no host.
+ *
+ * Os frames recebidos no log são entregues ao firmware real (setup/loop do main.cpp, estados,
+ * controle, rampa) no instante em que foram capturados, sobre um relógio virtual. Cada mudança da
+ * largura entregue ao modulador é escrita em stdout no mesmo formato das linhas `pwm` da captura.
+ *
+ * Uso: replay <captura.log> [--tick-us N] [--tail-ms N] [--rebase] [--compare] [--verbose]
+ */
+#include <Arduino.h>
+#include <stdlib.h>
+#include <vector>
+#include "ReplayHost.h"
+#include "../src/Modulator.h"
+#include "../src/Pulse/PulseHalSim.h"
+
+void setup();
+void loop();
+
+extern bool hostLogEnabled;
+
+// Quanto o relógio virtual anda entre duas chamadas do loop quando não há frame chegando.
+// Saídas disparadas por frames (controle, estados) saem iguais às do ESP-32 com qualquer valor;
+// as que dependem só do tempo (rampas, perda do gateway) são amostradas nesta resolução.
+#define REPLAY_DEFAULT_TICK_MICROS 1000
+
+// Depois do último registro, o loop continua por este tempo para as rampas e timeouts terminarem.
+// Com --compare, não há cauda.
+#define REPLAY_DEFAULT_TAIL_MILLIS 1000
+
+// Um relógio de 32 bits que volta para perto de zero a menos disso do fim deu a volta;
+// fora disso, o ESP-32 reiniciou
+#define REPLAY_WRAP_WINDOW_MICROS 10000000ULL
+
+// Com --rebase, o primeiro registro passa a chegar 1 s após o boot (logs do candump usam época)
+#define REPLAY_REBASE_MICROS 1000000ULL
+
+enum class EntryKind
+{
+    Received,
+    Transmitted,
+    PulseWidth
+};
+
+struct LogEntry
+{
+    uint64_t micros;
+    EntryKind kind;
+    twai_message_t message;
+};
+
+struct PulseWidthChange
+{
+    uint64_t micros;
+    uint16_t pulseWidth;
+};
+
+static std::vector<PulseWidthChange> replayed;
+
+static int hexValue(char digit)
+{
+    if (digit >= '0' && digit <= '9')
+        return digit - '0';
+    if (digit >= 'A' && digit <= 'F')
+        return digit - 'A' + 10;
+    if (digit >= 'a' && digit <= 'f')
+        return digit - 'a' + 10;
+    return -1;
+}
+
+/**
+ * Uma linha do candump: `(1.000200) can0 023#00C8`. Linhas vazias e comentários (#) são ignorados.
+ * Retorna false se a linha não for um registro.
+ */
+static bool parseLine(const char *line, uint64_t *rawMicros, LogEntry *entry)
+{
+    unsigned long long seconds, fraction;
+    char interface[16], frame[64];
+    if (sscanf(line, " (%llu.%llu) %15s %63s", &seconds, &fraction, interface, frame) != 4)
+        return false;
+
+    *rawMicros = seconds * 1000000ULL + fraction;
+
+    if (strcmp(interface, "tx") == 0)
+        entry->kind = EntryKind::Transmitted;
+    else if (strcmp(interface, "pwm") == 0)
+        entry->kind = EntryKind::PulseWidth;
+    else
+        entry->kind = EntryKind::Received;
+
+    char *separator = strchr(frame, '#');
+    if (separator == nullptr)
+        return false;
+    *separator = '\0';
+
+    memset(&entry->message, 0, sizeof(twai_message_t));
+    entry->message.identifier = strtoul(frame, nullptr, 16);
+
+    const char *payload = separator + 1;
+    uint8_t length = 0;
+    while (payload[0] != '\0' && payload[1] != '\0' && length < 8)
+    {
+        int high = hexValue(payload[0]);
+        int low = hexValue(payload[1]);
+        if (high < 0 || low < 0)
+            return false;
+        entry->message.data[length++] = (high << 4) | low;
+        payload += 2;
+    }
+    entry->message.data_length_code = length;
+    return true;
+}
+
+static bool readLog(const char *path, bool rebase, std::vector<LogEntry> *entries)
+{
+    FILE *file = fopen(path, "r");
+    if (file == nullptr)
+    {
+        perror(path);
+        return false;
+    }
+
+    // O micros() do ESP-32 tem 32 bits e zera num reinício; a linha do tempo da reprodução é contínua
+    uint64_t offset = 0;
+    uint64_t previous = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file) != nullptr)
+    {
+        LogEntry entry;
+        uint64_t rawMicros;
+        if (!parseLine(line, &rawMicros, &entry))
+            continue;
+
+        if (!entries->empty() && rawMicros + offset < previous)
+        {
+            if (previous - offset > (1ULL << 32) - REPLAY_WRAP_WINDOW_MICROS)
+                offset += 1ULL << 32;
+            else
+                offset = previous;
+        }
+
+        entry.micros = rawMicros + offset;
+        previous = entry.micros;
+        entries->push_back(entry);
+    }
+    fclose(file);
+
+    if (rebase && !entries->empty())
+    {
+        uint64_t first = (*entries)[0].micros;
+        for (LogEntry &entry : *entries)
+            entry.micros = entry.micros - first + REPLAY_REBASE_MICROS;
+    }
+    return true;
+}
+
+static void printPulseWidth(uint64_t micros, uint16_t pulseWidth)
+{
+    printf("(%llu.%06llu) pwm 000#%02X%02X\n", (unsigned long long)(micros / 1000000),
+           (unsigned long long)(micros % 1000000), pulseWidth >> 8, pulseWidth & 0xFF);
+}
+
+// Um passo do firmware no instante atual do relógio virtual. Um esp_restart() executa o setup de novo.
+static void runFirmware(void (*step)())
+{
+    try
+    {
+        step();
+    }
+    catch (HostRestart &)
+    {
+        if (hostLogEnabled)
+            fprintf(stderr, "I (%lu) replay: esp_restart\n", micros());
+        runFirmware(setup);
+    }
+}
+
+static bool compareWithCapture(const std::vector<LogEntry> &entries)
+{
+    std::vector<PulseWidthChange> captured;
+    for (const LogEntry &entry : entries)
+    {
+        if (entry.kind == EntryKind::PulseWidth)
+            captured.push_back({entry.micros, (uint16_t)((entry.message.data[0] << 8) | entry.message.data[1])});
+    }
+
+    if (captured.empty())
+    {
+        fprintf(stderr, "A captura não tem linhas pwm para comparar\n");
+        return false;
+    }
+
+    size_t count = std::min(captured.size(), replayed.size());
+    int64_t maxSkew = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (captured[i].pulseWidth != replayed[i].pulseWidth)
+        {
+            fprintf(stderr, "Divergência na mudança %zu: capturado %u us em %llu us, reproduzido %u us em %llu us\n",
+                    i, captured[i].pulseWidth, (unsigned long long)captured[i].micros, replayed[i].pulseWidth,
+                    (unsigned long long)replayed[i].micros);
+            return false;
+        }
+
+        int64_t skew = (int64_t)replayed[i].micros - (int64_t)captured[i].micros;
+        if (llabs(skew) > llabs(maxSkew))
+            maxSkew = skew;
+    }
+
+    if (captured.size() != replayed.size())
+    {
+        fprintf(stderr, "Quantidade de mudanças difere: capturadas %zu, reproduzidas %zu\n", captured.size(),
+                replayed.size());
+        return false;
+    }
+
+    fprintf(stderr, "%zu mudanças de largura idênticas; maior diferença de instante: %lld us\n", count,
+            (long long)maxSkew);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = nullptr;
+    uint64_t tickMicros = REPLAY_DEFAULT_TICK_MICROS;
+    uint64_t tailMicros = REPLAY_DEFAULT_TAIL_MILLIS * 1000ULL;
+    bool rebase = false;
+    bool compare = false;
+    bool validArguments = true;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--tick-us") == 0 && i + 1 < argc)
+            tickMicros = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--tail-ms") == 0 && i + 1 < argc)
+            tailMicros = strtoull(argv[++i], nullptr, 10) * 1000ULL;
+        else if (strcmp(argv[i], "--rebase") == 0)
+            rebase = true;
+        else if (strcmp(argv[i], "--compare") == 0)
+            compare = true;
+        else if (strcmp(argv[i], "--verbose") == 0)
+            hostLogEnabled = true;
+        else if (path == nullptr && argv[i][0] != '-')
+            path = argv[i];
+        else
+            validArguments = false;
+    }
+
+    if (!validArguments || path == nullptr || tickMicros == 0)
+    {
+        fprintf(stderr, "Uso: %s <captura.log> [--tick-us N] [--tail-ms N] [--rebase] [--compare] [--verbose]\n",
+                argv[0]);
+        return 2;
+    }
+
+    std::vector<LogEntry> entries;
+    if (!readLog(path, rebase, &entries))
+        return 2;
+
+    // Na comparação, a reprodução para onde a captura parou
+    if (compare)
+        tailMicros = 0;
+
+    uint64_t now = 0;
+    uint64_t end = (entries.empty() ? 0 : entries.back().micros) + tailMicros;
+    size_t next = 0;
+
+    hostSetMicros(now);
+    pulseHalSimSetTime(now);
+    runFirmware(setup);
+    uint16_t lastPulseWidth = modulatorGetPulseWidth();
+
+    while (true)
+    {
+        for (; next < entries.size() && entries[next].micros <= now; next++)
+        {
+            if (entries[next].kind == EntryKind::Received)
+                hostQueueReceive(&entries[next].message);
+        }
+
+        modulatorService();
+        runFirmware(loop);
+
+        uint16_t pulseWidth = modulatorGetPulseWidth();
+        if (pulseWidth != lastPulseWidth)
+        {
+            lastPulseWidth = pulseWidth;
+            replayed.push_back({now, pulseWidth});
+            printPulseWidth(now, pulseWidth);
+        }
+
+        if (now >= end)
+            break;
+
+        uint64_t following = now + tickMicros;
+        if (next < entries.size() && entries[next].micros < following)
+            following = entries[next].micros;
+
+        now = following;
+        hostSetMicros(now);
+        pulseHalSimSetTime((uint32_t)now);
+    }
+
+    if (compare)
+        return compareWithCapture(entries) ? 0 : 1;
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include "Capture.h"
+#ifdef TWAI_CAPTURE
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+
+enum class CapturedKind : uint8_t
+{
+    Received,
+    Transmitted,
+    PulseWidth
+};
+
+struct CapturedFrame
+{
+    uint32_t micros;
+    uint16_t identifier;
+    uint8_t length;
+    CapturedKind kind;
+    uint8_t data[8];
+};
+
+static const char *INTERFACE_NAMES[] = {"can0", "tx", "pwm"};
+
+static CapturedFrame ring[CAPTURE_RING_LENGTH];
+static uint16_t ringHead = 0;
+static uint16_t ringCount = 0;
+static uint32_t dropped = 0;
+static uint32_t droppedReported = 0;
+static portMUX_TYPE ringLock = portMUX_INITIALIZER_UNLOCKED;
+
+void captureBegin()
+{
+    Serial.begin(CAPTURE_SERIAL_BAUD);
+    ringHead = 0;
+    ringCount = 0;
+    dropped = 0;
+    droppedReported = 0;
+}
+
+static void push(const CapturedFrame &frame)
+{
+    portENTER_CRITICAL(&ringLock);
+    if (ringCount < CAPTURE_RING_LENGTH)
+    {
+        ring[(ringHead + ringCount) % CAPTURE_RING_LENGTH] = frame;
+        ringCount++;
+    }
+    else
+    {
+        dropped++;
+    }
+    portEXIT_CRITICAL(&ringLock);
+}
+
+void captureRecord(const twai_message_t *message, bool transmitted)
+{
+    CapturedFrame frame;
+    frame.micros = micros();
+    frame.identifier = message->identifier;
+    frame.length = message->data_length_code > 8 ? 8 : message->data_length_code;
+    frame.kind = transmitted ? CapturedKind::Transmitted : CapturedKind::Received;
+    memcpy(frame.data, message->data, sizeof(frame.data));
+    push(frame);
+}
+
+void captureRecordPulseWidth(uint16_t pulseWidthMicros)
+{
+    CapturedFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.micros = micros();
+    frame.length = 2;
+    frame.kind = CapturedKind::PulseWidth;
+    frame.data[0] = pulseWidthMicros >> 8;
+    frame.data[1] = pulseWidthMicros & 0xFF;
+    push(frame);
+}
+
+void captureLoop()
+{
+    char line[48];
+
+    if (dropped != droppedReported)
+    {
+        int length = snprintf(line, sizeof(line), "# %lu frames descartados\n", (unsigned long)dropped);
+        if (Serial.availableForWrite() < length)
+            return;
+        Serial.write((const uint8_t *)line, length);
+        droppedReported = dropped;
+    }
+
+    while (ringCount > 0)
+    {
+        CapturedFrame frame = ring[ringHead];
+
+        int length = snprintf(line, sizeof(line), "(%lu.%06lu) %s %03X#", (unsigned long)(frame.micros / 1000000),
+                              (unsigned long)(frame.micros % 1000000), INTERFACE_NAMES[(uint8_t)frame.kind],
+                              frame.identifier);
+        for (uint8_t i = 0; i < frame.length; i++)
+            length += snprintf(line + length, sizeof(line) - length, "%02X", frame.data[i]);
+        line[length++] = '\n';
+
+        if (Serial.availableForWrite() < length)
+            return;
+        Serial.write((const uint8_t *)line, length);
+
+        portENTER_CRITICAL(&ringLock);
+        ringHead = (ringHead + 1) % CAPTURE_RING_LENGTH;
+        ringCount--;
+        portEXIT_CRITICAL(&ringLock);
+    }
+}
+#endif
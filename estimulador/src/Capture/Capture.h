@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+#include <driver/twai.h>
+
+/**
+ * Captura dos frames do barramento pela serial, no formato de log do candump:
+ *   (segundos.microssegundos) can0 021#00C8   <- frame recebido
+ *   (segundos.microssegundos) tx 028#00C8     <- frame enviado
+ *   (segundos.microssegundos) pwm 000#00C8    <- nova largura entregue ao modulador
+ * O instante é o micros() em que o firmware tratou o frame. O log pode ser reproduzido no host
+ * com o `native_replay` (ver host/README.md), que compara as linhas `pwm`.
+ *
+ * Só é compilada com -DTWAI_CAPTURE (env Capture_serial).
+ */
+#ifdef TWAI_CAPTURE
+
+// Velocidade da serial na captura; 115200 não dá conta de todo o tráfego
+#define CAPTURE_SERIAL_BAUD 921600
+
+// Registros aguardando a serial. Se encher, os seguintes são descartados e contados.
+#define CAPTURE_RING_LENGTH 256
+
+void captureBegin();
+
+// Registra um frame. Pode ser chamado dos dois núcleos.
+void captureRecord(const twai_message_t *message, bool transmitted);
+
+// Registra a largura de pulso publicada para o modulador
+void captureRecordPulseWidth(uint16_t pulseWidthMicros);
+
+// Escreve na serial o que couber no buffer dela, sem bloquear
+void captureLoop();
+#endif
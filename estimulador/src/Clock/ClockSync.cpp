@@ -0,0 +1,11 @@
+#include "ClockSync.h"
+#include "../Twai/TwaiNode.h"
+#include <Arduino.h>
+
+NodeTimestamp clockSyncNow()
+{
+    NodeTimestamp timestamp;
+    timestamp.node = twaiNodeAddress();
+    timestamp.micros = micros();
+    return timestamp;
+}
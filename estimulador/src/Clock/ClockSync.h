@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+
+// O mesmo que em gateway/src/Clock/ClockSync.h
+#define CLOCK_NODE_GATEWAY 0
+
+/**
+ * Instante no relógio (micros()) de um dos nós: o gateway ou um estimulador, pelo endereço no barramento
+ * (TwaiNode.h). O gateway estima o offset e a deriva deste relógio a partir da troca
+ * LatencyPing/LatencyEcho (ver LinkMonitor.h) e leva ao relógio dele os instantes que o estimulador
+ * envia; aqui só se carimba.
+ */
+struct NodeTimestamp
+{
+    uint8_t node;
+    uint32_t micros;
+};
+
+NodeTimestamp clockSyncNow();
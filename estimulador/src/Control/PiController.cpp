@@ -0,0 +1,97 @@
+#include "PiController.h"
+
+static int32_t weightGainQ16;
+static int32_t proportionalGainQ16;
+static int32_t integralGainQ16;
+
+// Contribuição acumulada do termo integral, em us de largura (Q16)
+static int64_t integralQ16 = 0;
+
+static PiControllerTrace trace;
+
+static int32_t hundredthsToQ16(uint16_t hundredths)
+{
+    return ((int32_t)hundredths * PI_Q16_ONE + 50) / 100;
+}
+
+static int64_t clamp64(int64_t value, int64_t minimum, int64_t maximum)
+{
+    if (value < minimum)
+        return minimum;
+    if (value > maximum)
+        return maximum;
+    return value;
+}
+
+void piControllerBegin()
+{
+    weightGainQ16 = hundredthsToQ16(PI_DEFAULT_WEIGHT_GAIN);
+    proportionalGainQ16 = hundredthsToQ16(PI_DEFAULT_PROPORTIONAL_GAIN);
+    integralGainQ16 = hundredthsToQ16(PI_DEFAULT_INTEGRAL_GAIN);
+    piControllerReset();
+}
+
+void piControllerReset()
+{
+    integralQ16 = 0;
+}
+
+uint16_t piControllerStep(const PiControllerInput *input, uint32_t elapsedMs)
+{
+    if (elapsedMs > PI_CONTROLLER_MAX_STEP_MS)
+        elapsedMs = PI_CONTROLLER_MAX_STEP_MS;
+
+    // 0,1 × setpoint sem arredondamento: o erro é calculado em décimos
+    int64_t errorQ16 = ((int64_t)input->weight * 10 - input->setpoint) * PI_Q16_ONE / 10;
+
+    int64_t maximumQ16 = (int64_t)input->meseMax * PI_Q16_ONE;
+    int64_t minimumQ16 = (int64_t)input->meseMax * 4 * PI_Q16_ONE / 5;
+
+    int64_t baseQ16 = (int64_t)input->mese * PI_Q16_ONE + (int64_t)input->weight * weightGainQ16 +
+                      ((errorQ16 * proportionalGainQ16) >> 16);
+
+    // Ki é por segundo
+    int64_t incrementQ16 = (errorQ16 * integralGainQ16 / 1000 * elapsedMs) >> 16;
+
+    // Anti-windup por integração condicional: com a saída saturada, o integral não anda no sentido da
+    // saturação. O valor acumulado nunca é reescrito a partir do termo proporcional.
+    int64_t unclampedQ16 = baseQ16 + integralQ16;
+    bool saturatedHigh = unclampedQ16 >= maximumQ16 && incrementQ16 > 0;
+    bool saturatedLow = unclampedQ16 <= minimumQ16 && incrementQ16 < 0;
+    if (!saturatedHigh && !saturatedLow)
+        integralQ16 = clamp64(integralQ16 + incrementQ16, -maximumQ16, maximumQ16);
+
+    int64_t outputQ16 = clamp64(baseQ16 + integralQ16, minimumQ16, maximumQ16);
+
+    trace.weight = input->weight;
+    trace.errorTenths = (int64_t)input->weight * 10 - input->setpoint;
+    trace.integralMicros = integralQ16 >> 16;
+    trace.output = outputQ16 >> 16;
+    trace.minimum = minimumQ16 >> 16;
+    trace.maximum = input->meseMax;
+
+    return trace.output;
+}
+
+PiControllerTrace piControllerGetTrace()
+{
+    return trace;
+}
+
+void piControllerOnTWAIMessage(TwaiReceivedMessage *receivedMessage)
+{
+    switch (receivedMessage->Kind)
+    {
+    case TwaiReceivedMessageKind::SetGainCoefficient:
+        weightGainQ16 = hundredthsToQ16(receivedMessage->ExtraData);
+        break;
+    case TwaiReceivedMessageKind::SetProportionalGain:
+        proportionalGainQ16 = hundredthsToQ16(receivedMessage->ExtraData);
+        break;
+    case TwaiReceivedMessageKind::SetIntegralGain:
+        integralGainQ16 = hundredthsToQ16(receivedMessage->ExtraData);
+        break;
+    default:
+        break;
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <stdint.h>
+#include "../Twai/Twai.h"
+
+// Passo máximo do integral; um intervalo maior entre amostras (pacote perdido, pausa) conta como este
+#define PI_CONTROLLER_MAX_STEP_MS 50
+
+// Ganhos e estado em ponto fixo Q16.16
+#define PI_Q16_ONE 65536
+
+// Ganhos padrão, em centésimos. Com o integral em 0, a saída é a mesma da fórmula original.
+#define PI_DEFAULT_WEIGHT_GAIN 50
+#define PI_DEFAULT_PROPORTIONAL_GAIN 30
+#define PI_DEFAULT_INTEGRAL_GAIN 0
+
+struct PiControllerInput
+{
+    // Peso medido, já sem o peso residual
+    int32_t weight;
+
+    // Setpoint total das duas barras
+    int32_t setpoint;
+
+    uint16_t mese;
+    uint16_t meseMax;
+};
+
+// Volta os ganhos aos padrões e zera o integral
+void piControllerBegin();
+
+// Zera o integral, mantendo os ganhos recebidos
+void piControllerReset();
+
+// Valores internos do último passo, para a telemetria
+struct PiControllerTrace
+{
+    int32_t weight;
+    int32_t errorTenths;
+    int32_t integralMicros;
+    uint16_t output;
+    uint16_t minimum;
+    uint16_t maximum;
+};
+
+/**
+ * Um passo do controle, a cada amostra nova de peso, `elapsedMs` depois da anterior:
+ *   erro  = peso - 0,1 × setpoint
+ *   saída = mese + Kw × peso + Kp × erro + Ki × ∫erro dt
+ * A saída é limitada à faixa [0,8 × meseMax, meseMax]. Enquanto a saída está saturada, o integral não
+ * anda no sentido da saturação (anti-windup), e ele nunca passa de ±meseMax. Com Ki = 0, o integral
+ * fica em 0 e a saída é a da fórmula original.
+ */
+uint16_t piControllerStep(const PiControllerInput *input, uint32_t elapsedMs);
+
+PiControllerTrace piControllerGetTrace();
+
+// Trata as mensagens de ganho (Kw, Kp e Ki, em centésimos; Ki por segundo)
+void piControllerOnTWAIMessage(TwaiReceivedMessage *receivedMessage);
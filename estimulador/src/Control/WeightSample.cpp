@@ -0,0 +1,64 @@
+#include "WeightSample.h"
+#include <Arduino.h>
+
+static WeightSample latest;
+static WeightSample previous;
+static bool hasLatest = false;
+static bool hasPrevious = false;
+static bool latestTaken = true;
+
+void weightSampleReset()
+{
+    hasLatest = false;
+    hasPrevious = false;
+    latestTaken = true;
+}
+
+void weightSampleOnTWAIMessage(TwaiReceivedMessage *receivedMessage)
+{
+    WeightSample sample;
+    sample.weight = receivedMessage->ExtraData;
+    sample.sequence = receivedMessage->Payload[2];
+    // Idade contada a partir da chegada do frame, não de quando o loop chegou nele
+    unsigned long waitedMs = (micros() - receivedMessage->ReceivedMicros) / 1000;
+    sample.acquiredMs = millis() - waitedMs - receivedMessage->Payload[3];
+
+    // O gateway reenvia a mesma amostra até as balanças terem uma leitura nova
+    if (hasLatest && sample.sequence == latest.sequence)
+        return;
+
+    previous = latest;
+    hasPrevious = hasLatest;
+    latest = sample;
+    hasLatest = true;
+    latestTaken = false;
+}
+
+bool weightSampleTakeNew(WeightSample *sample, unsigned long *elapsedMs)
+{
+    if (latestTaken)
+        return false;
+
+    latestTaken = true;
+    *sample = latest;
+    *elapsedMs = hasPrevious ? latest.acquiredMs - previous.acquiredMs : 0;
+    return true;
+}
+
+int32_t weightSamplePredict(unsigned long nowMs)
+{
+    if (!hasLatest)
+        return 0;
+
+    unsigned long spacingMs = latest.acquiredMs - previous.acquiredMs;
+    if (!hasPrevious || spacingMs == 0 || spacingMs > WEIGHT_SLOPE_MAX_SPACING_MS)
+        return latest.weight;
+
+    unsigned long horizonMs = nowMs - latest.acquiredMs;
+    if (horizonMs > WEIGHT_PREDICTION_MAX_HORIZON_MS)
+        horizonMs = WEIGHT_PREDICTION_MAX_HORIZON_MS;
+
+    int32_t delta = (int32_t)latest.weight - previous.weight;
+    int32_t predicted = latest.weight + delta * (int32_t)horizonMs / (int32_t)spacingMs;
+    return predicted < 0 ? 0 : predicted;
+}
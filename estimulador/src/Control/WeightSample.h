@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+#include "../Twai/Twai.h"
+
+// Horizonte máximo da predição; amostras mais velhas que isso não são extrapoladas além dele
+#define WEIGHT_PREDICTION_MAX_HORIZON_MS 50
+
+// Duas amostras mais distantes que isso não dão uma inclinação confiável
+#define WEIGHT_SLOPE_MAX_SPACING_MS 100
+
+/**
+ * Uma leitura das balanças, como enviada pelo gateway: [peso u16][sequência u8][idade em ms u8].
+ * `acquiredMs` é o instante estimado da leitura no relógio do estimulador (recepção - idade).
+ */
+struct WeightSample
+{
+    uint16_t weight;
+    uint8_t sequence;
+    unsigned long acquiredMs;
+};
+
+void weightSampleReset();
+
+// Registra o frame WeightTotal recebido
+void weightSampleOnTWAIMessage(TwaiReceivedMessage *receivedMessage);
+
+// Retorna true uma vez por amostra nova, com o intervalo desde a amostra anterior
+bool weightSampleTakeNew(WeightSample *sample, unsigned long *elapsedMs);
+
+/**
+ * Peso previsto para `nowMs`, extrapolando linearmente as duas últimas amostras.
+ * Compensa o atraso da leitura, do filtro e do barramento; sem inclinação confiável, retorna a última amostra.
+ */
+int32_t weightSamplePredict(unsigned long nowMs);
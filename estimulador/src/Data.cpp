@@ -6,5 +6,8 @@ void dataReset()
 {
     memset(&data, 0, sizeof(data));
 
-    data.gainCoefficient = 0.5f;
+    for (int channel = 0; channel < PULSE_CHANNEL_COUNT; channel++)
+    {
+        data.channelAmplitudePercent[channel] = 100;
+    }
 }
\ No newline at end of file
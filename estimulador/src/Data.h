@@ -1,5 +1,6 @@
 #pragma once
 #include <stdint.h>
+#include "Pulse/PulseEngine.h"
 
 struct Data
 {
@@ -9,7 +10,12 @@ struct Data
     uint16_t mese;
     uint16_t meseMax;
     uint16_t setpointKg;
-    float gainCoefficient;
+
+    // Amplitude de cada par de canais, em porcentagem de `requestedPwm`
+    uint8_t channelAmplitudePercent[PULSE_CHANNEL_COUNT];
+
+    // Início pedido de cada par de canais, relativo ao início do pulso
+    uint16_t channelOffsetMicros[PULSE_CHANNEL_COUNT];
 };
 
 extern Data data;
@@ -0,0 +1,231 @@
+#include "LinkMonitor.h"
+#include "../Twai/TwaiHealth.h"
+#include <Arduino.h>
+#include <string.h>
+#include <esp_log.h>
+
+static const char *TAG = "LinkMonitor";
+
+static uint16_t timeoutMs = LINK_DEFAULT_TIMEOUT_MS;
+static bool armed = false;
+static bool lost = false;
+static uint16_t lastSequence = 0;
+static uint8_t gatewayState = 0;
+static unsigned long lastValidTime = 0;
+static unsigned long lastReportTime = 0;
+static TwaiReceiveStats lastReceiveStats;
+static LinkMonitorStats stats;
+
+// LatencyPing recebido, respondido no próximo linkMonitorLoop
+static bool pingPending = false;
+static uint8_t pingSequence[2];
+static uint32_t pingReceivedMicros = 0;
+
+// LatencyEcho enviado, esperando o carimbo de transmissão; o tempo entre a chegada do ping e o fim do
+// echo no barramento vai no echo seguinte (UINT16_MAX = desconhecido)
+static bool echoStampPending = false;
+static uint32_t echoPingReceivedMicros = 0;
+static uint16_t previousEchoResidence = UINT16_MAX;
+
+void linkMonitorReset()
+{
+    armed = false;
+    lost = false;
+    pingPending = false;
+    echoStampPending = false;
+    previousEchoResidence = UINT16_MAX;
+    lastValidTime = millis();
+    lastReportTime = millis();
+    lastReceiveStats = twaiGetReceiveStats();
+    memset(&stats, 0, sizeof(stats));
+}
+
+static void onHeartbeat(TwaiReceivedMessage *receivedMessage)
+{
+    uint8_t state = receivedMessage->Payload[0];
+    uint16_t sequence = (receivedMessage->Payload[1] << 8) | receivedMessage->Payload[2];
+
+    // Comparação com sinal: a sequência de 16 bits pode dar a volta
+    int16_t advance = (int16_t)(sequence - lastSequence);
+    if (armed && advance <= 0)
+    {
+        stats.rejected++;
+        return;
+    }
+
+    if (armed && advance > 1)
+        stats.gaps += advance - 1;
+
+    stats.heartbeats++;
+    armed = true;
+    lastSequence = sequence;
+    gatewayState = state;
+    lastValidTime = millis();
+}
+
+void linkMonitorOnTWAIMessage(TwaiReceivedMessage *receivedMessage)
+{
+    switch (receivedMessage->Kind)
+    {
+    case TwaiReceivedMessageKind::Heartbeat:
+        onHeartbeat(receivedMessage);
+        break;
+    case TwaiReceivedMessageKind::LatencyPing:
+        // Um ping novo substitui um ainda não respondido; o gateway já o deu como perdido
+        memcpy(pingSequence, receivedMessage->Payload, sizeof(pingSequence));
+        pingReceivedMicros = receivedMessage->ReceivedMicros;
+        pingPending = true;
+        if (!armed)
+            lastValidTime = millis();
+        break;
+    case TwaiReceivedMessageKind::SetLinkTimeout:
+    {
+        uint16_t requested = receivedMessage->ExtraData;
+        if (requested < LINK_MIN_TIMEOUT_MS)
+            requested = LINK_MIN_TIMEOUT_MS;
+        if (requested != timeoutMs)
+            ESP_LOGI(TAG, "Timeout do enlace: %u ms", requested);
+        timeoutMs = requested;
+        break;
+    }
+    default:
+        if (!armed)
+            lastValidTime = millis();
+        break;
+    }
+}
+
+bool linkMonitorIsLost()
+{
+    unsigned long silence = millis() - lastValidTime;
+    bool expired = silence >= (armed ? timeoutMs : LINK_UNARMED_TIMEOUT_MS);
+
+    if (expired && !lost)
+    {
+        stats.losses++;
+        stats.lastDetectionLatencyMs = silence;
+        if (silence > stats.maxDetectionLatencyMs)
+            stats.maxDetectionLatencyMs = silence;
+
+        ESP_LOGW(TAG, "Gateway perdido: %lu ms sem heartbeat válido (último estado %u, sequência %u)",
+                 silence, gatewayState, lastSequence);
+    }
+
+    lost = expired;
+    return expired;
+}
+
+LinkMonitorStats linkMonitorGetStats()
+{
+    return stats;
+}
+
+static uint8_t saturate8(uint32_t value)
+{
+    return value > UINT8_MAX ? UINT8_MAX : value;
+}
+
+static uint16_t saturate16(uint32_t value)
+{
+    return value > UINT16_MAX ? UINT16_MAX : value;
+}
+
+// [sequência u16][chegada do ping u32][chegada do ping anterior até o fim do echo anterior us u16].
+// Com o carimbo de transmissão, os dois instantes são do barramento: o gateway fecha com eles a troca
+// anterior e estima o relógio do estimulador (gateway/src/Clock/ClockSync.h).
+static void sendEcho()
+{
+    uint8_t payload[8];
+    memcpy(payload, pingSequence, sizeof(pingSequence));
+    payload[2] = pingReceivedMicros >> 24;
+    payload[3] = (pingReceivedMicros >> 16) & 0xFF;
+    payload[4] = (pingReceivedMicros >> 8) & 0xFF;
+    payload[5] = pingReceivedMicros & 0xFF;
+    payload[6] = previousEchoResidence >> 8;
+    payload[7] = previousEchoResidence & 0xFF;
+
+    echoStampPending = twaiSendTimestamped(TwaiSendMessageKind::LatencyEcho, payload, sizeof(payload));
+    echoPingReceivedMicros = pingReceivedMicros;
+    previousEchoResidence = UINT16_MAX;
+    pingPending = false;
+}
+
+static void takeEchoStamp()
+{
+    uint32_t sentMicros;
+    if (!echoStampPending || !twaiTakeTransmitTimestamp(TwaiSendMessageKind::LatencyEcho, &sentMicros))
+        return;
+
+    echoStampPending = false;
+    previousEchoResidence = saturate16(sentMicros - echoPingReceivedMicros);
+}
+
+void linkMonitorLoop()
+{
+    takeEchoStamp();
+
+    // O loop já rodou a máquina de estados: o echo sai no mesmo ponto que o feedback de PWM
+    if (pingPending)
+        sendEcho();
+
+    unsigned long now_ms = millis();
+    if (now_ms - lastReportTime < LINK_REPORT_INTERVAL_MS)
+        return;
+    lastReportTime = now_ms;
+
+    // [perdas u8][heartbeats rejeitados u8][latência da última detecção ms u16][latência máxima ms u16]
+    uint16_t lastLatency = saturate16(stats.lastDetectionLatencyMs);
+    uint16_t maxLatency = saturate16(stats.maxDetectionLatencyMs);
+
+    uint8_t payload[6];
+    payload[0] = saturate8(stats.losses);
+    payload[1] = saturate8(stats.rejected);
+    payload[2] = lastLatency >> 8;
+    payload[3] = lastLatency & 0xFF;
+    payload[4] = maxLatency >> 8;
+    payload[5] = maxLatency & 0xFF;
+
+    twaiSendPayload(TwaiSendMessageKind::LinkStatusReport, payload, sizeof(payload));
+
+    // Desde o último relatório: [frames lidos do driver u16][mensagens entregues u16][frames descartados u8]
+    // [frames perdidos no driver ou mensagens na fila u8][pico da fila u8][pico do atraso de entrega em 100 us u8]
+    TwaiReceiveStats receiveStats = twaiGetReceiveStats();
+    uint16_t frames = saturate16(receiveStats.frames - lastReceiveStats.frames);
+    uint16_t messages = saturate16(receiveStats.messages - lastReceiveStats.messages);
+    uint8_t rejected = saturate8(receiveStats.rejected - lastReceiveStats.rejected);
+    uint32_t lostNow = receiveStats.queueDropped + receiveStats.driverMissed + receiveStats.driverOverrun;
+    uint32_t lostBefore = lastReceiveStats.queueDropped + lastReceiveStats.driverMissed + lastReceiveStats.driverOverrun;
+    uint8_t lostFrames = saturate8(lostNow - lostBefore);
+    uint8_t maxQueueDepth = saturate8(receiveStats.maxQueueDepth);
+    uint8_t maxDeliveryLatency = saturate8((receiveStats.maxLatencyMicros + 99) / 100);
+    lastReceiveStats = receiveStats;
+    twaiResetReceivePeaks();
+
+    uint8_t receivePayload[8];
+    receivePayload[0] = frames >> 8;
+    receivePayload[1] = frames & 0xFF;
+    receivePayload[2] = messages >> 8;
+    receivePayload[3] = messages & 0xFF;
+    receivePayload[4] = rejected;
+    receivePayload[5] = lostFrames;
+    receivePayload[6] = maxQueueDepth;
+    receivePayload[7] = maxDeliveryLatency;
+
+    twaiSendPayload(TwaiSendMessageKind::ReceiveStatsReport, receivePayload, sizeof(receivePayload));
+
+    // [estado do driver u8][TEC u8][REC u8][carga em décimos de % u16][bus-offs u8][última recuperação ms u16]
+    TwaiHealth health = twaiHealthGet();
+    uint16_t lastRecovery = saturate16(health.lastRecoveryMs);
+
+    uint8_t healthPayload[8];
+    healthPayload[0] = health.state;
+    healthPayload[1] = saturate8(health.txErrorCounter);
+    healthPayload[2] = saturate8(health.rxErrorCounter);
+    healthPayload[3] = health.busLoadPermille >> 8;
+    healthPayload[4] = health.busLoadPermille & 0xFF;
+    healthPayload[5] = saturate8(health.busOffCount);
+    healthPayload[6] = lastRecovery >> 8;
+    healthPayload[7] = lastRecovery & 0xFF;
+
+    twaiSendPayload(TwaiSendMessageKind::BusHealthReport, healthPayload, sizeof(healthPayload));
+}
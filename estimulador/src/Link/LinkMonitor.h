@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+#include "../Twai/Twai.h"
+
+// Timeout padrão sem heartbeat válido, até o gateway configurar outro
+#define LINK_DEFAULT_TIMEOUT_MS 100
+
+// Menor timeout aceito: alguns períodos do heartbeat do gateway (10 ms)
+#define LINK_MIN_TIMEOUT_MS 30
+
+// Antes do primeiro heartbeat, vale a regra antiga: qualquer frame dentro deste tempo
+#define LINK_UNARMED_TIMEOUT_MS 1000
+
+// Intervalo entre relatórios de enlace (LinkStatusReport, ReceiveStatsReport e BusHealthReport) enviados ao gateway
+#define LINK_REPORT_INTERVAL_MS 1000
+
+struct LinkMonitorStats
+{
+    uint32_t heartbeats;
+
+    // Heartbeats com sequência repetida ou mais antiga que a última aceita
+    uint32_t rejected;
+
+    // Heartbeats que faltaram entre dois aceitos
+    uint32_t gaps;
+
+    uint32_t losses;
+
+    // Tempo entre o último heartbeat válido e a detecção da perda
+    uint32_t lastDetectionLatencyMs;
+    uint32_t maxDetectionLatencyMs;
+};
+
+void linkMonitorReset();
+
+// Trata Heartbeat ([estado do gateway u8][sequência u16]), SetLinkTimeout e LatencyPing; os outros frames só contam
+// antes do primeiro heartbeat
+void linkMonitorOnTWAIMessage(TwaiReceivedMessage *receivedMessage);
+
+/**
+ * Verdadeiro quando o gateway ficou mais que o timeout sem um heartbeat válido.
+ * Um gateway que continua enviando frames, mas cuja lógica travou, para de enviar heartbeats e é detectado.
+ */
+bool linkMonitorIsLost();
+
+LinkMonitorStats linkMonitorGetStats();
+
+// Responde o último LatencyPing (ver gateway/src/Latency/Latency.h) e envia o relatório periódico de enlace.
+// O echo sai com carimbo de transmissão, para a sincronização de relógio do gateway. Chamado depois da
+// máquina de estados.
+void linkMonitorLoop();
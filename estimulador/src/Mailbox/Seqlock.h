@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * Caixa de correio de um único escritor: a escrita nunca espera, e o leitor repete a cópia
+ * se ela cruzou uma escrita. Serve para passar valores entre tarefas em núcleos diferentes
+ * sem mutex. `T` precisa ser copiável byte a byte.
+ */
+template <typename T>
+class Seqlock
+{
+private:
+    std::atomic<uint32_t> sequence{0};
+    T value{};
+
+public:
+    void publish(const T &newValue)
+    {
+        uint32_t current = sequence.load(std::memory_order_relaxed);
+        sequence.store(current + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        value = newValue;
+
+        sequence.store(current + 2, std::memory_order_release);
+    }
+
+    // Número de publicações até agora; muda a cada `publish`
+    uint32_t version() const
+    {
+        return sequence.load(std::memory_order_acquire) >> 1;
+    }
+
+    T read() const
+    {
+        T copy;
+        uint32_t before;
+        uint32_t after;
+
+        do
+        {
+            before = sequence.load(std::memory_order_acquire);
+            copy = value;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) != 0 || before != after);
+
+        return copy;
+    }
+};
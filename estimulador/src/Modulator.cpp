@@ -1,47 +1,345 @@
 #include "Modulator.h"
-#include <Arduino.h>
+#include "Pulse/PulseEngine.h"
+#include "Pulse/PulseScheduler.h"
+#include "Pulse/PulseTiming.h"
+#include "Waveform/Waveform.h"
+#include "Mailbox/Seqlock.h"
+#include "Twai/Twai.h"
+#include "Data.h"
+#include "Capture/Capture.h"
+#include <esp_log.h>
+#include <string.h>
+#include <atomic>
+#ifdef ARDUINO
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
 
-static unsigned long lastModulateTime = 0;
-static uint32_t vDurationMicros = 0;
+static const char *TAG = "Modulator";
 
-void modulateOnce(int pulseWidthMicros)
+// Antecedência com que o próximo pulso é entregue ao motor de pulsos.
+// Curta o suficiente para que a largura usada seja a mais recente.
+#define MODULATION_QUEUE_LEAD_MICROS 500
+
+// O loop do núcleo 0 republica o comando a cada passada, que leva bem menos de 1 ms. Um comando mais
+// velho que isso quer dizer que o loop travou: a tarefa para de pulsar em vez de repetir a última largura.
+#define MODULATION_COMMAND_MAX_AGE_MICROS 20000
+
+#ifdef ARDUINO
+// A tarefa de modulação fica sozinha no núcleo 1; o loop do Arduino (CAN, estados) roda no núcleo 0
+#define MODULATION_TASK_CORE 1
+#define MODULATION_TASK_PRIORITY (configMAX_PRIORITIES - 1)
+#define MODULATION_TASK_STACK 4096
+
+// Com o próximo pulso mais longe que isso, a tarefa dorme um tick em vez de esperar ativamente
+#define MODULATION_SLEEP_THRESHOLD_MICROS 2000
+#endif
+
+/**
+ * O que o lado do CAN pede à tarefa de modulação. Publicado inteiro pela caixa de correio,
+ * então a tarefa sempre vê uma largura e uma configuração de canais coerentes entre si.
+ */
+struct ModulationCommand
+{
+    uint16_t pulseWidthMicros;
+
+    // Nenhum canal passa disso; 0 = MESE máximo ainda não recebido
+    uint16_t meseMaxMicros;
+
+    uint8_t channelAmplitudePercent[PULSE_CHANNEL_COUNT];
+    uint16_t channelOffsetMicros[PULSE_CHANNEL_COUNT];
+
+    // Um novo benchmark é pedido incrementando `benchRequestId`
+    uint16_t benchRequestId;
+    uint16_t benchPulseCount;
+
+    // Relógio do motor de pulsos na publicação
+    uint32_t publishedMicros;
+};
+
+// Escrita só pelo núcleo 0, lida pela tarefa de modulação
+static Seqlock<ModulationCommand> mailbox;
+static ModulationCommand lastPublished;
+
+// Estado da tarefa de modulação
+static WaveformTable table;
+static uint32_t trainStartMicros = 0;
+static uint8_t trainPulseIndex = 0;
+static uint32_t missedDeadlines = 0;
+static uint16_t handledBenchRequestId = 0;
+
+// Escrito pela tarefa, relatado pelo núcleo 0: o ESP_LOG e o envio ficam fora da tarefa
+static std::atomic<uint8_t> scheduleStatus{(uint8_t)PulseScheduleStatus::Ok};
+static PulseScheduleStatus lastScheduleStatus = PulseScheduleStatus::Ok;
+
+static void reportScheduleStatus(PulseScheduleStatus status)
 {
-    if (pulseWidthMicros >= 10)
+    if (status == lastScheduleStatus)
+        return;
+
+    lastScheduleStatus = status;
+    if (status == PulseScheduleStatus::DoesNotFit)
     {
-        digitalWrite(2, HIGH);
-        digitalWrite(32, HIGH);
-        delayMicroseconds(pulseWidthMicros);
-        digitalWrite(2, LOW);
-        digitalWrite(32, LOW);
-        delayMicroseconds(4);
+        ESP_LOGE(TAG, "Os canais pedidos não cabem no período de estimulação");
+    }
+    twaiSend(TwaiSendMessageKind::PulseScheduleStatusReport, (uint16_t)status);
+}
+
+static const PulseHal *modulationHal()
+{
+#ifdef ARDUINO
+    return &pulseHalRmt;
+#else
+    return &pulseHalSim;
+#endif
+}
+
+// O relógio do HAL não depende do motor de pulsos já iniciado: serve para o núcleo 0 carimbar os comandos
+static void publish(const ModulationCommand *command)
+{
+    lastPublished = *command;
+    lastPublished.publishedMicros = modulationHal()->nowMicros();
+    mailbox.publish(lastPublished);
+}
+
+static void serviceBegin()
+{
+    pulseEngineBegin(modulationHal());
 
-        digitalWrite(4, HIGH);
-        digitalWrite(33, HIGH);
-        delayMicroseconds(pulseWidthMicros);
-        digitalWrite(4, LOW);
-        digitalWrite(33, LOW);
-        delayMicroseconds(4);
+    pulseTimingReset();
+    table = waveformReadTable();
+    trainStartMicros = pulseEngineNowMicros();
+    trainPulseIndex = 0;
+    missedDeadlines = 0;
+    handledBenchRequestId = lastPublished.benchRequestId;
+}
+
+#ifdef ARDUINO
+static void modulatorTask(void *parameters)
+{
+    // O RMT registra a interrupção no núcleo que instala o driver
+    serviceBegin();
+
+    while (true)
+    {
+        uint32_t idleMicros = modulatorService();
+        if (idleMicros > MODULATION_SLEEP_THRESHOLD_MICROS)
+            vTaskDelay(1);
     }
-    else
+}
+#endif
+
+void modulatorBegin()
+{
+    waveformReset();
+
+    memset(&lastPublished, 0, sizeof(lastPublished));
+    for (int channel = 0; channel < PULSE_CHANNEL_COUNT; channel++)
     {
-        digitalWrite(2, LOW);
-        digitalWrite(4, LOW);
-        digitalWrite(32, LOW);
-        digitalWrite(33, LOW);
-        delayMicroseconds(8);
+        lastPublished.channelAmplitudePercent[channel] = data.channelAmplitudePercent[channel];
+        lastPublished.channelOffsetMicros[channel] = data.channelOffsetMicros[channel];
     }
+    publish(&lastPublished);
+
+    scheduleStatus = (uint8_t)PulseScheduleStatus::Ok;
+    lastScheduleStatus = PulseScheduleStatus::Ok;
+
+#ifdef ARDUINO
+    xTaskCreatePinnedToCore(modulatorTask, "modulator", MODULATION_TASK_STACK, nullptr, MODULATION_TASK_PRIORITY,
+                            nullptr, MODULATION_TASK_CORE);
+#else
+    serviceBegin();
+#endif
 }
 
-void modulateLoop(int pulseWidthMicros)
+void modulatorSetPulseWidth(int pulseWidthMicros)
 {
     if (pulseWidthMicros < 1)
         pulseWidthMicros = 0;
+    if (pulseWidthMicros > PULSE_MAX_DURATION_MICROS)
+        pulseWidthMicros = PULSE_MAX_DURATION_MICROS;
+
+    ModulationCommand command = lastPublished;
+    command.pulseWidthMicros = pulseWidthMicros;
+    command.meseMaxMicros = data.meseMax;
+    for (int channel = 0; channel < PULSE_CHANNEL_COUNT; channel++)
+    {
+        command.channelAmplitudePercent[channel] = data.channelAmplitudePercent[channel];
+        command.channelOffsetMicros[channel] = data.channelOffsetMicros[channel];
+    }
+
+#ifdef TWAI_CAPTURE
+    if (command.pulseWidthMicros != lastPublished.pulseWidthMicros)
+        captureRecordPulseWidth(command.pulseWidthMicros);
+#endif
+
+    publish(&command);
+}
+
+void modulatorLoop()
+{
+    // Renova o carimbo do comando: é o sinal de vida do núcleo 0 para a tarefa
+    publish(&lastPublished);
+
+    reportScheduleStatus((PulseScheduleStatus)scheduleStatus.load(std::memory_order_relaxed));
+    pulseTimingLoop();
+}
+
+uint16_t modulatorGetPulseWidth()
+{
+    return lastPublished.pulseWidthMicros;
+}
+
+void modulatorRequestBench(uint16_t pulseCount)
+{
+    if (pulseCount == 0)
+        return;
+
+#ifdef PULSE_BENCH_ENABLED
+    ESP_LOGW(TAG, "Benchmark: %u pulsos de %u us. Os eletrodos devem estar desconectados.", pulseCount,
+             PULSE_BENCH_WIDTH_MICROS);
+
+    ModulationCommand command = lastPublished;
+    command.benchRequestId++;
+    command.benchPulseCount = pulseCount;
+    publish(&command);
+#else
+    ESP_LOGE(TAG, "Benchmark recusado: este firmware não foi compilado para a bancada (env Bench_serial)");
+#endif
+}
+
+uint32_t modulatorService()
+{
+    ModulationCommand command = mailbox.read();
+
+    if (command.benchRequestId != handledBenchRequestId)
+    {
+        handledBenchRequestId = command.benchRequestId;
+        pulseTimingStartBench(command.benchPulseCount);
+    }
+
+    int pulseWidthMicros = command.pulseWidthMicros;
+    bool benchPulse = pulseTimingBenchActive();
+    if (benchPulse)
+        pulseWidthMicros = PULSE_BENCH_WIDTH_MICROS;
+
+    // Loop do núcleo 0 parado: sem comando recente, nenhum pulso sai
+    if ((int32_t)(pulseEngineNowMicros() - command.publishedMicros) > MODULATION_COMMAND_MAX_AGE_MICROS)
+    {
+        pulseWidthMicros = 0;
+        benchPulse = false;
+    }
+
+    pulseEngineService();
+    pulseTimingService();
+
+    if (pulseEnginePendingCount() > 0)
+    {
+        return 0;
+    }
+
+    uint32_t now_micros = pulseEngineNowMicros();
+
+    // Deadlines absolutos: um atraso não empurra os pulsos seguintes.
+    // Se trens inteiros já passaram, os pulsos perdidos são descartados e a grade é mantida.
+    uint32_t behind = now_micros - trainStartMicros;
+    if ((int32_t)behind >= (int32_t)table.periodMicros)
+    {
+        uint32_t skipped = behind / table.periodMicros;
+        trainStartMicros += skipped * table.periodMicros;
+        missedDeadlines += skipped * table.pulseCount - trainPulseIndex;
+        trainPulseIndex = 0;
+        table = waveformReadTable();
+    }
+
+    uint32_t deadline = trainStartMicros + table.pulseOffsetMicros[trainPulseIndex];
+    int32_t untilDeadline = (int32_t)(deadline - now_micros);
+    if (untilDeadline > MODULATION_QUEUE_LEAD_MICROS)
+    {
+        return untilDeadline - MODULATION_QUEUE_LEAD_MICROS;
+    }
+
+    if (pulseWidthMicros >= PULSE_MIN_WIDTH_MICROS)
+    {
+        PulseChannelRequest requests[PULSE_CHANNEL_COUNT];
+        for (int channel = 0; channel < PULSE_CHANNEL_COUNT; channel++)
+        {
+            uint32_t width = ((uint32_t)pulseWidthMicros * command.channelAmplitudePercent[channel]) / 100;
+            if (channel > 0)
+                width = (width * table.secondPhaseScaleQ8) >> 8;
+            if (command.meseMaxMicros > 0 && width > command.meseMaxMicros)
+                width = command.meseMaxMicros;
+            if (width < PULSE_MIN_WIDTH_MICROS)
+                width = 0;
+            if (width > PULSE_MAX_DURATION_MICROS)
+                width = PULSE_MAX_DURATION_MICROS;
+
+            requests[channel].widthMicros = width;
+            requests[channel].offsetMicros = command.channelOffsetMicros[channel];
+        }
+
+        PulseDescriptor pulse;
+        pulse.deadlineMicros = deadline;
+        PulseScheduleStatus status = pulseSchedule(requests, table.interphaseGapMicros,
+                                                   table.pulseSlotMicros[trainPulseIndex], &pulse);
+        scheduleStatus.store((uint8_t)status, std::memory_order_relaxed);
+
+        if (status != PulseScheduleStatus::DoesNotFit)
+        {
+            pulseEngineQueue(&pulse);
+            pulseEngineService();
+        }
+    }
+
+    if (benchPulse)
+        pulseTimingBenchPulseQueued();
+
+    trainPulseIndex++;
+    if (trainPulseIndex >= table.pulseCount)
+    {
+        trainStartMicros += table.periodMicros;
+        trainPulseIndex = 0;
+        table = waveformReadTable();
+    }
 
-    unsigned long now_micros = micros();
-    if (now_micros - lastModulateTime > vDurationMicros)
+    return 0;
+}
+
+uint32_t modulatorMissedDeadlines()
+{
+    return missedDeadlines + pulseEngineGetStats().dropped;
+}
+
+void modulatorOnTWAIMessage(TwaiReceivedMessage *receivedMessage)
+{
+    switch (receivedMessage->Kind)
     {
-        modulateOnce(pulseWidthMicros);
-        lastModulateTime = now_micros;
-        vDurationMicros = (uint32_t)(((1 / 35.0) * 1000000) - ((2 * pulseWidthMicros) - 8));
+    case TwaiReceivedMessageKind::SetChannelAmplitude:
+    {
+        // Octeto alto: canal. Octeto baixo: amplitude em porcentagem.
+        uint8_t channel = receivedMessage->ExtraData >> 8;
+        uint8_t amplitudePercent = receivedMessage->ExtraData & 0xFF;
+        if (channel >= PULSE_CHANNEL_COUNT)
+            break;
+
+        // Um canal nunca sai mais largo que a largura pedida, já limitada pelo controle
+        if (amplitudePercent > MODULATION_MAX_AMPLITUDE_PERCENT)
+        {
+            ESP_LOGE(TAG, "Amplitude do canal %u fora da faixa: %u%%", channel, amplitudePercent);
+            break;
+        }
+        data.channelAmplitudePercent[channel] = amplitudePercent;
+        break;
+    }
+    case TwaiReceivedMessageKind::SetChannelOffset:
+    {
+        // 2 bits altos: canal. 14 bits baixos: offset em us.
+        uint8_t channel = receivedMessage->ExtraData >> 14;
+        if (channel < PULSE_CHANNEL_COUNT)
+            data.channelOffsetMicros[channel] = receivedMessage->ExtraData & 0x3FFF;
+        break;
+    }
+    default:
+        break;
     }
-}
\ No newline at end of file
+}
@@ -1,3 +1,40 @@
 #pragma once
+#include <stdint.h>
+#include "Twai/Twai.h"
 
-void modulateLoop(int pulseWidthMicros);
\ No newline at end of file
+/**
+ * No ESP-32, a geração de pulsos roda numa tarefa própria no núcleo 1, com a maior prioridade.
+ * O lado do CAN e dos estados só publica o que quer; a tarefa nunca espera pelo barramento.
+ */
+void modulatorBegin();
+
+// Publica a largura pedida e a configuração atual dos canais. Chamado pelo loop dos estados.
+void modulatorSetPulseWidth(int pulseWidthMicros);
+
+/**
+ * Chamado a cada passada do loop do núcleo 0: renova o carimbo do comando publicado, sem o qual a tarefa
+ * para de pulsar, e envia os relatórios que a tarefa deixou prontos (a tarefa não envia nem escreve no log).
+ */
+void modulatorLoop();
+
+// Última largura publicada, já limitada: é a sequência que a reprodução no host compara
+uint16_t modulatorGetPulseWidth();
+
+/**
+ * Pede à tarefa de modulação um benchmark de `pulseCount` pulsos. Os pulsos saem nos eletrodos, então
+ * só um firmware compilado com PULSE_BENCH_ENABLED (env Bench_serial) os emite; o pedido não tem como
+ * ligar isso pelo barramento nem pelo aplicativo.
+ */
+void modulatorRequestBench(uint16_t pulseCount);
+
+// Um passo da tarefa de modulação. Retorna quantos us faltam até ela ter trabalho de novo.
+// No host, é chamado diretamente pela simulação.
+uint32_t modulatorService();
+
+// Só deve ser chamado pela tarefa de modulação
+uint32_t modulatorMissedDeadlines();
+
+#define MODULATION_MAX_AMPLITUDE_PERCENT 100
+
+// Trata as mensagens de amplitude e offset por canal. Amplitudes acima de 100% são recusadas.
+void modulatorOnTWAIMessage(TwaiReceivedMessage *receivedMessage);
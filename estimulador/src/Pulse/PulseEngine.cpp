@@ -0,0 +1,176 @@
+#include "PulseEngine.h"
+#include "PulseTiming.h"
+#include <string.h>
+#include <esp_log.h>
+
+static const char *TAG = "PulseEngine";
+
+static const PulseHal *hal = nullptr;
+
+// Fila circular de pulsos aguardando o deadline
+static PulseDescriptor queue[PULSE_QUEUE_LENGTH];
+static uint8_t queueHead = 0;
+static uint8_t queueCount = 0;
+
+static PulseEngineStats stats;
+
+// Pulso em andamento, aguardando o fim dos canais para ser medido
+static PulseDescriptor inFlight;
+static uint32_t inFlightStartMicros = 0;
+static uint8_t inFlightChannelMask = 0;
+static volatile uint32_t channelEndMicros[PULSE_CHANNEL_COUNT];
+static volatile uint8_t channelDoneMask = 0;
+
+// Pulso anterior, para medir o intervalo entre pulsos
+static bool hasPrevious = false;
+static uint32_t previousStartMicros = 0;
+static uint32_t previousDeadlineMicros = 0;
+
+void pulseEngineBegin(const PulseHal *selectedHal)
+{
+    hal = selectedHal;
+    queueHead = 0;
+    queueCount = 0;
+    memset(&stats, 0, sizeof(stats));
+    inFlightChannelMask = 0;
+    channelDoneMask = 0;
+    hasPrevious = false;
+
+    hal->begin();
+    ESP_LOGI(TAG, "Pulse HAL: %s", hal->TAG);
+}
+
+uint32_t pulseEngineNowMicros()
+{
+    return hal->nowMicros();
+}
+
+bool pulseEngineQueue(const PulseDescriptor *pulse)
+{
+    if (queueCount >= PULSE_QUEUE_LENGTH)
+    {
+        return false;
+    }
+
+    queue[(queueHead + queueCount) % PULSE_QUEUE_LENGTH] = *pulse;
+    queueCount++;
+    return true;
+}
+
+uint8_t pulseEnginePendingCount()
+{
+    return queueCount;
+}
+
+void pulseEngineChannelDone(uint8_t channel, uint32_t endMicros)
+{
+    channelEndMicros[channel] = endMicros;
+    channelDoneMask |= 1 << channel;
+}
+
+static void measureInFlight()
+{
+    if (inFlightChannelMask == 0 || (channelDoneMask & inFlightChannelMask) != inFlightChannelMask)
+    {
+        return;
+    }
+
+    for (uint8_t channel = 0; channel < PULSE_CHANNEL_COUNT; channel++)
+    {
+        if ((inFlightChannelMask & (1 << channel)) == 0)
+            continue;
+
+        uint32_t measuredWidth = channelEndMicros[channel] - inFlightStartMicros - inFlight.offsetMicros[channel];
+        pulseTimingRecordWidth(channel, (int32_t)measuredWidth - inFlight.widthMicros[channel]);
+    }
+
+    inFlightChannelMask = 0;
+}
+
+void pulseEngineService()
+{
+    measureInFlight();
+
+    if (queueCount == 0)
+    {
+        return;
+    }
+
+    const PulseDescriptor *head = &queue[queueHead];
+    uint32_t now = hal->nowMicros();
+
+    // Comparação com sinal: funciona mesmo quando o relógio de 32 bits dá a volta
+    int32_t lateness = (int32_t)(now - head->deadlineMicros);
+    if (lateness < 0)
+    {
+        return;
+    }
+
+    if (lateness > PULSE_MAX_LATENESS_MICROS)
+    {
+        stats.dropped++;
+        queueHead = (queueHead + 1) % PULSE_QUEUE_LENGTH;
+        queueCount--;
+        return;
+    }
+
+    if (hal->isBusy())
+    {
+        return;
+    }
+
+    // Se os canais do pulso anterior não informaram o fim até aqui, ele fica sem medição
+    inFlight = *head;
+    inFlightChannelMask = 0;
+    channelDoneMask = 0;
+    for (uint8_t channel = 0; channel < PULSE_CHANNEL_COUNT; channel++)
+    {
+        if (head->widthMicros[channel] > 0)
+            inFlightChannelMask |= 1 << channel;
+    }
+
+    inFlightStartMicros = hal->emit(head);
+
+    if (hasPrevious)
+    {
+        uint32_t measuredInterval = inFlightStartMicros - previousStartMicros;
+        uint32_t intendedInterval = head->deadlineMicros - previousDeadlineMicros;
+        pulseTimingRecordInterval((int32_t)(measuredInterval - intendedInterval));
+    }
+    hasPrevious = true;
+    previousStartMicros = inFlightStartMicros;
+    previousDeadlineMicros = head->deadlineMicros;
+
+    stats.emitted++;
+    if (lateness > PULSE_LATE_THRESHOLD_MICROS)
+    {
+        stats.late++;
+    }
+    if ((uint32_t)lateness > stats.maxLatenessMicros)
+    {
+        stats.maxLatenessMicros = lateness;
+    }
+
+    queueHead = (queueHead + 1) % PULSE_QUEUE_LENGTH;
+    queueCount--;
+}
+
+PulseEngineStats pulseEngineGetStats()
+{
+    return stats;
+}
+
+uint32_t pulseDescriptorSpanMicros(const PulseDescriptor *pulse)
+{
+    uint32_t span = 0;
+    for (int channel = 0; channel < PULSE_CHANNEL_COUNT; channel++)
+    {
+        if (pulse->widthMicros[channel] == 0)
+            continue;
+
+        uint32_t end = pulse->offsetMicros[channel] + pulse->widthMicros[channel];
+        if (end > span)
+            span = end;
+    }
+    return span;
+}
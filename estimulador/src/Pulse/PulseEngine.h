@@ -0,0 +1,78 @@
+#pragma once
+#include <stdint.h>
+
+// Canal 0: pinos 2/32. Canal 1: pinos 4/33.
+#define PULSE_CHANNEL_COUNT 2
+
+// Intervalo entre as fases de um pulso
+#define PULSE_INTERPHASE_GAP_MICROS 4
+
+// Larguras abaixo deste valor não geram pulso; a saída permanece em repouso
+#define PULSE_MIN_WIDTH_MICROS 10
+
+// Quantos descritores podem aguardar o seu deadline ao mesmo tempo
+#define PULSE_QUEUE_LENGTH 4
+
+// Maior duração de uma fase ou de um offset: os campos duration0/duration1 do RMT têm 15 bits
+#define PULSE_MAX_DURATION_MICROS 32767
+
+// Atraso tolerado entre o deadline e o disparo antes de contar o pulso como atrasado
+#define PULSE_LATE_THRESHOLD_MICROS 20
+
+// Um pulso mais atrasado que isso é descartado, para não sair colado ao próximo da grade
+#define PULSE_MAX_LATENESS_MICROS 2000
+
+/**
+ * Um pulso a ser gerado pelo periférico.
+ * `deadlineMicros` é absoluto (relógio do HAL). Os tempos de cada canal são relativos ao deadline.
+ * Um canal com largura 0 permanece em repouso durante o pulso.
+ */
+struct PulseDescriptor
+{
+    uint32_t deadlineMicros;
+    uint16_t offsetMicros[PULSE_CHANNEL_COUNT];
+    uint16_t widthMicros[PULSE_CHANNEL_COUNT];
+};
+
+/**
+ * Interface com o hardware que gera os pulsos.
+ * No ESP-32, `pulseHalRmt` usa o periférico RMT. No host, `pulseHalSim` usa um relógio simulado.
+ */
+typedef struct PulseHal
+{
+    const char *TAG;
+    void (*begin)();
+    uint32_t (*nowMicros)();
+    bool (*isBusy)();
+
+    // Dispara o pulso e retorna o instante em que ele começou. Ao fim de cada canal,
+    // o HAL chama `pulseEngineChannelDone`.
+    uint32_t (*emit)(const PulseDescriptor *pulse);
+} PulseHal;
+
+struct PulseEngineStats
+{
+    uint32_t emitted;
+    uint32_t late;
+    uint32_t dropped;
+    uint32_t maxLatenessMicros;
+};
+
+#ifdef ARDUINO
+extern const PulseHal pulseHalRmt;
+#else
+extern const PulseHal pulseHalSim;
+#endif
+
+void pulseEngineBegin(const PulseHal *hal);
+uint32_t pulseEngineNowMicros();
+bool pulseEngineQueue(const PulseDescriptor *pulse);
+uint8_t pulseEnginePendingCount();
+void pulseEngineService();
+PulseEngineStats pulseEngineGetStats();
+
+// Informa o fim de um canal do pulso em andamento. Pode ser chamado de uma ISR.
+void pulseEngineChannelDone(uint8_t channel, uint32_t endMicros);
+
+// Duração total de um pulso, do deadline até o fim da última fase
+uint32_t pulseDescriptorSpanMicros(const PulseDescriptor *pulse);
@@ -0,0 +1,121 @@
+#ifdef ARDUINO
+#include "PulseEngine.h"
+#include <Arduino.h>
+#include <driver/rmt.h>
+#include <esp_timer.h>
+
+// Cada canal do RMT aciona um par de pinos pela matriz de GPIO
+static const rmt_channel_t RMT_CHANNELS[PULSE_CHANNEL_COUNT] = {RMT_CHANNEL_0, RMT_CHANNEL_1};
+static const gpio_num_t PRIMARY_PINS[PULSE_CHANNEL_COUNT] = {GPIO_NUM_2, GPIO_NUM_4};
+static const gpio_num_t SECONDARY_PINS[PULSE_CHANNEL_COUNT] = {GPIO_NUM_32, GPIO_NUM_33};
+
+// Divisor do clock APB (80 MHz): 1 tick = 1 µs
+#define RMT_CLOCK_DIVIDER 80
+
+// Instante em que o último pulso disparado termina
+static uint32_t busyUntilMicros = 0;
+
+static uint32_t rmtNowMicros()
+{
+    return (uint32_t)esp_timer_get_time();
+}
+
+static void onRmtTxEnd(rmt_channel_t rmtChannel, void *arg)
+{
+    uint32_t now = rmtNowMicros();
+    for (uint8_t channel = 0; channel < PULSE_CHANNEL_COUNT; channel++)
+    {
+        if (RMT_CHANNELS[channel] == rmtChannel)
+            pulseEngineChannelDone(channel, now);
+    }
+}
+
+static void rmtBegin()
+{
+    for (int channel = 0; channel < PULSE_CHANNEL_COUNT; channel++)
+    {
+        rmt_config_t config = RMT_DEFAULT_CONFIG_TX(PRIMARY_PINS[channel], RMT_CHANNELS[channel]);
+        config.clk_div = RMT_CLOCK_DIVIDER;
+        config.tx_config.idle_output_en = true;
+        config.tx_config.idle_level = RMT_IDLE_LEVEL_LOW;
+
+        rmt_config(&config);
+        rmt_driver_install(RMT_CHANNELS[channel], 0, 0);
+
+        // Segundo pino do par recebe o mesmo sinal do canal
+        rmt_set_gpio(RMT_CHANNELS[channel], RMT_MODE_TX, SECONDARY_PINS[channel], false);
+    }
+
+    rmt_register_tx_end_callback(onRmtTxEnd, nullptr);
+
+    busyUntilMicros = rmtNowMicros();
+}
+
+static bool rmtIsBusy()
+{
+    return (int32_t)(rmtNowMicros() - busyUntilMicros) < 0;
+}
+
+/**
+ * Converte a fase de um canal em itens do RMT: repouso até o offset, nível alto durante a largura.
+ * Ao fim dos itens, o periférico volta sozinho ao nível de repouso (baixo).
+ */
+static uint16_t encodeChannel(const PulseDescriptor *pulse, int channel, rmt_item32_t *items)
+{
+    uint16_t offset = pulse->offsetMicros[channel];
+    uint16_t width = pulse->widthMicros[channel];
+
+    memset(items, 0, sizeof(rmt_item32_t) * 2);
+
+    if (offset == 0)
+    {
+        // duration1 = 0 já encerra a transmissão
+        items[0].level0 = 1;
+        items[0].duration0 = width;
+        return 1;
+    }
+
+    items[0].level0 = 0;
+    items[0].duration0 = offset;
+    items[0].level1 = 1;
+    items[0].duration1 = width;
+    // items[1], zerado, encerra a transmissão
+    return 2;
+}
+
+static uint32_t rmtEmit(const PulseDescriptor *pulse)
+{
+    rmt_item32_t items[PULSE_CHANNEL_COUNT][2];
+    uint16_t itemCount[PULSE_CHANNEL_COUNT];
+
+    for (int channel = 0; channel < PULSE_CHANNEL_COUNT; channel++)
+    {
+        itemCount[channel] = 0;
+        if (pulse->widthMicros[channel] == 0)
+            continue;
+
+        itemCount[channel] = encodeChannel(pulse, channel, items[channel]);
+        rmt_fill_tx_items(RMT_CHANNELS[channel], items[channel], itemCount[channel], 0);
+    }
+
+    // Os itens já estão na memória do RMT; os canais partem com diferença de poucos ciclos,
+    // bem abaixo do intervalo entre fases.
+    uint32_t startMicros = rmtNowMicros();
+    for (int channel = 0; channel < PULSE_CHANNEL_COUNT; channel++)
+    {
+        if (itemCount[channel] > 0)
+            rmt_tx_start(RMT_CHANNELS[channel], true);
+    }
+
+    busyUntilMicros = startMicros + pulseDescriptorSpanMicros(pulse);
+    return startMicros;
+}
+
+const PulseHal pulseHalRmt = {
+    .TAG = "RMT",
+    .begin = rmtBegin,
+    .nowMicros = rmtNowMicros,
+    .isBusy = rmtIsBusy,
+    .emit = rmtEmit,
+};
+#endif
@@ -0,0 +1,64 @@
+#ifndef ARDUINO
+#include "PulseHalSim.h"
+
+static uint32_t simNowMicros = 0;
+static uint32_t busyUntilMicros = 0;
+static PulseSimObserver observer = nullptr;
+
+void pulseHalSimSetTime(uint32_t nowMicros)
+{
+    simNowMicros = nowMicros;
+}
+
+void pulseHalSimAdvance(uint32_t deltaMicros)
+{
+    simNowMicros += deltaMicros;
+}
+
+void pulseHalSimSetObserver(PulseSimObserver newObserver)
+{
+    observer = newObserver;
+}
+
+static void simBegin()
+{
+    busyUntilMicros = simNowMicros;
+}
+
+static uint32_t simNow()
+{
+    return simNowMicros;
+}
+
+static bool simIsBusy()
+{
+    return (int32_t)(simNowMicros - busyUntilMicros) < 0;
+}
+
+static uint32_t simEmit(const PulseDescriptor *pulse)
+{
+    busyUntilMicros = simNowMicros + pulseDescriptorSpanMicros(pulse);
+
+    if (observer != nullptr)
+    {
+        observer(simNowMicros, pulse);
+    }
+
+    // Periférico ideal: cada canal termina exatamente no tempo pedido
+    for (uint8_t channel = 0; channel < PULSE_CHANNEL_COUNT; channel++)
+    {
+        if (pulse->widthMicros[channel] > 0)
+            pulseEngineChannelDone(channel, simNowMicros + pulse->offsetMicros[channel] + pulse->widthMicros[channel]);
+    }
+
+    return simNowMicros;
+}
+
+const PulseHal pulseHalSim = {
+    .TAG = "Sim",
+    .begin = simBegin,
+    .nowMicros = simNow,
+    .isBusy = simIsBusy,
+    .emit = simEmit,
+};
+#endif
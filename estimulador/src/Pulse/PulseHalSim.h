@@ -0,0 +1,15 @@
+#pragma once
+#ifndef ARDUINO
+#include <stdint.h>
+#include "PulseEngine.h"
+
+/**
+ * Relógio simulado para verificar a temporização dos pulsos num host Linux.
+ * O tempo só avança quando `pulseHalSimAdvance` é chamado.
+ */
+typedef void (*PulseSimObserver)(uint32_t startMicros, const PulseDescriptor *pulse);
+
+void pulseHalSimSetTime(uint32_t nowMicros);
+void pulseHalSimAdvance(uint32_t deltaMicros);
+void pulseHalSimSetObserver(PulseSimObserver observer);
+#endif
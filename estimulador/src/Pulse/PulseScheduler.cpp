@@ -0,0 +1,55 @@
+#include "PulseScheduler.h"
+
+PulseScheduleStatus pulseSchedule(const PulseChannelRequest requests[PULSE_CHANNEL_COUNT], uint16_t gapMicros,
+                                  uint32_t slotMicros, PulseDescriptor *pulse)
+{
+    // Ordem de disparo: offset pedido, e o índice do canal em caso de empate
+    uint8_t order[PULSE_CHANNEL_COUNT];
+    for (int i = 0; i < PULSE_CHANNEL_COUNT; i++)
+    {
+        order[i] = i;
+    }
+    for (int i = 1; i < PULSE_CHANNEL_COUNT; i++)
+    {
+        for (int j = i; j > 0 && requests[order[j]].offsetMicros < requests[order[j - 1]].offsetMicros; j--)
+        {
+            uint8_t swap = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = swap;
+        }
+    }
+
+    uint32_t earliestStart = 0;
+
+    for (int i = 0; i < PULSE_CHANNEL_COUNT; i++)
+    {
+        uint8_t channel = order[i];
+        const PulseChannelRequest *request = &requests[channel];
+
+        pulse->widthMicros[channel] = 0;
+        pulse->offsetMicros[channel] = 0;
+
+        if (request->widthMicros == 0)
+            continue;
+
+        uint32_t start = request->offsetMicros;
+        if (start < earliestStart)
+        {
+            start = earliestStart;
+        }
+
+        uint32_t end = start + request->widthMicros;
+        if (end > slotMicros || start > PULSE_MAX_DURATION_MICROS)
+        {
+            for (int c = 0; c < PULSE_CHANNEL_COUNT; c++)
+                pulse->widthMicros[c] = 0;
+            return PulseScheduleStatus::DoesNotFit;
+        }
+
+        pulse->offsetMicros[channel] = start;
+        pulse->widthMicros[channel] = request->widthMicros;
+        earliestStart = end + gapMicros;
+    }
+
+    return PulseScheduleStatus::Ok;
+}
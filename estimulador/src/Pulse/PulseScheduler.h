@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+#include "PulseEngine.h"
+
+// Largura e offset pedidos para um canal, relativos ao início do pulso
+struct PulseChannelRequest
+{
+    uint16_t widthMicros;
+    uint16_t offsetMicros;
+};
+
+enum class PulseScheduleStatus : uint8_t
+{
+    Ok = 0,
+
+    // Os canais não cabem antes do próximo pulso; nada é emitido
+    DoesNotFit = 1,
+};
+
+/**
+ * Posiciona os canais no pulso: cada canal começa no offset pedido, ou logo após o fim do canal
+ * anterior mais `gapMicros`, o que vier depois. Com offsets zerados, os canais saem em sequência. O pulso inteiro precisa terminar dentro de `slotMicros`.
+ */
+PulseScheduleStatus pulseSchedule(const PulseChannelRequest requests[PULSE_CHANNEL_COUNT], uint16_t gapMicros,
+                                  uint32_t slotMicros, PulseDescriptor *pulse);
@@ -0,0 +1,186 @@
+#include "PulseTiming.h"
+#include "../Modulator.h"
+#include "../Twai/Twai.h"
+#include "../Mailbox/Seqlock.h"
+#include <string.h>
+#include <esp_log.h>
+
+static const char *TAG = "PulseTiming";
+
+// Um relatório fechado pela tarefa de modulação, à espera do envio pelo núcleo 0
+struct PulseTimingSnapshot
+{
+    PulseHistogram histograms[1 + PULSE_CHANNEL_COUNT];
+    uint32_t missedDeadlines;
+    uint8_t flags;
+};
+
+// Estado da tarefa de modulação
+static PulseHistogram histograms[1 + PULSE_CHANNEL_COUNT];
+static uint32_t missedDeadlinesAtReset = 0;
+static uint32_t lastReportMicros = 0;
+
+// Escrito pela tarefa, lido pelo núcleo 0
+static Seqlock<PulseTimingSnapshot> publishedReport;
+static uint32_t sentReportVersion = 0;
+
+static uint16_t benchRemaining = 0;
+static bool benchRunning = false;
+
+static void histogramRecord(PulseHistogram *histogram, int32_t deviationMicros)
+{
+    uint32_t magnitude = deviationMicros < 0 ? -deviationMicros : deviationMicros;
+
+    uint8_t bucket = 0;
+    while (magnitude > 0 && bucket < PULSE_HISTOGRAM_BUCKETS - 1)
+    {
+        magnitude >>= 1;
+        bucket++;
+    }
+
+    histogram->buckets[bucket]++;
+    if (histogram->count == 0 || deviationMicros < histogram->minDeviationMicros)
+        histogram->minDeviationMicros = deviationMicros;
+    if (histogram->count == 0 || deviationMicros > histogram->maxDeviationMicros)
+        histogram->maxDeviationMicros = deviationMicros;
+    histogram->count++;
+}
+
+uint32_t pulseHistogramPercentile(const PulseHistogram *histogram, uint8_t percent)
+{
+    if (histogram->count == 0)
+        return 0;
+
+    uint32_t target = ((uint64_t)histogram->count * percent + 99) / 100;
+    uint32_t accumulated = 0;
+    for (int bucket = 0; bucket < PULSE_HISTOGRAM_BUCKETS; bucket++)
+    {
+        accumulated += histogram->buckets[bucket];
+        if (accumulated >= target)
+            return bucket == 0 ? 0 : (1UL << bucket) - 1;
+    }
+    return UINT32_MAX;
+}
+
+void pulseTimingReset()
+{
+    memset(histograms, 0, sizeof(histograms));
+    missedDeadlinesAtReset = modulatorMissedDeadlines();
+}
+
+void pulseTimingRecordInterval(int32_t deviationMicros)
+{
+    histogramRecord(&histograms[(uint8_t)PulseTimingMetric::Interval], deviationMicros);
+}
+
+void pulseTimingRecordWidth(uint8_t channel, int32_t deviationMicros)
+{
+    histogramRecord(&histograms[(uint8_t)PulseTimingMetric::WidthChannel0 + channel], deviationMicros);
+}
+
+static int16_t saturate16(int32_t value)
+{
+    if (value > INT16_MAX)
+        return INT16_MAX;
+    if (value < INT16_MIN)
+        return INT16_MIN;
+    return value;
+}
+
+/**
+ * Um frame por métrica: [seletor][mínimo i16][máximo i16][p99 u16][deadlines perdidos u8], big-endian.
+ */
+static void sendReport(const PulseTimingSnapshot *report)
+{
+    uint32_t missed = report->missedDeadlines;
+    if (missed > UINT8_MAX)
+        missed = UINT8_MAX;
+
+    uint8_t flags = report->flags;
+    for (uint8_t metric = 0; metric < 1 + PULSE_CHANNEL_COUNT; metric++)
+    {
+        const PulseHistogram *histogram = &report->histograms[metric];
+        int16_t minimum = saturate16(histogram->minDeviationMicros);
+        int16_t maximum = saturate16(histogram->maxDeviationMicros);
+        uint32_t p99 = pulseHistogramPercentile(histogram, 99);
+        if (p99 > UINT16_MAX)
+            p99 = UINT16_MAX;
+
+        uint8_t payload[8];
+        payload[0] = metric | flags;
+        payload[1] = (uint16_t)minimum >> 8;
+        payload[2] = (uint16_t)minimum & 0xFF;
+        payload[3] = (uint16_t)maximum >> 8;
+        payload[4] = (uint16_t)maximum & 0xFF;
+        payload[5] = p99 >> 8;
+        payload[6] = p99 & 0xFF;
+        payload[7] = missed;
+
+        twaiSendPayload(TwaiSendMessageKind::PulseTimingReport, payload, sizeof(payload));
+
+        ESP_LOGD(TAG, "Métrica %u: n=%lu min=%d max=%d p99=%lu perdidos=%lu", metric | flags,
+                 (unsigned long)histogram->count, minimum, maximum, (unsigned long)p99, (unsigned long)missed);
+    }
+}
+
+static void publishReport(uint8_t flags)
+{
+    PulseTimingSnapshot report;
+    memcpy(report.histograms, histograms, sizeof(histograms));
+    report.missedDeadlines = modulatorMissedDeadlines() - missedDeadlinesAtReset;
+    report.flags = flags;
+    publishedReport.publish(report);
+
+    pulseTimingReset();
+    lastReportMicros = pulseEngineNowMicros();
+}
+
+void pulseTimingService()
+{
+    if (benchRunning)
+    {
+        // Espera o último pulso do benchmark sair antes de relatar
+        if (benchRemaining == 0 && pulseEnginePendingCount() == 0)
+        {
+            benchRunning = false;
+            publishReport(PULSE_TIMING_BENCH_FLAG);
+        }
+        return;
+    }
+
+    if (pulseEngineNowMicros() - lastReportMicros >= PULSE_TIMING_REPORT_INTERVAL_MS * 1000UL)
+        publishReport(0);
+}
+
+void pulseTimingLoop()
+{
+    uint32_t version = publishedReport.version();
+    if (version == sentReportVersion)
+        return;
+
+    sentReportVersion = version;
+    PulseTimingSnapshot report = publishedReport.read();
+    sendReport(&report);
+}
+
+bool pulseTimingStartBench(uint16_t pulseCount)
+{
+    if (benchRunning || pulseCount == 0)
+        return false;
+
+    pulseTimingReset();
+    benchRemaining = pulseCount;
+    benchRunning = true;
+    return true;
+}
+
+bool pulseTimingBenchActive()
+{
+    return benchRunning && benchRemaining > 0;
+}
+
+void pulseTimingBenchPulseQueued()
+{
+    if (benchRemaining > 0)
+        benchRemaining--;
+}
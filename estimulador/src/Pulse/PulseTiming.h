@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+#include "PulseEngine.h"
+
+#define PULSE_HISTOGRAM_BUCKETS 16
+
+// Intervalo entre relatórios de temporização enviados ao gateway
+#define PULSE_TIMING_REPORT_INTERVAL_MS 1000
+
+// Largura fixa dos pulsos do modo de benchmark
+#define PULSE_BENCH_WIDTH_MICROS 100
+
+// Marca, no seletor do relatório, um resultado de benchmark
+#define PULSE_TIMING_BENCH_FLAG 0x80
+
+/**
+ * Histograma do desvio |medido - pretendido|, em buckets logarítmicos:
+ * bucket 0 = 0 us, bucket 1 = 1 us, bucket 2 = 2..3 us, bucket 3 = 4..7 us, e assim por diante.
+ */
+struct PulseHistogram
+{
+    uint32_t buckets[PULSE_HISTOGRAM_BUCKETS];
+    uint32_t count;
+    int32_t minDeviationMicros;
+    int32_t maxDeviationMicros;
+};
+
+enum class PulseTimingMetric : uint8_t
+{
+    Interval = 0,
+    WidthChannel0 = 1,
+    WidthChannel1 = 2,
+};
+
+void pulseTimingReset();
+void pulseTimingRecordInterval(int32_t deviationMicros);
+void pulseTimingRecordWidth(uint8_t channel, int32_t deviationMicros);
+
+// Limite superior, em us, do bucket onde o histograma atinge `percent` das amostras
+uint32_t pulseHistogramPercentile(const PulseHistogram *histogram, uint8_t percent);
+
+// As funções abaixo, até pulseTimingLoop, pertencem à tarefa de modulação; o resto do firmware usa
+// `modulatorRequestBench`.
+
+// Fecha o período do relatório, ou o benchmark quando ele termina, e publica o resultado para o núcleo 0.
+// Não envia nem escreve no log: a tarefa não espera pelo barramento.
+void pulseTimingService();
+
+bool pulseTimingStartBench(uint16_t pulseCount);
+bool pulseTimingBenchActive();
+void pulseTimingBenchPulseQueued();
+
+// Núcleo 0: envia ao gateway o último resultado publicado pela tarefa
+void pulseTimingLoop();
@@ -0,0 +1,130 @@
+#include "Ramp.h"
+#include "../Data.h"
+#include <Arduino.h>
+#include <math.h>
+#include <esp_log.h>
+
+static const char *TAG = "Ramp";
+
+static RampState state = RampState::Idle;
+static RampProfile profile = RampProfile::Linear;
+static uint16_t startPwm = 0;
+static uint16_t targetPwm = 0;
+static uint32_t durationMicros = 0;
+static uint32_t startMicros = 0;
+static uint8_t progressPercent = 0;
+static unsigned long lastStatusTime = 0;
+
+/**
+ * Frame RampStatus: [estado u8][largura atual u16][alvo u16][progresso em % u8].
+ */
+static void sendStatus()
+{
+    uint8_t payload[6];
+    payload[0] = (uint8_t)state;
+    payload[1] = data.requestedPwm >> 8;
+    payload[2] = data.requestedPwm & 0xFF;
+    payload[3] = targetPwm >> 8;
+    payload[4] = targetPwm & 0xFF;
+    payload[5] = progressPercent;
+
+    twaiSendPayload(TwaiSendMessageKind::RampStatus, payload, sizeof(payload));
+    lastStatusTime = millis();
+}
+
+// Fração da rampa já percorrida, de 0 a 1, dada a fração do tempo
+static float shape(float t)
+{
+    switch (profile)
+    {
+    case RampProfile::Exponential:
+        return expm1f(RAMP_EXPONENTIAL_CURVATURE * t) / expm1f(RAMP_EXPONENTIAL_CURVATURE);
+    case RampProfile::SCurve:
+        return t * t * (3.0f - 2.0f * t);
+    case RampProfile::Linear:
+    default:
+        return t;
+    }
+}
+
+void rampReset()
+{
+    state = RampState::Idle;
+    progressPercent = 0;
+}
+
+void rampOnTWAIMessage(TwaiReceivedMessage *receivedMessage)
+{
+    if (receivedMessage->Length < 5)
+        return;
+
+    uint16_t target = (receivedMessage->Payload[0] << 8) | receivedMessage->Payload[1];
+    uint16_t durationMs = (receivedMessage->Payload[2] << 8) | receivedMessage->Payload[3];
+    RampProfile requestedProfile = (RampProfile)receivedMessage->Payload[4];
+    if (requestedProfile > RampProfile::SCurve)
+        requestedProfile = RampProfile::Linear;
+
+    if (state == RampState::Running && target == targetPwm && durationMs * 1000UL == durationMicros &&
+        requestedProfile == profile)
+    {
+        return;
+    }
+
+    rampStart(target, durationMs, requestedProfile);
+}
+
+void rampStart(uint16_t target, uint16_t durationMs, RampProfile requestedProfile)
+{
+    profile = requestedProfile;
+    startPwm = data.requestedPwm;
+    targetPwm = target;
+    durationMicros = durationMs * 1000UL;
+    startMicros = micros();
+    progressPercent = 0;
+    state = RampState::Running;
+
+    ESP_LOGI(TAG, "Rampa de %u para %u us em %u ms, perfil %u", startPwm, targetPwm, durationMs,
+             (unsigned int)profile);
+
+    rampLoop();
+}
+
+void rampCancel()
+{
+    if (state != RampState::Running)
+        return;
+
+    state = RampState::Cancelled;
+    sendStatus();
+}
+
+bool rampIsRunning()
+{
+    return state == RampState::Running;
+}
+
+void rampLoop()
+{
+    if (state != RampState::Running)
+        return;
+
+    uint32_t elapsedMicros = micros() - startMicros;
+    if (elapsedMicros >= durationMicros)
+    {
+        data.requestedPwm = targetPwm;
+        progressPercent = 100;
+        state = RampState::Done;
+        sendStatus();
+        return;
+    }
+
+    float t = (float)elapsedMicros / durationMicros;
+    int32_t span = (int32_t)targetPwm - startPwm;
+    data.requestedPwm = startPwm + (int32_t)lroundf(span * shape(t));
+    progressPercent = t * 100;
+
+    if (millis() - lastStatusTime >= RAMP_STATUS_INTERVAL_MS)
+    {
+        sendStatus();
+    }
+}
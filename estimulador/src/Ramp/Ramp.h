@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+#include "../Twai/Twai.h"
+
+// Intervalo entre relatórios de progresso enquanto uma rampa está em andamento
+#define RAMP_STATUS_INTERVAL_MS 20
+
+// Curvatura do perfil exponencial: quanto maior, mais lenta a subida no início
+#define RAMP_EXPONENTIAL_CURVATURE 4.0f
+
+enum class RampProfile : uint8_t
+{
+    Linear = 0,
+    Exponential = 1,
+    SCurve = 2,
+};
+
+enum class RampState : uint8_t
+{
+    Idle = 0,
+    Running = 1,
+    Done = 2,
+    Cancelled = 3,
+};
+
+void rampReset();
+
+/**
+ * Trata o frame RampTo: [alvo u16][duração em ms u16][perfil u8].
+ * A rampa parte da largura pedida atual e roda no relógio de microssegundos do estimulador.
+ * Um RampTo igual ao da rampa em andamento é ignorado, então o gateway pode repeti-lo.
+ */
+void rampOnTWAIMessage(TwaiReceivedMessage *receivedMessage);
+
+// Inicia uma rampa da largura pedida atual até `targetPwm`
+void rampStart(uint16_t targetPwm, uint16_t durationMs, RampProfile profile);
+
+// Interrompe a rampa em andamento, mantendo a largura atual. Usado quando chega um SetRequestedPwm.
+void rampCancel();
+
+bool rampIsRunning();
+
+// Atualiza `data.requestedPwm` e envia o progresso ao gateway
+void rampLoop();
@@ -39,6 +39,16 @@ StateManager::StateManager()
                 .onExit = onGatewayDownSafetyStopStateExit,
             },
         },
+        {
+            StateKind::EmergencyStopState,
+            State{
+                .TAG = "EmergencyStopState",
+                .onEnter = onEmergencyStopStateEnter,
+                .onLoop = onEmergencyStopStateLoop,
+                .onTWAIMessage = onEmergencyStopStateTWAIMessage,
+                .onExit = onEmergencyStopStateExit,
+            },
+        },
     };
 }
 
@@ -6,7 +6,8 @@ enum class StateKind : uint8_t
 {
     WorkingMalhaAbertaState,
     WorkingMalhaFechadaState,
-    GatewayDownSafetyStopState
+    GatewayDownSafetyStopState,
+    EmergencyStopState
 };
 
 typedef struct State
@@ -49,4 +50,14 @@ void onWorkingMalhaFechadaStateExit();
 void onGatewayDownSafetyStopStateEnter();
 void onGatewayDownSafetyStopStateLoop();
 void onGatewayDownSafetyStopStateTWAIMessage(TwaiReceivedMessage *receivedMessage);
-void onGatewayDownSafetyStopStateExit();
\ No newline at end of file
+void onGatewayDownSafetyStopStateExit();
+void onEmergencyStopStateEnter();
+void onEmergencyStopStateLoop();
+void onEmergencyStopStateTWAIMessage(TwaiReceivedMessage *receivedMessage);
+void onEmergencyStopStateExit();
+
+// Estados de trabalho: copia para `data` os registros (peso, MESE, setpoint...) que mudaram desde a última chamada
+void workingTakeRegisters();
+
+// Trata o frame EmergencyStop em qualquer estado: confirma imediatamente e entra em EmergencyStopState
+void emergencyStopOnTWAIMessage(TwaiReceivedMessage *receivedMessage);
@@ -0,0 +1,114 @@
+#include "../StateManager.h"
+#include "../Twai/Twai.h"
+#include "../Twai/TwaiNode.h"
+#include "../Data.h"
+#include "../Modulator.h"
+#include "../Ramp/Ramp.h"
+#include "../Clock/ClockSync.h"
+#include <Arduino.h>
+
+// Rampa de descida da parada de emergência: curta, mas sem corte abrupto
+#define EMERGENCY_STOP_RAMP_MS 50
+
+static uint8_t sequence = 0;
+static uint32_t receivedMicros = 0;
+static bool zeroReported = false;
+static unsigned long lastTwaiSendTime = 0;
+
+void emergencyStopOnTWAIMessage(TwaiReceivedMessage *receivedMessage)
+{
+    if (receivedMessage->Kind != TwaiReceivedMessageKind::EmergencyStop)
+        return;
+
+    // O gateway repete o frame até receber a confirmação; só o primeiro inicia a parada
+    if (stateManager.currentKind != StateKind::EmergencyStopState || receivedMessage->Payload[0] != sequence)
+    {
+        sequence = receivedMessage->Payload[0];
+        receivedMicros = receivedMessage->ReceivedMicros;
+        if (stateManager.currentKind != StateKind::EmergencyStopState)
+            stateManager.switchTo(StateKind::EmergencyStopState);
+    }
+
+    // [sequência u8][tempo desde a recepção em us u32]
+    uint32_t sinceReceived = micros() - receivedMicros;
+    uint8_t payload[5];
+    payload[0] = sequence;
+    payload[1] = sinceReceived >> 24;
+    payload[2] = sinceReceived >> 16;
+    payload[3] = sinceReceived >> 8;
+    payload[4] = sinceReceived & 0xFF;
+
+    // A confirmação não espera os frames enfileirados antes dela (a fila é FIFO)
+    twaiClearTransmitQueue();
+    twaiSendPayload(TwaiSendMessageKind::EmergencyStopAck, payload, sizeof(payload));
+}
+
+void onEmergencyStopStateEnter()
+{
+    zeroReported = false;
+    lastTwaiSendTime = millis();
+    ESP_LOGW(stateManager.current->TAG, "Parada de emergência #%u. PWM: %u", sequence, data.requestedPwm);
+    rampStart(0, EMERGENCY_STOP_RAMP_MS, RampProfile::Linear);
+}
+
+void onEmergencyStopStateLoop()
+{
+    rampLoop();
+    modulatorSetPulseWidth(data.requestedPwm);
+
+    unsigned long now_ms = millis();
+    if (now_ms - lastTwaiSendTime > 5 * twaiNodeShare())
+    {
+        lastTwaiSendTime = now_ms;
+        twaiSend(TwaiSendMessageKind::PwmFeedbackEstimulador, (uint16_t)data.requestedPwm);
+    }
+
+    if (!zeroReported && data.requestedPwm == 0)
+    {
+        zeroReported = true;
+
+        // [sequência u8][tempo da recepção até a saída zerada em us u24][instante da saída zerada u32].
+        // O instante é do relógio do estimulador; o gateway o leva ao dele (gateway/src/Clock/ClockSync.h).
+        NodeTimestamp zeroReached = clockSyncNow();
+        uint32_t toZero = zeroReached.micros - receivedMicros;
+        if (toZero > 0xFFFFFF)
+            toZero = 0xFFFFFF;
+        uint8_t payload[8];
+        payload[0] = sequence;
+        payload[1] = toZero >> 16;
+        payload[2] = toZero >> 8;
+        payload[3] = toZero & 0xFF;
+        payload[4] = zeroReached.micros >> 24;
+        payload[5] = zeroReached.micros >> 16;
+        payload[6] = zeroReached.micros >> 8;
+        payload[7] = zeroReached.micros & 0xFF;
+        twaiSendPayload(TwaiSendMessageKind::EmergencyStopZeroReached, payload, sizeof(payload));
+
+        ESP_LOGW(stateManager.current->TAG, "Saída zerada %lu us após a parada de emergência", (unsigned long)toZero);
+    }
+}
+
+/**
+ * Só sai da parada depois de zerar a saída, quando o gateway volta a comandar a malha aberta.
+ */
+void onEmergencyStopStateTWAIMessage(TwaiReceivedMessage *receivedMessage)
+{
+    switch (receivedMessage->Kind)
+    {
+    case TwaiReceivedMessageKind::FirmwareInvokeReset:
+        esp_restart();
+        break;
+    case TwaiReceivedMessageKind::UseMalhaAberta:
+        if (zeroReported)
+            stateManager.switchTo(StateKind::WorkingMalhaAbertaState);
+        break;
+    default:
+        break;
+    }
+}
+
+void onEmergencyStopStateExit()
+{
+    rampCancel();
+    data.requestedPwm = 0;
+}
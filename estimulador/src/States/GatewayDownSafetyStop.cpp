@@ -39,7 +39,7 @@ void onGatewayDownSafetyStopStateLoop()
         esp_restart();
     }
 
-    modulateLoop(currentPulseWidth);
+    modulatorSetPulseWidth(currentPulseWidth);
 }
 
 /**
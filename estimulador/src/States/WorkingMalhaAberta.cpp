@@ -1,31 +1,36 @@
 #include "../StateManager.h"
 #include "../Twai/Twai.h"
+#include "../Twai/TwaiNode.h"
 #include "../Data.h"
 #include "../Modulator.h"
+#include "../Link/LinkMonitor.h"
+#include "../Control/PiController.h"
+#include "../Ramp/Ramp.h"
+#include "../Waveform/Waveform.h"
 #include <Arduino.h>
 
 static unsigned long lastTwaiSendTime = 0;
-static unsigned long lastTwaiRecvTime = 0;
 
 void onWorkingMalhaAbertaStateEnter()
 {
     lastTwaiSendTime = millis();
-    lastTwaiRecvTime = millis();
 }
 
 void onWorkingMalhaAbertaStateLoop()
 {
     // Segurança: Se o barramento cair durante a operação, o estimulador deverá tomar uma ação de decremento independente
-    if (millis() - lastTwaiRecvTime >= 1000)
+    if (linkMonitorIsLost())
     {
         stateManager.switchTo(StateKind::GatewayDownSafetyStopState);
         return;
     }
 
-    modulateLoop(data.requestedPwm);
+    workingTakeRegisters();
+    rampLoop();
+    modulatorSetPulseWidth(data.requestedPwm);
 
     unsigned long now_ms = millis();
-    if (now_ms - lastTwaiSendTime > 5)
+    if (now_ms - lastTwaiSendTime > 5 * twaiNodeShare())
     {
         lastTwaiSendTime = now_ms;
 
@@ -35,36 +40,38 @@ void onWorkingMalhaAbertaStateLoop()
 
 void onWorkingMalhaAbertaStateTWAIMessage(TwaiReceivedMessage *receivedMessage)
 {
-    lastTwaiRecvTime = millis();
 
     switch (receivedMessage->Kind)
     {
     case TwaiReceivedMessageKind::FirmwareInvokeReset:
         esp_restart();
         break;
-    case TwaiReceivedMessageKind::WeightTotal:
-        data.weightTotal = receivedMessage->ExtraData;
-        break;
-    case TwaiReceivedMessageKind::ResidualWeightTotal:
-        data.residualWeightTotal = receivedMessage->ExtraData;
-        break;
     case TwaiReceivedMessageKind::SetRequestedPwm:
+        rampCancel();
         data.requestedPwm = receivedMessage->ExtraData;
         break;
-    case TwaiReceivedMessageKind::MeseMax:
-        data.meseMax = receivedMessage->ExtraData;
-        break;
-    case TwaiReceivedMessageKind::Setpoint:
-        data.setpointKg = receivedMessage->ExtraData;
+    case TwaiReceivedMessageKind::RampTo:
+        rampOnTWAIMessage(receivedMessage);
         break;
     case TwaiReceivedMessageKind::UseMalhaFechada:
         stateManager.switchTo(StateKind::WorkingMalhaFechadaState);
         break;
-    case TwaiReceivedMessageKind::Mese:
-        data.mese = receivedMessage->ExtraData;
-        break;
     case TwaiReceivedMessageKind::SetGainCoefficient:
-        data.gainCoefficient = receivedMessage->ExtraData / 100.0f;
+    case TwaiReceivedMessageKind::SetProportionalGain:
+    case TwaiReceivedMessageKind::SetIntegralGain:
+        piControllerOnTWAIMessage(receivedMessage);
+        break;
+    case TwaiReceivedMessageKind::SetWaveform:
+        waveformOnTWAIMessage(receivedMessage);
+        break;
+    case TwaiReceivedMessageKind::SetChannelAmplitude:
+    case TwaiReceivedMessageKind::SetChannelOffset:
+        modulatorOnTWAIMessage(receivedMessage);
+        break;
+    case TwaiReceivedMessageKind::RunPulseBenchmark:
+        // Só sem estimulação em andamento; fora do firmware de bancada, modulatorRequestBench recusa
+        if (data.requestedPwm == 0)
+            modulatorRequestBench(receivedMessage->ExtraData);
         break;
     case TwaiReceivedMessageKind::GatewayResetHappened:
         ESP_LOGE(stateManager.current->TAG, "O Gateway reiniciou inesperadamente.");
@@ -73,4 +80,7 @@ void onWorkingMalhaAbertaStateTWAIMessage(TwaiReceivedMessage *receivedMessage)
     }
 }
 
-void onWorkingMalhaAbertaStateExit() {}
\ No newline at end of file
+void onWorkingMalhaAbertaStateExit()
+{
+    rampCancel();
+}
\ No newline at end of file
@@ -1,35 +1,35 @@
 #include "../Data.h"
 #include "../Modulator.h"
+#include "../Link/LinkMonitor.h"
+#include "../Control/PiController.h"
+#include "../Control/WeightSample.h"
+#include "../Telemetry/Telemetry.h"
+#include "../Waveform/Waveform.h"
 #include "../StateManager.h"
 #include "../Twai/Twai.h"
+#include "../Twai/TwaiNode.h"
 #include <Arduino.h>
 
 static unsigned long lastTwaiSendTime = 0;
-static unsigned long lastTwaiRecvTime = 0;
 
 static int largerPi = 0;
-static int integralErro = 0;
 
-int calculatePulseWidth()
+int calculatePulseWidth(unsigned long elapsedMs)
 {
-  // O setpoint é setado no aplicativo considerando apenas um dos lados devido à escala das barras. Para o controle, devemos considerar o setpoint "total" das duas barras.
-  const int setpoint = data.setpointKg * 2;
+  PiControllerInput input;
 
-  int pesoControle =
-      data.weightTotal - data.residualWeightTotal; // peso sem "ruído"
+  // O setpoint é setado no aplicativo considerando apenas um dos lados devido à escala das barras. Para o controle, devemos considerar o setpoint "total" das duas barras.
+  input.setpoint = data.setpointKg * 2;
 
-  int erroControle = pesoControle - setpoint * 0.1f;
+  // Peso sem "ruído", compensando o atraso entre a leitura das balanças e agora
+  input.weight = weightSamplePredict(millis()) - data.residualWeightTotal;
+  input.mese = data.mese;
+  input.meseMax = data.meseMax;
 
-  int pi =
-      pesoControle * data.gainCoefficient + data.mese + 0.3f * erroControle;
+  int pi = piControllerStep(&input, elapsedMs);
 
   int maximo = data.meseMax;
-  int minimo = maximo * 0.8f;
-
-  if (pi < minimo)
-    pi = minimo;
-  if (pi > maximo)
-    pi = maximo;
+  int minimo = maximo * 4 / 5;
 
   if (largerPi < minimo)
     largerPi = minimo;
@@ -42,32 +42,44 @@ int calculatePulseWidth()
     largerPi = pi;
   }
 
+  PiControllerTrace trace = piControllerGetTrace();
+  telemetryRecordControl(&trace, largerPi);
+
   return largerPi;
 }
 
 void onWorkingMalhaFechadaStateEnter()
 {
   lastTwaiSendTime = millis();
-  lastTwaiRecvTime = millis();
   largerPi = 0;
-  integralErro = 0;
+  piControllerReset();
+  // Amostras de antes da entrada não servem para inclinação nem contam como leitura nova
+  weightSampleReset();
 }
 
 void onWorkingMalhaFechadaStateLoop()
 {
   // Segurança: Se o barramento cair durante a operação, o estimulador deverá
   // tomar uma ação de decremento independente
-  if (millis() - lastTwaiRecvTime >= 1000)
+  if (linkMonitorIsLost())
   {
     stateManager.switchTo(StateKind::GatewayDownSafetyStopState);
     return;
   }
 
-  data.requestedPwm = calculatePulseWidth();
-  modulateLoop(data.requestedPwm);
+  workingTakeRegisters();
+
+  // O controle só roda quando chega uma leitura nova das balanças
+  WeightSample sample;
+  unsigned long elapsedMs;
+  if (weightSampleTakeNew(&sample, &elapsedMs))
+  {
+    data.requestedPwm = calculatePulseWidth(elapsedMs);
+  }
+  modulatorSetPulseWidth(data.requestedPwm);
 
   unsigned long now_ms = millis();
-  if (now_ms - lastTwaiSendTime > 5)
+  if (now_ms - lastTwaiSendTime > 5 * twaiNodeShare())
   {
     lastTwaiSendTime = now_ms;
 
@@ -79,36 +91,29 @@ void onWorkingMalhaFechadaStateLoop()
 void onWorkingMalhaFechadaStateTWAIMessage(
     TwaiReceivedMessage *receivedMessage)
 {
-  lastTwaiRecvTime = millis();
 
   switch (receivedMessage->Kind)
   {
   case TwaiReceivedMessageKind::FirmwareInvokeReset:
     esp_restart();
     break;
-  case TwaiReceivedMessageKind::WeightTotal:
-    data.weightTotal = receivedMessage->ExtraData;
-    break;
-  case TwaiReceivedMessageKind::ResidualWeightTotal:
-    data.residualWeightTotal = receivedMessage->ExtraData;
-    break;
   case TwaiReceivedMessageKind::SetRequestedPwm:
     data.requestedPwm = receivedMessage->ExtraData;
     break;
-  case TwaiReceivedMessageKind::MeseMax:
-    data.meseMax = receivedMessage->ExtraData;
-    break;
-  case TwaiReceivedMessageKind::Setpoint:
-    data.setpointKg = receivedMessage->ExtraData;
-    break;
   case TwaiReceivedMessageKind::UseMalhaAberta:
     stateManager.switchTo(StateKind::WorkingMalhaAbertaState);
     break;
-  case TwaiReceivedMessageKind::Mese:
-    data.mese = receivedMessage->ExtraData;
-    break;
   case TwaiReceivedMessageKind::SetGainCoefficient:
-    data.gainCoefficient = receivedMessage->ExtraData / 100.0f;
+  case TwaiReceivedMessageKind::SetProportionalGain:
+  case TwaiReceivedMessageKind::SetIntegralGain:
+    piControllerOnTWAIMessage(receivedMessage);
+    break;
+  case TwaiReceivedMessageKind::SetWaveform:
+    waveformOnTWAIMessage(receivedMessage);
+    break;
+  case TwaiReceivedMessageKind::SetChannelAmplitude:
+  case TwaiReceivedMessageKind::SetChannelOffset:
+    modulatorOnTWAIMessage(receivedMessage);
     break;
   case TwaiReceivedMessageKind::GatewayResetHappened:
     ESP_LOGE(stateManager.current->TAG, "O Gateway reiniciou inesperadamente.");
@@ -116,4 +121,8 @@ void onWorkingMalhaFechadaStateTWAIMessage(
   }
 }
 
-void onWorkingMalhaFechadaStateExit() {}
\ No newline at end of file
+void onWorkingMalhaFechadaStateExit()
+{
+  // Fora da malha fechada o último passo do PI não vale mais
+  telemetryStopControl();
+}
\ No newline at end of file
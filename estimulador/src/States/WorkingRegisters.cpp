@@ -0,0 +1,23 @@
+#include "../StateManager.h"
+#include "../Twai/TwaiRegisters.h"
+#include "../Data.h"
+#include "../Control/WeightSample.h"
+
+void workingTakeRegisters()
+{
+    TwaiReceivedMessage message;
+
+    if (twaiRegisterTake(TwaiReceivedMessageKind::WeightTotal, &message))
+    {
+        data.weightTotal = message.ExtraData;
+        weightSampleOnTWAIMessage(&message);
+    }
+    if (twaiRegisterTake(TwaiReceivedMessageKind::ResidualWeightTotal, &message))
+        data.residualWeightTotal = message.ExtraData;
+    if (twaiRegisterTake(TwaiReceivedMessageKind::Mese, &message))
+        data.mese = message.ExtraData;
+    if (twaiRegisterTake(TwaiReceivedMessageKind::MeseMax, &message))
+        data.meseMax = message.ExtraData;
+    if (twaiRegisterTake(TwaiReceivedMessageKind::Setpoint, &message))
+        data.setpointKg = message.ExtraData;
+}
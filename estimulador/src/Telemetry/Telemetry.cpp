@@ -0,0 +1,121 @@
+#include "Telemetry.h"
+#include "../Twai/TwaiNode.h"
+#include <Arduino.h>
+#include <esp_log.h>
+
+static const char *TAG = "Telemetry";
+
+static uint8_t rateHz = 0;
+static unsigned long periodMicros = 0;
+static unsigned long lastSendMicros = 0;
+static uint8_t sequence = 0;
+
+static PiControllerTrace latestTrace;
+static uint16_t latestLargerPi = 0;
+static bool hasTrace = false;
+static bool newSample = false;
+
+static uint32_t skippedBusy = 0;
+
+void telemetryReset()
+{
+    rateHz = 0;
+    hasTrace = false;
+    newSample = false;
+    skippedBusy = 0;
+}
+
+void telemetryRecordControl(const PiControllerTrace *trace, uint16_t largerPi)
+{
+    latestTrace = *trace;
+    latestLargerPi = largerPi;
+    hasTrace = true;
+    newSample = true;
+}
+
+void telemetryStopControl()
+{
+    hasTrace = false;
+    newSample = false;
+}
+
+void telemetryOnTWAIMessage(TwaiReceivedMessage *receivedMessage)
+{
+    if (receivedMessage->Kind != TwaiReceivedMessageKind::SetTelemetryRate)
+        return;
+
+    uint16_t requested = receivedMessage->ExtraData;
+    if (requested > TELEMETRY_MAX_RATE_HZ)
+        requested = TELEMETRY_MAX_RATE_HZ;
+
+    if (requested != rateHz)
+        ESP_LOGI(TAG, "Telemetria do controle: %u Hz", requested);
+
+    rateHz = requested;
+    periodMicros = rateHz > 0 ? 1000000UL / rateHz : 0;
+}
+
+static int16_t saturate16(int32_t value)
+{
+    if (value > INT16_MAX)
+        return INT16_MAX;
+    if (value < INT16_MIN)
+        return INT16_MIN;
+    return value;
+}
+
+void telemetryLoop()
+{
+    if (rateHz == 0 || !hasTrace)
+        return;
+
+    // Com vários estimuladores no barramento, a taxa máxima é dividida entre eles (TwaiNode.h)
+    unsigned long minimumPeriod = 1000000UL / TELEMETRY_MAX_RATE_HZ * twaiNodeShare();
+    unsigned long period = periodMicros > minimumPeriod ? periodMicros : minimumPeriod;
+
+    unsigned long now_us = micros();
+    if (now_us - lastSendMicros < period)
+        return;
+    lastSendMicros = now_us;
+
+    if (twaiPendingTransmissions() > TELEMETRY_MAX_PENDING_TX)
+    {
+        skippedBusy++;
+        return;
+    }
+
+    int16_t weight = saturate16(latestTrace.weight);
+    int16_t error = saturate16(latestTrace.errorTenths);
+    int16_t integral = saturate16(latestTrace.integralMicros);
+
+    uint8_t flags = 0;
+    if (newSample)
+        flags |= TELEMETRY_FLAG_NEW_SAMPLE;
+    if (latestTrace.output <= latestTrace.minimum)
+        flags |= TELEMETRY_FLAG_CLAMPED_LOW;
+    if (latestTrace.output >= latestTrace.maximum)
+        flags |= TELEMETRY_FLAG_CLAMPED_HIGH;
+    newSample = false;
+
+    uint8_t values[8];
+    values[0] = sequence++;
+    values[1] = (uint16_t)weight >> 8;
+    values[2] = (uint16_t)weight & 0xFF;
+    values[3] = (uint16_t)error >> 8;
+    values[4] = (uint16_t)error & 0xFF;
+    values[5] = (uint16_t)integral >> 8;
+    values[6] = (uint16_t)integral & 0xFF;
+    values[7] = flags;
+    twaiSendPayload(TwaiSendMessageKind::ControlTelemetry, values, sizeof(values));
+
+    uint8_t bounds[8];
+    bounds[0] = latestTrace.output >> 8;
+    bounds[1] = latestTrace.output & 0xFF;
+    bounds[2] = latestLargerPi >> 8;
+    bounds[3] = latestLargerPi & 0xFF;
+    bounds[4] = latestTrace.minimum >> 8;
+    bounds[5] = latestTrace.minimum & 0xFF;
+    bounds[6] = latestTrace.maximum >> 8;
+    bounds[7] = latestTrace.maximum & 0xFF;
+    twaiSendPayload(TwaiSendMessageKind::ControlTelemetryBounds, bounds, sizeof(bounds));
+}
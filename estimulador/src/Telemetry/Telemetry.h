@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+#include "../Twai/Twai.h"
+#include "../Control/PiController.h"
+
+#define TELEMETRY_MAX_RATE_HZ 200
+
+// Telemetria só sai com a fila de transmissão quase vazia, para não atrasar o tráfego de controle
+#define TELEMETRY_MAX_PENDING_TX 1
+
+// Bits de `flags` no frame ControlTelemetry
+#define TELEMETRY_FLAG_NEW_SAMPLE 0x01
+#define TELEMETRY_FLAG_CLAMPED_LOW 0x02
+#define TELEMETRY_FLAG_CLAMPED_HIGH 0x04
+
+void telemetryReset();
+
+// Guarda o passo mais recente do controle em malha fechada
+void telemetryRecordControl(const PiControllerTrace *trace, uint16_t largerPi);
+
+// O controle em malha fechada parou: nada é enviado até o próximo passo registrado
+void telemetryStopControl();
+
+// Trata SetTelemetryRate (Hz; 0 desliga)
+void telemetryOnTWAIMessage(TwaiReceivedMessage *receivedMessage);
+
+/**
+ * Envia, na taxa configurada, dois frames com identificadores de baixa prioridade:
+ *   ControlTelemetry:       [sequência u8][peso i16][erro em décimos i16][integral em us i16][flags u8]
+ *   ControlTelemetryBounds: [pi u16][largerPi u16][mínimo u16][máximo u16]
+ * O segundo frame vai logo depois do primeiro e pertence a ele.
+ */
+void telemetryLoop();
@@ -1,24 +1,134 @@
 #include <string.h>
 #include <Arduino.h>
 #include "Twai.h"
+#include "TwaiFilter.h"
+#include "TwaiRegisters.h"
+#include "TwaiHealth.h"
+#include "TwaiBitrate.h"
+#include "TwaiNode.h"
+#include "../Capture/Capture.h"
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#ifdef ARDUINO
+#include <freertos/task.h>
+#include <hal/twai_ll.h>
+#include <soc/twai_struct.h>
+#endif
 
 static const char *TAG = "Twai";
 
-static const twai_general_config_t g_config = TWAI_GENERAL_CONFIG_DEFAULT(WIRESS_GPIO_TX, WIRESS_GPIO_RX,
-                                                                          TWAI_MODE_NORMAL);
-static const twai_timing_config_t t_config = TWAI_TIMING_CONFIG_500KBITS();
-static const twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+// Tudo que algum módulo trata. O filtro de aceitação é calculado a partir desta lista;
+// um tipo novo em TwaiReceivedMessageKind precisa entrar aqui para chegar aos estados.
+static const uint8_t HANDLED_KINDS[] = {
+    TwaiReceivedMessageKind::EmergencyStop,
+    TwaiReceivedMessageKind::FirmwareInvokeReset,
+    TwaiReceivedMessageKind::GatewayResetHappened,
+    TwaiReceivedMessageKind::Heartbeat,
+    TwaiReceivedMessageKind::OperationCommand,
+    TwaiReceivedMessageKind::WeightTotal,
+    TwaiReceivedMessageKind::ResidualWeightTotal,
+    TwaiReceivedMessageKind::SetRequestedPwm,
+    TwaiReceivedMessageKind::RampTo,
+    TwaiReceivedMessageKind::LatencyPing,
+    TwaiReceivedMessageKind::OperationParameters,
+    TwaiReceivedMessageKind::Mese,
+    TwaiReceivedMessageKind::MeseMax,
+    TwaiReceivedMessageKind::Setpoint,
+    TwaiReceivedMessageKind::UseMalhaAberta,
+    TwaiReceivedMessageKind::UseMalhaFechada,
+    TwaiReceivedMessageKind::SetGainCoefficient,
+    TwaiReceivedMessageKind::SetProportionalGain,
+    TwaiReceivedMessageKind::SetIntegralGain,
+    TwaiReceivedMessageKind::SetLinkTimeout,
+    TwaiReceivedMessageKind::SetTelemetryRate,
+    TwaiReceivedMessageKind::SetBusBitrate,
+    TwaiReceivedMessageKind::SetWaveform,
+    TwaiReceivedMessageKind::SetChannelAmplitude,
+    TwaiReceivedMessageKind::SetChannelOffset,
+    TwaiReceivedMessageKind::RunPulseBenchmark,
+    TwaiReceivedMessageKind::NodeDiscover,
+    TwaiReceivedMessageKind::NodeAssign,
+    TwaiReceivedMessageKind::SetBusShare,
+    TwaiReceivedMessageKind::BenchFiller,
+
+    // Auto-recepção de twaiSendTimestamped; não chega aos módulos
+    TwaiSendMessageKind::LatencyEcho,
+};
+
+static TwaiFilterPlan filterPlan;
+
+// Mensagens da recepção para o loop. Os tipos com registro (TwaiRegisters.h) não passam por aqui.
+#define TWAI_MESSAGE_QUEUE_LENGTH 32
+
+// Frames que o driver guarda até a recepção ler; o padrão (5) não comporta uma rajada do gateway
+#define TWAI_DRIVER_RX_QUEUE_LENGTH 32
+
+// Frames esperando a vez de transmitir, em ordem de chegada (FIFO, não por prioridade). tools/can_rta.py lê este
+// valor: é o máximo de frames do próprio nó à frente de qualquer frame enfileirado.
+#define TWAI_DRIVER_TX_QUEUE_LENGTH 5
+
+static QueueHandle_t messageQueue = nullptr;
+
+#ifdef ARDUINO
+// A tarefa de recepção fica no núcleo do loop, logo acima dele: cada frame é carimbado e
+// desmembrado assim que o driver o entrega, mesmo com o loop ocupado num estado ou no controle
+#define TWAI_RX_TASK_CORE ARDUINO_RUNNING_CORE
+#define TWAI_RX_TASK_PRIORITY 2
+#define TWAI_RX_TASK_STACK 3072
+
+static void ingestFrame(const twai_message_t *frame, uint32_t receivedMicros);
+
+static void twaiRxTask(void *)
+{
+  twai_message_t frame;
+  while (true)
+  {
+    if (twai_receive(&frame, portMAX_DELAY) != ESP_OK)
+      continue;
+    ingestFrame(&frame, esp_timer_get_time());
+  }
+}
+#endif
 
-twai_message_t lastReceivedMessage;
 unsigned long lastReceivedMessageTime;
 
+// Separados por escritor: o loop envia e a recepção recebe
+static volatile uint32_t transmittedBits = 0;
+static volatile uint32_t receivedBits = 0;
+
+// Carimbo de transmissão: o identificador é escrito pelo loop antes do envio, o instante pela recepção
+static volatile int32_t timestampedIdentifier = -1;
+static volatile uint32_t transmitTimestamp = 0;
+static volatile bool transmitTimestampReady = false;
+
+// Bits de um frame padrão (ID de 11 bits) com `length` octetos, com o máximo de bits de stuffing
+static uint32_t frameBits(uint8_t length)
+{
+  uint32_t stuffable = 34 + 8 * length;
+  return 47 + 8 * length + (stuffable - 1) / 4;
+}
+
 void twaiStart()
 {
   lastReceivedMessageTime = millis();
-  memset(&lastReceivedMessage, 0, sizeof(twai_message_t));
+  messageQueue = xQueueCreate(TWAI_MESSAGE_QUEUE_LENGTH, sizeof(TwaiReceivedMessage));
+  twaiRegisterReset();
+
+  twai_timing_config_t t_config = twaiBitrateTiming(twaiBitrateSelect());
+  twai_general_config_t g_config = TWAI_GENERAL_CONFIG_DEFAULT(WIRESS_GPIO_TX, WIRESS_GPIO_RX, TWAI_MODE_NORMAL);
+  g_config.rx_queue_len = TWAI_DRIVER_RX_QUEUE_LENGTH;
+  g_config.tx_queue_len = TWAI_DRIVER_TX_QUEUE_LENGTH;
+
+  // Frames para todos e para este estimulador; o próprio endereço também serve à auto-recepção
+  uint8_t node = twaiNodeSelect();
+  filterPlan = twaiFilterPlan(HANDLED_KINDS, sizeof(HANDLED_KINDS), (1 << TWAI_BROADCAST_NODE) | (1 << node));
+  ESP_LOGI(TAG, "Filter: %s, code=%08X mask=%08X, %u of 2048 IDs accepted",
+           filterPlan.config.single_filter ? "single" : "dual", filterPlan.config.acceptance_code,
+           filterPlan.config.acceptance_mask, filterPlan.acceptedIdCount);
 
   // Install TWAI driver
-  if (twai_driver_install(&g_config, &t_config, &f_config) == ESP_OK)
+  if (twai_driver_install(&g_config, &t_config, &filterPlan.config) == ESP_OK)
   {
     ESP_LOGI(TAG, "Driver installed!");
   }
@@ -38,58 +148,260 @@ void twaiStart()
     ESP_LOGE(TAG, "Failed to start driver");
     return;
   }
+
+#ifdef ARDUINO
+  xTaskCreatePinnedToCore(twaiRxTask, "twaiRx", TWAI_RX_TASK_STACK, nullptr, TWAI_RX_TASK_PRIORITY, nullptr,
+                          TWAI_RX_TASK_CORE);
+#endif
+  twaiHealthStart();
 }
 
 void twaiSend(TwaiSendMessageKind kind, uint16_t extraData)
 {
-  twai_message_t message;
-  message.identifier = kind;
-  message.flags = TWAI_MSG_FLAG_NONE;
-  message.data_length_code = 4;
+  uint8_t payload[4] = {0};
+  payload[0] = extraData >> 8;
+  payload[1] = extraData & 0xFF;
+
+  twaiSendPayload(kind, payload, sizeof(payload));
+}
 
-  uint8_t octet1 = extraData >> 8;
-  uint8_t octet2 = extraData & 0xFF;
+static bool transmit(uint32_t identifier, const uint8_t *payload, uint8_t length, uint32_t flags)
+{
+  twai_message_t message;
+  memset(&message, 0, sizeof(message));
+  message.identifier = identifier;
+  message.flags = flags;
+  message.data_length_code = length;
+  memcpy(message.data, payload, length);
 
-  message.data[0] = octet1;
-  message.data[1] = octet2;
+#ifdef TWAI_CAPTURE
+  captureRecord(&message, true);
+#endif
 
   // Fila de transmissão
   if (twai_transmit(&message, pdMS_TO_TICKS(0)) == ESP_OK)
   {
-    //  ESP_LOGD(TAG, "Message (Kind=%0X, Data=%0X) queued for transmission", kind, extraData);
+    transmittedBits += frameBits(length);
+    //  ESP_LOGD(TAG, "Message (Id=%0X, Length=%d) queued for transmission", identifier, length);
+    return true;
   }
   else
   {
-    //  ESP_LOGD(TAG, "Failed to queue message (Kind=%0X, Data=%0X) for transmission", kind, extraData);
+    //  ESP_LOGD(TAG, "Failed to queue message (Id=%0X, Length=%d) for transmission", identifier, length);
+    return false;
   }
 }
 
-esp_err_t twaiReceive(TwaiReceivedMessage *received)
+void twaiSendPayload(TwaiSendMessageKind kind, const uint8_t *payload, uint8_t length)
+{
+  transmit(twaiIdentifier(kind, twaiNodeAddress()), payload, length, TWAI_MSG_FLAG_NONE);
+}
+
+void twaiClearTransmitQueue()
+{
+  twai_clear_transmit_queue();
+#ifdef ARDUINO
+  // O driver não tem como cancelar o frame que está no controlador. Um que perdeu a arbitragem ficaria
+  // tentando de novo com a sua prioridade, na frente do que vier depois; um que já está no fio termina.
+  twai_ll_set_cmd_abort_tx(&TWAI);
+#endif
+}
+
+bool twaiSendTimestamped(TwaiSendMessageKind kind, const uint8_t *payload, uint8_t length)
+{
+  uint32_t identifier = twaiIdentifier(kind, twaiNodeAddress());
+  transmitTimestampReady = false;
+  timestampedIdentifier = identifier;
+  return transmit(identifier, payload, length, TWAI_MSG_FLAG_SELF);
+}
+
+bool twaiTakeTransmitTimestamp(TwaiSendMessageKind kind, uint32_t *micros)
+{
+  if (timestampedIdentifier != (int32_t)twaiIdentifier(kind, twaiNodeAddress()) || !transmitTimestampReady)
+    return false;
+
+  *micros = transmitTimestamp;
+  transmitTimestampReady = false;
+  return true;
+}
+
+// `frames`, `messages`, `rejected` e `queueDropped` são escritos pela recepção; os picos, pelo loop
+static TwaiReceiveStats receiveStats;
+
+// Entrega a mensagem ao registro do tipo ou, se ele não tiver um, à fila do loop
+static void publish(TwaiReceivedMessage *message, uint32_t receivedMicros)
+{
+  message->ReceivedMicros = receivedMicros;
+  receiveStats.messages++;
+
+  if (twaiRegisterWrite(message))
+    return;
+
+  if (xQueueSend(messageQueue, message, 0) != pdTRUE)
+    receiveStats.queueDropped++;
+}
+
+// Uma mensagem como a que o gateway mandaria sozinha com twaiSend/twaiSendPayload
+static void unpack(TwaiReceivedMessageKind kind, uint8_t node, const uint8_t *payload, uint8_t length,
+                   uint32_t receivedMicros)
+{
+  TwaiReceivedMessage message;
+  memset(&message, 0, sizeof(TwaiReceivedMessage));
+  message.Kind = kind;
+  message.Node = node;
+  message.Length = 4;
+  memcpy(message.Payload, payload, length);
+  message.ExtraData = (message.Payload[0] << 8) | message.Payload[1];
+  publish(&message, receivedMicros);
+}
+
+static void unpackOperationCommand(const uint8_t *data, uint8_t node, uint32_t receivedMicros)
 {
-  memset(&lastReceivedMessage, 0, sizeof(twai_message_t));
-  memset(received, 0, sizeof(TwaiReceivedMessage));
+  // [campos u8][peso u16][sequência u8][idade ms u8][PWM u16][reservado]
+  static const uint8_t none[2] = {0, 0};
+  uint8_t fields = data[0];
 
-  esp_err_t statusCode = twai_receive(&lastReceivedMessage, pdMS_TO_TICKS(0));
-  if (statusCode == ESP_OK)
+  if (fields & OperationUseMalhaAberta)
+    unpack(TwaiReceivedMessageKind::UseMalhaAberta, node, none, sizeof(none), receivedMicros);
+  if (fields & OperationUseMalhaFechada)
+    unpack(TwaiReceivedMessageKind::UseMalhaFechada, node, none, sizeof(none), receivedMicros);
+  if (fields & OperationWeight)
+    unpack(TwaiReceivedMessageKind::WeightTotal, node, &data[1], 4, receivedMicros);
+  if (fields & OperationRequestedPwm)
+    unpack(TwaiReceivedMessageKind::SetRequestedPwm, node, &data[5], 2, receivedMicros);
+}
+
+static void unpackOperationParameters(const uint8_t *data, uint8_t node, uint32_t receivedMicros)
+{
+  // [campos u8][setpoint u16][mese u16][mese máx. u16][ganho u8]
+  uint8_t fields = data[0];
+  uint8_t gain[2] = {0, data[7]};
+
+  if (fields & OperationSetpoint)
+    unpack(TwaiReceivedMessageKind::Setpoint, node, &data[1], 2, receivedMicros);
+  if (fields & OperationMese)
+    unpack(TwaiReceivedMessageKind::Mese, node, &data[3], 2, receivedMicros);
+  if (fields & OperationMeseMax)
+    unpack(TwaiReceivedMessageKind::MeseMax, node, &data[5], 2, receivedMicros);
+  if (fields & OperationGainCoefficient)
+    unpack(TwaiReceivedMessageKind::SetGainCoefficient, node, gain, sizeof(gain), receivedMicros);
+}
+
+// Trata um frame lido do driver: filtra, desmembra frames agrupados e publica as mensagens
+static void ingestFrame(const twai_message_t *frame, uint32_t receivedMicros)
+{
+  // Auto-recepção de twaiSendTimestamped: o frame já foi contado no envio
+  if (frame->identifier == (uint32_t)timestampedIdentifier)
   {
-    // Received OK!
-    uint8_t octet1 = lastReceivedMessage.data[0];
-    uint8_t octet2 = lastReceivedMessage.data[1];
-    uint16_t data = (octet1 << 8) | octet2;
+    transmitTimestamp = receivedMicros;
+    transmitTimestampReady = true;
+    return;
+  }
+
+  receiveStats.frames++;
+  receivedBits += frameBits(frame->data_length_code);
+
+  // O filtro de hardware aceita alguns IDs a mais; estes param aqui
+  if (!twaiFilterHandles(&filterPlan, frame->identifier))
+  {
+    receiveStats.rejected++;
+    ESP_LOGD(TAG, "Rejected message Id=%0X", frame->identifier);
+    return;
+  }
+
+  lastReceivedMessageTime = millis();
 
-    received->Kind = (TwaiReceivedMessageKind)lastReceivedMessage.identifier;
-    received->ExtraData = data;
+#ifdef TWAI_CAPTURE
+  captureRecord(frame, false);
+#endif
 
-    lastReceivedMessageTime = millis();
+  TwaiReceivedMessageKind kind = (TwaiReceivedMessageKind)(frame->identifier >> TWAI_NODE_BITS);
+  uint8_t node = frame->identifier & TWAI_NODE_MASK;
 
-    ESP_LOGD(TAG, "Received message Kind=%0X Data=%000X", received->Kind, received->ExtraData);
+  switch (kind)
+  {
+  case TwaiReceivedMessageKind::OperationCommand:
+  case TwaiReceivedMessageKind::OperationParameters:
+    if (frame->data_length_code < 8)
+    {
+      ESP_LOGW(TAG, "Frame agrupado curto: Kind=%0X Length=%d", kind, frame->data_length_code);
+    }
+    else if (kind == TwaiReceivedMessageKind::OperationCommand)
+    {
+      unpackOperationCommand(frame->data, node, receivedMicros);
+    }
+    else
+    {
+      unpackOperationParameters(frame->data, node, receivedMicros);
+    }
+    return;
+  default:
+    break;
   }
-  else
+
+  // Received OK!
+  uint8_t octet1 = frame->data[0];
+  uint8_t octet2 = frame->data[1];
+  uint16_t data = (octet1 << 8) | octet2;
+
+  TwaiReceivedMessage message;
+  message.Kind = kind;
+  message.Node = node;
+  message.ExtraData = data;
+  message.Length = frame->data_length_code;
+  memcpy(message.Payload, frame->data, sizeof(message.Payload));
+
+  ESP_LOGD(TAG, "Received message Kind=%0X Data=%000X", message.Kind, message.ExtraData);
+  publish(&message, receivedMicros);
+}
+
+esp_err_t twaiReceive(TwaiReceivedMessage *received)
+{
+  if (messageQueue == nullptr)
+    return ESP_ERR_INVALID_STATE;
+
+#ifndef ARDUINO
+  // No host não há tarefa de recepção: os frames do driver simulado são tratados aqui
+  twai_message_t frame;
+  while (twai_receive(&frame, pdMS_TO_TICKS(0)) == ESP_OK)
+    ingestFrame(&frame, esp_timer_get_time());
+#endif
+
+  // Inclui a mensagem que vai ser lida agora
+  uint32_t depth = uxQueueMessagesWaiting(messageQueue);
+  if (depth > receiveStats.maxQueueDepth)
+    receiveStats.maxQueueDepth = depth;
+
+  if (xQueueReceive(messageQueue, received, 0) != pdTRUE)
   {
-    // ESP_LOGD(TAG, "Message RX queue empty. Status code: 0x%0X", statusCode);
+    // ESP_LOGD(TAG, "Message RX queue empty.");
+    return ESP_ERR_TIMEOUT;
   }
 
-  return statusCode;
+  uint32_t latency = micros() - received->ReceivedMicros;
+  if (latency > receiveStats.maxLatencyMicros)
+    receiveStats.maxLatencyMicros = latency;
+
+  return ESP_OK;
+}
+
+TwaiReceiveStats twaiGetReceiveStats()
+{
+  TwaiReceiveStats stats = receiveStats;
+
+  twai_status_info_t status;
+  if (twai_get_status_info(&status) == ESP_OK)
+  {
+    stats.driverMissed = status.rx_missed_count;
+    stats.driverOverrun = status.rx_overrun_count;
+  }
+  return stats;
+}
+
+void twaiResetReceivePeaks()
+{
+  receiveStats.maxQueueDepth = 0;
+  receiveStats.maxLatencyMicros = 0;
 }
 
 bool twaiIsAvailable()
@@ -105,3 +417,19 @@ bool twaiIsAvailable()
 
   return status.state == twai_state_t::TWAI_STATE_RUNNING && (timeSinceLastMessage < 500);
 }
+
+uint32_t twaiPendingTransmissions()
+{
+  twai_status_info_t status;
+  if (twai_get_status_info(&status) != ESP_OK)
+  {
+    return 0;
+  }
+
+  return status.msgs_to_tx;
+}
+
+uint32_t twaiGetBusBits()
+{
+  return transmittedBits + receivedBits;
+}
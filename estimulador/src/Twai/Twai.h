@@ -1,6 +1,7 @@
 #pragma once
 #include <driver/twai.h>
 #include <Arduino.h>
+#include "TwaiFilter.h"
 
 #define WIRESS_GPIO_TX GPIO_NUM_17
 #define WIRESS_GPIO_RX GPIO_NUM_16
@@ -8,33 +9,166 @@
 // #define WIRESS_GPIO_TX GPIO_NUM_5
 // #define WIRESS_GPIO_RX GPIO_NUM_4
 
+/**
+ * O tipo ocupa os 8 bits altos do identificador, e o nó os 3 baixos (ver TwaiFilter.h): quanto menor o
+ * tipo, maior a prioridade na arbitragem. Os tipos são agrupados por criticidade (segurança, enlace,
+ * controle, parâmetros, configuração, relatórios, telemetria) e, dentro de cada faixa, o bit 3 indica a
+ * origem (0 = gateway, 1 = estimulador). Os frames do estimulador saem com o endereço dele (TwaiNode.h).
+ * Os dois firmwares precisam concordar com tools/can_messages.csv, onde estão os períodos e prazos;
+ * tools/can_rta.py confere isso e calcula o pior tempo de resposta de cada frame antes do build.
+ */
 enum TwaiSendMessageKind : uint8_t
 {
-    PwmFeedbackEstimulador = 0x6A
+    EmergencyStopAck = 0x08,
+    EmergencyStopZeroReached = 0x09,
+    PwmFeedbackEstimulador = 0x28,
+    RampStatus = 0x29,
+    LatencyEcho = 0x2A,
+    PulseScheduleStatusReport = 0x68,
+    LinkStatusReport = 0x69,
+    ReceiveStatsReport = 0x6A,
+    PulseTimingReport = 0x6B,
+    BusHealthReport = 0x6C,
+    NodeAnnounce = 0x78,
+    ControlTelemetry = 0xE8,
+    ControlTelemetryBounds = 0xE9
 };
 
 enum TwaiReceivedMessageKind : uint8_t
 {
-    FirmwareInvokeReset = 0x01,
-    GatewayResetHappened = 0x02,
-    WeightTotal = 0x51,
-    ResidualWeightTotal = 0x52,
-    SetRequestedPwm = 0x61,
-    Mese = 0x71,
-    MeseMax = 0x72,
-    Setpoint = 0x81,
-    UseMalhaAberta = 0x82,
-    UseMalhaFechada = 0x83,
-    SetGainCoefficient = 0xA1,
+    EmergencyStop = 0x00,
+    GatewayResetHappened = 0x01,
+    Heartbeat = 0x10,
+    OperationCommand = 0x20,
+    SetRequestedPwm = 0x21,
+    RampTo = 0x22,
+    WeightTotal = 0x23,
+    ResidualWeightTotal = 0x24,
+    LatencyPing = 0x25,
+    OperationParameters = 0x30,
+    Mese = 0x31,
+    MeseMax = 0x32,
+    Setpoint = 0x33,
+    UseMalhaAberta = 0x34,
+    UseMalhaFechada = 0x35,
+    SetGainCoefficient = 0x40,
+    SetProportionalGain = 0x41,
+    SetIntegralGain = 0x42,
+    SetLinkTimeout = 0x43,
+    SetTelemetryRate = 0x44,
+    SetBusBitrate = 0x45,
+    SetBusShare = 0x46,
+    SetWaveform = 0x50,
+    SetChannelAmplitude = 0x54,
+    SetChannelOffset = 0x55,
+    FirmwareInvokeReset = 0x70,
+    RunPulseBenchmark = 0x71,
+    NodeDiscover = 0x72,
+    NodeAssign = 0x73,
+    BenchFiller = 0xF0,
 };
 
+/**
+ * Campos presentes num frame OperationCommand: [campos u8][peso u16][sequência u8][idade ms u8][PWM u16][reservado].
+ * O frame substitui UseMalhaAberta/UseMalhaFechada, WeightTotal e SetRequestedPwm enviados a cada ciclo.
+ */
+enum OperationCommandField : uint8_t
+{
+    OperationUseMalhaAberta = 0x01,
+    OperationUseMalhaFechada = 0x02,
+    OperationWeight = 0x04,
+    OperationRequestedPwm = 0x08
+};
+
+/**
+ * Campos presentes num frame OperationParameters: [campos u8][setpoint u16][mese u16][mese máx. u16][ganho u8].
+ * O frame substitui Setpoint, Mese, MeseMax e SetGainCoefficient enviados a cada ciclo.
+ */
+enum OperationParameterField : uint8_t
+{
+    OperationSetpoint = 0x01,
+    OperationMese = 0x02,
+    OperationMeseMax = 0x04,
+    OperationGainCoefficient = 0x08
+};
+
+// Nó de destino dos frames do gateway que valem para todos os estimuladores
+#define TWAI_BROADCAST_NODE 0
+
+static inline uint32_t twaiIdentifier(uint8_t kind, uint8_t node)
+{
+    return ((uint32_t)kind << TWAI_NODE_BITS) | (node & TWAI_NODE_MASK);
+}
+
 struct TwaiReceivedMessage
 {
     TwaiReceivedMessageKind Kind;
+
+    // Destino do frame: TWAI_BROADCAST_NODE ou o endereço deste estimulador
+    uint8_t Node;
+
     uint16_t ExtraData;
+
+    // Conteúdo completo do frame, para mensagens com mais de 2 octetos
+    uint8_t Length;
+    uint8_t Payload[8];
+
+    // micros() do instante em que o driver entregou o frame, antes de qualquer atraso do loop
+    uint32_t ReceivedMicros;
+};
+
+// Frames lidos do driver e mensagens geradas por eles; um frame agrupado gera várias mensagens
+struct TwaiReceiveStats
+{
+    uint32_t frames;
+    uint32_t messages;
+
+    // Frames que passaram pelo filtro de hardware mas não são tratados por nenhum módulo
+    uint32_t rejected;
+
+    // Mensagens perdidas com a fila para o loop cheia
+    uint32_t queueDropped;
+
+    // Contadores do driver: frames perdidos com a fila dele cheia e por estouro do FIFO do controlador
+    uint32_t driverMissed;
+    uint32_t driverOverrun;
+
+    // Picos desde twaiResetReceivePeaks: mensagens esperando na fila e tempo entre a entrega do
+    // frame pelo driver e a entrega da mensagem ao módulo
+    uint32_t maxQueueDepth;
+    uint32_t maxLatencyMicros;
 };
 
 void twaiStart();
 void twaiSend(TwaiSendMessageKind kind, uint16_t extraData);
+void twaiSendPayload(TwaiSendMessageKind kind, const uint8_t *payload, uint8_t length);
+
+/**
+ * Descarta os frames que esperam na fila de transmissão e cancela o que está no controlador, se ainda não
+ * ganhou a arbitragem. Para um frame que não pode esperar os enfileirados antes dele (a fila é FIFO).
+ */
+void twaiClearTransmitQueue();
+
+/**
+ * Envio com carimbo de transmissão: o frame sai com auto-recepção, e a recepção guarda o instante em
+ * que o próprio controlador o recebeu de volta, que é o fim do frame no barramento, o mesmo instante
+ * em que o gateway o recebe. Um tipo por vez; um envio novo descarta o carimbo anterior.
+ * Retorna false se a fila de transmissão estava cheia.
+ */
+bool twaiSendTimestamped(TwaiSendMessageKind kind, const uint8_t *payload, uint8_t length);
+
+// Verdadeiro uma vez, quando o carimbo do último twaiSendTimestamped deste tipo estiver disponível
+bool twaiTakeTransmitTimestamp(TwaiSendMessageKind kind, uint32_t *micros);
+
+// Entrega uma mensagem por chamada. Frames agrupados são desmembrados nas mensagens individuais equivalentes.
+// Os tipos com registro (TwaiRegisters.h) não chegam por aqui; são lidos com twaiRegisterTake.
 esp_err_t twaiReceive(TwaiReceivedMessage *received);
+TwaiReceiveStats twaiGetReceiveStats();
+void twaiResetReceivePeaks();
 bool twaiIsAvailable();
+
+// Frames na fila de transmissão que ainda não saíram
+uint32_t twaiPendingTransmissions();
+
+// Bits dos frames enviados e recebidos (depois do filtro de hardware), no pior caso de bit stuffing
+uint32_t twaiGetBusBits();
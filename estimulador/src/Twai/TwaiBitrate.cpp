@@ -0,0 +1,178 @@
+#include "TwaiBitrate.h"
+#include "TwaiHealth.h"
+#include "../Modulator.h"
+#include <Arduino.h>
+#include <esp_log.h>
+#ifdef ARDUINO
+#include <Preferences.h>
+#endif
+
+static const char *TAG = "TwaiBitrate";
+
+// Na ordem da sondagem, depois da guardada. As mesmas que o gateway aceita (conferido por tools/can_rta.py):
+// a 125 kbit/s os prazos do barramento não cabem.
+static const uint32_t SUPPORTED_BITRATES[] = {500000, 1000000, 250000};
+
+#define TWAI_BITRATE_COUNT (sizeof(SUPPORTED_BITRATES) / sizeof(SUPPORTED_BITRATES[0]))
+
+static uint32_t activeBitrate = TWAI_DEFAULT_BITRATE;
+static unsigned long lastHeardTime = 0;
+
+static bool isSupported(uint32_t bitrate)
+{
+    for (size_t i = 0; i < TWAI_BITRATE_COUNT; i++)
+    {
+        if (SUPPORTED_BITRATES[i] == bitrate)
+            return true;
+    }
+    return false;
+}
+
+twai_timing_config_t twaiBitrateTiming(uint32_t bitrate)
+{
+    switch (bitrate)
+    {
+    case 125000:
+        return TWAI_TIMING_CONFIG_125KBITS();
+    case 250000:
+        return TWAI_TIMING_CONFIG_250KBITS();
+    case 1000000:
+        return TWAI_TIMING_CONFIG_1MBITS();
+    default:
+        return TWAI_TIMING_CONFIG_500KBITS();
+    }
+}
+
+uint32_t twaiGetBitrate()
+{
+    return activeBitrate;
+}
+
+#ifdef ARDUINO
+static Preferences preferences;
+
+static uint32_t loadBitrate()
+{
+    preferences.begin("twai", true);
+    uint32_t bitrate = preferences.getUInt("bitrate", TWAI_DEFAULT_BITRATE);
+    preferences.end();
+    return isSupported(bitrate) ? bitrate : TWAI_DEFAULT_BITRATE;
+}
+
+static void storeBitrate(uint32_t bitrate)
+{
+    preferences.begin("twai", false);
+    preferences.putUInt("bitrate", bitrate);
+    preferences.end();
+}
+
+// Verdadeiro se chegou um frame válido nesta taxa. Em somente-escuta o nó não confirma nem sinaliza
+// erros, então uma taxa errada não atrapalha o barramento.
+static bool probe(uint32_t bitrate)
+{
+    twai_general_config_t g_config = TWAI_GENERAL_CONFIG_DEFAULT(WIRESS_GPIO_TX, WIRESS_GPIO_RX, TWAI_MODE_LISTEN_ONLY);
+    twai_timing_config_t t_config = twaiBitrateTiming(bitrate);
+    twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+
+    if (twai_driver_install(&g_config, &t_config, &f_config) != ESP_OK)
+        return false;
+
+    bool heard = false;
+    if (twai_start() == ESP_OK)
+    {
+        twai_message_t message;
+        heard = twai_receive(&message, pdMS_TO_TICKS(TWAI_BITRATE_PROBE_WINDOW_MS)) == ESP_OK;
+        twai_stop();
+    }
+    twai_driver_uninstall();
+    return heard;
+}
+
+uint32_t twaiBitrateSelect()
+{
+    uint32_t stored = loadBitrate();
+
+    for (int round = 0; round < TWAI_BITRATE_PROBE_ROUNDS; round++)
+    {
+        if (probe(stored))
+        {
+            activeBitrate = stored;
+            ESP_LOGI(TAG, "Barramento a %u bit/s", activeBitrate);
+            return activeBitrate;
+        }
+
+        for (size_t i = 0; i < TWAI_BITRATE_COUNT; i++)
+        {
+            if (SUPPORTED_BITRATES[i] == stored || !probe(SUPPORTED_BITRATES[i]))
+                continue;
+
+            activeBitrate = SUPPORTED_BITRATES[i];
+            storeBitrate(activeBitrate);
+            ESP_LOGW(TAG, "Barramento a %u bit/s, não %u; taxa guardada", activeBitrate, stored);
+            return activeBitrate;
+        }
+    }
+
+    activeBitrate = stored;
+    ESP_LOGW(TAG, "Barramento em silêncio; usando a taxa guardada, %u bit/s", activeBitrate);
+    return activeBitrate;
+}
+#else
+// No host não há barramento para sondar
+uint32_t twaiBitrateSelect()
+{
+    activeBitrate = TWAI_DEFAULT_BITRATE;
+    return activeBitrate;
+}
+#endif
+
+void twaiBitrateOnTWAIMessage(TwaiReceivedMessage *receivedMessage)
+{
+    if (receivedMessage->Kind != TwaiReceivedMessageKind::SetBusBitrate)
+        return;
+
+    uint32_t bitrate = (uint32_t)receivedMessage->ExtraData * 1000;
+    if (bitrate == activeBitrate)
+        return;
+
+    if (!isSupported(bitrate))
+    {
+        ESP_LOGW(TAG, "Taxa não suportada: %u bit/s", bitrate);
+        return;
+    }
+
+    // A troca reinicia o estimulador; nunca no meio de uma estimulação
+    if (modulatorGetPulseWidth() != 0)
+    {
+        ESP_LOGW(TAG, "Troca para %u bit/s ignorada durante a estimulação", bitrate);
+        return;
+    }
+
+    ESP_LOGW(TAG, "Trocando para %u bit/s", bitrate);
+#ifdef ARDUINO
+    storeBitrate(bitrate);
+#endif
+    esp_restart();
+}
+
+void twaiBitrateLoop()
+{
+    unsigned long now = millis();
+    if (twaiIsAvailable())
+    {
+        lastHeardTime = now;
+        return;
+    }
+
+    if (now - lastHeardTime < TWAI_BITRATE_REPROBE_SILENCE_MS)
+        return;
+
+    // Barramento quieto, sem erros: o gateway está desligado, não noutra taxa
+    TwaiHealth health = twaiHealthGet();
+    if (health.rxErrorCounter == 0 || modulatorGetPulseWidth() != 0)
+        return;
+
+    ESP_LOGW(TAG, "Só erros de recepção (REC=%u) há %lu ms; reiniciando para sondar a taxa", health.rxErrorCounter,
+             now - lastHeardTime);
+    esp_restart();
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <stdint.h>
+#include <driver/twai.h>
+#include "Twai.h"
+
+/**
+ * Taxa do barramento escolhida em tempo de execução e guardada na flash.
+ *
+ * No boot, antes de instalar o driver, o estimulador escuta o barramento em modo somente-escuta em cada
+ * taxa suportada, começando pela guardada; a primeira em que chega um frame válido é adotada (e
+ * guardada, se mudou). Sem nada no barramento, fica com a guardada. Assim, trocar a taxa do gateway
+ * basta: o estimulador acha a nova no próximo boot, ou sozinho se ficar preso na taxa errada.
+ */
+
+#define TWAI_DEFAULT_BITRATE 500000
+
+// Tempo ouvindo cada taxa: o gateway envia o heartbeat a cada 10 ms
+#define TWAI_BITRATE_PROBE_WINDOW_MS 30
+
+// Voltas por todas as taxas antes de desistir. O gateway pode estar terminando o próprio boot.
+#define TWAI_BITRATE_PROBE_ROUNDS 3
+
+// Sem nenhum frame por este tempo, mas com erros de recepção, a taxa do barramento mudou: reinicia para sondar
+#define TWAI_BITRATE_REPROBE_SILENCE_MS 2000
+
+// Sonda o barramento e retorna a taxa a usar. Chamado por twaiStart com o driver desinstalado.
+uint32_t twaiBitrateSelect();
+
+twai_timing_config_t twaiBitrateTiming(uint32_t bitrate);
+
+// Taxa em uso, em bit/s
+uint32_t twaiGetBitrate();
+
+// Trata SetBusBitrate (kbit/s): guarda a taxa e reinicia, se o estimulador não estiver estimulando
+void twaiBitrateOnTWAIMessage(TwaiReceivedMessage *receivedMessage);
+
+// Reinicia para sondar de novo se o gateway sumiu e o barramento só tem erros
+void twaiBitrateLoop();
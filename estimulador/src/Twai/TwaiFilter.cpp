@@ -0,0 +1,171 @@
+#include "TwaiFilter.h"
+#include <string.h>
+
+#define TWAI_STANDARD_ID_COUNT 2048
+#define TWAI_STANDARD_ID_MASK 0x7FF
+
+// Filtro de um ID padrão: aceita `id` quando (id ^ code) & ~mask == 0
+struct IdFilter
+{
+    uint16_t code;
+    uint16_t mask;
+};
+
+// Menor filtro que aceita os nós de `nodes` (bit i = nó i) no campo de nó do ID
+static IdFilter coverNodes(uint8_t nodes)
+{
+    IdFilter filter = {0, 0};
+    bool first = true;
+    for (uint8_t node = 0; node <= TWAI_NODE_MASK; node++)
+    {
+        if (!(nodes & (1 << node)))
+            continue;
+        if (first)
+            filter.code = node;
+        else
+            filter.mask |= node ^ filter.code;
+        first = false;
+    }
+    filter.code &= ~filter.mask;
+    return filter;
+}
+
+// Menor filtro que aceita todos os tipos do grupo com os nós de `nodes`: os bits em que eles diferem ficam livres
+static IdFilter coverGroup(const uint8_t *ids, size_t count, IdFilter nodes)
+{
+    IdFilter filter = {ids[0], 0};
+    for (size_t i = 1; i < count; i++)
+        filter.mask |= ids[i] ^ ids[0];
+    filter.code &= ~filter.mask;
+
+    filter.code = (filter.code << TWAI_NODE_BITS) | nodes.code;
+    filter.mask = (filter.mask << TWAI_NODE_BITS) | nodes.mask;
+    return filter;
+}
+
+static bool matches(IdFilter filter, uint16_t id)
+{
+    return ((id ^ filter.code) & ~filter.mask & TWAI_STANDARD_ID_MASK) == 0;
+}
+
+static uint16_t acceptedCount(IdFilter first, IdFilter second)
+{
+    uint16_t accepted = 0;
+    for (uint16_t id = 0; id < TWAI_STANDARD_ID_COUNT; id++)
+    {
+        if (matches(first, id) || matches(second, id))
+            accepted++;
+    }
+    return accepted;
+}
+
+/**
+ * Layout dos registradores para frames padrão (ver documentação do driver TWAI do ESP-IDF).
+ * Simples: ID nos bits 31..21, RTR no 20, dois primeiros octetos nos bits 15..0.
+ * Duplo: filtro 1 com ID nos bits 31..21, RTR no 20 e o primeiro octeto nos bits 19..16 e 3..0;
+ * filtro 2 com ID nos bits 15..5 e RTR no 4.
+ */
+static twai_filter_config_t singleConfig(IdFilter filter)
+{
+    twai_filter_config_t config;
+    config.acceptance_code = (uint32_t)filter.code << 21;
+    config.acceptance_mask = ((uint32_t)filter.mask << 21) | 0x001FFFFF;
+    config.single_filter = true;
+    return config;
+}
+
+static twai_filter_config_t dualConfig(IdFilter first, IdFilter second)
+{
+    twai_filter_config_t config;
+    config.acceptance_code = ((uint32_t)first.code << 21) | ((uint32_t)second.code << 5);
+    config.acceptance_mask = ((uint32_t)first.mask << 21) | ((uint32_t)second.mask << 5) | 0x001F001F;
+    config.single_filter = false;
+    return config;
+}
+
+static void sortIds(uint8_t *ids, size_t count)
+{
+    for (size_t i = 1; i < count; i++)
+    {
+        uint8_t id = ids[i];
+        size_t j = i;
+        for (; j > 0 && ids[j - 1] > id; j--)
+            ids[j] = ids[j - 1];
+        ids[j] = id;
+    }
+}
+
+TwaiFilterPlan twaiFilterPlan(const uint8_t *kinds, size_t count, uint8_t nodes)
+{
+    TwaiFilterPlan plan;
+    memset(&plan, 0, sizeof(plan));
+
+    if (count == 0 || count > 256)
+    {
+        plan.config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+        plan.acceptedIdCount = TWAI_STANDARD_ID_COUNT;
+        memset(plan.handled, 0xFF, sizeof(plan.handled));
+        plan.nodes = 0xFF;
+        return plan;
+    }
+
+    uint8_t ids[256];
+    memcpy(ids, kinds, count);
+    sortIds(ids, count);
+    for (size_t i = 0; i < count; i++)
+        plan.handled[ids[i] / 32] |= 1UL << (ids[i] % 32);
+    plan.nodes = nodes;
+    IdFilter nodeFilter = coverNodes(nodes);
+
+    IdFilter single = coverGroup(ids, count, nodeFilter);
+    plan.config = singleConfig(single);
+    plan.acceptedIdCount = acceptedCount(single, single);
+
+    // Divisão por faixa: os menores IDs num filtro, os maiores no outro
+    for (size_t split = 1; split < count; split++)
+    {
+        IdFilter first = coverGroup(ids, split, nodeFilter);
+        IdFilter second = coverGroup(ids + split, count - split, nodeFilter);
+        uint16_t accepted = acceptedCount(first, second);
+        if (accepted < plan.acceptedIdCount)
+        {
+            plan.config = dualConfig(first, second);
+            plan.acceptedIdCount = accepted;
+        }
+    }
+
+    // Divisão por um bit do tipo
+    for (uint8_t bit = 0; bit < 8; bit++)
+    {
+        uint8_t groups[2][256];
+        size_t sizes[2] = {0, 0};
+        for (size_t i = 0; i < count; i++)
+        {
+            uint8_t group = (ids[i] >> bit) & 1;
+            groups[group][sizes[group]++] = ids[i];
+        }
+        if (sizes[0] == 0 || sizes[1] == 0)
+            continue;
+
+        IdFilter first = coverGroup(groups[0], sizes[0], nodeFilter);
+        IdFilter second = coverGroup(groups[1], sizes[1], nodeFilter);
+        uint16_t accepted = acceptedCount(first, second);
+        if (accepted < plan.acceptedIdCount)
+        {
+            plan.config = dualConfig(first, second);
+            plan.acceptedIdCount = accepted;
+        }
+    }
+
+    return plan;
+}
+
+bool twaiFilterHandles(const TwaiFilterPlan *plan, uint32_t identifier)
+{
+    if (identifier > TWAI_STANDARD_ID_MASK)
+        return false;
+
+    uint8_t kind = identifier >> TWAI_NODE_BITS;
+    uint8_t node = identifier & TWAI_NODE_MASK;
+    return ((plan->handled[kind / 32] >> (kind % 32)) & 1) && ((plan->nodes >> node) & 1);
+}
@@ -0,0 +1,139 @@
+#include "TwaiHealth.h"
+#include "Twai.h"
+#include "TwaiBitrate.h"
+#include "../Mailbox/Seqlock.h"
+#include <Arduino.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#ifdef ARDUINO
+#include <freertos/task.h>
+#endif
+
+// Escrito só pela tarefa de saúde
+static Seqlock<TwaiHealth> published;
+
+#ifdef ARDUINO
+static const char *TAG = "TwaiHealth";
+
+// Alertas que acordam a tarefa antes do intervalo de amostragem
+#define TWAI_HEALTH_ALERTS                                                                                     \
+    (TWAI_ALERT_BUS_OFF | TWAI_ALERT_BUS_RECOVERED | TWAI_ALERT_ERR_PASS | TWAI_ALERT_ERR_ACTIVE |           \
+     TWAI_ALERT_ABOVE_ERR_WARN)
+
+static TwaiHealth health;
+
+// Da tarefa: bus-off em andamento e quando começou
+static bool inBusOff = false;
+static bool recoveryStalled = false;
+static unsigned long busOffSince = 0;
+
+static unsigned long loadWindowStart = 0;
+static uint32_t loadWindowBits = 0;
+
+static void updateBusLoad(unsigned long now)
+{
+    unsigned long elapsed = now - loadWindowStart;
+    if (elapsed < TWAI_HEALTH_LOAD_WINDOW_MS)
+        return;
+
+    uint32_t bits = twaiGetBusBits();
+    uint64_t permille = (uint64_t)(bits - loadWindowBits) * 1000 * 1000 / ((uint64_t)twaiGetBitrate() * elapsed);
+    health.busLoadPermille = permille > 1000 ? 1000 : permille;
+    loadWindowBits = bits;
+    loadWindowStart = now;
+}
+
+// Bus-off: pede a recuperação. Parado depois de um bus-off: a recuperação terminou, religa o driver.
+static void recover(twai_state_t state, unsigned long now)
+{
+    if (state == TWAI_STATE_BUS_OFF)
+    {
+        if (!inBusOff)
+        {
+            inBusOff = true;
+            recoveryStalled = false;
+            busOffSince = now;
+            health.busOffCount++;
+            ESP_LOGE(TAG, "Bus-off (TEC=%u), iniciando recuperação", health.txErrorCounter);
+        }
+
+        // Se falhar, tenta de novo no próximo alerta ou amostra
+        if (twai_initiate_recovery() != ESP_OK)
+            ESP_LOGW(TAG, "twai_initiate_recovery falhou");
+        return;
+    }
+
+    if (!inBusOff)
+        return;
+
+    if (state == TWAI_STATE_STOPPED)
+    {
+        if (twai_start() != ESP_OK)
+        {
+            ESP_LOGW(TAG, "twai_start após a recuperação falhou");
+            return;
+        }
+
+        inBusOff = false;
+        health.recoveries++;
+        health.lastRecoveryMs = now - busOffSince;
+        if (health.lastRecoveryMs > health.maxRecoveryMs)
+            health.maxRecoveryMs = health.lastRecoveryMs;
+        ESP_LOGW(TAG, "Barramento recuperado em %u ms", health.lastRecoveryMs);
+        return;
+    }
+
+    if (!recoveryStalled && now - busOffSince > TWAI_HEALTH_RECOVERY_TIMEOUT_MS)
+    {
+        recoveryStalled = true;
+        health.stalledRecoveries++;
+        ESP_LOGE(TAG, "Recuperação passou de %u ms; o barramento não fica livre", TWAI_HEALTH_RECOVERY_TIMEOUT_MS);
+    }
+}
+
+static void twaiHealthTask(void *)
+{
+    loadWindowStart = millis();
+    loadWindowBits = twaiGetBusBits();
+
+    while (true)
+    {
+        uint32_t alerts = 0;
+        twai_read_alerts(&alerts, pdMS_TO_TICKS(TWAI_HEALTH_SAMPLE_INTERVAL_MS));
+
+        twai_status_info_t status;
+        if (twai_get_status_info(&status) != ESP_OK)
+            continue;
+
+        unsigned long now = millis();
+        health.state = status.state;
+        health.txErrorCounter = status.tx_error_counter;
+        health.rxErrorCounter = status.rx_error_counter;
+        health.txFailed = status.tx_failed_count;
+        health.arbitrationLost = status.arb_lost_count;
+        health.busErrors = status.bus_error_count;
+        health.rxMissed = status.rx_missed_count + status.rx_overrun_count;
+
+        if (alerts & TWAI_ALERT_ERR_PASS)
+            ESP_LOGW(TAG, "Erro passivo (TEC=%u REC=%u)", health.txErrorCounter, health.rxErrorCounter);
+
+        recover(status.state, now);
+        updateBusLoad(now);
+        published.publish(health);
+    }
+}
+#endif
+
+void twaiHealthStart()
+{
+#ifdef ARDUINO
+    twai_reconfigure_alerts(TWAI_HEALTH_ALERTS, nullptr);
+    xTaskCreatePinnedToCore(twaiHealthTask, "twaiHealth", TWAI_HEALTH_TASK_STACK, nullptr, TWAI_HEALTH_TASK_PRIORITY,
+                            nullptr, ARDUINO_RUNNING_CORE);
+#endif
+}
+
+TwaiHealth twaiHealthGet()
+{
+    return published.read();
+}
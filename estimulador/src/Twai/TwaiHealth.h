@@ -0,0 +1,62 @@
+#pragma once
+#include <stdint.h>
+#include <driver/twai.h>
+
+/**
+ * Saúde do barramento e recuperação automática de bus-off.
+ *
+ * Uma tarefa acorda a cada alerta do driver (bus-off, recuperação concluída, mudança de estado de erro)
+ * ou a cada TWAI_HEALTH_SAMPLE_INTERVAL_MS, lê `twai_get_status_info` e guarda uma cópia para o loop.
+ * Em bus-off, ela inicia a recuperação na hora; quando o controlador volta a parado, religa o driver.
+ * A recuperação em si é feita pelo controlador (128 ocorrências de 11 bits recessivos, ~3 ms a
+ * 500 kbit/s com o barramento livre), então o enlace volta em alguns ms, sem depender do loop.
+ */
+
+// Maior intervalo entre duas leituras do estado do driver
+#define TWAI_HEALTH_SAMPLE_INTERVAL_MS 10
+
+// Janela da estimativa de carga do barramento
+#define TWAI_HEALTH_LOAD_WINDOW_MS 250
+
+// Uma recuperação que passa disso é registrada como travada (barramento preso em dominante, sem terminação...)
+#define TWAI_HEALTH_RECOVERY_TIMEOUT_MS 100
+
+// A tarefa fica acima da recepção: uma rajada de frames não atrasa a recuperação
+#define TWAI_HEALTH_TASK_PRIORITY 3
+#define TWAI_HEALTH_TASK_STACK 2048
+
+struct TwaiHealth
+{
+    twai_state_t state;
+
+    // Contadores de erro do controlador: acima de 127, erro passivo; TEC acima de 255, bus-off
+    uint32_t txErrorCounter;
+    uint32_t rxErrorCounter;
+
+    // Totais do driver desde o boot
+    uint32_t txFailed;
+    uint32_t arbitrationLost;
+    uint32_t busErrors;
+
+    // Frames recebidos perdidos no driver (fila cheia ou estouro do FIFO)
+    uint32_t rxMissed;
+
+    // Frames enviados e recebidos na última janela, em décimos de porcento da capacidade
+    uint16_t busLoadPermille;
+
+    uint32_t busOffCount;
+    uint32_t recoveries;
+
+    // Do bus-off até o driver religado
+    uint32_t lastRecoveryMs;
+    uint32_t maxRecoveryMs;
+
+    // Recuperações que passaram de TWAI_HEALTH_RECOVERY_TIMEOUT_MS
+    uint32_t stalledRecoveries;
+};
+
+// Chamado por twaiStart depois que o driver está rodando
+void twaiHealthStart();
+
+// Última leitura da tarefa de saúde
+TwaiHealth twaiHealthGet();
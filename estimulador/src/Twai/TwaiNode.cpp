@@ -0,0 +1,139 @@
+#include "TwaiNode.h"
+#include "../Modulator.h"
+#include <Arduino.h>
+#include <string.h>
+#include <esp_log.h>
+#ifdef ARDUINO
+#include <Preferences.h>
+#include <esp_mac.h>
+#endif
+
+static const char *TAG = "TwaiNode";
+
+static uint8_t address = TWAI_NODE_DEFAULT_ADDRESS;
+static uint8_t share = 1;
+static uint8_t mac[6];
+
+static bool announcePending = false;
+static unsigned long announceTime = 0;
+
+#ifdef ARDUINO
+static Preferences preferences;
+
+static uint8_t loadAddress()
+{
+    preferences.begin("twai", true);
+    uint8_t stored = preferences.getUChar("node", TWAI_NODE_DEFAULT_ADDRESS);
+    preferences.end();
+    return stored >= 1 && stored <= TWAI_NODE_MAX_ADDRESS ? stored : TWAI_NODE_DEFAULT_ADDRESS;
+}
+
+static void storeAddress(uint8_t node)
+{
+    preferences.begin("twai", false);
+    preferences.putUChar("node", node);
+    preferences.end();
+}
+
+static void readMac()
+{
+    esp_efuse_mac_get_default(mac);
+}
+#else
+// No host não há flash nem MAC
+static uint8_t loadAddress()
+{
+    return TWAI_NODE_DEFAULT_ADDRESS;
+}
+
+static void readMac()
+{
+    static const uint8_t hostMac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    memcpy(mac, hostMac, sizeof(mac));
+}
+#endif
+
+// A espera vem do fim do MAC: placas diferentes quase sempre anunciam em instantes diferentes
+static void scheduleAnnounce()
+{
+    announcePending = true;
+    announceTime = millis() + (mac[5] % TWAI_NODE_ANNOUNCE_BACKOFF_MS);
+}
+
+uint8_t twaiNodeSelect()
+{
+    readMac();
+    address = loadAddress();
+    scheduleAnnounce();
+    ESP_LOGI(TAG, "Endereço no barramento: %u (MAC %02X:%02X:%02X:%02X:%02X:%02X)", address, mac[0], mac[1],
+             mac[2], mac[3], mac[4], mac[5]);
+    return address;
+}
+
+uint8_t twaiNodeAddress()
+{
+    return address;
+}
+
+uint8_t twaiNodeShare()
+{
+    return share;
+}
+
+static void onAssign(const uint8_t *payload)
+{
+    // [MAC 6][endereço u8]
+    if (memcmp(payload, mac, sizeof(mac)) != 0)
+        return;
+
+    uint8_t assigned = payload[6];
+    if (assigned == address || assigned < 1 || assigned > TWAI_NODE_MAX_ADDRESS)
+        return;
+
+    // A troca reinicia o estimulador; nunca no meio de uma estimulação
+    if (modulatorGetPulseWidth() != 0)
+    {
+        ESP_LOGW(TAG, "Endereço %u ignorado durante a estimulação", assigned);
+        return;
+    }
+
+    ESP_LOGW(TAG, "Endereço trocado de %u para %u", address, assigned);
+#ifdef ARDUINO
+    storeAddress(assigned);
+#endif
+    esp_restart();
+}
+
+void twaiNodeOnTWAIMessage(TwaiReceivedMessage *receivedMessage)
+{
+    switch (receivedMessage->Kind)
+    {
+    case TwaiReceivedMessageKind::NodeDiscover:
+        scheduleAnnounce();
+        break;
+    case TwaiReceivedMessageKind::NodeAssign:
+        onAssign(receivedMessage->Payload);
+        break;
+    case TwaiReceivedMessageKind::SetBusShare:
+    {
+        uint16_t requested = receivedMessage->ExtraData;
+        if (requested < 1 || requested > TWAI_NODE_MAX_ADDRESS || requested == share)
+            break;
+
+        share = requested;
+        ESP_LOGI(TAG, "Barramento dividido por %u", share);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void twaiNodeLoop()
+{
+    if (!announcePending || (long)(millis() - announceTime) < 0)
+        return;
+
+    announcePending = false;
+    twaiSendPayload(TwaiSendMessageKind::NodeAnnounce, mac, sizeof(mac));
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+#include "Twai.h"
+
+/**
+ * Endereço deste estimulador no barramento, de 1 a 7, guardado na flash. Vai no campo de nó de todo
+ * frame que ele envia e escolhe, com o nó 0 (todos), os frames do gateway que ele aceita.
+ *
+ * No boot e a cada NodeDiscover, o estimulador se anuncia (NodeAnnounce: [MAC 6]) depois de uma espera
+ * tirada do MAC, para que duas placas com o mesmo endereço não transmitam o mesmo identificador ao mesmo
+ * tempo. Se o endereço já é de outra placa, o gateway responde com NodeAssign ([MAC 6][endereço u8]): o
+ * estimulador com esse MAC guarda o endereço novo e reinicia.
+ *
+ * SetBusShare diz quantos estimuladores dividem o barramento; nas taxas lentas, o gateway conta cada
+ * placa mais de uma vez. O feedback de PWM e a telemetria do controle, os frames periódicos mais
+ * frequentes, ficam mais espaçados na mesma proporção, e a carga total deles não cresce com o número
+ * de placas.
+ */
+
+// Endereço de uma placa que nunca recebeu NodeAssign
+#define TWAI_NODE_DEFAULT_ADDRESS 1
+
+#define TWAI_NODE_MAX_ADDRESS 7
+
+// Maior espera antes do anúncio, em ms
+#define TWAI_NODE_ANNOUNCE_BACKOFF_MS 32
+
+// Lê o endereço guardado. Chamado por twaiStart antes de montar o filtro de aceitação.
+uint8_t twaiNodeSelect();
+
+uint8_t twaiNodeAddress();
+
+// Divisor do barramento, segundo o último SetBusShare (1 até chegar algum)
+uint8_t twaiNodeShare();
+
+// Trata NodeDiscover, NodeAssign e SetBusShare
+void twaiNodeOnTWAIMessage(TwaiReceivedMessage *receivedMessage);
+
+// Envia o anúncio pendente quando a espera termina
+void twaiNodeLoop();
@@ -0,0 +1,82 @@
+#include "TwaiRegisters.h"
+#include "../Mailbox/Seqlock.h"
+
+// Tipos com registro; os demais seguem pela fila de mensagens
+static const TwaiReceivedMessageKind REGISTER_KINDS[] = {
+    TwaiReceivedMessageKind::WeightTotal,
+    TwaiReceivedMessageKind::ResidualWeightTotal,
+    TwaiReceivedMessageKind::Mese,
+    TwaiReceivedMessageKind::MeseMax,
+    TwaiReceivedMessageKind::Setpoint,
+};
+
+#define TWAI_REGISTER_COUNT (sizeof(REGISTER_KINDS) / sizeof(REGISTER_KINDS[0]))
+
+// Escritos pela tarefa de recepção
+static Seqlock<TwaiReceivedMessage> registers[TWAI_REGISTER_COUNT];
+
+// Do loop: versão de cada registro na última leitura
+static uint32_t takenVersion[TWAI_REGISTER_COUNT];
+static uint32_t superseded[TWAI_REGISTER_COUNT];
+
+// Versão de cada registro no último twaiRegisterReset
+static uint32_t resetVersion[TWAI_REGISTER_COUNT];
+
+static int registerIndex(TwaiReceivedMessageKind kind)
+{
+    for (size_t i = 0; i < TWAI_REGISTER_COUNT; i++)
+    {
+        if (REGISTER_KINDS[i] == kind)
+            return i;
+    }
+    return -1;
+}
+
+void twaiRegisterReset()
+{
+    for (size_t i = 0; i < TWAI_REGISTER_COUNT; i++)
+    {
+        resetVersion[i] = registers[i].version();
+        takenVersion[i] = resetVersion[i];
+        superseded[i] = 0;
+    }
+}
+
+bool twaiRegisterWrite(const TwaiReceivedMessage *message)
+{
+    int index = registerIndex(message->Kind);
+    if (index < 0)
+        return false;
+
+    registers[index].publish(*message);
+    return true;
+}
+
+bool twaiRegisterTake(TwaiReceivedMessageKind kind, TwaiReceivedMessage *message)
+{
+    int index = registerIndex(kind);
+    if (index < 0)
+        return false;
+
+    // A versão é lida antes do valor: uma escrita entre as duas leituras só faz o valor ser relido depois
+    uint32_t version = registers[index].version();
+    if (version == takenVersion[index])
+        return false;
+
+    *message = registers[index].read();
+    superseded[index] += version - takenVersion[index] - 1;
+    takenVersion[index] = version;
+    return true;
+}
+
+TwaiRegisterStats twaiGetRegisterStats(TwaiReceivedMessageKind kind)
+{
+    TwaiRegisterStats stats = {0, 0};
+    int index = registerIndex(kind);
+    if (index < 0)
+        return stats;
+
+    stats.written = registers[index].version() - resetVersion[index];
+    stats.superseded = superseded[index];
+    return stats;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+#include "Twai.h"
+
+/**
+ * Último valor recebido de cada tipo que descreve um estado do gateway (peso, setpoint, MESE...).
+ * A recepção escreve cada frame destes tipos no seu registro em vez de enfileirá-lo; o controle lê
+ * o registro quando precisa. Um frame sobrescrito antes de ser lido não faz falta: o seguinte já
+ * traz o valor atual. Os demais tipos são comandos e continuam chegando um a um por `twaiReceive`.
+ */
+
+// Contadores de um registro
+struct TwaiRegisterStats
+{
+    // Frames escritos no registro
+    uint32_t written;
+
+    // Frames sobrescritos por um mais novo antes de `twaiRegisterTake` os ler
+    uint32_t superseded;
+};
+
+// Esquece os valores guardados e zera os contadores
+void twaiRegisterReset();
+
+// Chamado pela recepção. Retorna false se o tipo não tem registro.
+bool twaiRegisterWrite(const TwaiReceivedMessage *message);
+
+// Copia o valor mais recente do tipo, se chegou algum desde a última leitura. Só o loop lê os registros.
+bool twaiRegisterTake(TwaiReceivedMessageKind kind, TwaiReceivedMessage *message);
+
+TwaiRegisterStats twaiGetRegisterStats(TwaiReceivedMessageKind kind);
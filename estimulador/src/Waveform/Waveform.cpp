@@ -0,0 +1,147 @@
+#include "Waveform.h"
+#include "../Pulse/PulseEngine.h"
+#include "../Mailbox/Seqlock.h"
+#include <string.h>
+#include <esp_log.h>
+
+static const char *TAG = "Waveform";
+
+static const WaveformConfig DEFAULT_CONFIG = {
+    .frequencyHz = 35,
+    .pulsesPerTrain = 1,
+    .intraTrainIntervalMicros = 0,
+    .interphaseGapMicros = PULSE_INTERPHASE_GAP_MICROS,
+    .secondPhasePercent = 100,
+};
+
+static WaveformConfig currentConfig;
+
+// Tabela publicada para a tarefa de modulação
+static Seqlock<WaveformTable> publishedTable;
+
+static bool compileTable(const WaveformConfig *config, WaveformTable *table)
+{
+    if (config->frequencyHz < WAVEFORM_MIN_FREQUENCY_HZ || config->frequencyHz > WAVEFORM_MAX_FREQUENCY_HZ)
+    {
+        ESP_LOGE(TAG, "Frequência fora da faixa: %u Hz", config->frequencyHz);
+        return false;
+    }
+
+    if (config->pulsesPerTrain < 1 || config->pulsesPerTrain > WAVEFORM_MAX_PULSES_PER_TRAIN)
+    {
+        ESP_LOGE(TAG, "Pulsos por trem fora da faixa: %u", config->pulsesPerTrain);
+        return false;
+    }
+
+    if (config->interphaseGapMicros < WAVEFORM_MIN_INTERPHASE_GAP_MICROS ||
+        config->interphaseGapMicros > WAVEFORM_MAX_INTERPHASE_GAP_MICROS)
+    {
+        ESP_LOGE(TAG, "Intervalo entre fases fora da faixa: %u us", config->interphaseGapMicros);
+        return false;
+    }
+
+    if (config->secondPhasePercent < WAVEFORM_MIN_SECOND_PHASE_PERCENT ||
+        config->secondPhasePercent > WAVEFORM_MAX_SECOND_PHASE_PERCENT)
+    {
+        ESP_LOGE(TAG, "Segunda fase fora da faixa: %u%%", config->secondPhasePercent);
+        return false;
+    }
+
+    if (config->pulsesPerTrain > 1 && config->intraTrainIntervalMicros < WAVEFORM_MIN_INTRA_TRAIN_MICROS)
+    {
+        ESP_LOGE(TAG, "Intervalo entre pulsos do trem muito curto: %u us", config->intraTrainIntervalMicros);
+        return false;
+    }
+
+    table->periodMicros = 1000000UL / config->frequencyHz;
+    table->pulseCount = config->pulsesPerTrain;
+    table->interphaseGapMicros = config->interphaseGapMicros;
+    table->secondPhaseScaleQ8 = ((uint32_t)config->secondPhasePercent * 256) / 100;
+
+    for (int i = 0; i < table->pulseCount; i++)
+    {
+        table->pulseOffsetMicros[i] = (uint32_t)i * config->intraTrainIntervalMicros;
+    }
+
+    // O último pulso do trem precisa deixar o mesmo espaço antes do próximo trem
+    uint32_t lastOffset = table->pulseOffsetMicros[table->pulseCount - 1];
+    if (lastOffset + WAVEFORM_MIN_INTRA_TRAIN_MICROS > table->periodMicros)
+    {
+        ESP_LOGE(TAG, "Trem de %u pulsos não cabe no período de %lu us", table->pulseCount,
+                 (unsigned long)table->periodMicros);
+        return false;
+    }
+
+    for (int i = 0; i < table->pulseCount; i++)
+    {
+        uint32_t nextOffset = i + 1 < table->pulseCount ? table->pulseOffsetMicros[i + 1] : table->periodMicros;
+        table->pulseSlotMicros[i] = nextOffset - table->pulseOffsetMicros[i];
+    }
+
+    return true;
+}
+
+void waveformReset()
+{
+    currentConfig = DEFAULT_CONFIG;
+
+    WaveformTable table;
+    compileTable(&currentConfig, &table);
+    publishedTable.publish(table);
+}
+
+bool waveformConfigure(const WaveformConfig *config)
+{
+    if (memcmp(config, &currentConfig, sizeof(WaveformConfig)) == 0)
+    {
+        return true;
+    }
+
+    WaveformTable table;
+    if (!compileTable(config, &table))
+    {
+        return false;
+    }
+
+    currentConfig = *config;
+    publishedTable.publish(table);
+
+    ESP_LOGI(TAG, "Forma de onda: %u Hz, %u pulso(s) a cada %u us, intervalo entre fases %u us, segunda fase %u%%",
+             config->frequencyHz, config->pulsesPerTrain, config->intraTrainIntervalMicros,
+             config->interphaseGapMicros, config->secondPhasePercent);
+    return true;
+}
+
+const WaveformConfig *waveformGetConfig()
+{
+    return &currentConfig;
+}
+
+WaveformTable waveformReadTable()
+{
+    return publishedTable.read();
+}
+
+bool waveformOnTWAIMessage(TwaiReceivedMessage *receivedMessage)
+{
+    if (receivedMessage->Kind != TwaiReceivedMessageKind::SetWaveform)
+        return false;
+
+    if (receivedMessage->Length < 5)
+    {
+        ESP_LOGE(TAG, "Frame de forma de onda curto: %u octetos", receivedMessage->Length);
+        return true;
+    }
+
+    // Todos os campos num frame só: uma mudança de frequência e de padrão nunca fica pela metade
+    const uint8_t *payload = receivedMessage->Payload;
+    WaveformConfig config;
+    config.frequencyHz = payload[0];
+    config.pulsesPerTrain = payload[1];
+    config.intraTrainIntervalMicros = payload[2] * 100;
+    config.interphaseGapMicros = payload[3];
+    config.secondPhasePercent = payload[4];
+
+    waveformConfigure(&config);
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include "../Twai/Twai.h"
+
+#define WAVEFORM_MIN_FREQUENCY_HZ 10
+#define WAVEFORM_MAX_FREQUENCY_HZ 100
+
+// Pulsos por trem: 1 = pulso simples, 2 = doublet, mais que isso = burst
+#define WAVEFORM_MAX_PULSES_PER_TRAIN 4
+
+// Espaço mínimo entre pulsos de um mesmo trem, para caber a maior largura de fase
+#define WAVEFORM_MIN_INTRA_TRAIN_MICROS 2000
+
+#define WAVEFORM_MIN_INTERPHASE_GAP_MICROS 4
+#define WAVEFORM_MAX_INTERPHASE_GAP_MICROS 200
+
+// A segunda fase nunca é mais larga que a primeira, que já está limitada pelo MESE máximo
+#define WAVEFORM_MIN_SECOND_PHASE_PERCENT 10
+#define WAVEFORM_MAX_SECOND_PHASE_PERCENT 100
+
+/**
+ * Parâmetros da forma de onda, como recebidos pelo barramento.
+ */
+struct WaveformConfig
+{
+    uint8_t frequencyHz;
+    uint8_t pulsesPerTrain;
+    uint16_t intraTrainIntervalMicros;
+    uint8_t interphaseGapMicros;
+
+    // Largura da segunda fase relativa à primeira. 100 = simétrico.
+    uint8_t secondPhasePercent;
+};
+
+/**
+ * Configuração compilada em tabela: o laço de modulação só indexa estes valores.
+ */
+struct WaveformTable
+{
+    uint32_t periodMicros;
+    uint8_t pulseCount;
+    uint32_t pulseOffsetMicros[WAVEFORM_MAX_PULSES_PER_TRAIN];
+
+    // Tempo disponível para cada pulso, até o início do pulso seguinte
+    uint32_t pulseSlotMicros[WAVEFORM_MAX_PULSES_PER_TRAIN];
+    uint16_t interphaseGapMicros;
+
+    // Escala da segunda fase em Q8 (256 = 100%)
+    uint16_t secondPhaseScaleQ8;
+};
+
+void waveformReset();
+bool waveformConfigure(const WaveformConfig *config);
+const WaveformConfig *waveformGetConfig();
+// Cópia da tabela publicada mais recente. Pode ser chamada da tarefa de modulação.
+WaveformTable waveformReadTable();
+
+/**
+ * Trata o frame SetWaveform, que traz a configuração inteira:
+ * [frequência Hz][pulsos por trem][intervalo entre pulsos, em 100 us][intervalo entre fases us][segunda fase %].
+ * Uma configuração inválida é recusada por inteiro; a anterior continua valendo.
+ * Retorna true se a mensagem era SetWaveform.
+ */
+bool waveformOnTWAIMessage(TwaiReceivedMessage *receivedMessage);
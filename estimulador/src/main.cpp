@@ -1,8 +1,15 @@
 #include <Arduino.h>
 #include <esp_log.h>
 #include "Twai/Twai.h"
+#include "Twai/TwaiBitrate.h"
+#include "Twai/TwaiNode.h"
 #include "StateManager.h"
 #include "Data.h"
+#include "Modulator.h"
+#include "Control/PiController.h"
+#include "Link/LinkMonitor.h"
+#include "Telemetry/Telemetry.h"
+#include "Capture/Capture.h"
 
 #define DEBUG(variable) ESP_LOGI(TAG, #variable ": %d", variable)
 
@@ -14,9 +21,16 @@ Data data;
 void setup()
 {
   dataReset();
+  piControllerBegin();
 
+#ifdef TWAI_CAPTURE
+  captureBegin();
+#else
   Serial.begin(115200);
+#endif
   twaiStart();
+  linkMonitorReset();
+  telemetryReset();
 
   pinMode(2, OUTPUT);
   pinMode(4, OUTPUT);
@@ -28,6 +42,10 @@ void setup()
   digitalWrite(32, LOW);
   digitalWrite(33, LOW);
 
+  // Pinos 2/32 e 4/33 ficam em LOW até o periférico de pulsos assumi-los,
+  // a partir de uma tarefa no núcleo 1. Este loop roda no núcleo 0.
+  modulatorBegin();
+
   stateManager.setup(StateKind::WorkingMalhaAbertaState);
 }
 
@@ -37,10 +55,25 @@ void loop()
   TwaiReceivedMessage latestMessage;
   while (twaiReceive(&latestMessage) == ESP_OK)
   {
+    linkMonitorOnTWAIMessage(&latestMessage);
+    emergencyStopOnTWAIMessage(&latestMessage);
+    telemetryOnTWAIMessage(&latestMessage);
+    twaiBitrateOnTWAIMessage(&latestMessage);
+    twaiNodeOnTWAIMessage(&latestMessage);
     stateManager.onTWAIMessage(&latestMessage);
   }
 
   // twaiSend(TwaiSendMessageKind::PwmFeedbackEstimulador, 0);
 
   stateManager.loop();
+  modulatorLoop();
+
+  linkMonitorLoop();
+  telemetryLoop();
+  twaiBitrateLoop();
+  twaiNodeLoop();
+
+#ifdef TWAI_CAPTURE
+  captureLoop();
+#endif
 }
@@ -0,0 +1,115 @@
+/**
+ * Perda e volta do enlace com o gateway, com o firmware inteiro sobre o relógio virtual do host: sem heartbeat, o
+ * estimulador entra na parada segura e só sai dela quando o gateway reinicia, mesmo que os heartbeats voltem antes.
+ */
+#include <unity.h>
+#include <string.h>
+#include "Data.h"
+#include "StateManager.h"
+#include "Twai/Twai.h"
+#include "Modulator.h"
+#include "../host/ReplayHost.h"
+
+void setup();
+void loop();
+
+// Passo do relógio virtual entre duas chamadas do loop
+#define STEP_MICROS 1000
+
+static uint64_t nowMicros;
+static uint16_t heartbeatSequence;
+
+static void receive(TwaiReceivedMessageKind kind, const uint8_t *payload, uint8_t length)
+{
+    twai_message_t frame = {};
+    frame.identifier = twaiIdentifier((uint8_t)kind, TWAI_BROADCAST_NODE);
+    frame.data_length_code = length;
+    memcpy(frame.data, payload, length);
+    hostQueueReceive(&frame);
+}
+
+// Roda o loop por `durationMs`, com o comando de malha aberta a cada 15 ms e, se `heartbeats`, o heartbeat a cada 10 ms
+static void run(uint32_t durationMs, uint16_t requestedPwm, bool heartbeats)
+{
+    for (uint32_t elapsedMs = 0; elapsedMs < durationMs; elapsedMs++)
+    {
+        if (heartbeats && elapsedMs % 10 == 0)
+        {
+            heartbeatSequence++;
+            uint8_t heartbeat[3] = {0, (uint8_t)(heartbeatSequence >> 8), (uint8_t)(heartbeatSequence & 0xFF)};
+            receive(TwaiReceivedMessageKind::Heartbeat, heartbeat, sizeof(heartbeat));
+        }
+        if (elapsedMs % 15 == 0)
+        {
+            uint8_t command[8] = {OperationUseMalhaAberta | OperationRequestedPwm, 0, 0, 0, 0,
+                                  (uint8_t)(requestedPwm >> 8), (uint8_t)(requestedPwm & 0xFF), 0};
+            receive(TwaiReceivedMessageKind::OperationCommand, command, sizeof(command));
+        }
+
+        loop();
+        nowMicros += STEP_MICROS;
+        hostSetMicros(nowMicros);
+    }
+}
+
+void setUp()
+{
+    nowMicros = 1000000;
+    heartbeatSequence = 0;
+    hostSetMicros(nowMicros);
+    setup();
+}
+
+void tearDown()
+{
+}
+
+void test_stays_at_zero_until_gateway_reset()
+{
+    run(200, 20, true);
+    TEST_ASSERT_TRUE(stateManager.currentKind == StateKind::WorkingMalhaAbertaState);
+    TEST_ASSERT_EQUAL_UINT16(20, modulatorGetPulseWidth());
+
+    // O gateway segue mandando o comando, mas sem heartbeat: a lógica dele travou
+    run(300, 20, false);
+    TEST_ASSERT_TRUE(stateManager.currentKind == StateKind::GatewayDownSafetyStopState);
+
+    // Os heartbeats voltam com o comando de malha aberta: a largura só desce, até 0, e fica lá
+    uint16_t lastPulseWidth = modulatorGetPulseWidth();
+    for (int i = 0; i < 40; i++)
+    {
+        run(50, 20, true);
+        TEST_ASSERT_TRUE(stateManager.currentKind == StateKind::GatewayDownSafetyStopState);
+        TEST_ASSERT_TRUE(modulatorGetPulseWidth() <= lastPulseWidth);
+        lastPulseWidth = modulatorGetPulseWidth();
+    }
+    TEST_ASSERT_EQUAL_UINT16(0, lastPulseWidth);
+
+    // Só o reset do gateway rearma: o estimulador reinicia e parte do zero
+    receive(TwaiReceivedMessageKind::GatewayResetHappened, NULL, 0);
+    bool restarted = false;
+    try
+    {
+        run(100, 20, true);
+    }
+    catch (HostRestart &)
+    {
+        restarted = true;
+    }
+    TEST_ASSERT_TRUE(restarted);
+}
+
+void test_stays_stopped_while_heartbeats_are_missing()
+{
+    run(200, 300, true);
+    run(1000, 300, false);
+    TEST_ASSERT_TRUE(stateManager.currentKind == StateKind::GatewayDownSafetyStopState);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_stays_at_zero_until_gateway_reset);
+    RUN_TEST(test_stays_stopped_while_heartbeats_are_missing);
+    return UNITY_END();
+}
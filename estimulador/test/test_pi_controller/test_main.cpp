@@ -0,0 +1,140 @@
+/**
+ * Controle em malha fechada: com os ganhos padrão (Ki = 0), a saída do PI em Q16 é a da fórmula
+ * original em float, passo a passo; com Ki > 0, o anti-windup não acumula enquanto a saída está saturada.
+ */
+#include <unity.h>
+#include "Control/PiController.h"
+
+// Diferença tolerada: a fórmula original arredonda 0,1f e 0,3f em float antes de truncar
+#define FLOAT_TOLERANCE_MICROS 1
+
+#define RANDOM_STEPS 200000
+
+static uint32_t randomState;
+
+static uint32_t randomBelow(uint32_t limit)
+{
+    randomState = randomState * 1664525 + 1013904223;
+    return (randomState >> 8) % limit;
+}
+
+// A fórmula de antes do PI (calculatePulseWidth), sem o estágio monotônico largerPi
+static int floatFormula(int weight, int setpointKg, int mese, int meseMax, uint8_t weightGainHundredths)
+{
+    const int setpoint = setpointKg * 2;
+    float gainCoefficient = weightGainHundredths / 100.0f;
+
+    int erroControle = weight - setpoint * 0.1f;
+    int pi = weight * gainCoefficient + mese + 0.3f * erroControle;
+
+    int maximo = meseMax;
+    int minimo = maximo * 0.8f;
+    if (pi < minimo)
+        pi = minimo;
+    if (pi > maximo)
+        pi = maximo;
+    return pi;
+}
+
+static void setWeightGain(uint8_t hundredths)
+{
+    TwaiReceivedMessage message = {};
+    message.Kind = TwaiReceivedMessageKind::SetGainCoefficient;
+    message.ExtraData = hundredths;
+    piControllerOnTWAIMessage(&message);
+}
+
+static void setIntegralGain(uint8_t hundredths)
+{
+    TwaiReceivedMessage message = {};
+    message.Kind = TwaiReceivedMessageKind::SetIntegralGain;
+    message.ExtraData = hundredths;
+    piControllerOnTWAIMessage(&message);
+}
+
+static uint16_t step(int weight, int setpointKg, uint16_t mese, uint16_t meseMax, uint32_t elapsedMs = 10)
+{
+    PiControllerInput input;
+    input.weight = weight;
+    input.setpoint = setpointKg * 2;
+    input.mese = mese;
+    input.meseMax = meseMax;
+    return piControllerStep(&input, elapsedMs);
+}
+
+void setUp()
+{
+    randomState = 12345;
+    piControllerBegin();
+}
+
+void tearDown()
+{
+}
+
+// O caso que o anti-windup antigo quebrava: saturação do proporcional escrita no integral com Ki = 0
+void test_proportional_saturation_does_not_reach_integral()
+{
+    TEST_ASSERT_EQUAL_UINT16(200, step(400, 50, 100, 200));
+    TEST_ASSERT_EQUAL_UINT16(floatFormula(140, 50, 100, 200, PI_DEFAULT_WEIGHT_GAIN), step(140, 50, 100, 200));
+    TEST_ASSERT_EQUAL_INT32(0, piControllerGetTrace().integralMicros);
+}
+
+void test_default_gains_match_float_formula_step_by_step()
+{
+    uint8_t weightGain = PI_DEFAULT_WEIGHT_GAIN;
+    for (int i = 0; i < RANDOM_STEPS; i++)
+    {
+        // Uma sessão nova de vez em quando, com outro Kw
+        if (i % 1000 == 0)
+        {
+            weightGain = randomBelow(101);
+            setWeightGain(weightGain);
+            piControllerReset();
+        }
+
+        int weight = randomBelow(1500);
+        int setpointKg = randomBelow(200);
+        uint16_t mese = randomBelow(400);
+        uint16_t meseMax = mese + randomBelow(400);
+
+        int expected = floatFormula(weight, setpointKg, mese, meseMax, weightGain);
+        TEST_ASSERT_INT_WITHIN(FLOAT_TOLERANCE_MICROS, expected, step(weight, setpointKg, mese, meseMax));
+        TEST_ASSERT_EQUAL_INT32(0, piControllerGetTrace().integralMicros);
+    }
+}
+
+void test_integral_does_not_wind_up_while_saturated()
+{
+    setIntegralGain(100);
+
+    // Peso muito acima do setpoint: saída saturada no máximo por 10 s
+    for (int i = 0; i < 1000; i++)
+        TEST_ASSERT_EQUAL_UINT16(200, step(600, 50, 100, 200));
+    TEST_ASSERT_EQUAL_INT32(0, piControllerGetTrace().integralMicros);
+
+    // Com o peso de volta perto do setpoint, a saída sai da saturação já no primeiro passo
+    uint16_t output = step(20, 50, 100, 200);
+    TEST_ASSERT_EQUAL_UINT16(floatFormula(20, 50, 100, 200, PI_DEFAULT_WEIGHT_GAIN), output);
+    TEST_ASSERT_GREATER_THAN(output, 200);
+}
+
+void test_integral_acts_inside_range()
+{
+    setIntegralGain(100);
+
+    // Saída dentro da faixa, erro positivo: o integral cresce 1 us/s por unidade de erro
+    for (int i = 0; i < 100; i++)
+        step(60, 50, 100, 400);
+    TEST_ASSERT_INT_WITHIN(1, 50, piControllerGetTrace().integralMicros);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_proportional_saturation_does_not_reach_integral);
+    RUN_TEST(test_default_gains_match_float_formula_step_by_step);
+    RUN_TEST(test_integral_does_not_wind_up_while_saturated);
+    RUN_TEST(test_integral_acts_inside_range);
+    return UNITY_END();
+}
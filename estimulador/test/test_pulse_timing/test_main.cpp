@@ -0,0 +1,183 @@
+/**
+ * Temporização dos pulsos sobre o relógio simulado (PulseHalSim): a grade absoluta de deadlines,
+ * o descarte de pulsos atrasados demais, o corte quando o loop do núcleo 0 para de renovar o comando e os
+ * limites de largura (RMT, amplitude por canal, MESE máximo).
+ */
+#include <unity.h>
+#include "Data.h"
+#include "Modulator.h"
+#include "Pulse/PulseEngine.h"
+#include "Pulse/PulseHalSim.h"
+#include "Pulse/PulseScheduler.h"
+#include "Waveform/Waveform.h"
+
+// Passo do relógio simulado entre duas chamadas da tarefa de modulação
+#define STEP_MICROS 5
+
+#define MAX_PULSES 64
+
+struct EmittedPulse
+{
+    uint32_t startMicros;
+    PulseDescriptor pulse;
+};
+
+static EmittedPulse emitted[MAX_PULSES];
+static int emittedCount = 0;
+
+static void recordPulse(uint32_t startMicros, const PulseDescriptor *pulse)
+{
+    if (emittedCount < MAX_PULSES)
+        emitted[emittedCount] = {startMicros, *pulse};
+    emittedCount++;
+}
+
+// `loopRunning`: se o loop do núcleo 0 continua renovando o comando
+static void runModulator(uint32_t durationMicros, bool loopRunning = true)
+{
+    for (uint32_t elapsed = 0; elapsed < durationMicros; elapsed += STEP_MICROS)
+    {
+        if (loopRunning)
+            modulatorLoop();
+        modulatorService();
+        pulseHalSimAdvance(STEP_MICROS);
+    }
+}
+
+void setUp()
+{
+    emittedCount = 0;
+    pulseHalSimSetTime(1000);
+    pulseHalSimSetObserver(recordPulse);
+    dataReset();
+    modulatorBegin();
+}
+
+void tearDown()
+{
+    pulseHalSimSetObserver(nullptr);
+}
+
+void test_pulses_follow_deadline_grid()
+{
+    uint32_t period = waveformReadTable().periodMicros;
+    modulatorSetPulseWidth(200);
+    runModulator(1000000);
+
+    TEST_ASSERT_INT_WITHIN(1, 1000000 / period, emittedCount);
+    for (int i = 0; i < emittedCount && i < MAX_PULSES; i++)
+    {
+        const EmittedPulse *pulse = &emitted[i];
+        TEST_ASSERT_EQUAL_UINT32((uint32_t)i * period, pulse->pulse.deadlineMicros - emitted[0].pulse.deadlineMicros);
+        TEST_ASSERT_LESS_OR_EQUAL(STEP_MICROS, pulse->startMicros - pulse->pulse.deadlineMicros);
+
+        // Canais em sequência, separados pelo intervalo entre fases
+        TEST_ASSERT_EQUAL_UINT16(200, pulse->pulse.widthMicros[0]);
+        TEST_ASSERT_EQUAL_UINT16(200, pulse->pulse.widthMicros[1]);
+        TEST_ASSERT_EQUAL_UINT16(200 + PULSE_INTERPHASE_GAP_MICROS, pulse->pulse.offsetMicros[1]);
+    }
+}
+
+void test_stall_skips_pulses_without_moving_grid()
+{
+    uint32_t period = waveformReadTable().periodMicros;
+    modulatorSetPulseWidth(200);
+    runModulator(100000);
+    int beforeStall = emittedCount;
+
+    // A tarefa fica parada por três períodos e meio
+    pulseHalSimAdvance(3 * period + period / 2);
+    runModulator(200000);
+
+    TEST_ASSERT_GREATER_THAN(0, (int)modulatorMissedDeadlines());
+    TEST_ASSERT_GREATER_THAN(beforeStall, emittedCount);
+    for (int i = 0; i < emittedCount && i < MAX_PULSES; i++)
+    {
+        const EmittedPulse *pulse = &emitted[i];
+        TEST_ASSERT_EQUAL_UINT32(0, (pulse->pulse.deadlineMicros - emitted[0].pulse.deadlineMicros) % period);
+        TEST_ASSERT_LESS_OR_EQUAL(PULSE_MAX_LATENESS_MICROS, pulse->startMicros - pulse->pulse.deadlineMicros);
+    }
+}
+
+void test_engine_drops_pulse_later_than_bound()
+{
+    pulseEngineBegin(&pulseHalSim);
+    pulseHalSimSetTime(100000);
+
+    PulseDescriptor pulse = {};
+    pulse.widthMicros[0] = 100;
+
+    // No limite, o pulso ainda sai, contado como atrasado
+    pulse.deadlineMicros = 100000 - PULSE_MAX_LATENESS_MICROS;
+    TEST_ASSERT_TRUE(pulseEngineQueue(&pulse));
+    pulseEngineService();
+    TEST_ASSERT_EQUAL(1, emittedCount);
+    TEST_ASSERT_EQUAL_UINT32(1, pulseEngineGetStats().emitted);
+    TEST_ASSERT_EQUAL_UINT32(1, pulseEngineGetStats().late);
+
+    // Um us além do limite, é descartado
+    pulseHalSimAdvance(1000);
+    pulse.deadlineMicros = 101000 - PULSE_MAX_LATENESS_MICROS - 1;
+    TEST_ASSERT_TRUE(pulseEngineQueue(&pulse));
+    pulseEngineService();
+    TEST_ASSERT_EQUAL(1, emittedCount);
+    TEST_ASSERT_EQUAL_UINT32(1, pulseEngineGetStats().dropped);
+    TEST_ASSERT_EQUAL(0, pulseEnginePendingCount());
+}
+
+void test_widths_fit_rmt_duration()
+{
+    modulatorSetPulseWidth(40000);
+    TEST_ASSERT_EQUAL_UINT16(PULSE_MAX_DURATION_MICROS, modulatorGetPulseWidth());
+
+    // Um canal que começaria além do que o RMT representa não é agendado
+    PulseChannelRequest requests[PULSE_CHANNEL_COUNT] = {{PULSE_MAX_DURATION_MICROS, 0}, {100, 0}};
+    PulseDescriptor pulse;
+    TEST_ASSERT_TRUE(pulseSchedule(requests, PULSE_INTERPHASE_GAP_MICROS, 100000, &pulse) ==
+                     PulseScheduleStatus::DoesNotFit);
+}
+
+void test_channel_width_limited_by_mese_max()
+{
+    TwaiReceivedMessage amplitude = {};
+    amplitude.Kind = TwaiReceivedMessageKind::SetChannelAmplitude;
+    amplitude.ExtraData = (1 << 8) | 255;
+    modulatorOnTWAIMessage(&amplitude);
+    TEST_ASSERT_EQUAL_UINT8(100, data.channelAmplitudePercent[1]);
+
+    data.meseMax = 150;
+    modulatorSetPulseWidth(200);
+    runModulator(100000);
+
+    TEST_ASSERT_GREATER_THAN(0, emittedCount);
+    TEST_ASSERT_EQUAL_UINT16(150, emitted[0].pulse.widthMicros[0]);
+    TEST_ASSERT_EQUAL_UINT16(150, emitted[0].pulse.widthMicros[1]);
+}
+
+void test_stalled_loop_stops_pulses()
+{
+    modulatorSetPulseWidth(200);
+    runModulator(100000);
+    int beforeStall = emittedCount;
+    TEST_ASSERT_GREATER_THAN(0, beforeStall);
+
+    // Com o núcleo 0 travado, no máximo o pulso já entregue ao motor ainda sai
+    runModulator(500000, false);
+    TEST_ASSERT_LESS_OR_EQUAL(beforeStall + 1, emittedCount);
+
+    // E volta a pulsar assim que o loop renova o comando
+    runModulator(100000);
+    TEST_ASSERT_GREATER_THAN(beforeStall + 1, emittedCount);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_pulses_follow_deadline_grid);
+    RUN_TEST(test_stall_skips_pulses_without_moving_grid);
+    RUN_TEST(test_engine_drops_pulse_later_than_bound);
+    RUN_TEST(test_widths_fit_rmt_duration);
+    RUN_TEST(test_channel_width_limited_by_mese_max);
+    RUN_TEST(test_stalled_loop_stops_pulses);
+    return UNITY_END();
+}
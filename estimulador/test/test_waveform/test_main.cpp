@@ -0,0 +1,74 @@
+/**
+ * Configuração da forma de onda pelo frame SetWaveform: aplicada por inteiro ou recusada por inteiro.
+ */
+#include <unity.h>
+#include "Twai/Twai.h"
+#include "Waveform/Waveform.h"
+
+static TwaiReceivedMessage waveformMessage(uint8_t frequencyHz, uint8_t pulsesPerTrain, uint8_t intraTrainInterval,
+                                           uint8_t interphaseGapMicros, uint8_t secondPhasePercent)
+{
+    TwaiReceivedMessage message = {};
+    message.Kind = TwaiReceivedMessageKind::SetWaveform;
+    message.Length = 5;
+    message.Payload[0] = frequencyHz;
+    message.Payload[1] = pulsesPerTrain;
+    message.Payload[2] = intraTrainInterval;
+    message.Payload[3] = interphaseGapMicros;
+    message.Payload[4] = secondPhasePercent;
+    return message;
+}
+
+void setUp()
+{
+    waveformReset();
+}
+
+void tearDown()
+{
+}
+
+void test_frequency_and_pattern_change_together()
+{
+    // 20 Hz com 4 pulsos a cada 10 ms, depois 50 Hz com 2 pulsos a cada 5 ms: nenhuma das duas
+    // mudanças cabe sozinha na configuração anterior
+    TwaiReceivedMessage message = waveformMessage(20, 4, 100, 4, 100);
+    TEST_ASSERT_TRUE(waveformOnTWAIMessage(&message));
+    TEST_ASSERT_EQUAL_UINT8(4, waveformGetConfig()->pulsesPerTrain);
+
+    message = waveformMessage(50, 2, 50, 4, 100);
+    TEST_ASSERT_TRUE(waveformOnTWAIMessage(&message));
+
+    WaveformTable table = waveformReadTable();
+    TEST_ASSERT_EQUAL_UINT32(20000, table.periodMicros);
+    TEST_ASSERT_EQUAL_UINT8(2, table.pulseCount);
+    TEST_ASSERT_EQUAL_UINT32(5000, table.pulseOffsetMicros[1]);
+}
+
+void test_invalid_field_rejects_whole_frame()
+{
+    const WaveformConfig before = *waveformGetConfig();
+
+    TwaiReceivedMessage secondPhaseTooWide = waveformMessage(50, 2, 50, 4, WAVEFORM_MAX_SECOND_PHASE_PERCENT + 1);
+    waveformOnTWAIMessage(&secondPhaseTooWide);
+    TEST_ASSERT_EQUAL_UINT8(before.frequencyHz, waveformGetConfig()->frequencyHz);
+    TEST_ASSERT_EQUAL_UINT8(before.pulsesPerTrain, waveformGetConfig()->pulsesPerTrain);
+
+    TwaiReceivedMessage gapTooLong = waveformMessage(50, 2, 50, WAVEFORM_MAX_INTERPHASE_GAP_MICROS + 1, 100);
+    waveformOnTWAIMessage(&gapTooLong);
+    TEST_ASSERT_EQUAL_UINT8(before.frequencyHz, waveformGetConfig()->frequencyHz);
+
+    TwaiReceivedMessage shortFrame = waveformMessage(50, 2, 50, 4, 100);
+    shortFrame.Length = 4;
+    waveformOnTWAIMessage(&shortFrame);
+    TEST_ASSERT_EQUAL_UINT8(before.frequencyHz, waveformGetConfig()->frequencyHz);
+    TEST_ASSERT_EQUAL_UINT32(1000000 / before.frequencyHz, waveformReadTable().periodMicros);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_frequency_and_pattern_change_together);
+    RUN_TEST(test_invalid_field_rejects_whole_frame);
+    return UNITY_END();
+}
@@ -1,4 +1,5 @@
 #include "Bluetooth.h"
+#include "../EmergencyStop/EmergencyStop.h"
 #include <esp_log.h>
 
 static const char *TAG = "Bluetooth";
@@ -29,6 +30,13 @@ void onControlWritten(BLEDevice device, BLECharacteristic characteristic)
   BluetoothControlCode code = (BluetoothControlCode)(fullPayload & 0x00FF);
   uint8_t extraData = (fullPayload & 0xFF00) >> 8;
 
+  // Caminho rápido: o estimulador recebe a parada antes de a máquina de estados ver o comando,
+  // mesmo se a conexão já tiver passado do timeout
+  if (code == BluetoothControlCode::MainOperation_EmergencyStop)
+  {
+    emergencyStopTrigger();
+  }
+
   unsigned long now = millis();
 
   if (deviceReady && now - lastAlivePacketTime >= TIMEOUT)
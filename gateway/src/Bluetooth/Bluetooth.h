@@ -33,14 +33,63 @@ enum class BluetoothControlCode
     MainOperation_DecreaseMESEMaxOnce = 0x33,
     MainOperation_EmergencyStop = 0x38,
 
+    ParameterSetup_SetChannelAmplitude0 = 0x41,
+    ParameterSetup_SetChannelAmplitude1 = 0x42,
+    ParameterSetup_SetChannelOffset0 = 0x43,
+    ParameterSetup_SetChannelOffset1 = 0x44,
+
+    /**
+     * Curva das rampas de subida gradual e de parada: 0 = linear, 1 = exponencial, 2 = curva em S.
+     */
+    ParameterSetup_SetRampProfile = 0x60,
     ParameterSetup_SetGradualIncreaseTime = 0x61,
+    ParameterSetup_SetProportionalGain = 0x62,
     ParameterSetup_SetTransitionTime = 0x63,
     ParameterSetup_SetGradualDecreaseTime = 0x64,
+    ParameterSetup_SetIntegralGain = 0x65,
     ParameterSetup_SetMalhaFechadaAboveSetpointTime = 0x66,
     ParameterSetup_SetGainCoefficient = 0x67,
+    ParameterSetup_SetWaveformFrequency = 0x68,
+    ParameterSetup_SetWaveformPulsesPerTrain = 0x69,
+    ParameterSetup_SetWaveformIntraTrainInterval = 0x6A,
+    ParameterSetup_SetWaveformInterphaseGap = 0x6B,
+    ParameterSetup_SetWaveformSecondPhase = 0x6C,
     ParameterSetup_Reset = 0x6D,
     ParameterSetup_Save = 0x6E,
     ParameterSetup_Complete = 0x6F,
+
+    /**
+     * Dispara o benchmark de temporização dos pulsos no estimulador. Os eletrodos devem estar desconectados.
+     */
+    Diagnostics_RunPulseBenchmark = 0x70,
+
+    /**
+     * Taxa, em Hz, da telemetria interna do controle repassada pela serial. 0 desliga; máximo 200.
+     */
+    Diagnostics_SetTelemetryRate = 0x71,
+
+    /**
+     * Taxa do barramento CAN: 0 = 125 kbit/s, 1 = 250 kbit/s, 2 = 500 kbit/s, 3 = 1 Mbit/s. 0 é
+     * recusado: os prazos do barramento não cabem nela.
+     * Só na parametrização; o gateway e o estimulador reiniciam na nova taxa.
+     */
+    Diagnostics_SetCanBitrate = 0x72,
+
+    /**
+     * Escolhe, pelo endereço no barramento (1 a 7), o estimulador que os próximos controles Nodes_ ajustam.
+     */
+    Nodes_SelectNode = 0x73,
+
+    /**
+     * Fração, em %, do PWM pedido que vai para o estimulador escolhido. 100 (o padrão) = o PWM inteiro.
+     */
+    Nodes_SetPwmPercent = 0x74,
+
+    /**
+     * 1 = o gateway reinicia em modo sniffer (só escuta o barramento e grava na serial; ver Sniffer.h).
+     * Só na parametrização, numa placa que não controla o estimulador.
+     */
+    Diagnostics_SetSnifferMode = 0x75,
 };
 
 typedef struct __attribute__((__packed__))
@@ -57,7 +106,7 @@ typedef struct __attribute__((__packed__))
     {
         unsigned isEEGFlagSet : 1;
         unsigned isCANAvailable : 1;
-        unsigned reserved6 : 1;
+        unsigned isPulseScheduleInvalid : 1;
         unsigned reserved5 : 1;
         unsigned reserved4 : 1;
         unsigned reserved3 : 1;
@@ -78,6 +127,38 @@ typedef struct __attribute__((__packed__))
 
     // Informar o app do estado atual da operação
     uint8_t mainOperationStateInformApp[6];
+
+    // Saúde do barramento CAN (Twai/TwaiHealth.h). Contadores saturam no máximo do campo.
+    struct __attribute__((__packed__))
+    {
+        // twai_state_t: 0 parado, 1 rodando, 2 bus-off, 3 recuperando
+        uint8_t state;
+        uint8_t txErrorCounter;
+        uint8_t rxErrorCounter;
+
+        // Décimos de porcento
+        uint16_t busLoadPermille;
+
+        uint16_t busOffCount;
+        uint16_t lastRecoveryMs;
+        uint16_t txFailed;
+        uint16_t arbitrationLost;
+        uint16_t rxMissed;
+
+        // Do último relatório do estimulador; estado 0xFF se nenhum chegou
+        uint8_t stimulatorState;
+        uint8_t stimulatorTxErrorCounter;
+        uint8_t stimulatorRxErrorCounter;
+        uint8_t stimulatorBusOffCount;
+    } canHealth;
+
+    // Ida e volta gateway -> estimulador -> gateway (Latency/Latency.h) na janela móvel, em us, saturado
+    struct __attribute__((__packed__))
+    {
+        uint16_t p50Micros;
+        uint16_t p99Micros;
+        uint16_t maxMicros;
+    } canLatency;
 } BleStatusPacket;
 
 typedef void (*BluetoothControlCallback)(BluetoothControlCode code, uint8_t extraData);
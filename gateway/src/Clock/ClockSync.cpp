@@ -0,0 +1,232 @@
+#include "ClockSync.h"
+#include <Arduino.h>
+#include <esp_log.h>
+#include <math.h>
+#include <string.h>
+#include "../Twai/TwaiFilter.h"
+
+static const char *TAG = "ClockSync";
+
+// Endereços de estimulador possíveis, mais o 0, que não é usado
+#define CLOCK_SYNC_NODE_COUNT (TWAI_NODE_MASK + 1)
+
+// Estimativa do relógio de um estimulador
+struct NodeClock
+{
+  // Troca à espera do t3 - t2, que vem no echo seguinte
+  bool previousValid;
+  uint16_t previousSequence;
+  uint32_t previousPingSent;     // t1
+  uint32_t previousPingReceived; // t2
+  uint32_t previousEchoReceived; // t4
+
+  unsigned long lastAcceptedTime;
+
+  // Janela: instante da troca no relógio do gateway e offset medido nela
+  uint32_t windowGatewayMicros[CLOCK_SYNC_WINDOW_SAMPLES];
+  uint32_t windowOffset[CLOCK_SYNC_WINDOW_SAMPLES];
+  uint16_t windowHead;
+  uint16_t windowCount;
+
+  // Reta ajustada à janela: offset(t) = modelOffset + modelDrift * (t - modelGatewayMicros)
+  bool modelValid;
+  uint32_t modelGatewayMicros;
+  uint32_t modelOffset;
+  double modelDrift;
+
+  uint32_t rejected;
+  uint32_t lost;
+  int32_t lastRoundTripMicros;
+  int32_t lastResidualMicros;
+};
+
+static NodeClock clocks[CLOCK_SYNC_NODE_COUNT];
+
+static unsigned long lastReportTime = 0;
+
+// Os relógios são micros() de 32 bits: tudo em aritmética modular, com diferenças curtas em int32_t
+static uint32_t offsetAt(const NodeClock *clock, uint32_t gatewayMicros)
+{
+  int32_t elapsed = (int32_t)(gatewayMicros - clock->modelGatewayMicros);
+  return clock->modelOffset + (uint32_t)(int32_t)lround(clock->modelDrift * elapsed);
+}
+
+// Mínimos quadrados sobre a janela, relativos à amostra mais antiga
+static void fit(NodeClock *clock)
+{
+  uint16_t count = clock->windowCount;
+  uint16_t oldest = (clock->windowHead + CLOCK_SYNC_WINDOW_SAMPLES - count) % CLOCK_SYNC_WINDOW_SAMPLES;
+  uint32_t baseGateway = clock->windowGatewayMicros[oldest];
+  uint32_t baseOffset = clock->windowOffset[oldest];
+
+  double sumX = 0, sumY = 0;
+  for (uint16_t i = 0; i < count; i++)
+  {
+    uint16_t index = (oldest + i) % CLOCK_SYNC_WINDOW_SAMPLES;
+    sumX += (int32_t)(clock->windowGatewayMicros[index] - baseGateway);
+    sumY += (int32_t)(clock->windowOffset[index] - baseOffset);
+  }
+  double meanX = sumX / count;
+  double meanY = sumY / count;
+
+  double sumXX = 0, sumXY = 0;
+  for (uint16_t i = 0; i < count; i++)
+  {
+    uint16_t index = (oldest + i) % CLOCK_SYNC_WINDOW_SAMPLES;
+    double x = (int32_t)(clock->windowGatewayMicros[index] - baseGateway) - meanX;
+    double y = (int32_t)(clock->windowOffset[index] - baseOffset) - meanY;
+    sumXX += x * x;
+    sumXY += x * y;
+  }
+
+  clock->modelGatewayMicros = baseGateway + (uint32_t)lround(meanX);
+  clock->modelOffset = baseOffset + (uint32_t)(int32_t)lround(meanY);
+  clock->modelDrift = sumXX > 0 ? sumXY / sumXX : 0;
+  clock->modelValid = true;
+}
+
+static void addExchange(uint8_t node, uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4)
+{
+  NodeClock *clock = &clocks[node];
+  int32_t roundTrip = (int32_t)((t4 - t1) - (t3 - t2));
+  if (abs(roundTrip) > CLOCK_SYNC_MAX_ROUND_TRIP_MICROS)
+  {
+    clock->rejected++;
+    ESP_LOGD(TAG, "Estimulador %u: troca %u rejeitada, ida e volta de %d us", node, clock->previousSequence,
+             roundTrip);
+    return;
+  }
+
+  // Média de (t2 - t1) e (t3 - t4) sem estourar: a diferença entre os dois é curta
+  uint32_t forward = t2 - t1;
+  uint32_t backward = t3 - t4;
+  uint32_t offset = forward + (uint32_t)((int32_t)(backward - forward) / 2);
+  uint32_t gatewayMicros = t1 + (t4 - t1) / 2;
+
+  unsigned long now = millis();
+  if (clock->modelValid)
+  {
+    int32_t residual = (int32_t)(offset - offsetAt(clock, gatewayMicros));
+    bool stale = now - clock->lastAcceptedTime >= CLOCK_SYNC_STALE_MS;
+    if (stale || abs(residual) > CLOCK_SYNC_JUMP_MICROS)
+    {
+      ESP_LOGW(TAG, "Estimulador %u: offset a %d us da reta%s; recomeçando a estimativa", node, residual,
+               stale ? " após um silêncio" : "");
+      clock->windowCount = 0;
+      residual = 0;
+    }
+    clock->lastResidualMicros = residual;
+  }
+
+  clock->windowGatewayMicros[clock->windowHead] = gatewayMicros;
+  clock->windowOffset[clock->windowHead] = offset;
+  clock->windowHead = (clock->windowHead + 1) % CLOCK_SYNC_WINDOW_SAMPLES;
+  if (clock->windowCount < CLOCK_SYNC_WINDOW_SAMPLES)
+    clock->windowCount++;
+
+  fit(clock);
+  clock->lastRoundTripMicros = roundTrip;
+  clock->lastAcceptedTime = now;
+}
+
+void clockSyncBegin()
+{
+  memset(clocks, 0, sizeof(clocks));
+  lastReportTime = millis();
+}
+
+static void report(uint8_t node)
+{
+  ClockSyncStats stats = clockSyncGetStats(node);
+
+  char line[72];
+  int length = snprintf(line, sizeof(line), "S,%u,%u,%u,%u,%d,%d,%d\n", node, stats.samples, stats.rejected,
+                        stats.lost, stats.offsetMicros, stats.driftPpb, stats.lastResidualMicros);
+  if (length <= 0 || Serial.availableForWrite() < length)
+    return;
+  Serial.write((const uint8_t *)line, length);
+}
+
+void clockSyncLoop()
+{
+  unsigned long now = millis();
+  if (now - lastReportTime < CLOCK_SYNC_REPORT_INTERVAL_MS)
+    return;
+  lastReportTime = now;
+
+  for (uint8_t node = 1; node < CLOCK_SYNC_NODE_COUNT; node++)
+  {
+    if (clocks[node].previousValid)
+      report(node);
+  }
+}
+
+void clockSyncOnExchange(uint8_t node, uint16_t sequence, uint32_t pingSentMicros, uint32_t pingReceivedMicros,
+                         uint32_t echoReceivedMicros, uint16_t previousResidenceMicros)
+{
+  if (node == CLOCK_NODE_GATEWAY || node >= CLOCK_SYNC_NODE_COUNT)
+    return;
+
+  NodeClock *clock = &clocks[node];
+  if (clock->previousValid)
+  {
+    if (clock->previousSequence == (uint16_t)(sequence - 1) && previousResidenceMicros != UINT16_MAX)
+      addExchange(node, clock->previousPingSent, clock->previousPingReceived,
+                  clock->previousPingReceived + previousResidenceMicros, clock->previousEchoReceived);
+    else
+      clock->lost++;
+  }
+
+  clock->previousValid = true;
+  clock->previousSequence = sequence;
+  clock->previousPingSent = pingSentMicros;
+  clock->previousPingReceived = pingReceivedMicros;
+  clock->previousEchoReceived = echoReceivedMicros;
+}
+
+NodeTimestamp clockSyncNow()
+{
+  NodeTimestamp timestamp;
+  timestamp.node = CLOCK_NODE_GATEWAY;
+  timestamp.micros = micros();
+  return timestamp;
+}
+
+static bool isSynchronized(const NodeClock *clock)
+{
+  return clock->modelValid && millis() - clock->lastAcceptedTime < CLOCK_SYNC_STALE_MS;
+}
+
+bool clockSyncToGatewayMicros(NodeTimestamp timestamp, uint32_t *gatewayMicros)
+{
+  if (timestamp.node == CLOCK_NODE_GATEWAY)
+  {
+    *gatewayMicros = timestamp.micros;
+    return true;
+  }
+
+  if (timestamp.node >= CLOCK_SYNC_NODE_COUNT || !isSynchronized(&clocks[timestamp.node]))
+    return false;
+
+  // A reta é em função do tempo do gateway: uma iteração basta, a deriva é de ppm
+  const NodeClock *clock = &clocks[timestamp.node];
+  uint32_t estimate = timestamp.micros - clock->modelOffset;
+  *gatewayMicros = timestamp.micros - offsetAt(clock, estimate);
+  return true;
+}
+
+ClockSyncStats clockSyncGetStats(uint8_t node)
+{
+  const NodeClock *clock = &clocks[node & TWAI_NODE_MASK];
+
+  ClockSyncStats stats;
+  stats.synchronized = isSynchronized(clock);
+  stats.samples = clock->windowCount;
+  stats.rejected = clock->rejected;
+  stats.lost = clock->lost;
+  stats.offsetMicros = clock->modelValid ? (int32_t)offsetAt(clock, micros()) : 0;
+  stats.driftPpb = lround(clock->modelDrift * 1e9);
+  stats.lastRoundTripMicros = clock->lastRoundTripMicros;
+  stats.lastResidualMicros = clock->lastResidualMicros;
+  return stats;
+}
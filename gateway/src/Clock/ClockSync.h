@@ -0,0 +1,91 @@
+#pragma once
+#include <stdint.h>
+
+/**
+ * Sincronização do relógio de cada estimulador com o do gateway, para pôr eventos dos nós na mesma
+ * linha do tempo. Troca em duas vias, como no PTP, em cima do LatencyPing/LatencyEcho (Latency.h), sem
+ * frames a mais no barramento. Os instantes são o fim de cada frame no barramento (auto-recepção, ver
+ * twaiSendTimestamped), e não a fila de transmissão:
+ *
+ *   t1  fim do LatencyPing, carimbo de transmissão do gateway
+ *   t2  chegada do ping no estimulador, no echo
+ *   t3  fim do LatencyEcho, carimbo de transmissão do estimulador; vai como t3 - t2 no echo seguinte
+ *   t4  chegada do echo no gateway
+ *
+ * offset = ((t2 - t1) + (t3 - t4)) / 2, o relógio do estimulador menos o do gateway. Como os quatro
+ * instantes são o fim de um frame visto pelos dois nós, o tempo de ida e volta (t4 - t1) - (t3 - t2)
+ * fica perto de zero; o que sobra é a variação da latência de recepção, e metade dela vira erro no
+ * offset. A deriva é a inclinação de uma reta ajustada aos offsets da janela.
+ *
+ * O ping vai para todos, e cada estimulador responde com o próprio echo: cada um tem a sua janela e a
+ * sua reta, pelo endereço no barramento.
+ */
+
+// Trocas na janela da reta, uma a cada LATENCY_PING_INTERVAL_MS (~3 s). Com cristais de ±40 ppm, o
+// offset anda até 4 us entre trocas; a reta cobre isso.
+#define CLOCK_SYNC_WINDOW_SAMPLES 32
+
+// Trocas com ida e volta maior que esta (recepção atrasada num dos nós) ficam fora da janela
+#define CLOCK_SYNC_MAX_ROUND_TRIP_MICROS 100
+
+// Um offset tão longe da reta é um salto do relógio do estimulador (reinício); a janela recomeça
+#define CLOCK_SYNC_JUMP_MICROS 1000
+
+// Sem troca aceita por este tempo, a estimativa deixa de valer (estimulador reiniciou ou saiu do barramento)
+#define CLOCK_SYNC_STALE_MS 5000
+
+// Intervalo entre as linhas na serial
+#define CLOCK_SYNC_REPORT_INTERVAL_MS 5000
+
+// Nó dos instantes do gateway; os estimuladores são identificados pelo endereço no barramento (1 a 7)
+#define CLOCK_NODE_GATEWAY 0
+
+// Instante no relógio (micros()) de um dos nós; clockSyncToGatewayMicros leva ao relógio do gateway
+struct NodeTimestamp
+{
+  uint8_t node;
+  uint32_t micros;
+};
+
+struct ClockSyncStats
+{
+  // Verdadeiro com ao menos uma troca aceita nos últimos CLOCK_SYNC_STALE_MS
+  bool synchronized;
+
+  // Trocas na janela; desde o boot, rejeitadas pela ida e volta e que não fecharam (echo seguinte
+  // perdido ou residência desconhecida)
+  uint16_t samples;
+  uint32_t rejected;
+  uint32_t lost;
+
+  // Relógio do estimulador menos o do gateway, agora, e deriva dele em partes por bilhão
+  int32_t offsetMicros;
+  int32_t driftPpb;
+
+  // Da última troca aceita: ida e volta e erro da estimativa anterior para o offset medido
+  int32_t lastRoundTripMicros;
+  int32_t lastResidualMicros;
+};
+
+void clockSyncBegin();
+
+/**
+ * A cada CLOCK_SYNC_REPORT_INTERVAL_MS, uma linha na serial por estimulador que já respondeu:
+ *   S,nó,amostras,rejeitadas,perdidas,offset_us,deriva_ppb,resíduo_us
+ * Se a serial não tiver espaço, a linha é descartada em vez de bloquear o loop.
+ */
+void clockSyncLoop();
+
+/**
+ * Chamado por Latency a cada LatencyEcho da troca em andamento, com o endereço do estimulador que
+ * respondeu: t1, t2 e t4 desta troca e t3 - t2 da anterior (UINT16_MAX = desconhecido), que a completa.
+ */
+void clockSyncOnExchange(uint8_t node, uint16_t sequence, uint32_t pingSentMicros, uint32_t pingReceivedMicros,
+                         uint32_t echoReceivedMicros, uint16_t previousResidenceMicros);
+
+NodeTimestamp clockSyncNow();
+
+// Falso se o instante é de um estimulador sem estimativa válida
+bool clockSyncToGatewayMicros(NodeTimestamp timestamp, uint32_t *gatewayMicros);
+
+ClockSyncStats clockSyncGetStats(uint8_t node);
@@ -1,5 +1,9 @@
 #include "Data.h"
 #include "Bluetooth/Bluetooth.h"
+#include "Scale/Scale.h"
+#include "Twai/TwaiHealth.h"
+#include "Latency/Latency.h"
+#include "Nodes/Nodes.h"
 #include "string.h"
 #include <Arduino.h>
 #include "./Flags.h"
@@ -8,6 +12,19 @@
 
 static const char *TAG = "Data";
 
+// Target of the last RampTo, before scaling it per stimulator
+static uint16_t lastRampTarget = 0;
+
+static uint8_t saturate8(uint32_t value)
+{
+  return value > UINT8_MAX ? UINT8_MAX : value;
+}
+
+static uint16_t saturate16(uint32_t value)
+{
+  return value > UINT16_MAX ? UINT16_MAX : value;
+}
+
 Data::Data()
 {
   pinMode(OVBOXPin, INPUT);
@@ -28,6 +45,23 @@ void Data::reset()
          sizeof(this->mainOperationStateInformApp));
   memset(&this->parameterSetup, 0, sizeof(this->parameterSetup));
   this->parameterSetup.gainCoefficient = 50;
+  this->control.proportionalGain = 30;
+  this->control.integralGain = 0;
+  this->waveform.frequencyHz = 35;
+  this->waveform.pulsesPerTrain = 1;
+  this->waveform.intraTrainInterval = 50;
+  this->waveform.interphaseGapMicros = 4;
+  this->waveform.secondPhasePercent = 100;
+  for (int channel = 0; channel < 2; channel++)
+  {
+    this->channels[channel].amplitudePercent = 100;
+    this->channels[channel].offset = 0;
+  }
+  this->pulseScheduleDoesNotFit = false;
+  this->rampProfile = RampProfile::Linear;
+  this->ramp.state = RampState::Idle;
+  this->ramp.targetPwm = 0;
+  this->ramp.progressPercent = 0;
 }
 
 void Data::sendToBle()
@@ -58,6 +92,7 @@ void Data::sendToBle()
   status.setpoint = data.setpoint;
   status.status_flags.isEEGFlagSet = data.isOVBoxFlagSet() ? 1 : 0;
   status.status_flags.isCANAvailable = twaiIsAvailable() ? 1 : 0;
+  status.status_flags.isPulseScheduleInvalid = data.pulseScheduleDoesNotFit ? 1 : 0;
 
   // Copy the operation state information array from the data to the status packet.
   memcpy(status.mainOperationStateInformApp, this->mainOperationStateInformApp,
@@ -67,9 +102,171 @@ void Data::sendToBle()
   memcpy(&status.parameterSetup, &this->parameterSetup,
          sizeof(this->parameterSetup));
 
+  // Bus health sampled by the TWAI health task, plus the last report from the stimulator.
+  TwaiHealth health = twaiHealthGet();
+  status.canHealth.state = health.state;
+  status.canHealth.txErrorCounter = saturate8(health.txErrorCounter);
+  status.canHealth.rxErrorCounter = saturate8(health.rxErrorCounter);
+  status.canHealth.busLoadPermille = health.busLoadPermille;
+  status.canHealth.busOffCount = saturate16(health.busOffCount);
+  status.canHealth.lastRecoveryMs = saturate16(health.lastRecoveryMs);
+  status.canHealth.txFailed = saturate16(health.txFailed);
+  status.canHealth.arbitrationLost = saturate16(health.arbitrationLost);
+  status.canHealth.rxMissed = saturate16(health.rxMissed);
+
+  TwaiStimulatorHealth stimulatorHealth = twaiHealthGetStimulator();
+  status.canHealth.stimulatorState = stimulatorHealth.received ? stimulatorHealth.state : 0xFF;
+  status.canHealth.stimulatorTxErrorCounter = stimulatorHealth.txErrorCounter;
+  status.canHealth.stimulatorRxErrorCounter = stimulatorHealth.rxErrorCounter;
+  status.canHealth.stimulatorBusOffCount = stimulatorHealth.busOffCount;
+
+  // Round-trip latency of the control path.
+  LatencyStats latency = latencyGetStats();
+  status.canLatency.p50Micros = saturate16(latency.p50Micros);
+  status.canLatency.p99Micros = saturate16(latency.p99Micros);
+  status.canLatency.maxMicros = saturate16(latency.maxMicros);
+
   bluetoothWriteStatusData(&status);
 }
 
+void Data::sendWaveformToTwai()
+{
+  // The whole waveform goes in one frame, so the stimulator never applies half of a change.
+  uint8_t waveform[5] = {this->waveform.frequencyHz, this->waveform.pulsesPerTrain,
+                         this->waveform.intraTrainInterval, this->waveform.interphaseGapMicros,
+                         this->waveform.secondPhasePercent};
+  twaiSendPayload(TwaiSendMessageKind::SetWaveform, waveform, sizeof(waveform));
+
+  for (int channel = 0; channel < 2; channel++)
+  {
+    twaiSend(TwaiSendMessageKind::SetChannelAmplitude, (channel << 8) | this->channels[channel].amplitudePercent);
+    twaiSend(TwaiSendMessageKind::SetChannelOffset, (channel << 14) | (this->channels[channel].offset * 10));
+  }
+}
+
+// [weight u16][sample sequence u8][sample age in ms u8]. The stimulator runs the closed loop
+// once per new sequence and uses the age to compensate for the delay.
+static void encodeWeight(uint16_t weightTotal, uint8_t *payload)
+{
+  unsigned long age = millis() - scaleGetSampleTime();
+  if (age > UINT8_MAX)
+    age = UINT8_MAX;
+
+  payload[0] = weightTotal >> 8;
+  payload[1] = weightTotal & 0xFF;
+  payload[2] = scaleGetSampleSequence();
+  payload[3] = age;
+}
+
+void Data::sendOperationCommandToTwai(uint8_t fields, uint16_t weightTotal, uint16_t requestedPwm)
+{
+  // [fields u8][weight u16][sample sequence u8][sample age in ms u8][requested PWM u16][reserved]
+  uint8_t payload[8] = {0};
+  payload[0] = fields;
+  encodeWeight(weightTotal, &payload[1]);
+  payload[5] = requestedPwm >> 8;
+  payload[6] = requestedPwm & 0xFF;
+
+  // The sample age grows by itself between samples; only a new sample or another field counts as a change
+  uint8_t compareMask = (uint8_t)~(1 << 4);
+  if (nodesHaveUniformPwm())
+  {
+    twaiSendOnChange(TwaiSendMessageKind::OperationCommand, payload, sizeof(payload), compareMask);
+    return;
+  }
+
+  // Some stimulator gets a fraction of the PWM: one frame per stimulator, addressed to it
+  uint8_t present = nodesGetPresentMask();
+  for (uint8_t node = 1; node <= NODES_MAX_ADDRESS; node++)
+  {
+    if (!(present & (1 << node)))
+      continue;
+
+    uint16_t nodePwm = nodesScalePwm(node, requestedPwm);
+    payload[5] = nodePwm >> 8;
+    payload[6] = nodePwm & 0xFF;
+    twaiSendOnChange(TwaiSendMessageKind::OperationCommand, payload, sizeof(payload), compareMask, node);
+  }
+}
+
+void Data::sendOperationParametersToTwai(uint8_t fields, uint16_t setpoint, uint16_t mese, uint16_t meseMax)
+{
+  // [fields u8][setpoint u16][mese u16][mese max u16][gain coefficient u8]
+  uint8_t payload[8];
+  payload[0] = fields;
+  payload[1] = setpoint >> 8;
+  payload[2] = setpoint & 0xFF;
+  payload[3] = mese >> 8;
+  payload[4] = mese & 0xFF;
+  payload[5] = meseMax >> 8;
+  payload[6] = meseMax & 0xFF;
+  payload[7] = this->parameterSetup.gainCoefficient;
+
+  twaiSendOnChange(TwaiSendMessageKind::OperationParameters, payload, sizeof(payload));
+}
+
+void Data::sendRampToTwai(uint16_t targetPwm, uint16_t durationMs, RampProfile profile)
+{
+  // [target u16][duration ms u16][profile u8]
+  uint8_t payload[5];
+  payload[0] = targetPwm >> 8;
+  payload[1] = targetPwm & 0xFF;
+  payload[2] = durationMs >> 8;
+  payload[3] = durationMs & 0xFF;
+  payload[4] = (uint8_t)profile;
+  lastRampTarget = targetPwm;
+
+  if (nodesHaveUniformPwm())
+  {
+    twaiSendPayload(TwaiSendMessageKind::RampTo, payload, sizeof(payload));
+    return;
+  }
+
+  // Same as the operation command: each stimulator ramps to its own fraction of the target
+  uint8_t present = nodesGetPresentMask();
+  for (uint8_t node = 1; node <= NODES_MAX_ADDRESS; node++)
+  {
+    if (!(present & (1 << node)))
+      continue;
+
+    uint16_t nodeTarget = nodesScalePwm(node, targetPwm);
+    payload[0] = nodeTarget >> 8;
+    payload[1] = nodeTarget & 0xFF;
+    twaiSendPayload(TwaiSendMessageKind::RampTo, payload, sizeof(payload), node);
+  }
+}
+
+void Data::sendControlGainsToTwai()
+{
+  twaiSend(TwaiSendMessageKind::SetGainCoefficient, this->parameterSetup.gainCoefficient);
+  twaiSend(TwaiSendMessageKind::SetProportionalGain, this->control.proportionalGain);
+  twaiSend(TwaiSendMessageKind::SetIntegralGain, this->control.integralGain);
+}
+
+void Data::onTWAIMessage(TwaiReceivedMessage *receivedMessage)
+{
+  switch (receivedMessage->Kind)
+  {
+  case TwaiReceivedMessageKind::PulseScheduleStatusReport:
+    this->pulseScheduleDoesNotFit = receivedMessage->ExtraData != 0;
+    if (this->pulseScheduleDoesNotFit)
+    {
+      ESP_LOGE(TAG, "O estimulador informou que os canais pedidos não cabem no período de estimulação");
+    }
+    break;
+  case TwaiReceivedMessageKind::RampStatus:
+    // [state u8][current PWM u16][target u16][progress % u8]
+    this->ramp.state = (RampState)receivedMessage->Payload[0];
+    this->ramp.targetPwm = (receivedMessage->Payload[3] << 8) | receivedMessage->Payload[4];
+
+    // A stimulator ramping to a fraction of the target reports the fraction
+    if (this->ramp.targetPwm == nodesScalePwm(receivedMessage->Node, lastRampTarget))
+      this->ramp.targetPwm = lastRampTarget;
+    this->ramp.progressPercent = receivedMessage->Payload[5];
+    break;
+  }
+}
+
 void Data::debugPrintAll()
 {
   ESP_LOGI(TAG, "");
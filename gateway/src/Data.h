@@ -54,6 +54,62 @@ public:
         uint8_t gainCoefficient;
     } parameterSetup;
 
+    // Closed loop controller gains sent to the stimulator, in hundredths. The weight gain is `parameterSetup.gainCoefficient`.
+    struct
+    {
+        // Gain applied to the control error.
+        uint8_t proportionalGain;
+
+        // Gain applied to the integral of the control error, per second. 0 disables the integral term.
+        uint8_t integralGain;
+    } control;
+
+    // Stimulation waveform configured in the stimulator over TWAI.
+    struct
+    {
+        // Stimulation frequency, in Hz.
+        uint8_t frequencyHz;
+
+        // Pulses per train: 1 for single pulses, 2 for doublets, more for bursts.
+        uint8_t pulsesPerTrain;
+
+        // Interval between the pulses of a train, in units of 100 us.
+        uint8_t intraTrainInterval;
+
+        // Gap between the two phases of a pulse, in us.
+        uint8_t interphaseGapMicros;
+
+        // Width of the second phase relative to the first one. 100 means symmetric.
+        uint8_t secondPhasePercent;
+    } waveform;
+
+    // Per channel pair layout of each pulse: pins 2/32 are channel 0, pins 4/33 are channel 1.
+    struct
+    {
+        // Amplitude of the channel, as a percentage of the requested PWM.
+        uint8_t amplitudePercent;
+
+        // Requested start of the channel within the pulse, in units of 10 us.
+        uint8_t offset;
+    } channels[2];
+
+    // Curve of the gradual increase and decrease ramps run by the stimulator.
+    RampProfile rampProfile;
+
+    // Latest ramp progress reported by the stimulator.
+    struct
+    {
+        RampState state;
+
+        // Target of the reported ramp, to tell it apart from an older one.
+        uint16_t targetPwm;
+
+        uint8_t progressPercent;
+    } ramp;
+
+    // Set when the stimulator reports that the requested channel layout does not fit in the stimulation period.
+    bool pulseScheduleDoesNotFit;
+
     // Array to hold the operation state information for the Android application.
     uint8_t mainOperationStateInformApp[6];
 
@@ -68,6 +124,30 @@ public:
     // Function to send the data to the BLE module.
     void sendToBle();
 
+    // Function to send the waveform and channel layout to the stimulator.
+    void sendWaveformToTwai();
+
+    // Function to send the per-cycle operation command in a single frame: mode, total weight (tagged with the
+    // scale sample sequence and age) and requested PWM. `fields` is a mask of OperationCommandField; fields
+    // not in the mask are left unchanged in the stimulator. Like the parameters below, the frame only goes
+    // out when something changed or at the TWAI refresh interval. If a stimulator gets a fraction of the PWM
+    // (nodesScalePwm), each stimulator gets its own frame, addressed to it.
+    void sendOperationCommandToTwai(uint8_t fields, uint16_t weightTotal, uint16_t requestedPwm);
+
+    // Function to send setpoint, MESE, MESE max and the gain coefficient in a single frame.
+    // `fields` is a mask of OperationParameterField.
+    void sendOperationParametersToTwai(uint8_t fields, uint16_t setpoint, uint16_t mese, uint16_t meseMax);
+
+    // Function to ask the stimulator to ramp from its current PWM to `targetPwm` over `durationMs`.
+    // The stimulator runs the ramp on its own clock and reports progress with RampStatus frames.
+    void sendRampToTwai(uint16_t targetPwm, uint16_t durationMs, RampProfile profile);
+
+    // Function to send the closed loop controller gains to the stimulator.
+    void sendControlGainsToTwai();
+
+    // Function to handle TWAI messages that are relevant in every state.
+    void onTWAIMessage(TwaiReceivedMessage *receivedMessage);
+
     // Function to debug print the data.
     void debugPrintAll();
 
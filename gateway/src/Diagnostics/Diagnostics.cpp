@@ -0,0 +1,146 @@
+#include "Diagnostics.h"
+#include "../Twai/TwaiHealth.h"
+#include "../Twai/TwaiBitrate.h"
+#include <Arduino.h>
+#include <esp_log.h>
+
+static const char *TAG = "Diagnostics";
+
+static bool flooding = false;
+static unsigned long floodStartTime = 0;
+static unsigned long floodDuration = 0;
+static uint32_t floodFramesSent = 0;
+
+static unsigned long lastBusLoadTime = 0;
+static TwaiBusStats lastBusStats;
+
+// Frames que o estimulador leu do driver, e quantos deles descartou, no último relatório
+static uint16_t stimulatorReceivedFrames = 0;
+static uint16_t stimulatorRejectedFrames = 0;
+
+// Recepção do estimulador no último relatório: frames perdidos (driver ou fila), pico da fila e do atraso em us
+static uint8_t stimulatorLostFrames = 0;
+static uint8_t stimulatorMaxQueueDepth = 0;
+static uint32_t stimulatorMaxLatencyMicros = 0;
+
+static const char *METRIC_NAMES[] = {"intervalo", "largura canal 0", "largura canal 1"};
+
+void diagnosticsStartPulseBenchmark(uint16_t pulseCount)
+{
+  ESP_LOGW(TAG, "Benchmark de pulsos: %u pulsos, barramento inundado durante o teste", pulseCount);
+
+  twaiSend(TwaiSendMessageKind::RunPulseBenchmark, pulseCount);
+
+  flooding = true;
+  floodStartTime = millis();
+  floodDuration = (unsigned long)pulseCount * DIAGNOSTICS_BENCH_PULSE_PERIOD_MS;
+  floodFramesSent = 0;
+}
+
+static void logBusLoad()
+{
+  unsigned long now = millis();
+  if (now - lastBusLoadTime < DIAGNOSTICS_BUS_LOAD_INTERVAL_MS)
+  {
+    return;
+  }
+
+  TwaiBusStats stats = twaiGetBusStats();
+  unsigned long elapsed = now - lastBusLoadTime;
+  uint32_t transmitted = stats.transmittedFrames - lastBusStats.transmittedFrames;
+  uint32_t received = stats.receivedFrames - lastBusStats.receivedFrames;
+  uint32_t bits = stats.bits - lastBusStats.bits;
+  uint32_t rejected = stats.rejectedFrames - lastBusStats.rejectedFrames;
+  uint32_t suppressed = stats.suppressedFrames - lastBusStats.suppressedFrames;
+  uint32_t queueDropped = stats.receiveQueueDropped - lastBusStats.receiveQueueDropped;
+  uint32_t driverLost = stats.driverMissed + stats.driverOverrun - lastBusStats.driverMissed - lastBusStats.driverOverrun;
+  lastBusLoadTime = now;
+  lastBusStats = stats;
+  twaiResetReceivePeaks();
+
+  // bits / (taxa * segundos), em décimos de porcento
+  uint32_t loadPermille = (uint64_t)bits * 1000 * 1000 / ((uint64_t)twaiGetBitrate() * elapsed);
+  ESP_LOGI(TAG, "Barramento: %u.%u%% de carga em %lu ms; %u frames enviados (%u sem mudança não enviados), "
+                "%u recebidos (%u descartados pelo filtro)",
+           loadPermille / 10, loadPermille % 10, elapsed, transmitted, suppressed, received, rejected);
+  ESP_LOGI(TAG, "Recepção: fila com até %u frames, %u perdidos na fila e %u no driver, "
+                "atraso até a entrega de até %u us",
+           stats.maxReceiveQueueDepth, queueDropped, driverLost, stats.maxReceiveLatencyMicros);
+  ESP_LOGI(TAG, "Estimulador: %u frames/s lidos, %u descartados pelo filtro; fila com até %u frames, %u perdidos, "
+                "atraso até a entrega de até %u us",
+           stimulatorReceivedFrames, stimulatorRejectedFrames, stimulatorMaxQueueDepth, stimulatorLostFrames,
+           stimulatorMaxLatencyMicros);
+
+  TwaiHealth health = twaiHealthGet();
+  TwaiStimulatorHealth stimulatorHealth = twaiHealthGetStimulator();
+  ESP_LOGI(TAG, "Saúde: estado %d, TEC=%u REC=%u, %u falhas de envio, %u arbitragens perdidas, %u erros de "
+                "barramento; %u bus-offs, recuperação em até %u ms",
+           health.state, health.txErrorCounter, health.rxErrorCounter, health.txFailed, health.arbitrationLost,
+           health.busErrors, health.busOffCount, health.maxRecoveryMs);
+  ESP_LOGI(TAG, "Saúde no estimulador: estado %d, TEC=%u REC=%u, %u.%u%% de carga, %u bus-offs",
+           stimulatorHealth.state, stimulatorHealth.txErrorCounter, stimulatorHealth.rxErrorCounter,
+           stimulatorHealth.busLoadPermille / 10, stimulatorHealth.busLoadPermille % 10,
+           stimulatorHealth.busOffCount);
+}
+
+void diagnosticsLoop()
+{
+  logBusLoad();
+
+  if (!flooding)
+  {
+    return;
+  }
+
+  if (millis() - floodStartTime >= floodDuration)
+  {
+    flooding = false;
+    Serial.printf("Benchmark: %lu frames de enchimento enviados\n", (unsigned long)floodFramesSent);
+    return;
+  }
+
+  // Mantém a fila de transmissão cheia: o estimulador recebe frames o tempo todo
+  uint8_t filler[8] = {0};
+  for (int i = 0; i < 4; i++)
+  {
+    twaiSendPayload(TwaiSendMessageKind::BenchFiller, filler, sizeof(filler));
+    floodFramesSent++;
+  }
+}
+
+void diagnosticsOnTWAIMessage(TwaiReceivedMessage *receivedMessage)
+{
+  switch (receivedMessage->Kind)
+  {
+  case TwaiReceivedMessageKind::ReceiveStatsReport:
+    // A cada segundo: [frames lidos do driver u16][mensagens entregues u16][frames descartados u8]
+    // [frames perdidos no driver ou mensagens na fila u8][pico da fila u8][pico do atraso de entrega em 100 us u8]
+    stimulatorReceivedFrames = (receivedMessage->Payload[0] << 8) | receivedMessage->Payload[1];
+    stimulatorRejectedFrames = receivedMessage->Payload[4];
+    stimulatorLostFrames = receivedMessage->Payload[5];
+    stimulatorMaxQueueDepth = receivedMessage->Payload[6];
+    stimulatorMaxLatencyMicros = receivedMessage->Payload[7] * 100;
+    break;
+  case TwaiReceivedMessageKind::PulseTimingReport:
+  {
+    // [seletor][mínimo i16][máximo i16][p99 u16][deadlines perdidos u8], big-endian
+    const uint8_t *payload = receivedMessage->Payload;
+    uint8_t metric = payload[0] & 0x7F;
+    bool bench = (payload[0] & 0x80) != 0;
+    int16_t minimum = (int16_t)((payload[1] << 8) | payload[2]);
+    int16_t maximum = (int16_t)((payload[3] << 8) | payload[4]);
+    uint16_t p99 = (payload[5] << 8) | payload[6];
+    uint8_t missed = payload[7];
+
+    if (!bench)
+    {
+      ESP_LOGD(TAG, "Temporização (%u): min=%d max=%d p99=%u perdidos=%u", metric, minimum, maximum, p99, missed);
+      break;
+    }
+
+    Serial.printf("Benchmark %s: desvio min=%d us, max=%d us, p99<=%u us, deadlines perdidos=%u\n",
+                  metric < 3 ? METRIC_NAMES[metric] : "?", minimum, maximum, p99, missed);
+    break;
+  }
+  }
+}
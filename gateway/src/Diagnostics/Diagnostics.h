@@ -0,0 +1,16 @@
+#pragma once
+#include <stdint.h>
+#include "../Twai/Twai.h"
+
+// Pulsos do benchmark de temporização do estimulador
+#define DIAGNOSTICS_BENCH_PULSE_COUNT 200
+
+// Estimativa da duração de um pulso do benchmark, para saber quando parar de inundar o barramento
+#define DIAGNOSTICS_BENCH_PULSE_PERIOD_MS 30
+
+// Intervalo entre os registros de carga do barramento
+#define DIAGNOSTICS_BUS_LOAD_INTERVAL_MS 1000
+
+void diagnosticsStartPulseBenchmark(uint16_t pulseCount);
+void diagnosticsLoop();
+void diagnosticsOnTWAIMessage(TwaiReceivedMessage *receivedMessage);
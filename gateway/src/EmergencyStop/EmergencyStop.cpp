@@ -0,0 +1,135 @@
+#include "EmergencyStop.h"
+#include "../Clock/ClockSync.h"
+#include "../Nodes/Nodes.h"
+#include <Arduino.h>
+#include <esp_log.h>
+#include <string.h>
+
+static const char *TAG = "EmergencyStop";
+
+static EmergencyStopTimings timings;
+static bool waitingAck = false;
+static unsigned long lastSendTime = 0;
+
+// Estimuladores presentes no comando que ainda não confirmaram ou não zeraram (bit i = endereço i). Sem
+// nenhum estimulador conhecido, a primeira resposta basta.
+static uint8_t pendingAckNodes = 0;
+static uint8_t pendingZeroNodes = 0;
+static bool zeroReported = false;
+static bool zeroOutputUnknown = false;
+
+static uint32_t readU32(const uint8_t *bytes)
+{
+  return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+}
+
+// A fila de transmissão é FIFO: sem descartá-la, a parada esperaria os frames enfileirados antes dela
+static void sendFrame()
+{
+  uint8_t payload[1] = {timings.sequence};
+  twaiClearTransmitQueue();
+  twaiSendPayload(TwaiSendMessageKind::EmergencyStop, payload, sizeof(payload));
+  timings.attempts++;
+  lastSendTime = millis();
+}
+
+void emergencyStopTrigger()
+{
+  uint32_t now_us = micros();
+  uint8_t sequence = timings.sequence + 1;
+
+  memset(&timings, 0, sizeof(timings));
+  timings.sequence = sequence;
+  timings.commandMicros = now_us;
+
+  sendFrame();
+  timings.sentMicros = micros();
+  waitingAck = true;
+  pendingAckNodes = nodesGetPresentMask();
+  pendingZeroNodes = pendingAckNodes;
+  zeroReported = false;
+  zeroOutputUnknown = false;
+}
+
+void emergencyStopLoop()
+{
+  if (!waitingAck || millis() - lastSendTime < EMERGENCY_STOP_RESEND_INTERVAL_MS)
+  {
+    return;
+  }
+
+  if (timings.attempts >= EMERGENCY_STOP_MAX_ATTEMPTS)
+  {
+    ESP_LOGE(TAG, "Parada de emergência #%u sem confirmação após %u tentativas (estimuladores 0x%02X)",
+             timings.sequence, timings.attempts, pendingAckNodes);
+    waitingAck = false;
+    return;
+  }
+
+  sendFrame();
+}
+
+void emergencyStopOnTWAIMessage(TwaiReceivedMessage *receivedMessage)
+{
+  switch (receivedMessage->Kind)
+  {
+  case TwaiReceivedMessageKind::EmergencyStopAck:
+    if (receivedMessage->Payload[0] == timings.sequence && waitingAck)
+    {
+      // Os estimuladores que já confirmaram recebem os reenvios e confirmam de novo
+      pendingAckNodes &= ~(1 << receivedMessage->Node);
+      if (pendingAckNodes != 0)
+        break;
+
+      waitingAck = false;
+      timings.ackMicros = receivedMessage->ReceivedMicros;
+    }
+    break;
+  case TwaiReceivedMessageKind::EmergencyStopZeroReached:
+    if (receivedMessage->Payload[0] == timings.sequence && !zeroReported)
+    {
+      // [sequência u8][recepção até o zero em us u24][instante do zero no relógio do estimulador u32]
+      const uint8_t *payload = receivedMessage->Payload;
+      uint32_t toZeroMicros = ((uint32_t)payload[1] << 16) | (payload[2] << 8) | payload[3];
+      if (toZeroMicros > timings.stimulatorToZeroMicros)
+        timings.stimulatorToZeroMicros = toZeroMicros;
+
+      // Com vários estimuladores, vale o último a zerar; um sem sincronização deixa o instante desconhecido
+      uint32_t zeroOutputMicros;
+      NodeTimestamp zeroOutput = {receivedMessage->Node, readU32(&payload[4])};
+      if (!clockSyncToGatewayMicros(zeroOutput, &zeroOutputMicros))
+        zeroOutputUnknown = true;
+      else if (timings.zeroOutputMicros == 0 || (int32_t)(zeroOutputMicros - timings.zeroOutputMicros) > 0)
+        timings.zeroOutputMicros = zeroOutputMicros;
+
+      pendingZeroNodes &= ~(1 << receivedMessage->Node);
+      if (pendingZeroNodes != 0)
+        break;
+
+      zeroReported = true;
+      timings.zeroReachedMicros = receivedMessage->ReceivedMicros;
+      if (zeroOutputUnknown)
+        timings.zeroOutputMicros = 0;
+
+      ESP_LOGW(TAG, "Parada de emergência #%u: envio %lu us, confirmação %lu us, saída zerada %lu us após o comando "
+                    "(estimulador: %lu us da recepção ao zero, %u tentativa(s))",
+               timings.sequence, (unsigned long)(timings.sentMicros - timings.commandMicros),
+               (unsigned long)(timings.ackMicros - timings.commandMicros),
+               (unsigned long)(timings.zeroReachedMicros - timings.commandMicros),
+               (unsigned long)timings.stimulatorToZeroMicros, timings.attempts);
+
+      // Sem a fila de transmissão do estimulador e o frame de volta
+      if (timings.zeroOutputMicros != 0)
+        ESP_LOGW(TAG, "Parada de emergência #%u: saída zerada de fato %ld us após o comando (relógio sincronizado)",
+                 timings.sequence, (long)(int32_t)(timings.zeroOutputMicros - timings.commandMicros));
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+EmergencyStopTimings emergencyStopGetTimings()
+{
+  return timings;
+}
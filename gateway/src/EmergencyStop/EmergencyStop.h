@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+#include "../Twai/Twai.h"
+
+// Sem confirmação do estimulador depois deste tempo, o frame de parada é reenviado
+#define EMERGENCY_STOP_RESEND_INTERVAL_MS 10
+
+// Tentativas de envio antes de desistir; a parada segura por perda de enlace continua valendo
+#define EMERGENCY_STOP_MAX_ATTEMPTS 20
+
+/**
+ * Instantes de uma parada de emergência, em us. Os do gateway são no relógio do gateway;
+ * os do estimulador são durações medidas por ele a partir da recepção do frame, exceto
+ * zeroOutputMicros, o instante em que a saída zerou levado ao relógio do gateway (0 sem sincronização).
+ * Com vários estimuladores, a confirmação e o zero são os do último a responder, e a duração no
+ * estimulador é a maior.
+ */
+struct EmergencyStopTimings
+{
+    uint8_t sequence;
+    uint32_t commandMicros;
+    uint32_t sentMicros;
+    uint32_t ackMicros;
+    uint32_t zeroReachedMicros;
+    uint32_t stimulatorToZeroMicros;
+    uint32_t zeroOutputMicros;
+    uint8_t attempts;
+};
+
+/**
+ * Envia o frame EmergencyStop (identificador 0x00, a maior prioridade do barramento).
+ * Chamado direto do tratador de escrita do BLE, antes de a máquina de estados ver o comando.
+ */
+void emergencyStopTrigger();
+
+void emergencyStopLoop();
+void emergencyStopOnTWAIMessage(TwaiReceivedMessage *receivedMessage);
+
+EmergencyStopTimings emergencyStopGetTimings();
@@ -0,0 +1,108 @@
+#include "Heartbeat.h"
+#include "../StateManager.h"
+#include <Arduino.h>
+#include <esp_log.h>
+
+static const char *TAG = "Heartbeat";
+
+static uint16_t sequence = 0;
+static unsigned long lastHeartbeatTime = 0;
+static unsigned long lastTimeoutSendTime = 0;
+static uint8_t lastReportedLosses = 0;
+
+// Pior período do loop principal na janela atual e na anterior
+static unsigned long lastLoopTime = 0;
+static unsigned long worstLoopMs = 0;
+static unsigned long previousWorstLoopMs = 0;
+static uint16_t linkTimeoutMs = HEARTBEAT_MIN_LINK_TIMEOUT_MS;
+
+static uint16_t linkTimeoutFor(unsigned long loopPeriodMs)
+{
+  unsigned long timeout = 2 * loopPeriodMs + HEARTBEAT_INTERVAL_MS;
+  if (timeout < HEARTBEAT_MIN_LINK_TIMEOUT_MS)
+    return HEARTBEAT_MIN_LINK_TIMEOUT_MS;
+  if (timeout > HEARTBEAT_MAX_LINK_TIMEOUT_MS)
+    return HEARTBEAT_MAX_LINK_TIMEOUT_MS;
+  return timeout;
+}
+
+static void sendLinkTimeout(unsigned long now)
+{
+  lastTimeoutSendTime = now;
+  twaiSend(TwaiSendMessageKind::SetLinkTimeout, linkTimeoutMs);
+}
+
+void heartbeatBegin()
+{
+  sequence = 0;
+  lastHeartbeatTime = millis();
+  lastLoopTime = millis();
+  worstLoopMs = 0;
+  previousWorstLoopMs = 0;
+  linkTimeoutMs = HEARTBEAT_MIN_LINK_TIMEOUT_MS;
+  sendLinkTimeout(millis());
+}
+
+void heartbeatLoop()
+{
+  unsigned long now = millis();
+
+  unsigned long loopPeriodMs = now - lastLoopTime;
+  lastLoopTime = now;
+  if (loopPeriodMs > worstLoopMs)
+    worstLoopMs = loopPeriodMs;
+
+  // Um loop mais lento que o previsto sobe o timeout na hora, antes que ele se repita
+  if (linkTimeoutFor(worstLoopMs) > linkTimeoutMs)
+  {
+    linkTimeoutMs = linkTimeoutFor(worstLoopMs);
+    ESP_LOGW(TAG, "Loop de %lu ms, timeout do enlace: %u ms", loopPeriodMs, linkTimeoutMs);
+    sendLinkTimeout(now);
+  }
+
+  if (now - lastHeartbeatTime >= HEARTBEAT_INTERVAL_MS)
+  {
+    lastHeartbeatTime = now;
+    sequence++;
+
+    uint8_t payload[3];
+    payload[0] = (uint8_t)stateManager.currentKind;
+    payload[1] = sequence >> 8;
+    payload[2] = sequence & 0xFF;
+    twaiSendPayload(TwaiSendMessageKind::Heartbeat, payload, sizeof(payload));
+  }
+
+  if (now - lastTimeoutSendTime >= HEARTBEAT_TIMEOUT_RESEND_INTERVAL_MS)
+  {
+    linkTimeoutMs = linkTimeoutFor(max(worstLoopMs, previousWorstLoopMs));
+    previousWorstLoopMs = worstLoopMs;
+    worstLoopMs = 0;
+    sendLinkTimeout(now);
+  }
+}
+
+void heartbeatOnTWAIMessage(TwaiReceivedMessage *receivedMessage)
+{
+  switch (receivedMessage->Kind)
+  {
+  case TwaiReceivedMessageKind::LinkStatusReport:
+  {
+    // [perdas u8][heartbeats rejeitados u8][latência da última detecção ms u16][latência máxima ms u16]
+    const uint8_t *payload = receivedMessage->Payload;
+    uint8_t losses = payload[0];
+    uint8_t rejected = payload[1];
+    uint16_t lastLatency = (payload[2] << 8) | payload[3];
+    uint16_t maxLatency = (payload[4] << 8) | payload[5];
+
+    if (losses != lastReportedLosses)
+    {
+      lastReportedLosses = losses;
+      ESP_LOGW(TAG, "Estimulador perdeu o enlace %u vez(es). Detecção: última %u ms, máxima %u ms. Rejeitados: %u",
+               losses, lastLatency, maxLatency, rejected);
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+#include "../Twai/Twai.h"
+
+// Período do heartbeat enviado ao estimulador
+#define HEARTBEAT_INTERVAL_MS 10
+
+// Silêncio, em ms, depois do qual o estimulador considera o gateway perdido e inicia a parada segura.
+// É derivado do pior período medido do loop principal (que envia o heartbeat): duas vezes o pior período
+// mais o intervalo do heartbeat, dentro da faixa abaixo. O estimulador não aceita menos que 30 ms.
+#define HEARTBEAT_MIN_LINK_TIMEOUT_MS 100
+#define HEARTBEAT_MAX_LINK_TIMEOUT_MS 500
+
+// O timeout é reenviado periodicamente, para o caso de o estimulador reiniciar. Também é a janela da medição
+// do pior período do loop: o timeout sobe assim que um loop mais lento aparece e só desce depois de duas
+// janelas sem ele.
+#define HEARTBEAT_TIMEOUT_RESEND_INTERVAL_MS 1000
+
+void heartbeatBegin();
+
+/**
+ * Envia o heartbeat: [estado do gateway u8][sequência u16].
+ * Chamado no loop principal depois da máquina de estados, então um gateway travado para de enviá-lo.
+ */
+void heartbeatLoop();
+
+// Mostra o relatório de enlace enviado pelo estimulador
+void heartbeatOnTWAIMessage(TwaiReceivedMessage *receivedMessage);
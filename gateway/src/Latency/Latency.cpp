@@ -0,0 +1,177 @@
+#include "Latency.h"
+#include "../Clock/ClockSync.h"
+#include "../Nodes/Nodes.h"
+#include <Arduino.h>
+#include <esp_log.h>
+
+static const char *TAG = "Latency";
+
+static uint16_t sequence = 0;
+static uint32_t pingSentMicros = 0;
+
+// Estimuladores presentes no envio do ping e os que já responderam (bit i = endereço i)
+static uint8_t expectedNodes = 0;
+static uint8_t answeredNodes = 0;
+
+// Fim do ping no barramento, o mesmo para todos os echos dele
+static bool pingBusKnown = false;
+static uint32_t pingBusMicros = 0;
+static unsigned long lastPingTime = 0;
+static unsigned long lastReportTime = 0;
+
+// Janela móvel: as amostras, na ordem de chegada, e o histograma delas
+static uint32_t window[LATENCY_WINDOW_SAMPLES];
+static uint16_t windowHead = 0;
+static uint16_t windowCount = 0;
+static uint16_t histogram[LATENCY_BUCKET_COUNT];
+
+static uint32_t lost = 0;
+static uint32_t lastResidenceMicros = 0;
+
+static uint16_t bucketOf(uint32_t micros)
+{
+  uint32_t bucket = micros / LATENCY_BUCKET_MICROS;
+  return bucket >= LATENCY_BUCKET_COUNT ? LATENCY_BUCKET_COUNT - 1 : bucket;
+}
+
+static void addSample(uint32_t micros)
+{
+  if (windowCount == LATENCY_WINDOW_SAMPLES)
+    histogram[bucketOf(window[windowHead])]--;
+  else
+    windowCount++;
+
+  window[windowHead] = micros;
+  histogram[bucketOf(micros)]++;
+  windowHead = (windowHead + 1) % LATENCY_WINDOW_SAMPLES;
+}
+
+// Limite superior da faixa que contém o percentil `permille`
+static uint32_t percentile(uint16_t permille)
+{
+  if (windowCount == 0)
+    return 0;
+
+  uint32_t rank = ((uint32_t)windowCount * permille + 999) / 1000;
+  uint32_t seen = 0;
+  for (uint16_t i = 0; i < LATENCY_BUCKET_COUNT; i++)
+  {
+    seen += histogram[i];
+    if (seen >= rank)
+      return (i + 1) * LATENCY_BUCKET_MICROS;
+  }
+  return LATENCY_BUCKET_COUNT * LATENCY_BUCKET_MICROS;
+}
+
+void latencyBegin()
+{
+  sequence = 0;
+  expectedNodes = 0;
+  answeredNodes = 0;
+  lastPingTime = millis();
+  lastReportTime = millis();
+}
+
+static void sendPing()
+{
+  sequence++;
+
+  uint8_t payload[2];
+  payload[0] = sequence >> 8;
+  payload[1] = sequence & 0xFF;
+
+  // Com carimbo de transmissão: o fim do ping no barramento abre uma troca da sincronização de relógio
+  pingSentMicros = micros();
+  pingBusKnown = false;
+  answeredNodes = 0;
+  bool sent = twaiSendTimestamped(TwaiSendMessageKind::LatencyPing, payload, sizeof(payload));
+  expectedNodes = sent ? nodesGetPresentMask() : 0;
+}
+
+static void report()
+{
+  LatencyStats stats = latencyGetStats();
+
+  char line[64];
+  int length = snprintf(line, sizeof(line), "L,%u,%u,%u,%u,%u,%u\n", stats.samples, stats.lost, stats.p50Micros,
+                        stats.p99Micros, stats.maxMicros, stats.lastResidenceMicros);
+  if (length <= 0 || Serial.availableForWrite() < length)
+    return;
+  Serial.write((const uint8_t *)line, length);
+}
+
+void latencyLoop()
+{
+  unsigned long now = millis();
+
+  if (now - lastPingTime >= LATENCY_PING_INTERVAL_MS)
+  {
+    lastPingTime = now;
+    uint8_t missing = expectedNodes & ~answeredNodes;
+    for (uint8_t node = 1; node <= NODES_MAX_ADDRESS; node++)
+    {
+      if (missing & (1 << node))
+      {
+        lost++;
+        ESP_LOGD(TAG, "Ping %u sem resposta do estimulador %u", sequence, node);
+      }
+    }
+    sendPing();
+  }
+
+  if (now - lastReportTime >= LATENCY_REPORT_INTERVAL_MS)
+  {
+    lastReportTime = now;
+    report();
+  }
+}
+
+void latencyOnTWAIMessage(TwaiReceivedMessage *receivedMessage)
+{
+  if (receivedMessage->Kind != TwaiReceivedMessageKind::LatencyEcho)
+    return;
+
+  const uint8_t *payload = receivedMessage->Payload;
+  uint16_t echoedSequence = (payload[0] << 8) | payload[1];
+
+  // Resposta atrasada de um ping já dado como perdido, ou repetida
+  uint8_t node = receivedMessage->Node;
+  if (echoedSequence != sequence || (answeredNodes & (1 << node)))
+    return;
+
+  answeredNodes |= 1 << node;
+
+  // Até a recepção do echo pelo driver: o tempo que ele esperou na fila até o loop não é do caminho medido
+  addSample(receivedMessage->ReceivedMicros - pingSentMicros);
+
+  uint32_t pingReceivedMicros =
+      ((uint32_t)payload[2] << 24) | ((uint32_t)payload[3] << 16) | (payload[4] << 8) | payload[5];
+  uint16_t previousResidence = (payload[6] << 8) | payload[7];
+  if (previousResidence != UINT16_MAX)
+    lastResidenceMicros = previousResidence;
+
+  // O fim do ping no barramento já foi visto: a tarefa de recepção o tratou antes do primeiro echo
+  if (!pingBusKnown)
+    pingBusKnown = twaiTakeTransmitTimestamp(TwaiSendMessageKind::LatencyPing, &pingBusMicros);
+  if (pingBusKnown)
+    clockSyncOnExchange(node, sequence, pingBusMicros, pingReceivedMicros, receivedMessage->ReceivedMicros,
+                        previousResidence);
+}
+
+LatencyStats latencyGetStats()
+{
+  LatencyStats stats;
+  stats.samples = windowCount;
+  stats.lost = lost;
+  stats.p50Micros = percentile(500);
+  stats.p99Micros = percentile(990);
+  stats.lastResidenceMicros = lastResidenceMicros;
+
+  stats.maxMicros = 0;
+  for (uint16_t i = 0; i < windowCount; i++)
+  {
+    if (window[i] > stats.maxMicros)
+      stats.maxMicros = window[i];
+  }
+  return stats;
+}
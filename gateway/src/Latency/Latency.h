@@ -0,0 +1,62 @@
+#pragma once
+#include <stdint.h>
+#include "../Twai/Twai.h"
+
+/**
+ * Tempo de ida e volta do caminho de controle. O gateway envia LatencyPing pelo loop, como envia o PWM;
+ * o estimulador o recebe pela fila do loop e só responde (LatencyEcho) depois de rodar a máquina de
+ * estados, como faz com o feedback de PWM. Os dois frames ficam na faixa de controle, logo abaixo dos
+ * frames que medem, e disputam a arbitragem como eles.
+ *
+ * Ping: [sequência u16]
+ * Echo: [sequência u16][chegada do ping no estimulador u32][residência do echo anterior us u16]
+ *
+ * Os dois frames saem com carimbo de transmissão, e a mesma troca alimenta a sincronização de relógio
+ * (ClockSync.h). A residência é do ping anterior: da chegada dele ao fim do echo no barramento, medida
+ * só depois de o echo sair. UINT16_MAX = desconhecida.
+ *
+ * O ping vai para todos os estimuladores, e cada um responde com o próprio echo. As amostras de todos
+ * entram no mesmo histograma; um ping conta como perdido uma vez para cada estimulador presente que não
+ * respondeu.
+ */
+
+// Intervalo entre pings. Um ping sem resposta até o seguinte conta como perdido.
+#define LATENCY_PING_INTERVAL_MS 100
+
+// Amostras da janela móvel do histograma (~25 s com o intervalo acima)
+#define LATENCY_WINDOW_SAMPLES 256
+
+// Histograma em faixas de 50 us até 10 ms; acima disso, a amostra fica na última faixa
+#define LATENCY_BUCKET_MICROS 50
+#define LATENCY_BUCKET_COUNT 200
+
+// Intervalo entre as linhas na serial
+#define LATENCY_REPORT_INTERVAL_MS 5000
+
+struct LatencyStats
+{
+  // Amostras na janela e respostas perdidas desde o boot
+  uint16_t samples;
+  uint32_t lost;
+
+  // Da janela. Os percentis são o limite superior da faixa do histograma.
+  uint32_t p50Micros;
+  uint32_t p99Micros;
+  uint32_t maxMicros;
+
+  // Tempo entre a chegada de um ping no estimulador e o fim da resposta no barramento, do último conhecido
+  uint32_t lastResidenceMicros;
+};
+
+void latencyBegin();
+
+/**
+ * Envia o ping e, a cada LATENCY_REPORT_INTERVAL_MS, uma linha na serial:
+ *   L,amostras,perdidos,p50_us,p99_us,máximo_us,residência_us
+ * Se a serial não tiver espaço, a linha é descartada em vez de bloquear o loop.
+ */
+void latencyLoop();
+
+void latencyOnTWAIMessage(TwaiReceivedMessage *receivedMessage);
+
+LatencyStats latencyGetStats();
@@ -0,0 +1,204 @@
+#include "Nodes.h"
+#include "../Twai/TwaiBitrate.h"
+#include <Arduino.h>
+#include <esp_log.h>
+#include <string.h>
+
+static const char *TAG = "Nodes";
+
+// Indexado pelo endereço; o 0 é o do gateway e fica sem uso
+static NodeState nodes[NODES_MAX_ADDRESS + 1];
+
+static uint8_t announcedShare = 0;
+static uint8_t selectedNode = 1;
+
+static void resetNode(uint8_t node)
+{
+  memset(&nodes[node], 0, sizeof(NodeState));
+  nodes[node].pwmPercent = 100;
+}
+
+void nodesBegin()
+{
+  for (uint8_t node = 0; node <= NODES_MAX_ADDRESS; node++)
+    resetNode(node);
+  announcedShare = 0;
+
+  twaiSend(TwaiSendMessageKind::NodeDiscover, 0);
+}
+
+uint8_t nodesGetPresentMask()
+{
+  uint8_t mask = 0;
+  for (uint8_t node = 1; node <= NODES_MAX_ADDRESS; node++)
+  {
+    if (nodes[node].present)
+      mask |= 1 << node;
+  }
+  return mask;
+}
+
+uint8_t nodesGetCount()
+{
+  uint8_t count = 0;
+  for (uint8_t node = 1; node <= NODES_MAX_ADDRESS; node++)
+  {
+    if (nodes[node].present)
+      count++;
+  }
+  return count;
+}
+
+// Placas presentes (1 sem nenhuma) vezes o multiplicador da taxa em uso
+static uint8_t currentShare()
+{
+  uint8_t count = nodesGetCount();
+  return (count > 0 ? count : 1) * twaiBitrateShareScale();
+}
+
+static void sendShare()
+{
+  announcedShare = currentShare();
+  twaiSend(TwaiSendMessageKind::SetBusShare, announcedShare);
+}
+
+void nodesLoop()
+{
+  unsigned long now = millis();
+  for (uint8_t node = 1; node <= NODES_MAX_ADDRESS; node++)
+  {
+    if (nodes[node].present && now - nodes[node].lastSeenTime >= NODES_TIMEOUT_MS)
+    {
+      ESP_LOGW(TAG, "Estimulador %u saiu do barramento", node);
+      uint8_t pwmPercent = nodes[node].pwmPercent;
+      resetNode(node);
+      nodes[node].pwmPercent = pwmPercent;
+    }
+  }
+
+  if (currentShare() != announcedShare)
+    sendShare();
+}
+
+static uint8_t lowestFreeAddress()
+{
+  for (uint8_t node = 1; node <= NODES_MAX_ADDRESS; node++)
+  {
+    if (!nodes[node].present)
+      return node;
+  }
+  return 0;
+}
+
+static void onAnnounce(uint8_t node, const uint8_t *mac)
+{
+  NodeState *state = &nodes[node];
+  if (!state->macKnown || memcmp(state->mac, mac, sizeof(state->mac)) == 0)
+  {
+    if (!state->macKnown)
+      ESP_LOGI(TAG, "Estimulador %u: MAC %02X:%02X:%02X:%02X:%02X:%02X", node, mac[0], mac[1], mac[2], mac[3],
+               mac[4], mac[5]);
+    state->macKnown = true;
+    memcpy(state->mac, mac, sizeof(state->mac));
+
+    // Acabou de ligar: não sabe quantos dividem o barramento
+    sendShare();
+    return;
+  }
+
+  // Duas placas no mesmo endereço: a que se anunciou agora muda de endereço
+  uint8_t assigned = lowestFreeAddress();
+  if (assigned == 0)
+  {
+    ESP_LOGE(TAG, "Endereço %u em uso por duas placas e nenhum endereço livre", node);
+    return;
+  }
+
+  ESP_LOGW(TAG, "Endereço %u em uso por outra placa; a de MAC %02X:%02X:%02X:%02X:%02X:%02X vai para o %u", node,
+           mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], assigned);
+  uint8_t payload[7];
+  memcpy(payload, mac, 6);
+  payload[6] = assigned;
+  twaiSendPayload(TwaiSendMessageKind::NodeAssign, payload, sizeof(payload));
+}
+
+void nodesOnTWAIMessage(TwaiReceivedMessage *receivedMessage)
+{
+  uint8_t node = receivedMessage->Node;
+  if (node == TWAI_BROADCAST_NODE)
+    return;
+
+  NodeState *state = &nodes[node];
+  if (!state->present)
+  {
+    state->present = true;
+    ESP_LOGI(TAG, "Estimulador %u entrou no barramento", node);
+    if (nodesGetCount() > twaiBitrateMaxNodes())
+      ESP_LOGE(TAG, "%u estimuladores no barramento; a %u bit/s, os prazos só valem até %u", nodesGetCount(),
+               twaiGetBitrate(), twaiBitrateMaxNodes());
+  }
+  state->lastSeenTime = millis();
+
+  switch (receivedMessage->Kind)
+  {
+  case TwaiReceivedMessageKind::NodeAnnounce:
+    onAnnounce(node, receivedMessage->Payload);
+    break;
+  case TwaiReceivedMessageKind::PwmFeedbackEstimulador:
+    state->pwmFeedback = receivedMessage->ExtraData;
+    break;
+  default:
+    break;
+  }
+}
+
+void nodesOnBLEControl(BluetoothControlCode code, uint8_t extraData)
+{
+  switch (code)
+  {
+  case BluetoothControlCode::Nodes_SelectNode:
+    if (extraData < 1 || extraData > NODES_MAX_ADDRESS)
+    {
+      ESP_LOGW(TAG, "Endereço inválido: %u", extraData);
+      break;
+    }
+    selectedNode = extraData;
+    break;
+  case BluetoothControlCode::Nodes_SetPwmPercent:
+    nodes[selectedNode].pwmPercent = extraData > 100 ? 100 : extraData;
+    ESP_LOGI(TAG, "Estimulador %u: %u%% do PWM pedido", selectedNode, nodes[selectedNode].pwmPercent);
+    break;
+  default:
+    break;
+  }
+}
+
+bool nodesIsPrimary(uint8_t node)
+{
+  for (uint8_t candidate = 1; candidate <= NODES_MAX_ADDRESS; candidate++)
+  {
+    if (nodes[candidate].present)
+      return candidate == node;
+  }
+  return true;
+}
+
+bool nodesHaveUniformPwm()
+{
+  for (uint8_t node = 1; node <= NODES_MAX_ADDRESS; node++)
+  {
+    if (nodes[node].present && nodes[node].pwmPercent != 100)
+      return false;
+  }
+  return true;
+}
+
+uint16_t nodesScalePwm(uint8_t node, uint16_t pwm)
+{
+  return (uint32_t)pwm * nodes[node].pwmPercent / 100;
+}
+
+const NodeState *nodesGet(uint8_t node)
+{
+  return &nodes[node & TWAI_NODE_MASK];
+}
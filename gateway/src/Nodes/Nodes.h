@@ -0,0 +1,73 @@
+#pragma once
+#include <stdint.h>
+#include "../Twai/Twai.h"
+#include "../Bluetooth/Bluetooth.h"
+
+/**
+ * Estimuladores no barramento, pelo endereço de cada um (1 a 7, o campo de nó do identificador; ver
+ * TwaiFilter.h). Um estimulador está presente enquanto chega algum frame dele.
+ *
+ * Descoberta: no boot, o gateway envia NodeDiscover e cada estimulador responde com NodeAnnounce
+ * ([MAC 6]); um estimulador que liga depois se anuncia sozinho. Se um anúncio chega de um endereço que
+ * já é de outra placa, o gateway manda a placa nova para o menor endereço livre (NodeAssign:
+ * [MAC 6][endereço u8]); ela guarda o endereço e reinicia.
+ *
+ * Escalonamento: o gateway informa aos estimuladores quantos estão presentes (SetBusShare), e cada um
+ * espaça na mesma proporção o feedback de PWM e a telemetria do controle; a 250 kbit/s, o dobro
+ * (twaiBitrateShareScale). O resto dos frames de cada estimulador é pouco frequente. Quantas placas cabem nos
+ * prazos depende da taxa do barramento (twaiBitrateMaxNodes, conferido por tools/can_rta.py).
+ */
+
+// O maior endereço que cabe no campo de nó
+#define NODES_MAX_ADDRESS 7
+
+// Sem nenhum frame de um estimulador por este tempo, ele saiu do barramento. O feedback de PWM sai a
+// cada 5 ms vezes o número de placas, e o BusHealthReport a cada segundo.
+#define NODES_TIMEOUT_MS 1000
+
+struct NodeState
+{
+  bool present;
+
+  // Falso até o primeiro NodeAnnounce do endereço
+  bool macKnown;
+  uint8_t mac[6];
+
+  unsigned long lastSeenTime;
+
+  // Último PwmFeedbackEstimulador
+  uint16_t pwmFeedback;
+
+  // Fração do PWM pedido enviada a esta placa, em %
+  uint8_t pwmPercent;
+};
+
+void nodesBegin();
+
+// Expira os estimuladores calados e reenvia SetBusShare quando a contagem muda
+void nodesLoop();
+
+// Chamado com todas as mensagens, de qualquer estimulador
+void nodesOnTWAIMessage(TwaiReceivedMessage *receivedMessage);
+
+// Trata Nodes_SelectNode e Nodes_SetPwmPercent
+void nodesOnBLEControl(BluetoothControlCode code, uint8_t extraData);
+
+// Bit i = estimulador de endereço i presente
+uint8_t nodesGetPresentMask();
+
+uint8_t nodesGetCount();
+
+/**
+ * Verdadeiro para o estimulador de menor endereço presente, ou para qualquer um enquanto nenhum foi
+ * visto. A máquina de estados, os relatórios e a telemetria acompanham só ele.
+ */
+bool nodesIsPrimary(uint8_t node);
+
+// Verdadeiro se todas as placas presentes recebem o PWM pedido inteiro: o comando pode ir para todos
+bool nodesHaveUniformPwm();
+
+// PWM pedido levado à fração de `node`
+uint16_t nodesScalePwm(uint8_t node, uint16_t pwm);
+
+const NodeState *nodesGet(uint8_t node);
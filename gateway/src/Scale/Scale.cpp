@@ -44,9 +44,12 @@ void switchScale(Scale scaleId)
     }
 }
 
-void readScale(Scale scaleId)
+// Lê a balança só se a conversão já terminou; scale.read() espera por ela, até 100 ms a 10 amostras/s
+bool readScaleIfReady(Scale scaleId)
 {
     switchScale(scaleId);
+    if (!scale.is_ready())
+        return false;
 
     currentReading[scaleId] = scale.read() - baseReading[scaleId];
     float value = (currentReading[scaleId] / CORRECAO[scaleId]);
@@ -57,6 +60,7 @@ void readScale(Scale scaleId)
     }
 
     readingRing[scaleId][ringIndex] = value;
+    return true;
 }
 
 float scaleGetMeasurement(Scale scaleId)
@@ -74,6 +78,12 @@ float scaleGetMeasurement(Scale scaleId)
     return menor;
 }
 
+// Balanças já lidas na amostra em andamento
+static bool sampleRead[4] = {false, false, false, false};
+
+static uint8_t sampleSequence = 0;
+static unsigned long sampleTime = 0;
+
 void scaleBeginOrDie()
 {
     ESP_LOGI(TAG, "Scale setup");
@@ -94,19 +104,30 @@ void scaleBeginOrDie()
     baseReading[Scale::D] = scale.read_average();
 }
 
-// scaleUpdate reads all the scales values and saves them.
+// scaleUpdate reads the scales whose conversion is ready, without blocking the main loop. The sample is
+// complete once all four have been read.
 void scaleUpdate()
 {
-    readScale(Scale::A);
-    readScale(Scale::B);
-    readScale(Scale::C);
-    readScale(Scale::D);
+    bool sampleComplete = true;
+    for (int scaleId = Scale::A; scaleId <= Scale::D; scaleId++)
+    {
+        if (!sampleRead[scaleId])
+            sampleRead[scaleId] = readScaleIfReady((Scale)scaleId);
+        sampleComplete = sampleComplete && sampleRead[scaleId];
+    }
+
+    if (!sampleComplete)
+        return;
+    memset(sampleRead, 0, sizeof(sampleRead));
 
     ringIndex++;
     if (ringIndex >= SCALE_RING_BUFFER_SIZE)
     {
         ringIndex = 0;
     }
+
+    sampleSequence++;
+    sampleTime = millis();
 }
 
 int scaleGetWeightL()
@@ -123,4 +144,14 @@ int scaleGetTotalWeight()
 {
     return scaleGetWeightL() + scaleGetWeightR();
 }
+
+uint8_t scaleGetSampleSequence()
+{
+    return sampleSequence;
+}
+
+unsigned long scaleGetSampleTime()
+{
+    return sampleTime;
+}
 #endif
@@ -1,3 +1,6 @@
+#pragma once
+#include <stdint.h>
+
 enum Scale
 {
     A,
@@ -13,3 +16,9 @@ void scaleUpdate();
 int scaleGetWeightL();
 int scaleGetWeightR();
 int scaleGetTotalWeight();
+
+// Incrementa a cada leitura nova das balanças; identifica a amostra enviada ao estimulador
+uint8_t scaleGetSampleSequence();
+
+// millis() da leitura mais recente
+unsigned long scaleGetSampleTime();
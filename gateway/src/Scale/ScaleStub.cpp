@@ -36,6 +36,9 @@ void readScale(Scale scaleId)
   correctedReadingKg[scaleId] = medida + CORRECAO[scaleId];
 }
 
+static uint8_t sampleSequence = 0;
+static unsigned long sampleTime = 0;
+
 void scaleBeginOrDie()
 {
 
@@ -50,6 +53,9 @@ void scaleUpdate()
   readScale(Scale::B);
   readScale(Scale::C);
   readScale(Scale::D);
+
+  sampleSequence++;
+  sampleTime = millis();
 }
 
 int scaleGetMeasurement(Scale whichOne)
@@ -71,4 +77,14 @@ int scaleGetTotalWeight()
 {
   return scaleGetWeightL() + scaleGetWeightR();
 }
+
+uint8_t scaleGetSampleSequence()
+{
+  return sampleSequence;
+}
+
+unsigned long scaleGetSampleTime()
+{
+  return sampleTime;
+}
 #endif
@@ -0,0 +1,209 @@
+#include "Sniffer.h"
+#include "../Twai/Twai.h"
+#include "../Twai/TwaiBitrate.h"
+#include <Arduino.h>
+#include <Preferences.h>
+#include <driver/twai.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+static const char *TAG = "Sniffer";
+
+static Preferences preferences;
+
+// -1 até a primeira leitura da flash
+static int8_t enabled = -1;
+
+// Escritos só pela tarefa de captura
+static uint32_t capturedFrames = 0;
+static uint32_t serialDropped = 0;
+
+bool snifferIsEnabled()
+{
+  if (enabled < 0)
+  {
+    preferences.begin("twai", true);
+    enabled = preferences.getBool("sniffer", false) ? 1 : 0;
+    preferences.end();
+  }
+  return enabled == 1;
+}
+
+void snifferSetEnabled(bool enable)
+{
+  if (enable == snifferIsEnabled())
+    return;
+
+  preferences.begin("twai", false);
+  preferences.putBool("sniffer", enable);
+  preferences.end();
+
+  ESP_LOGW(TAG, "Modo sniffer %s; reiniciando", enable ? "ligado" : "desligado");
+  Serial.flush();
+  esp_restart();
+}
+
+static uint8_t crc8(const uint8_t *data, uint8_t length)
+{
+  uint8_t crc = 0;
+  for (uint8_t i = 0; i < length; i++)
+  {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++)
+      crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+  }
+  return crc;
+}
+
+static uint8_t putU16(uint8_t *out, uint16_t value)
+{
+  out[0] = value & 0xFF;
+  out[1] = value >> 8;
+  return 2;
+}
+
+static uint8_t putU32(uint8_t *out, uint32_t value)
+{
+  for (uint8_t i = 0; i < 4; i++)
+    out[i] = (value >> (8 * i)) & 0xFF;
+  return 4;
+}
+
+// `record` já tem os dados a partir do octeto 3; completa o cabeçalho e o CRC. Sem espaço no buffer da
+// serial, o registro é descartado em vez de bloquear a captura.
+static bool writeRecord(uint8_t *record, uint8_t type, uint8_t length)
+{
+  record[0] = SNIFFER_SYNC;
+  record[1] = type;
+  record[2] = length;
+  record[3 + length] = crc8(record + 1, length + 2);
+
+  uint8_t total = length + 4;
+  if (Serial.availableForWrite() < total)
+    return false;
+  Serial.write(record, total);
+  return true;
+}
+
+static void writeFrame(uint32_t receivedMicros, const twai_message_t *message)
+{
+  uint8_t record[3 + 4 + 4 + 8 + 1];
+  uint8_t length = putU32(record + 3, receivedMicros);
+  uint8_t type;
+  if (message->extd)
+  {
+    type = SNIFFER_RECORD_EXTENDED_FRAME;
+    length += putU32(record + 3 + length, message->identifier | (message->rtr ? 0x80000000 : 0));
+  }
+  else
+  {
+    type = SNIFFER_RECORD_STANDARD_FRAME;
+    length += putU16(record + 3 + length, message->identifier | (message->rtr ? 0x8000 : 0));
+  }
+
+  // Um quadro remoto não leva octetos, qualquer que seja o DLC
+  uint8_t dataLength = message->rtr ? 0 : (message->data_length_code > 8 ? 8 : message->data_length_code);
+  memcpy(record + 3 + length, message->data, dataLength);
+  length += dataLength;
+
+  if (!writeRecord(record, type, length))
+    serialDropped++;
+}
+
+static void writeStats()
+{
+  twai_status_info_t status;
+  memset(&status, 0, sizeof(status));
+  twai_get_status_info(&status);
+
+  uint8_t record[3 + 7 * 4 + 1];
+  uint8_t length = 0;
+  length += putU32(record + 3 + length, esp_timer_get_time());
+  length += putU32(record + 3 + length, twaiGetBitrate());
+  length += putU32(record + 3 + length, capturedFrames);
+  length += putU32(record + 3 + length, serialDropped);
+  length += putU32(record + 3 + length, status.rx_missed_count);
+  length += putU32(record + 3 + length, status.rx_overrun_count);
+  length += putU32(record + 3 + length, status.bus_error_count);
+
+  // Sem espaço agora, sai no próximo intervalo; os contadores são totais desde o boot
+  writeRecord(record, SNIFFER_RECORD_STATS, length);
+}
+
+static void snifferTask(void *)
+{
+  unsigned long lastStatsTime = millis();
+  writeStats();
+
+  while (true)
+  {
+    twai_message_t message;
+    if (twai_receive(&message, pdMS_TO_TICKS(SNIFFER_STATS_INTERVAL_MS)) == ESP_OK)
+    {
+      uint32_t receivedMicros = esp_timer_get_time();
+      capturedFrames++;
+      writeFrame(receivedMicros, &message);
+    }
+
+    if (millis() - lastStatsTime >= SNIFFER_STATS_INTERVAL_MS)
+    {
+      lastStatsTime = millis();
+      writeStats();
+    }
+  }
+}
+
+void snifferStart()
+{
+  // O texto do log iria misturado aos registros
+  esp_log_level_set("*", ESP_LOG_NONE);
+
+  Serial.setTxBufferSize(SNIFFER_SERIAL_TX_BUFFER);
+  Serial.begin(SNIFFER_SERIAL_BAUD);
+
+  // A sondagem já é em somente-escuta; sem frames, fica com a taxa guardada
+  twai_timing_config_t t_config = twaiBitrateTiming(twaiBitrateSelect());
+  twai_general_config_t g_config = TWAI_GENERAL_CONFIG_DEFAULT(WIRESS_GPIO_TX, WIRESS_GPIO_RX, TWAI_MODE_LISTEN_ONLY);
+  g_config.rx_queue_len = SNIFFER_DRIVER_RX_QUEUE_LENGTH;
+  twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+
+  if (twai_driver_install(&g_config, &t_config, &f_config) != ESP_OK || twai_start() != ESP_OK)
+  {
+    // Sem log: a serial já é do sniffer. As estatísticas não saem, e o conversor acusa o silêncio.
+    return;
+  }
+
+  xTaskCreatePinnedToCore(snifferTask, "sniffer", SNIFFER_TASK_STACK, nullptr, SNIFFER_TASK_PRIORITY, nullptr,
+                          SNIFFER_TASK_CORE);
+}
+
+void snifferLoop()
+{
+  static char line[16];
+  static uint8_t lineLength = 0;
+
+  while (Serial.available() > 0)
+  {
+    char received = Serial.read();
+    if (received != '\n' && received != '\r')
+    {
+      // Uma linha que enche o buffer não é comando e é ignorada inteira
+      if (lineLength < sizeof(line))
+        line[lineLength++] = received;
+      continue;
+    }
+
+    if (lineLength > 0 && lineLength < sizeof(line))
+    {
+      line[lineLength] = '\0';
+      if (strcmp(line, "sniffer 1") == 0)
+        snifferSetEnabled(true);
+      else if (strcmp(line, "sniffer 0") == 0)
+        snifferSetEnabled(false);
+    }
+    lineLength = 0;
+  }
+}
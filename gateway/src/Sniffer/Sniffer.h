@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+
+/**
+ * Modo sniffer: o gateway só escuta o barramento (TWAI_MODE_LISTEN_ONLY, sem filtro) e escreve cada frame
+ * na serial em binário. Em somente-escuta o nó não transmite, não confirma e não sinaliza erros: a
+ * captura não muda em nada o tráfego. Feito para uma segunda placa de gateway ligada ao barramento da
+ * clínica; o gateway que controla o estimulador continua normal.
+ *
+ * O modo fica guardado na flash e vale a partir do próximo boot. Liga e desliga pelo controle
+ * Diagnostics_SetSnifferMode, ou pela serial com as linhas "sniffer 1" e "sniffer 0" (nos dois modos).
+ * No modo sniffer não há balanças, Bluetooth nem máquina de estados.
+ *
+ * Cada registro na serial:
+ *   0xA5, tipo u8, tamanho u8, dados[tamanho], CRC-8 (polinômio 0x07) de tipo, tamanho e dados
+ * Inteiros em little-endian. Tipos:
+ *   0x01 frame padrão:    micros u32, identificador u16 (bit 15 = RTR), octetos do frame
+ *   0x02 frame estendido: micros u32, identificador u32 (bit 31 = RTR), octetos do frame
+ *   0x10 estatísticas:    micros u32, taxa u32 (bit/s), frames u32, descartados na serial u32,
+ *                         perdidos no driver u32, estouros do FIFO u32, erros de barramento u32
+ * O instante é o esp_timer lido pela tarefa do sniffer assim que o driver entrega o frame; ele volta a
+ * zero a cada ~71 min, e as estatísticas saem a cada segundo para que a volta possa ser desfeita.
+ * tools/can_sniffer.py lê a serial e escreve o log no formato do candump.
+ */
+
+#define SNIFFER_SERIAL_BAUD 921600
+
+// Buffer de transmissão da serial. Um frame de 8 octetos ocupa 18 octetos na serial; a 921600 baud
+// cabem ~5100 por segundo, o bastante para o barramento a 500 kbit/s cheio de frames de 8 octetos.
+#define SNIFFER_SERIAL_TX_BUFFER 8192
+
+// Frames que o driver guarda até a tarefa ler
+#define SNIFFER_DRIVER_RX_QUEUE_LENGTH 64
+
+#define SNIFFER_STATS_INTERVAL_MS 1000
+
+// Sem Bluetooth no modo sniffer, o núcleo 0 fica só para a tarefa
+#define SNIFFER_TASK_CORE 0
+#define SNIFFER_TASK_PRIORITY 5
+#define SNIFFER_TASK_STACK 3072
+
+#define SNIFFER_SYNC 0xA5
+#define SNIFFER_RECORD_STANDARD_FRAME 0x01
+#define SNIFFER_RECORD_EXTENDED_FRAME 0x02
+#define SNIFFER_RECORD_STATS 0x10
+
+// Modo guardado na flash, lido no primeiro uso
+bool snifferIsEnabled();
+
+// Guarda o modo e reinicia o gateway, se ele mudou
+void snifferSetEnabled(bool enabled);
+
+// Chamado por setup() no modo sniffer, no lugar do resto: serial, driver e tarefa de captura
+void snifferStart();
+
+// Lê os comandos "sniffer 0"/"sniffer 1" da serial, nos dois modos
+void snifferLoop();
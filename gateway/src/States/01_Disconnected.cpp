@@ -28,13 +28,9 @@ void onDisconnectedStateLoop()
     if (now - lastTwaiSendTime >= 15)
     {
         lastTwaiSendTime = now;
-        twaiSend(TwaiSendMessageKind::UseMalhaAberta, 0);
-        twaiSend(TwaiSendMessageKind::WeightTotal, scaleGetWeightL() + scaleGetWeightR());
-        twaiSend(TwaiSendMessageKind::SetRequestedPwm, 0);
-        twaiSend(TwaiSendMessageKind::Setpoint, 0);
-        twaiSend(TwaiSendMessageKind::Mese, 0);
-        twaiSend(TwaiSendMessageKind::MeseMax, 0);
-        twaiSend(TwaiSendMessageKind::SetGainCoefficient, data.parameterSetup.gainCoefficient);
+        data.sendOperationCommandToTwai(OperationUseMalhaAberta | OperationWeight | OperationRequestedPwm,
+                                        scaleGetWeightL() + scaleGetWeightR(), 0);
+        data.sendOperationParametersToTwai(OperationAllParameters, 0, 0, 0);
     }
 }
 
@@ -2,9 +2,12 @@
 #include <esp_log.h>
 #include "../Bluetooth/Bluetooth.h"
 #include "../Twai/Twai.h"
+#include "../Twai/TwaiBitrate.h"
 #include "../Data.h"
 #include "../StateManager.h"
 #include "../Scale/Scale.h"
+#include "../Diagnostics/Diagnostics.h"
+#include "../Sniffer/Sniffer.h"
 #include "Preferences.h"
 
 static const char *TAG = "ParameterSetup";
@@ -16,6 +19,25 @@ static unsigned long lastTwaiSendTime = 0;
 #define PARAMETERS_DEFAULT_GRADUAL_DECREASE_TIME 1500
 #define PARAMETERS_DEFAULT_MALHA_FECHADA_ABOVE_SETPOINT_TIME 2000
 #define PARAMETERS_DEFAULT_GAIN 50
+#define PARAMETERS_DEFAULT_PROPORTIONAL_GAIN 30
+#define PARAMETERS_DEFAULT_INTEGRAL_GAIN 0
+#define PARAMETERS_DEFAULT_WAVEFORM_FREQUENCY 35
+#define PARAMETERS_DEFAULT_WAVEFORM_PULSES_PER_TRAIN 1
+#define PARAMETERS_DEFAULT_WAVEFORM_INTRA_TRAIN_INTERVAL 50
+#define PARAMETERS_DEFAULT_WAVEFORM_INTERPHASE_GAP 4
+#define PARAMETERS_DEFAULT_WAVEFORM_SECOND_PHASE 100
+#define PARAMETERS_DEFAULT_CHANNEL_AMPLITUDE 100
+#define PARAMETERS_DEFAULT_CHANNEL_OFFSET 0
+#define PARAMETERS_DEFAULT_RAMP_PROFILE RampProfile::Linear
+
+// Faixas aceitas; o estimulador confere de novo (Waveform/Waveform.h) e recusa a forma de onda inteira
+#define PARAMETERS_MIN_WAVEFORM_INTERPHASE_GAP 4
+#define PARAMETERS_MAX_WAVEFORM_INTERPHASE_GAP 200
+#define PARAMETERS_MIN_WAVEFORM_SECOND_PHASE 10
+#define PARAMETERS_MAX_WAVEFORM_SECOND_PHASE 100
+
+// Um canal nunca sai mais largo que a largura pedida (MODULATION_MAX_AMPLITUDE_PERCENT no estimulador)
+#define PARAMETERS_MAX_CHANNEL_AMPLITUDE 100
 
 static Preferences preferences;
 
@@ -29,6 +51,22 @@ void reloadData(bool resetToDefaults)
     data.parameterSetup.gradualDecreaseTime = preferences.getUShort("c", PARAMETERS_DEFAULT_GRADUAL_DECREASE_TIME);
     data.parameterSetup.malhaFechadaAboveSetpointTime = preferences.getUShort("d", PARAMETERS_DEFAULT_MALHA_FECHADA_ABOVE_SETPOINT_TIME);
     data.parameterSetup.gainCoefficient = preferences.getUChar("e", PARAMETERS_DEFAULT_GAIN);
+    data.waveform.frequencyHz = preferences.getUChar("f", PARAMETERS_DEFAULT_WAVEFORM_FREQUENCY);
+    data.waveform.pulsesPerTrain = preferences.getUChar("g", PARAMETERS_DEFAULT_WAVEFORM_PULSES_PER_TRAIN);
+    data.waveform.intraTrainInterval = preferences.getUChar("h", PARAMETERS_DEFAULT_WAVEFORM_INTRA_TRAIN_INTERVAL);
+    data.waveform.interphaseGapMicros = preferences.getUChar("i", PARAMETERS_DEFAULT_WAVEFORM_INTERPHASE_GAP);
+    data.waveform.secondPhasePercent = preferences.getUChar("j", PARAMETERS_DEFAULT_WAVEFORM_SECOND_PHASE);
+    data.channels[0].amplitudePercent =
+        min(preferences.getUChar("k", PARAMETERS_DEFAULT_CHANNEL_AMPLITUDE), (uint8_t)PARAMETERS_MAX_CHANNEL_AMPLITUDE);
+    data.channels[1].amplitudePercent =
+        min(preferences.getUChar("l", PARAMETERS_DEFAULT_CHANNEL_AMPLITUDE), (uint8_t)PARAMETERS_MAX_CHANNEL_AMPLITUDE);
+    data.channels[0].offset = preferences.getUChar("m", PARAMETERS_DEFAULT_CHANNEL_OFFSET);
+    data.channels[1].offset = preferences.getUChar("n", PARAMETERS_DEFAULT_CHANNEL_OFFSET);
+    data.control.proportionalGain = preferences.getUChar("o", PARAMETERS_DEFAULT_PROPORTIONAL_GAIN);
+    data.control.integralGain = preferences.getUChar("p", PARAMETERS_DEFAULT_INTEGRAL_GAIN);
+    data.rampProfile = (RampProfile)preferences.getUChar("q", (uint8_t)PARAMETERS_DEFAULT_RAMP_PROFILE);
+    if (data.rampProfile > RAMP_PROFILE_LAST)
+        data.rampProfile = PARAMETERS_DEFAULT_RAMP_PROFILE;
     preferences.end();
 }
 
@@ -40,12 +78,26 @@ void saveData()
     preferences.putUShort("c", data.parameterSetup.gradualDecreaseTime);
     preferences.putUShort("d", data.parameterSetup.malhaFechadaAboveSetpointTime);
     preferences.putUChar("e", data.parameterSetup.gainCoefficient);
+    preferences.putUChar("f", data.waveform.frequencyHz);
+    preferences.putUChar("g", data.waveform.pulsesPerTrain);
+    preferences.putUChar("h", data.waveform.intraTrainInterval);
+    preferences.putUChar("i", data.waveform.interphaseGapMicros);
+    preferences.putUChar("j", data.waveform.secondPhasePercent);
+    preferences.putUChar("k", data.channels[0].amplitudePercent);
+    preferences.putUChar("l", data.channels[1].amplitudePercent);
+    preferences.putUChar("m", data.channels[0].offset);
+    preferences.putUChar("n", data.channels[1].offset);
+    preferences.putUChar("o", data.control.proportionalGain);
+    preferences.putUChar("p", data.control.integralGain);
+    preferences.putUChar("q", (uint8_t)data.rampProfile);
     preferences.end();
 }
 
 void onParameterSetupStateEnter()
 {
     reloadData(false);
+    data.sendWaveformToTwai();
+    data.sendControlGainsToTwai();
 }
 
 void onParameterSetupStateLoop()
@@ -60,13 +112,9 @@ void onParameterSetupStateLoop()
     long now = millis();
     if (now - lastTwaiSendTime >= 15)
     {
-        twaiSend(TwaiSendMessageKind::UseMalhaAberta, 0);
-        twaiSend(TwaiSendMessageKind::WeightTotal, scaleGetWeightL() + scaleGetWeightR());
-        twaiSend(TwaiSendMessageKind::SetRequestedPwm, 0);
-        twaiSend(TwaiSendMessageKind::Setpoint, 0);
-        twaiSend(TwaiSendMessageKind::Mese, 0);
-        twaiSend(TwaiSendMessageKind::MeseMax, 0);
-        twaiSend(TwaiSendMessageKind::SetGainCoefficient, data.parameterSetup.gainCoefficient);
+        data.sendOperationCommandToTwai(OperationUseMalhaAberta | OperationWeight | OperationRequestedPwm,
+                                        scaleGetWeightL() + scaleGetWeightR(), 0);
+        data.sendOperationParametersToTwai(OperationAllParameters, 0, 0, 0);
     }
 }
 
@@ -96,17 +144,95 @@ void onParameterSetupStateBLEControl(BluetoothControlCode code, uint8_t extraDat
     case BluetoothControlCode::ParameterSetup_SetMalhaFechadaAboveSetpointTime:
         data.parameterSetup.malhaFechadaAboveSetpointTime = max(extraData * 100, 1);
         break;
+    case BluetoothControlCode::ParameterSetup_SetRampProfile:
+        if (extraData > (uint8_t)RAMP_PROFILE_LAST)
+        {
+            ESP_LOGE(TAG, "Perfil de rampa desconhecido: %u", extraData);
+            break;
+        }
+        data.rampProfile = (RampProfile)extraData;
+        break;
     case BluetoothControlCode::ParameterSetup_SetGainCoefficient:
         ESP_LOGI(TAG, "Coeficiente de ganho definido pelo aplicativo: %f", extraData / 100.0f);
         data.parameterSetup.gainCoefficient = extraData;
         break;
+    case BluetoothControlCode::ParameterSetup_SetProportionalGain:
+        data.control.proportionalGain = extraData;
+        data.sendControlGainsToTwai();
+        break;
+    case BluetoothControlCode::ParameterSetup_SetIntegralGain:
+        data.control.integralGain = extraData;
+        data.sendControlGainsToTwai();
+        break;
+    case BluetoothControlCode::ParameterSetup_SetWaveformFrequency:
+        data.waveform.frequencyHz = extraData;
+        data.sendWaveformToTwai();
+        break;
+    case BluetoothControlCode::ParameterSetup_SetWaveformPulsesPerTrain:
+        data.waveform.pulsesPerTrain = extraData;
+        data.sendWaveformToTwai();
+        break;
+    case BluetoothControlCode::ParameterSetup_SetWaveformIntraTrainInterval:
+        data.waveform.intraTrainInterval = extraData;
+        data.sendWaveformToTwai();
+        break;
+    case BluetoothControlCode::ParameterSetup_SetWaveformInterphaseGap:
+        if (extraData < PARAMETERS_MIN_WAVEFORM_INTERPHASE_GAP || extraData > PARAMETERS_MAX_WAVEFORM_INTERPHASE_GAP)
+        {
+            ESP_LOGE(TAG, "Intervalo entre fases fora da faixa: %u us", extraData);
+            break;
+        }
+        data.waveform.interphaseGapMicros = extraData;
+        data.sendWaveformToTwai();
+        break;
+    case BluetoothControlCode::ParameterSetup_SetWaveformSecondPhase:
+        if (extraData < PARAMETERS_MIN_WAVEFORM_SECOND_PHASE || extraData > PARAMETERS_MAX_WAVEFORM_SECOND_PHASE)
+        {
+            ESP_LOGE(TAG, "Segunda fase fora da faixa: %u%%", extraData);
+            break;
+        }
+        data.waveform.secondPhasePercent = extraData;
+        data.sendWaveformToTwai();
+        break;
+    case BluetoothControlCode::ParameterSetup_SetChannelAmplitude0:
+    case BluetoothControlCode::ParameterSetup_SetChannelAmplitude1:
+    {
+        int channel = code == BluetoothControlCode::ParameterSetup_SetChannelAmplitude0 ? 0 : 1;
+        if (extraData > PARAMETERS_MAX_CHANNEL_AMPLITUDE)
+        {
+            ESP_LOGE(TAG, "Amplitude do canal %d fora da faixa: %u%%", channel, extraData);
+            break;
+        }
+        data.channels[channel].amplitudePercent = extraData;
+        data.sendWaveformToTwai();
+        break;
+    }
+    case BluetoothControlCode::ParameterSetup_SetChannelOffset0:
+        data.channels[0].offset = extraData;
+        data.sendWaveformToTwai();
+        break;
+    case BluetoothControlCode::ParameterSetup_SetChannelOffset1:
+        data.channels[1].offset = extraData;
+        data.sendWaveformToTwai();
+        break;
     case BluetoothControlCode::ParameterSetup_Reset:
         reloadData(true);
+        data.sendWaveformToTwai();
+        data.sendControlGainsToTwai();
         break;
     case BluetoothControlCode::ParameterSetup_Save:
         // Salvar preferências na memória
         saveData();
         break;
+    case BluetoothControlCode::Diagnostics_RunPulseBenchmark:
+        diagnosticsStartPulseBenchmark(DIAGNOSTICS_BENCH_PULSE_COUNT);
+        break;
+    case BluetoothControlCode::Diagnostics_SetCanBitrate:
+        twaiBitrateChange(extraData);
+        break;
+    case BluetoothControlCode::Diagnostics_SetSnifferMode:
+        snifferSetEnabled(extraData != 0);
+        break;
     case BluetoothControlCode::ParameterSetup_Complete:
         stateManager.switchTo(StateKind::MESECollecter);
         return;
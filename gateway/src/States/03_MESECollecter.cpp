@@ -78,13 +78,9 @@ void onMESECollecterStateLoop()
     if (now - lastTwaiSendTime >= 15)
     {
         lastTwaiSendTime = now;
-        twaiSend(TwaiSendMessageKind::UseMalhaAberta, 0);
-        twaiSend(TwaiSendMessageKind::WeightTotal, scaleGetWeightL() + scaleGetWeightR());
-        twaiSend(TwaiSendMessageKind::SetRequestedPwm, requestedPwm);
-        twaiSend(TwaiSendMessageKind::Setpoint, data.setpoint);
-        twaiSend(TwaiSendMessageKind::Mese, data.mese);
-        twaiSend(TwaiSendMessageKind::MeseMax, data.meseMax);
-        twaiSend(TwaiSendMessageKind::SetGainCoefficient, data.parameterSetup.gainCoefficient);
+        data.sendOperationCommandToTwai(OperationUseMalhaAberta | OperationWeight | OperationRequestedPwm,
+                                        scaleGetWeightL() + scaleGetWeightR(), requestedPwm);
+        data.sendOperationParametersToTwai(OperationAllParameters, data.setpoint, data.mese, data.meseMax);
     }
 }
 
@@ -14,6 +14,10 @@ void onOperationStartEnter()
 {
   data.meseMax = data.mese * 1.2f;
   data.setpoint = data.collectedWeight * 0.5f;
+
+  // Garante que o estimulador tem a forma de onda configurada antes de estimular
+  data.sendWaveformToTwai();
+  data.sendControlGainsToTwai();
 }
 
 void onOperationStartLoop()
@@ -42,14 +46,9 @@ void onOperationStartLoop()
   if (now - lastTwaiSendTime >= 15)
   {
     lastTwaiSendTime = now;
-    twaiSend(TwaiSendMessageKind::SetRequestedPwm, 0);
-    twaiSend(TwaiSendMessageKind::UseMalhaAberta, 0);
-    twaiSend(TwaiSendMessageKind::WeightTotal,
-             scaleGetWeightL() + scaleGetWeightR());
-    twaiSend(TwaiSendMessageKind::Setpoint, 0);
-    twaiSend(TwaiSendMessageKind::Mese, 0);
-    twaiSend(TwaiSendMessageKind::MeseMax, 0);
-    twaiSend(TwaiSendMessageKind::SetGainCoefficient, data.parameterSetup.gainCoefficient);
+    data.sendOperationCommandToTwai(OperationUseMalhaAberta | OperationWeight | OperationRequestedPwm,
+                                    scaleGetWeightL() + scaleGetWeightR(), 0);
+    data.sendOperationParametersToTwai(OperationAllParameters, 0, 0, 0);
   }
 
   data.mainOperationStateInformApp[0] = (uint8_t)stateManager.currentKind;
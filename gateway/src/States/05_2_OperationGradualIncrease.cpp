@@ -9,14 +9,23 @@
 
 static const char *TAG = "OperationGradualIncrease";
 static unsigned long lastTwaiSendTime = 0;
-static unsigned long lastStepTime = 0;
+static unsigned long rampStartTime = 0;
+static unsigned long rampSendTime = 0;
 
-static uint16_t gradualIncreaseInterval;
+static void sendRamp()
+{
+    uint16_t duration = operationRampDurationMs(data.parameterSetup.gradualIncreaseTime, data.pwmFeedback, data.mese);
+
+    twaiSend(TwaiSendMessageKind::UseMalhaAberta, 0);
+    data.sendRampToTwai(data.mese, duration, data.rampProfile);
+    rampSendTime = millis();
+}
 
 void onOperationGradualIncreaseEnter()
 {
-    lastStepTime = millis();
-    gradualIncreaseInterval = data.parameterSetup.gradualIncreaseTime / data.mese;
+    rampStartTime = millis();
+    data.ramp.state = RampState::Idle;
+    sendRamp();
 }
 
 void onOperationGradualIncreaseLoop()
@@ -39,24 +48,22 @@ void onOperationGradualIncreaseLoop()
         return;
     }
 
-    ESP_LOGI(TAG, "Interval: %d\n", gradualIncreaseInterval);
-
-    unsigned int pwmIncreaseTimeDelta = now - lastStepTime;
-    if (pwmIncreaseTimeDelta >= gradualIncreaseInterval)
+    // A rampa roda no estimulador; só reenviamos se ele não confirmou que está nela
+    bool rampConfirmed = data.ramp.targetPwm == data.mese && data.ramp.state != RampState::Idle &&
+                         data.ramp.state != RampState::Cancelled;
+    if (!rampConfirmed && now - rampSendTime >= OPERATION_RAMP_RESEND_INTERVAL_MS)
     {
-        twaiSend(TwaiSendMessageKind::SetRequestedPwm, data.pwmFeedback + 1);
-        twaiSend(TwaiSendMessageKind::UseMalhaAberta, 0);
-        lastStepTime = now;
+        ESP_LOGW(TAG, "Sem progresso da rampa, reenviando.");
+        sendRamp();
     }
 
+    unsigned int pwmIncreaseTimeDelta = now - rampStartTime;
+
     if (now - lastTwaiSendTime >= 15)
     {
         lastTwaiSendTime = now;
-        twaiSend(TwaiSendMessageKind::WeightTotal, scaleGetWeightL() + scaleGetWeightR());
-        twaiSend(TwaiSendMessageKind::Setpoint, 0);
-        twaiSend(TwaiSendMessageKind::Mese, 0);
-        twaiSend(TwaiSendMessageKind::MeseMax, 0);
-        twaiSend(TwaiSendMessageKind::SetGainCoefficient, data.parameterSetup.gainCoefficient);
+        data.sendOperationCommandToTwai(OperationWeight, scaleGetWeightL() + scaleGetWeightR(), 0);
+        data.sendOperationParametersToTwai(OperationAllParameters, 0, 0, 0);
     }
 
     data.mainOperationStateInformApp[0] = (uint8_t)stateManager.currentKind;
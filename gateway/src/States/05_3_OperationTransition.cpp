@@ -45,13 +45,9 @@ void onOperationTransitionLoop()
         // teremos o peso residual do final da etapa de transição
         twaiSend(TwaiSendMessageKind::ResidualWeightTotal, scaleGetTotalWeight());
 
-        twaiSend(TwaiSendMessageKind::SetRequestedPwm, data.mese);
-        twaiSend(TwaiSendMessageKind::UseMalhaAberta, 0);
-        twaiSend(TwaiSendMessageKind::WeightTotal, scaleGetTotalWeight());
-        twaiSend(TwaiSendMessageKind::Setpoint, data.setpoint);
-        twaiSend(TwaiSendMessageKind::Mese, data.mese);
-        twaiSend(TwaiSendMessageKind::MeseMax, data.meseMax);
-        twaiSend(TwaiSendMessageKind::SetGainCoefficient, data.parameterSetup.gainCoefficient);
+        data.sendOperationCommandToTwai(OperationUseMalhaAberta | OperationWeight | OperationRequestedPwm,
+                                        scaleGetTotalWeight(), data.mese);
+        data.sendOperationParametersToTwai(OperationAllParameters, data.setpoint, data.mese, data.meseMax);
     }
 
     data.mainOperationStateInformApp[0] = (uint8_t)stateManager.currentKind;
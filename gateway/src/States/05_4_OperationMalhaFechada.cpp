@@ -51,12 +51,9 @@ void onOperationMalhaFechadaLoop()
     {
         lastTwaiSendTime = now;
         // Malha fechada; PWM enviado não importa; é calculado pelo firmware do estimulador
-        twaiSend(TwaiSendMessageKind::UseMalhaFechada, 0);
-        twaiSend(TwaiSendMessageKind::MeseMax, data.meseMax);
-        twaiSend(TwaiSendMessageKind::WeightTotal, scaleGetWeightL() + scaleGetWeightR());
-        twaiSend(TwaiSendMessageKind::Setpoint, data.setpoint);
-        twaiSend(TwaiSendMessageKind::Mese, data.mese);
-        twaiSend(TwaiSendMessageKind::SetGainCoefficient, data.parameterSetup.gainCoefficient);
+        data.sendOperationCommandToTwai(OperationUseMalhaFechada | OperationWeight,
+                                        scaleGetWeightL() + scaleGetWeightR(), 0);
+        data.sendOperationParametersToTwai(OperationAllParameters, data.setpoint, data.mese, data.meseMax);
     }
 
     data.mainOperationStateInformApp[0] = (uint8_t)stateManager.currentKind;
@@ -9,14 +9,24 @@
 
 static const char *TAG = "OperationStop";
 static unsigned long lastTwaiSendTime = 0;
-static unsigned long lastStepTime = 0;
+static unsigned long rampStartTime = 0;
+static unsigned long rampSendTime = 0;
 
-static uint16_t gradualDecreaseInterval;
+static void sendRamp()
+{
+    uint16_t duration = operationRampDurationMs(data.parameterSetup.gradualDecreaseTime, data.pwmFeedback, 0);
+
+    twaiSend(TwaiSendMessageKind::UseMalhaAberta, 0);
+    data.sendRampToTwai(0, duration, data.rampProfile);
+    rampSendTime = millis();
+}
 
 void onOperationStopEnter()
 {
-    lastStepTime = millis();
-    gradualDecreaseInterval = data.parameterSetup.gradualDecreaseTime / data.mese;
+    rampStartTime = millis();
+    lastTwaiSendTime = millis();
+    data.ramp.state = RampState::Idle;
+    sendRamp();
 }
 
 void onOperationStopLoop()
@@ -25,21 +35,23 @@ void onOperationStopLoop()
 
     ESP_LOGD(TAG, "PWM: %d/0", data.pwmFeedback, 0);
 
-    int requestedPwm = data.pwmFeedback - 1;
-    if (requestedPwm < 0)
+    bool rampConfirmed = data.ramp.targetPwm == 0 && data.ramp.state != RampState::Idle &&
+                         data.ramp.state != RampState::Cancelled;
+    if (!rampConfirmed && now - rampSendTime >= OPERATION_RAMP_RESEND_INTERVAL_MS)
     {
-        requestedPwm = 0;
+        ESP_LOGW(TAG, "Sem progresso da rampa, reenviando.");
+        sendRamp();
     }
 
-    unsigned int pwmDecreaseTimeDelta = now - lastStepTime;
-    if (pwmDecreaseTimeDelta >= gradualDecreaseInterval)
+    if (now - lastTwaiSendTime >= 15)
     {
-        twaiSend(TwaiSendMessageKind::SetRequestedPwm, requestedPwm);
-        twaiSend(TwaiSendMessageKind::UseMalhaAberta, 0);
-        twaiSend(TwaiSendMessageKind::SetGainCoefficient, data.parameterSetup.gainCoefficient);
-        lastStepTime = now;
+        lastTwaiSendTime = now;
+        data.sendOperationCommandToTwai(OperationUseMalhaAberta, 0, 0);
+        data.sendOperationParametersToTwai(OperationGainCoefficient, 0, 0, 0);
     }
 
+    unsigned int pwmDecreaseTimeDelta = now - rampStartTime;
+
     data.mainOperationStateInformApp[0] = (uint8_t)stateManager.currentKind;
     data.mainOperationStateInformApp[1] = pwmDecreaseTimeDelta & 0xFF;
     data.mainOperationStateInformApp[2] = (pwmDecreaseTimeDelta >> 8) & 0xFF;
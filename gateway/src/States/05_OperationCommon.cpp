@@ -1,5 +1,22 @@
 #include <Arduino.h>
 #include "05_OperationCommon.h"
 #include "Scale/Scale.h"
+#include "../Data.h"
 
-uint8_t OPERATION_MESE_MAX_CHANGE_STEP = 5;
\ No newline at end of file
+uint8_t OPERATION_MESE_MAX_CHANGE_STEP = 5;
+
+uint16_t operationRampDurationMs(uint16_t fullTimeMs, uint16_t fromPwm, uint16_t toPwm)
+{
+    if (data.mese == 0)
+    {
+        return 0;
+    }
+
+    uint32_t distance = fromPwm > toPwm ? fromPwm - toPwm : toPwm - fromPwm;
+    uint32_t duration = (uint32_t)fullTimeMs * distance / data.mese;
+    if (duration > UINT16_MAX)
+    {
+        duration = UINT16_MAX;
+    }
+    return duration;
+}
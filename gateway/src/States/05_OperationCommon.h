@@ -2,3 +2,13 @@
 #include <stdint.h>
 
 extern uint8_t OPERATION_MESE_MAX_CHANGE_STEP;
+
+
+// Sem RampStatus da rampa pedida depois deste tempo, o RampTo é reenviado
+#define OPERATION_RAMP_RESEND_INTERVAL_MS 100
+
+/**
+ * Duração de uma rampa de `fromPwm` até `toPwm` que mantém a velocidade configurada:
+ * `fullTimeMs` é o tempo para percorrer de 0 até o MESE.
+ */
+uint16_t operationRampDurationMs(uint16_t fullTimeMs, uint16_t fromPwm, uint16_t toPwm);
@@ -0,0 +1,92 @@
+#include "Telemetry.h"
+#include <Arduino.h>
+#include <esp_log.h>
+
+static const char *TAG = "Telemetry";
+
+static uint8_t rateHz = TELEMETRY_DEFAULT_RATE_HZ;
+static unsigned long lastRateSendTime = 0;
+
+// Primeiro frame de cada amostra, aguardando o frame com os limites
+static bool hasValues = false;
+static uint8_t sequence;
+static int16_t weight;
+static int16_t errorTenths;
+static int16_t integralMicros;
+static uint8_t flags;
+
+static uint32_t droppedLines = 0;
+
+static uint16_t readU16(const uint8_t *bytes)
+{
+  return (bytes[0] << 8) | bytes[1];
+}
+
+void telemetryBegin()
+{
+  lastRateSendTime = millis();
+  twaiSend(TwaiSendMessageKind::SetTelemetryRate, rateHz);
+}
+
+void telemetryLoop()
+{
+  unsigned long now = millis();
+  if (now - lastRateSendTime >= TELEMETRY_RATE_RESEND_INTERVAL_MS)
+  {
+    lastRateSendTime = now;
+    twaiSend(TwaiSendMessageKind::SetTelemetryRate, rateHz);
+  }
+}
+
+void telemetryOnBLEControl(BluetoothControlCode code, uint8_t extraData)
+{
+  if (code != BluetoothControlCode::Diagnostics_SetTelemetryRate)
+  {
+    return;
+  }
+
+  rateHz = extraData > TELEMETRY_MAX_RATE_HZ ? TELEMETRY_MAX_RATE_HZ : extraData;
+  ESP_LOGI(TAG, "Telemetria do controle: %u Hz", rateHz);
+  twaiSend(TwaiSendMessageKind::SetTelemetryRate, rateHz);
+  lastRateSendTime = millis();
+}
+
+void telemetryOnTWAIMessage(TwaiReceivedMessage *receivedMessage)
+{
+  const uint8_t *payload = receivedMessage->Payload;
+
+  switch (receivedMessage->Kind)
+  {
+  case TwaiReceivedMessageKind::ControlTelemetry:
+    sequence = payload[0];
+    weight = (int16_t)readU16(&payload[1]);
+    errorTenths = (int16_t)readU16(&payload[3]);
+    integralMicros = (int16_t)readU16(&payload[5]);
+    flags = payload[7];
+    hasValues = true;
+    break;
+  case TwaiReceivedMessageKind::ControlTelemetryBounds:
+  {
+    if (!hasValues)
+    {
+      break;
+    }
+    hasValues = false;
+
+    char line[64];
+    int length = snprintf(line, sizeof(line), "T,%u,%d,%d,%d,%u,%u,%u,%u,%u\n", sequence, weight, errorTenths,
+                          integralMicros, flags, readU16(&payload[0]), readU16(&payload[2]), readU16(&payload[4]),
+                          readU16(&payload[6]));
+
+    if (length <= 0 || Serial.availableForWrite() < length)
+    {
+      droppedLines++;
+      break;
+    }
+    Serial.write((const uint8_t *)line, length);
+    break;
+  }
+  default:
+    break;
+  }
+}
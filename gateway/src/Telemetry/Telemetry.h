@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+#include "../Twai/Twai.h"
+#include "../Bluetooth/Bluetooth.h"
+
+// Taxa da telemetria do controle pedida ao estimulador ao ligar. 0 = desligada.
+#define TELEMETRY_DEFAULT_RATE_HZ 0
+#define TELEMETRY_MAX_RATE_HZ 200
+
+// A taxa é reenviada periodicamente, para o caso de o estimulador reiniciar
+#define TELEMETRY_RATE_RESEND_INTERVAL_MS 1000
+
+void telemetryBegin();
+void telemetryLoop();
+
+// Diagnostics_SetTelemetryRate: muda a taxa em qualquer estado
+void telemetryOnBLEControl(BluetoothControlCode code, uint8_t extraData);
+
+/**
+ * Repassa os frames de telemetria do estimulador pela serial, uma linha CSV por amostra:
+ *   T,sequência,peso,erro_décimos,integral_us,flags,pi,largerPi,mínimo,máximo
+ * Se a serial não tiver espaço, a linha é descartada em vez de bloquear o loop.
+ */
+void telemetryOnTWAIMessage(TwaiReceivedMessage *receivedMessage);
@@ -1,24 +1,122 @@
 #include <string.h>
 #include <Arduino.h>
 #include "Twai.h"
+#include "TwaiFilter.h"
+#include "TwaiHealth.h"
+#include "TwaiBitrate.h"
+#include <esp_timer.h>
+#include <hal/twai_ll.h>
+#include <soc/twai_struct.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
 
 static const char *TAG = "Twai";
 
-static const twai_general_config_t g_config = TWAI_GENERAL_CONFIG_DEFAULT(WIRESS_GPIO_TX, WIRESS_GPIO_RX,
-                                                                          TWAI_MODE_NORMAL);
-static const twai_timing_config_t t_config = TWAI_TIMING_CONFIG_500KBITS();
-static const twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+// Tudo que algum módulo trata. O filtro de aceitação é calculado a partir desta lista;
+// um tipo novo em TwaiReceivedMessageKind precisa entrar aqui para chegar aos estados.
+static const uint8_t HANDLED_KINDS[] = {
+    TwaiReceivedMessageKind::EmergencyStopAck,
+    TwaiReceivedMessageKind::EmergencyStopZeroReached,
+    TwaiReceivedMessageKind::PwmFeedbackEstimulador,
+    TwaiReceivedMessageKind::PulseScheduleStatusReport,
+    TwaiReceivedMessageKind::PulseTimingReport,
+    TwaiReceivedMessageKind::RampStatus,
+    TwaiReceivedMessageKind::LatencyEcho,
+    TwaiReceivedMessageKind::LinkStatusReport,
+    TwaiReceivedMessageKind::ReceiveStatsReport,
+    TwaiReceivedMessageKind::BusHealthReport,
+    TwaiReceivedMessageKind::ControlTelemetry,
+    TwaiReceivedMessageKind::ControlTelemetryBounds,
+    TwaiReceivedMessageKind::NodeAnnounce,
+
+    // Auto-recepção de twaiSendTimestamped; não chega aos módulos
+    TwaiSendMessageKind::LatencyPing,
+};
+
+static TwaiFilterPlan filterPlan;
 
-twai_message_t lastReceivedMessage;
 unsigned long lastReceivedMessageTime;
 
+static TwaiBusStats busStats;
+
+// A tarefa de recepção fica no núcleo do loop, logo acima dele: cada frame é carimbado assim que
+// o driver o entrega, mesmo com o loop ocupado com as balanças ou o Bluetooth
+#define TWAI_RX_TASK_CORE ARDUINO_RUNNING_CORE
+#define TWAI_RX_TASK_PRIORITY 2
+#define TWAI_RX_TASK_STACK 2048
+#define TWAI_RX_QUEUE_LENGTH 32
+
+// Frames que o driver guarda até a tarefa de recepção ler; o padrão é 5
+#define TWAI_DRIVER_RX_QUEUE_LENGTH 16
+
+// Frames esperando a vez de transmitir, em ordem de chegada (FIFO, não por prioridade). tools/can_rta.py lê este
+// valor: é o máximo de frames do próprio nó à frente de qualquer frame enfileirado.
+#define TWAI_DRIVER_TX_QUEUE_LENGTH 5
+
+// Um frame lido do driver, com o instante em que saiu da fila do driver
+struct TwaiRxFrame
+{
+  twai_message_t message;
+  uint32_t receivedMicros;
+};
+
+static QueueHandle_t rxQueue = nullptr;
+
+// Escrito só pela tarefa de recepção
+static volatile uint32_t rxQueueDropped = 0;
+
+// Carimbo de transmissão: o identificador é escrito pelo loop antes do envio, o instante pela tarefa de recepção
+static volatile int32_t timestampedIdentifier = -1;
+static volatile uint32_t transmitTimestamp = 0;
+static volatile bool transmitTimestampReady = false;
+
+static void twaiRxTask(void *)
+{
+  TwaiRxFrame frame;
+  while (true)
+  {
+    if (twai_receive(&frame.message, portMAX_DELAY) != ESP_OK)
+      continue;
+    frame.receivedMicros = esp_timer_get_time();
+
+    // Auto-recepção de twaiSendTimestamped: o frame já foi contado no envio
+    if (frame.message.identifier == (uint32_t)timestampedIdentifier)
+    {
+      transmitTimestamp = frame.receivedMicros;
+      transmitTimestampReady = true;
+      continue;
+    }
+
+    if (xQueueSend(rxQueue, &frame, 0) != pdTRUE)
+      rxQueueDropped++;
+  }
+}
+
+// Bits de um frame padrão (ID de 11 bits) com `length` octetos, com o máximo de bits de stuffing
+static uint32_t frameBits(uint8_t length)
+{
+  uint32_t stuffable = 34 + 8 * length;
+  return 47 + 8 * length + (stuffable - 1) / 4;
+}
+
 void twaiStart()
 {
   lastReceivedMessageTime = millis();
-  memset(&lastReceivedMessage, 0, sizeof(twai_message_t));
+
+  twai_timing_config_t t_config = twaiBitrateTiming(twaiBitrateSelect());
+  twai_general_config_t g_config = TWAI_GENERAL_CONFIG_DEFAULT(WIRESS_GPIO_TX, WIRESS_GPIO_RX, TWAI_MODE_NORMAL);
+  g_config.rx_queue_len = TWAI_DRIVER_RX_QUEUE_LENGTH;
+  g_config.tx_queue_len = TWAI_DRIVER_TX_QUEUE_LENGTH;
+
+  // Frames de todos os estimuladores; o nó 0 é o do próprio gateway, na auto-recepção
+  filterPlan = twaiFilterPlan(HANDLED_KINDS, sizeof(HANDLED_KINDS), 0xFF);
+  ESP_LOGI(TAG, "Filter: %s, code=%08X mask=%08X, %u of 2048 IDs accepted",
+           filterPlan.config.single_filter ? "single" : "dual", filterPlan.config.acceptance_code,
+           filterPlan.config.acceptance_mask, filterPlan.acceptedIdCount);
 
   // Install TWAI driver
-  if (twai_driver_install(&g_config, &t_config, &f_config) == ESP_OK)
+  if (twai_driver_install(&g_config, &t_config, &filterPlan.config) == ESP_OK)
   {
     ESP_LOGI(TAG, "Driver installed!");
   }
@@ -38,58 +136,210 @@ void twaiStart()
     ESP_LOGE(TAG, "Failed to start driver");
     return;
   }
+
+  rxQueue = xQueueCreate(TWAI_RX_QUEUE_LENGTH, sizeof(TwaiRxFrame));
+  xTaskCreatePinnedToCore(twaiRxTask, "twaiRx", TWAI_RX_TASK_STACK, nullptr, TWAI_RX_TASK_PRIORITY, nullptr,
+                          TWAI_RX_TASK_CORE);
+  twaiHealthStart();
 }
 
-void twaiSend(TwaiSendMessageKind kind, uint16_t extraData)
+void twaiSend(TwaiSendMessageKind kind, uint16_t extraData, uint8_t node)
 {
-  twai_message_t message;
-  message.identifier = kind;
-  message.flags = TWAI_MSG_FLAG_NONE;
-  message.data_length_code = 4;
+  uint8_t payload[4] = {0};
+  payload[0] = extraData >> 8;
+  payload[1] = extraData & 0xFF;
 
-  uint8_t octet1 = extraData >> 8;
-  uint8_t octet2 = extraData & 0xFF;
+  twaiSendPayload(kind, payload, sizeof(payload), node);
+}
 
-  message.data[0] = octet1;
-  message.data[1] = octet2;
+static bool transmit(uint32_t identifier, const uint8_t *payload, uint8_t length, uint32_t flags)
+{
+  twai_message_t message;
+  memset(&message, 0, sizeof(message));
+  message.identifier = identifier;
+  message.flags = flags;
+  message.data_length_code = length;
+  memcpy(message.data, payload, length);
 
   // Fila de transmissão
   if (twai_transmit(&message, pdMS_TO_TICKS(0)) == ESP_OK)
   {
-    //  ESP_LOGD(TAG, "Message (Kind=%0X, Data=%0X) queued for transmission", kind, extraData);
+    busStats.transmittedFrames++;
+    busStats.bits += frameBits(length);
+    //  ESP_LOGD(TAG, "Message (Id=%0X, Length=%d) queued for transmission", identifier, length);
+    return true;
   }
   else
   {
-    //  ESP_LOGD(TAG, "Failed to queue message (Kind=%0X, Data=%0X) for transmission", kind, extraData);
+    //  ESP_LOGD(TAG, "Failed to queue message (Id=%0X, Length=%d) for transmission", identifier, length);
+    return false;
   }
 }
 
+bool twaiSendPayload(TwaiSendMessageKind kind, const uint8_t *payload, uint8_t length, uint8_t node)
+{
+  return transmit(twaiIdentifier(kind, node), payload, length, TWAI_MSG_FLAG_NONE);
+}
+
+void twaiClearTransmitQueue()
+{
+  twai_clear_transmit_queue();
+
+  // O driver não tem como cancelar o frame que está no controlador. Um que perdeu a arbitragem ficaria
+  // tentando de novo com a sua prioridade, na frente do que vier depois; um que já está no fio termina.
+  twai_ll_set_cmd_abort_tx(&TWAI);
+}
+
+bool twaiSendTimestamped(TwaiSendMessageKind kind, const uint8_t *payload, uint8_t length)
+{
+  uint32_t identifier = twaiIdentifier(kind, TWAI_BROADCAST_NODE);
+  transmitTimestampReady = false;
+  timestampedIdentifier = identifier;
+  return transmit(identifier, payload, length, TWAI_MSG_FLAG_SELF);
+}
+
+bool twaiTakeTransmitTimestamp(TwaiSendMessageKind kind, uint32_t *micros)
+{
+  if (timestampedIdentifier != (int32_t)twaiIdentifier(kind, TWAI_BROADCAST_NODE) || !transmitTimestampReady)
+    return false;
+
+  *micros = transmitTimestamp;
+  transmitTimestampReady = false;
+  return true;
+}
+
+// Último conteúdo enviado de cada tipo e nó que usam twaiSendOnChange
+struct SentValue
+{
+  bool used;
+  bool valid;
+  TwaiSendMessageKind kind;
+  uint8_t node;
+  uint8_t length;
+  uint8_t payload[8];
+  unsigned long sentTime;
+};
+
+static SentValue sentValues[TWAI_CHANGE_SLOT_COUNT];
+
+static SentValue *findSentValue(TwaiSendMessageKind kind, uint8_t node)
+{
+  for (int i = 0; i < TWAI_CHANGE_SLOT_COUNT; i++)
+  {
+    if (sentValues[i].used && sentValues[i].kind == kind && sentValues[i].node == node)
+      return &sentValues[i];
+  }
+
+  for (int i = 0; i < TWAI_CHANGE_SLOT_COUNT; i++)
+  {
+    if (!sentValues[i].used)
+    {
+      memset(&sentValues[i], 0, sizeof(SentValue));
+      sentValues[i].used = true;
+      sentValues[i].kind = kind;
+      sentValues[i].node = node;
+      return &sentValues[i];
+    }
+  }
+
+  return nullptr;
+}
+
+static bool payloadChanged(const SentValue *sent, const uint8_t *payload, uint8_t length, uint8_t compareMask)
+{
+  if (!sent->valid || sent->length != length)
+    return true;
+
+  for (uint8_t i = 0; i < length; i++)
+  {
+    if ((compareMask & (1 << i)) && sent->payload[i] != payload[i])
+      return true;
+  }
+  return false;
+}
+
+void twaiSendOnChange(TwaiSendMessageKind kind, const uint8_t *payload, uint8_t length, uint8_t compareMask,
+                      uint8_t node)
+{
+  SentValue *sent = findSentValue(kind, node);
+  if (sent == nullptr)
+  {
+    ESP_LOGE(TAG, "Sem espaço para o envio por mudança (Kind=%0X, nó %u); aumente TWAI_CHANGE_SLOT_COUNT", kind,
+             node);
+    twaiSendPayload(kind, payload, length, node);
+    return;
+  }
+
+  unsigned long now = millis();
+  if (!payloadChanged(sent, payload, length, compareMask) && now - sent->sentTime < TWAI_REFRESH_INTERVAL_MS)
+  {
+    busStats.suppressedFrames++;
+    return;
+  }
+
+  // Se a fila estava cheia, o valor continua como não enviado e sai na próxima chamada
+  if (!twaiSendPayload(kind, payload, length, node))
+    return;
+
+  sent->valid = true;
+  sent->length = length;
+  memcpy(sent->payload, payload, length);
+  sent->sentTime = now;
+}
+
 esp_err_t twaiReceive(TwaiReceivedMessage *received)
 {
-  memset(&lastReceivedMessage, 0, sizeof(twai_message_t));
-  memset(received, 0, sizeof(TwaiReceivedMessage));
+  if (rxQueue == nullptr)
+    return ESP_ERR_INVALID_STATE;
 
-  esp_err_t statusCode = twai_receive(&lastReceivedMessage, pdMS_TO_TICKS(0));
-  if (statusCode == ESP_OK)
+  TwaiRxFrame frame;
+  while (true)
   {
+    // Inclui o frame que vai ser lido agora
+    uint32_t depth = uxQueueMessagesWaiting(rxQueue);
+    if (depth > busStats.maxReceiveQueueDepth)
+      busStats.maxReceiveQueueDepth = depth;
+
+    if (xQueueReceive(rxQueue, &frame, 0) != pdTRUE)
+    {
+      // ESP_LOGD(TAG, "Message RX queue empty.");
+      return ESP_ERR_TIMEOUT;
+    }
+
+    const twai_message_t *message = &frame.message;
+    busStats.receivedFrames++;
+    busStats.bits += frameBits(message->data_length_code);
+
+    // O filtro de hardware aceita alguns IDs a mais; estes param aqui
+    if (!twaiFilterHandles(&filterPlan, message->identifier))
+    {
+      busStats.rejectedFrames++;
+      ESP_LOGD(TAG, "Rejected message Id=%0X", message->identifier);
+      continue;
+    }
+
     // Received OK!
-    uint8_t octet1 = lastReceivedMessage.data[0];
-    uint8_t octet2 = lastReceivedMessage.data[1];
+    uint8_t octet1 = message->data[0];
+    uint8_t octet2 = message->data[1];
     uint16_t data = (octet1 << 8) | octet2;
 
-    received->Kind = (TwaiReceivedMessageKind)lastReceivedMessage.identifier;
+    memset(received, 0, sizeof(TwaiReceivedMessage));
+    received->Kind = (TwaiReceivedMessageKind)(message->identifier >> TWAI_NODE_BITS);
+    received->Node = message->identifier & TWAI_NODE_MASK;
     received->ExtraData = data;
+    received->Length = message->data_length_code;
+    memcpy(received->Payload, message->data, sizeof(received->Payload));
+    received->ReceivedMicros = frame.receivedMicros;
 
     lastReceivedMessageTime = millis();
 
-    ESP_LOGD(TAG, "Received message Kind=%0X Data=%000X", received->Kind, received->ExtraData);
-  }
-  else
-  {
-    // ESP_LOGD(TAG, "Message RX queue empty. Status code: 0x%0X", statusCode);
-  }
+    uint32_t latency = micros() - frame.receivedMicros;
+    if (latency > busStats.maxReceiveLatencyMicros)
+      busStats.maxReceiveLatencyMicros = latency;
 
-  return statusCode;
+    ESP_LOGD(TAG, "Received message Kind=%0X Node=%u Data=%000X", received->Kind, received->Node, received->ExtraData);
+    return ESP_OK;
+  }
 }
 
 bool twaiIsAvailable()
@@ -105,3 +355,28 @@ bool twaiIsAvailable()
 
   return status.state == twai_state_t::TWAI_STATE_RUNNING && (timeSinceLastMessage < 500);
 }
+
+TwaiBusStats twaiGetBusStats()
+{
+  TwaiBusStats stats = busStats;
+  stats.receiveQueueDropped = rxQueueDropped;
+
+  twai_status_info_t status;
+  if (twai_get_status_info(&status) == ESP_OK)
+  {
+    stats.driverMissed = status.rx_missed_count;
+    stats.driverOverrun = status.rx_overrun_count;
+  }
+  return stats;
+}
+
+void twaiResetReceivePeaks()
+{
+  busStats.maxReceiveQueueDepth = 0;
+  busStats.maxReceiveLatencyMicros = 0;
+}
+
+uint32_t twaiGetBusBits()
+{
+  return busStats.bits;
+}
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <Arduino.h>
 #include <driver/twai.h>
 #include "../Flags.h"
+#include "TwaiFilter.h"
 
 #ifdef USE_DEVELOPMENT_CAN_PINOUT
 // ESP-32 de desenvolvimento
@@ -14,36 +15,207 @@
 #define WIRESS_GPIO_RX GPIO_NUM_25
 #endif
 
+/**
+ * O tipo ocupa os 8 bits altos do identificador, e o nó os 3 baixos (ver TwaiFilter.h): quanto menor o
+ * tipo, maior a prioridade na arbitragem. Os tipos são agrupados por criticidade (segurança, enlace,
+ * controle, parâmetros, configuração, relatórios, telemetria) e, dentro de cada faixa, o bit 3 indica a
+ * origem (0 = gateway, 1 = estimulador).
+ * Os dois firmwares precisam concordar com tools/can_messages.csv, onde estão os períodos e prazos;
+ * tools/can_rta.py confere isso e calcula o pior tempo de resposta de cada frame antes do build.
+ */
 enum TwaiSendMessageKind : uint8_t
 {
-  FirmwareInvokeReset = 0x01,
-  GatewayResetHappened = 0x02,
-  WeightTotal = 0x51,
-  ResidualWeightTotal = 0x52,
-  SetRequestedPwm = 0x61,
-  Mese = 0x71,
-  MeseMax = 0x72,
-  Setpoint = 0x81,
-  UseMalhaAberta = 0x82,
-  UseMalhaFechada = 0x83,
-  SetGainCoefficient = 0xA1
+  EmergencyStop = 0x00,
+  GatewayResetHappened = 0x01,
+  Heartbeat = 0x10,
+  OperationCommand = 0x20,
+  SetRequestedPwm = 0x21,
+  RampTo = 0x22,
+  WeightTotal = 0x23,
+  ResidualWeightTotal = 0x24,
+  LatencyPing = 0x25,
+  OperationParameters = 0x30,
+  Mese = 0x31,
+  MeseMax = 0x32,
+  Setpoint = 0x33,
+  UseMalhaAberta = 0x34,
+  UseMalhaFechada = 0x35,
+  SetGainCoefficient = 0x40,
+  SetProportionalGain = 0x41,
+  SetIntegralGain = 0x42,
+  SetLinkTimeout = 0x43,
+  SetTelemetryRate = 0x44,
+  SetBusBitrate = 0x45,
+  SetBusShare = 0x46,
+  SetWaveform = 0x50,
+  SetChannelAmplitude = 0x54,
+  SetChannelOffset = 0x55,
+  FirmwareInvokeReset = 0x70,
+  RunPulseBenchmark = 0x71,
+  NodeDiscover = 0x72,
+  NodeAssign = 0x73,
+  BenchFiller = 0xF0
 };
 
 enum TwaiReceivedMessageKind : uint8_t
 {
-  PwmFeedbackEstimulador = 0x6A
+  EmergencyStopAck = 0x08,
+  EmergencyStopZeroReached = 0x09,
+  PwmFeedbackEstimulador = 0x28,
+  RampStatus = 0x29,
+  LatencyEcho = 0x2A,
+  PulseScheduleStatusReport = 0x68,
+  LinkStatusReport = 0x69,
+  ReceiveStatsReport = 0x6A,
+  PulseTimingReport = 0x6B,
+  BusHealthReport = 0x6C,
+  NodeAnnounce = 0x78,
+  ControlTelemetry = 0xE8,
+  ControlTelemetryBounds = 0xE9
 };
 
+// Campos presentes num frame OperationCommand: [campos u8][peso u16][sequência u8][idade ms u8][PWM u16][reservado].
+// O estimulador trata cada campo como se tivesse recebido o frame individual correspondente.
+enum OperationCommandField : uint8_t
+{
+  OperationUseMalhaAberta = 0x01,
+  OperationUseMalhaFechada = 0x02,
+  OperationWeight = 0x04,
+  OperationRequestedPwm = 0x08
+};
+
+// Campos presentes num frame OperationParameters: [campos u8][setpoint u16][mese u16][mese máx. u16][ganho u8].
+enum OperationParameterField : uint8_t
+{
+  OperationSetpoint = 0x01,
+  OperationMese = 0x02,
+  OperationMeseMax = 0x04,
+  OperationGainCoefficient = 0x08,
+  OperationAllParameters = 0x0F
+};
+
+// Curva da rampa executada pelo estimulador
+enum class RampProfile : uint8_t
+{
+  Linear = 0,
+  Exponential = 1,
+  SCurve = 2
+};
+
+#define RAMP_PROFILE_LAST RampProfile::SCurve
+
+enum class RampState : uint8_t
+{
+  Idle = 0,
+  Running = 1,
+  Done = 2,
+  Cancelled = 3
+};
+
+// Nó de destino dos frames que valem para todos os estimuladores
+#define TWAI_BROADCAST_NODE 0
+
+static inline uint32_t twaiIdentifier(uint8_t kind, uint8_t node)
+{
+  return ((uint32_t)kind << TWAI_NODE_BITS) | (node & TWAI_NODE_MASK);
+}
+
 struct TwaiReceivedMessage
 {
   TwaiReceivedMessageKind Kind;
+
+  // Estimulador que enviou o frame (1 a 7)
+  uint8_t Node;
+
   uint16_t ExtraData;
+
+  // Conteúdo completo do frame, para mensagens com mais de 2 octetos
+  uint8_t Length;
+  uint8_t Payload[8];
+
+  // micros() do instante em que o driver entregou o frame, antes de qualquer atraso do loop
+  uint32_t ReceivedMicros;
+};
+
+// Intervalo de reenvio de um frame sem mudança. Pode ser trocado com -DTWAI_REFRESH_INTERVAL_MS=...
+#ifndef TWAI_REFRESH_INTERVAL_MS
+#define TWAI_REFRESH_INTERVAL_MS 100
+#endif
+
+// O estimulador, antes do primeiro heartbeat, considera o gateway perdido após 1 s sem nenhum frame
+// (LINK_UNARMED_TIMEOUT_MS). A atualização precisa ficar bem abaixo disso.
+static_assert(TWAI_REFRESH_INTERVAL_MS <= 500, "TWAI_REFRESH_INTERVAL_MS deve ficar abaixo do timeout do estimulador");
+
+// Pares tipo e nó diferentes enviados com twaiSendOnChange
+#define TWAI_CHANGE_SLOT_COUNT 16
+
+// Frames e bits que o gateway enviou ou recebeu (depois do filtro de hardware), no pior caso de bit stuffing
+struct TwaiBusStats
+{
+  uint32_t transmittedFrames;
+  uint32_t receivedFrames;
+  uint32_t bits;
+
+  // Frames que passaram pelo filtro de hardware mas não são tratados por nenhum módulo
+  uint32_t rejectedFrames;
+
+  // Frames de twaiSendOnChange que não saíram por não terem mudado
+  uint32_t suppressedFrames;
+
+  // Frames recebidos perdidos com a fila da tarefa de recepção cheia
+  uint32_t receiveQueueDropped;
+
+  // Contadores do driver: frames perdidos com a fila dele cheia e por estouro do FIFO do controlador
+  uint32_t driverMissed;
+  uint32_t driverOverrun;
+
+  // Picos desde twaiResetReceivePeaks: frames esperando na fila de recepção e tempo entre a entrega
+  // pelo driver e a entrega da mensagem ao módulo
+  uint32_t maxReceiveQueueDepth;
+  uint32_t maxReceiveLatencyMicros;
 };
 
 void twaiStart();
 
-void twaiSend(TwaiSendMessageKind kind, uint16_t extraData);
+// `node` é o estimulador de destino; o padrão vale para todos
+void twaiSend(TwaiSendMessageKind kind, uint16_t extraData, uint8_t node = TWAI_BROADCAST_NODE);
+
+// Retorna false se a fila de transmissão estava cheia
+bool twaiSendPayload(TwaiSendMessageKind kind, const uint8_t *payload, uint8_t length,
+                     uint8_t node = TWAI_BROADCAST_NODE);
+
+/**
+ * Descarta os frames que esperam na fila de transmissão e cancela o que está no controlador, se ainda não
+ * ganhou a arbitragem. Para um frame que não pode esperar os enfileirados antes dele (a fila é FIFO).
+ */
+void twaiClearTransmitQueue();
+
+/**
+ * Envio por mudança: o frame só sai se o conteúdo mudou desde o último envio deste tipo ou se passou o
+ * intervalo de atualização. Octetos fora de `compareMask` (bit i = octeto i) não contam como mudança;
+ * servem para campos que mudam sozinhos, como a idade da amostra de peso. Cada nó de destino tem o seu
+ * último conteúdo.
+ */
+void twaiSendOnChange(TwaiSendMessageKind kind, const uint8_t *payload, uint8_t length, uint8_t compareMask = 0xFF,
+                      uint8_t node = TWAI_BROADCAST_NODE);
+
+/**
+ * Envio com carimbo de transmissão: o frame sai com auto-recepção, e a tarefa de recepção guarda o
+ * instante em que o próprio controlador o recebeu de volta, o fim do frame no barramento, o mesmo
+ * instante em que os outros nós o recebem. Sai para todos os estimuladores. Um tipo por vez; um envio
+ * novo descarta o carimbo anterior.
+ */
+bool twaiSendTimestamped(TwaiSendMessageKind kind, const uint8_t *payload, uint8_t length);
+
+// Verdadeiro uma vez, quando o carimbo do último twaiSendTimestamped deste tipo estiver disponível
+bool twaiTakeTransmitTimestamp(TwaiSendMessageKind kind, uint32_t *micros);
 
 esp_err_t twaiReceive(TwaiReceivedMessage *received);
 
 bool twaiIsAvailable();
+
+TwaiBusStats twaiGetBusStats();
+void twaiResetReceivePeaks();
+
+// O mesmo que twaiGetBusStats().bits, sem copiar o resto; lido pela tarefa de saúde (TwaiHealth.h)
+uint32_t twaiGetBusBits();
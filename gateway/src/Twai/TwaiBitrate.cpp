@@ -0,0 +1,187 @@
+#include "TwaiBitrate.h"
+#include <Arduino.h>
+#include <Preferences.h>
+#include <esp_log.h>
+
+static const char *TAG = "TwaiBitrate";
+
+struct TwaiBitrateLimit
+{
+  uint32_t bitrate;
+
+  // Estimuladores que cabem nos prazos de tools/can_messages.csv nesta taxa; 0 = taxa recusada
+  uint8_t maxNodes;
+
+  // Multiplica o SetBusShare: o feedback de PWM e a telemetria do controle ficam mais espaçados, como se
+  // houvesse mais placas. Vezes maxNodes, não passa de 7, o maior que o estimulador aceita.
+  uint8_t shareScale;
+};
+
+// Índices de twaiBitrateChange. tools/can_rta.py lê esta tabela e confere os prazos em cada taxa aceita, de 1
+// até o seu limite. A 125 kbit/s nem um estimulador cabe: só os frames de controle do gateway, a cada 15 ms,
+// já passam dos prazos.
+static const TwaiBitrateLimit SUPPORTED_BITRATES[] = {
+    {125000, 0, 1},
+    {250000, 1, 2},
+    {500000, 3, 1},
+    {1000000, 7, 1},
+};
+
+#define TWAI_BITRATE_COUNT (sizeof(SUPPORTED_BITRATES) / sizeof(SUPPORTED_BITRATES[0]))
+
+// Ordem da sondagem depois da taxa guardada: as mais usadas primeiro
+static const uint32_t PROBE_ORDER[] = {500000, 1000000, 250000};
+
+static uint32_t activeBitrate = TWAI_DEFAULT_BITRATE;
+
+static Preferences preferences;
+
+static const TwaiBitrateLimit *limitAt(uint32_t bitrate)
+{
+  for (size_t i = 0; i < TWAI_BITRATE_COUNT; i++)
+  {
+    if (SUPPORTED_BITRATES[i].bitrate == bitrate)
+      return &SUPPORTED_BITRATES[i];
+  }
+  return nullptr;
+}
+
+static bool isSupported(uint32_t bitrate)
+{
+  const TwaiBitrateLimit *limit = limitAt(bitrate);
+  return limit != nullptr && limit->maxNodes > 0;
+}
+
+static uint32_t loadBitrate()
+{
+  preferences.begin("twai", true);
+  uint32_t bitrate = preferences.getUInt("bitrate", TWAI_DEFAULT_BITRATE);
+  preferences.end();
+  return isSupported(bitrate) ? bitrate : TWAI_DEFAULT_BITRATE;
+}
+
+static void storeBitrate(uint32_t bitrate)
+{
+  preferences.begin("twai", false);
+  preferences.putUInt("bitrate", bitrate);
+  preferences.end();
+}
+
+twai_timing_config_t twaiBitrateTiming(uint32_t bitrate)
+{
+  switch (bitrate)
+  {
+  case 125000:
+    return TWAI_TIMING_CONFIG_125KBITS();
+  case 250000:
+    return TWAI_TIMING_CONFIG_250KBITS();
+  case 1000000:
+    return TWAI_TIMING_CONFIG_1MBITS();
+  default:
+    return TWAI_TIMING_CONFIG_500KBITS();
+  }
+}
+
+uint32_t twaiGetBitrate()
+{
+  return activeBitrate;
+}
+
+uint8_t twaiBitrateMaxNodes()
+{
+  const TwaiBitrateLimit *limit = limitAt(activeBitrate);
+  return limit != nullptr ? limit->maxNodes : 0;
+}
+
+uint8_t twaiBitrateShareScale()
+{
+  const TwaiBitrateLimit *limit = limitAt(activeBitrate);
+  return limit != nullptr ? limit->shareScale : 1;
+}
+
+// Verdadeiro se chegou um frame válido nesta taxa. Em somente-escuta o nó não confirma nem sinaliza
+// erros, então uma taxa errada não atrapalha o barramento.
+static bool probe(uint32_t bitrate)
+{
+  twai_general_config_t g_config = TWAI_GENERAL_CONFIG_DEFAULT(WIRESS_GPIO_TX, WIRESS_GPIO_RX, TWAI_MODE_LISTEN_ONLY);
+  twai_timing_config_t t_config = twaiBitrateTiming(bitrate);
+  twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+
+  if (twai_driver_install(&g_config, &t_config, &f_config) != ESP_OK)
+    return false;
+
+  bool heard = false;
+  if (twai_start() == ESP_OK)
+  {
+    twai_message_t message;
+    heard = twai_receive(&message, pdMS_TO_TICKS(TWAI_BITRATE_PROBE_WINDOW_MS)) == ESP_OK;
+    twai_stop();
+  }
+  twai_driver_uninstall();
+  return heard;
+}
+
+uint32_t twaiBitrateSelect()
+{
+  uint32_t stored = loadBitrate();
+
+  // Uma volta só: sem o estimulador, o gateway segue com a taxa guardada e o estimulador o acha depois
+  if (probe(stored))
+  {
+    activeBitrate = stored;
+    ESP_LOGI(TAG, "Barramento a %u bit/s", activeBitrate);
+    return activeBitrate;
+  }
+
+  for (size_t i = 0; i < sizeof(PROBE_ORDER) / sizeof(PROBE_ORDER[0]); i++)
+  {
+    if (PROBE_ORDER[i] == stored || !probe(PROBE_ORDER[i]))
+      continue;
+
+    activeBitrate = PROBE_ORDER[i];
+    storeBitrate(activeBitrate);
+    ESP_LOGW(TAG, "Barramento a %u bit/s, não %u; taxa guardada", activeBitrate, stored);
+    return activeBitrate;
+  }
+
+  activeBitrate = stored;
+  ESP_LOGW(TAG, "Barramento em silêncio; usando a taxa guardada, %u bit/s", activeBitrate);
+  return activeBitrate;
+}
+
+bool twaiBitrateChange(uint8_t index)
+{
+  if (index >= TWAI_BITRATE_COUNT)
+  {
+    ESP_LOGW(TAG, "Índice de taxa inválido: %u", index);
+    return false;
+  }
+
+  uint32_t bitrate = SUPPORTED_BITRATES[index].bitrate;
+  if (bitrate == activeBitrate)
+    return false;
+
+  if (!isSupported(bitrate))
+  {
+    ESP_LOGW(TAG, "%u bit/s recusado: os prazos do barramento não cabem nesta taxa", bitrate);
+    return false;
+  }
+
+  ESP_LOGW(TAG, "Trocando o barramento para %u bit/s; os dois nós reiniciam", bitrate);
+
+  for (int i = 0; i < TWAI_BITRATE_ANNOUNCE_COUNT; i++)
+    twaiSend(TwaiSendMessageKind::SetBusBitrate, bitrate / 1000);
+
+  unsigned long start = millis();
+  while (millis() - start < TWAI_BITRATE_ANNOUNCE_TIMEOUT_MS)
+  {
+    twai_status_info_t status;
+    if (twai_get_status_info(&status) != ESP_OK || status.msgs_to_tx == 0)
+      break;
+    delay(1);
+  }
+
+  storeBitrate(bitrate);
+  esp_restart();
+  return true;
+}
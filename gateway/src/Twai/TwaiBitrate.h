@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include <driver/twai.h>
+#include "Twai.h"
+
+/**
+ * Taxa do barramento escolhida em tempo de execução e guardada na flash.
+ *
+ * No boot, antes de instalar o driver, o gateway escuta o barramento em modo somente-escuta em cada
+ * taxa suportada, começando pela guardada; a primeira em que chega um frame válido é adotada (e
+ * guardada, se mudou). Sem nada no barramento (o estimulador ainda não ligou), fica com a guardada.
+ * A troca pelo aplicativo (Diagnostics_SetCanBitrate) avisa o estimulador e reinicia os dois nós.
+ */
+
+#define TWAI_DEFAULT_BITRATE 500000
+
+// Tempo ouvindo cada taxa: o estimulador envia o feedback de PWM a cada 6 ms, 12 ms a 250 kbit/s
+#define TWAI_BITRATE_PROBE_WINDOW_MS 30
+
+// Vezes que SetBusBitrate é enviado antes de o gateway reiniciar, e espera máxima pela fila de transmissão
+#define TWAI_BITRATE_ANNOUNCE_COUNT 3
+#define TWAI_BITRATE_ANNOUNCE_TIMEOUT_MS 50
+
+// Sonda o barramento e retorna a taxa a usar. Chamado por twaiStart com o driver desinstalado.
+uint32_t twaiBitrateSelect();
+
+twai_timing_config_t twaiBitrateTiming(uint32_t bitrate);
+
+// Taxa em uso, em bit/s
+uint32_t twaiGetBitrate();
+
+// Estimuladores que cabem nos prazos do barramento na taxa em uso
+uint8_t twaiBitrateMaxNodes();
+
+// Multiplicador do SetBusShare na taxa em uso: 2 a 250 kbit/s, 1 nas outras
+uint8_t twaiBitrateShareScale();
+
+/**
+ * Troca a taxa do barramento: 0 = 125 kbit/s, 1 = 250 kbit/s, 2 = 500 kbit/s, 3 = 1 Mbit/s.
+ * Envia SetBusBitrate ao estimulador, guarda a taxa e reinicia o gateway. Retorna false (sem reiniciar)
+ * se o índice é inválido, a taxa já está em uso ou os prazos não cabem nela (125 kbit/s).
+ */
+bool twaiBitrateChange(uint8_t index);
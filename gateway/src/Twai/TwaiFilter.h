@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <driver/twai.h>
+
+/**
+ * Identificador de 11 bits: [tipo u8][nó 3 bits]. O tipo vem na frente, então a prioridade na
+ * arbitragem continua sendo a do tipo, e o mesmo tipo de nós diferentes fica lado a lado. Nos frames
+ * do gateway o nó é o destino (0 = todos); nos dos estimuladores, a origem (1 a 7).
+ */
+#define TWAI_NODE_BITS 3
+#define TWAI_NODE_MASK 0x07
+
+/**
+ * Filtro de aceitação do TWAI calculado a partir dos tipos e dos nós que o nó trata.
+ * O hardware compara o ID com um código e uma máscara; um conjunto de IDs espalhados só cabe num
+ * filtro que aceita mais do que o necessário. Por isso o plano também guarda o conjunto exato,
+ * para o estágio de software em `twaiReceive` descartar o que passou a mais.
+ */
+struct TwaiFilterPlan
+{
+  twai_filter_config_t config;
+
+  // Quantos dos 2048 IDs padrão o filtro de hardware deixa passar
+  uint16_t acceptedIdCount;
+
+  // Um bit por tipo tratado pelo nó
+  uint32_t handled[8];
+
+  // Um bit por nó aceito no campo de nó do identificador
+  uint8_t nodes;
+};
+
+/**
+ * Escolhe entre um filtro simples e dois filtros (modo duplo) o que aceita menos IDs.
+ * No modo duplo, os tipos são divididos em dois grupos: por um bit do tipo ou por faixa. `nodes` tem
+ * um bit por nó aceito (bit 0 = difusão) e vale para todos os tipos.
+ */
+TwaiFilterPlan twaiFilterPlan(const uint8_t *kinds, size_t count, uint8_t nodes);
+
+// Verdadeiro se o tipo e o nó do identificador são tratados pelo nó
+bool twaiFilterHandles(const TwaiFilterPlan *plan, uint32_t identifier);
@@ -5,9 +5,18 @@
 #include <driver/twai.h>
 #include <Bluetooth/Bluetooth.h>
 #include "Twai/Twai.h"
+#include "Twai/TwaiHealth.h"
 #include "Scale/Scale.h"
 #include "Data.h"
 #include "StateManager.h"
+#include "Diagnostics/Diagnostics.h"
+#include "Heartbeat/Heartbeat.h"
+#include "EmergencyStop/EmergencyStop.h"
+#include "Telemetry/Telemetry.h"
+#include "Latency/Latency.h"
+#include "Clock/ClockSync.h"
+#include "Nodes/Nodes.h"
+#include "Sniffer/Sniffer.h"
 
 #define ONBOARD_LED 2
 
@@ -18,6 +27,13 @@ Data data;
 
 void setup()
 {
+  // Placa só de captura: nada além do sniffer
+  if (snifferIsEnabled())
+  {
+    snifferStart();
+    return;
+  }
+
   Serial.begin(115200);
   scaleBeginOrDie();
   bluetoothSetup();
@@ -25,16 +41,30 @@ void setup()
 
   twaiSend(TwaiSendMessageKind::GatewayResetHappened, 0);
 
+  nodesBegin();
   stateManager.setup(StateKind::Disconnected);
+  heartbeatBegin();
+  telemetryBegin();
+  latencyBegin();
+  clockSyncBegin();
 
   bluetoothSetControlCallback([](BluetoothControlCode code, uint8_t extraData)
                               {
     ESP_LOGI(TAG, "Control! Code=%X ExtraData=%d\n", code, extraData);
+    telemetryOnBLEControl(code, extraData);
+    nodesOnBLEControl(code, extraData);
     stateManager.onBLEControl(code, extraData); });
 }
 
 void loop()
 {
+  if (snifferIsEnabled())
+  {
+    snifferLoop();
+    delay(10);
+    return;
+  }
+
   // Coletar dados das balanças
   scaleUpdate();
   data.weightL = scaleGetWeightL();
@@ -47,12 +77,36 @@ void loop()
   TwaiReceivedMessage twaiMessage;
   while (twaiReceive(&twaiMessage) == ESP_OK)
   {
+    nodesOnTWAIMessage(&twaiMessage);
+    emergencyStopOnTWAIMessage(&twaiMessage);
+    latencyOnTWAIMessage(&twaiMessage);
+
+    // O resto acompanha um estimulador só, o de menor endereço
+    if (!nodesIsPrimary(twaiMessage.Node))
+      continue;
+
+    data.onTWAIMessage(&twaiMessage);
+    diagnosticsOnTWAIMessage(&twaiMessage);
+    twaiHealthOnTWAIMessage(&twaiMessage);
+    heartbeatOnTWAIMessage(&twaiMessage);
+    telemetryOnTWAIMessage(&twaiMessage);
     stateManager.onTWAIMessage(&twaiMessage);
   }
 
   // Spin da máquina de estados
   stateManager.loop();
 
+  // Prova de vida para o estimulador, só depois de a máquina de estados rodar
+  heartbeatLoop();
+  nodesLoop();
+  emergencyStopLoop();
+  telemetryLoop();
+  latencyLoop();
+  clockSyncLoop();
+
+  diagnosticsLoop();
+  snifferLoop();
+
   // Feedback para o telefone
   data.sendToBle();
 }
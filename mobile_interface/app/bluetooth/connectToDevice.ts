@@ -16,8 +16,9 @@ export default async function connectToDevice(device: Device): Promise<Device |
 
     console.log("Got MTU size: " + device.mtu);
 
-    if (device.mtu < 32) {
-      alert("Erro na conexão Bluetooth: dispositivo não suporta MTU maior que 32.");
+    // Pacote de status (BleStatusPacket, 53 octetos) mais o cabeçalho de 3 octetos da notificação
+    if (device.mtu < 56) {
+      alert("Erro na conexão Bluetooth: dispositivo não suporta MTU de 56 ou mais.");
       throw new Error("Got insufficient MTU size: " + device.mtu);
     }
 
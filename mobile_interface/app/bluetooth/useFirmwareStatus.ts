@@ -16,6 +16,60 @@ export enum FirmwareState {
   OperationStop
 }
 
+export enum CanBusState {
+  Stopped,
+  Running,
+  BusOff,
+  Recovering
+}
+
+/**
+ * Saúde do barramento CAN no gateway e, do último relatório dele, no estimulador.
+ * Os contadores são totais desde o boot do gateway e saturam no máximo do campo.
+ */
+interface CanHealth {
+  state: CanBusState;
+  txErrorCounter: number;
+  rxErrorCounter: number;
+
+  /**
+   * Carga do barramento na última janela de 250 ms, em porcento.
+   */
+  busLoad: number;
+  busOffCount: number;
+  lastRecoveryMs: number;
+  txFailed: number;
+  arbitrationLost: number;
+  rxMissed: number;
+
+  /**
+   * null enquanto o estimulador não enviou nenhum relatório.
+   */
+  stimulator: null | {
+    state: CanBusState;
+    txErrorCounter: number;
+    rxErrorCounter: number;
+    busOffCount: number;
+  };
+}
+
+/**
+ * Ida e volta gateway -> estimulador -> gateway do caminho de controle, em us, na janela móvel do gateway.
+ */
+interface CanLatency {
+  p50Micros: number;
+  p99Micros: number;
+  maxMicros: number;
+}
+
+/**
+ * Offset de `canHealth` no pacote de status: depois dos 6 octetos de mainOperationStateInformApp.
+ */
+const CAN_HEALTH_OFFSET = 28;
+const CAN_HEALTH_LENGTH = 19;
+const CAN_LATENCY_OFFSET = CAN_HEALTH_OFFSET + CAN_HEALTH_LENGTH;
+const CAN_LATENCY_LENGTH = 6;
+
 interface StatusPacket {
   pwm: number;
   weightL: number;
@@ -27,6 +81,7 @@ interface StatusPacket {
   statusFlags: {
     isEEGFlagSet: boolean;
     isCANAvailable: boolean;
+    isPulseScheduleInvalid: boolean;
   };
   mainOperationState:
     | null
@@ -45,6 +100,16 @@ interface StatusPacket {
         errorPositiveTimer: number;
       }
     | { state: FirmwareState.OperationStop; pwmDecreaseTimeDelta: number };
+
+  /**
+   * null com um gateway anterior ao envio da saúde do barramento.
+   */
+  canHealth: CanHealth | null;
+
+  /**
+   * null com um gateway anterior à medição de latência.
+   */
+  canLatency: CanLatency | null;
   parameters: {
     gradualIncreaseTime: number;
     transitionTime: number;
@@ -81,20 +146,62 @@ const ControlCodes = {
   Parallel_SetWeightFromArgument: 0x16,
   Parallel_Complete: 0x1f,
 
+  ParameterSetup_SetChannelAmplitude0: 0x41,
+  ParameterSetup_SetChannelAmplitude1: 0x42,
+  ParameterSetup_SetChannelOffset0: 0x43,
+  ParameterSetup_SetChannelOffset1: 0x44,
+
   MainOperation_GoBackToParallel: 0x30,
   MainOperation_SetSetpoint: 0x31,
   MainOperation_IncreaseMESEMaxOnce: 0x32,
   MainOperation_DecreaseMESEMaxOnce: 0x33,
   MainOperation_EmergencyStop: 0x38,
 
+  /**
+   * Curva das rampas de subida gradual e de parada: 0 = linear, 1 = exponencial, 2 = curva em S.
+   */
+  ParameterSetup_SetRampProfile: 0x60,
   ParameterSetup_SetGradualIncreaseTime: 0x61,
+  ParameterSetup_SetProportionalGain: 0x62,
   ParameterSetup_SetTransitionTime: 0x63,
   ParameterSetup_SetGradualDecreaseTime: 0x64,
+  ParameterSetup_SetIntegralGain: 0x65,
   ParameterSetup_SetMalhaFechadaAboveSetpointTime: 0x66,
   ParameterSetup_SetGainCoefficient: 0x67,
+  ParameterSetup_SetWaveformFrequency: 0x68,
+  ParameterSetup_SetWaveformPulsesPerTrain: 0x69,
+  ParameterSetup_SetWaveformIntraTrainInterval: 0x6a,
+  ParameterSetup_SetWaveformInterphaseGap: 0x6b,
+  ParameterSetup_SetWaveformSecondPhase: 0x6c,
   ParameterSetup_Reset: 0x6d,
   ParameterSetup_Save: 0x6e,
-  ParameterSetup_Complete: 0x6f
+  ParameterSetup_Complete: 0x6f,
+
+  Diagnostics_RunPulseBenchmark: 0x70,
+  Diagnostics_SetTelemetryRate: 0x71,
+
+  /**
+   * Taxa do barramento CAN: 0 = 125 kbit/s, 1 = 250 kbit/s, 2 = 500 kbit/s, 3 = 1 Mbit/s. 0 é
+   * recusado: os prazos do barramento não cabem nela.
+   * Só na parametrização; o gateway e o estimulador reiniciam na nova taxa.
+   */
+  Diagnostics_SetCanBitrate: 0x72,
+
+  /**
+   * Escolhe, pelo endereço no barramento (1 a 7), o estimulador que os próximos controles Nodes_ ajustam.
+   */
+  Nodes_SelectNode: 0x73,
+
+  /**
+   * Fração, em %, do PWM pedido que vai para o estimulador escolhido. 100 (o padrão) = o PWM inteiro.
+   */
+  Nodes_SetPwmPercent: 0x74,
+
+  /**
+   * 1 = o gateway reinicia em modo sniffer (só escuta o barramento e grava na serial).
+   * Só na parametrização, numa placa que não controla o estimulador.
+   */
+  Diagnostics_SetSnifferMode: 0x75
 } as const;
 
 type ControlCodeDispatcher = (options: {
@@ -103,6 +210,66 @@ type ControlCodeDispatcher = (options: {
   data?: number;
 }) => Promise<boolean>;
 
+function parseCanHealth(packet: Buffer): CanHealth | null {
+  if (packet.length < CAN_HEALTH_OFFSET + CAN_HEALTH_LENGTH) {
+    return null;
+  }
+
+  const reader = new BufferReader(packet);
+  reader.offset = CAN_HEALTH_OFFSET;
+
+  const state = reader.readUnsignedChar() as CanBusState;
+  const txErrorCounter = reader.readUnsignedChar();
+  const rxErrorCounter = reader.readUnsignedChar();
+  const busLoad = reader.readUnsignedShortLE() / 10;
+  const busOffCount = reader.readUnsignedShortLE();
+  const lastRecoveryMs = reader.readUnsignedShortLE();
+  const txFailed = reader.readUnsignedShortLE();
+  const arbitrationLost = reader.readUnsignedShortLE();
+  const rxMissed = reader.readUnsignedShortLE();
+
+  const stimulatorState = reader.readUnsignedChar();
+  const stimulatorTxErrorCounter = reader.readUnsignedChar();
+  const stimulatorRxErrorCounter = reader.readUnsignedChar();
+  const stimulatorBusOffCount = reader.readUnsignedChar();
+
+  return {
+    state,
+    txErrorCounter,
+    rxErrorCounter,
+    busLoad,
+    busOffCount,
+    lastRecoveryMs,
+    txFailed,
+    arbitrationLost,
+    rxMissed,
+    stimulator:
+      stimulatorState === 0xff
+        ? null
+        : {
+            state: stimulatorState as CanBusState,
+            txErrorCounter: stimulatorTxErrorCounter,
+            rxErrorCounter: stimulatorRxErrorCounter,
+            busOffCount: stimulatorBusOffCount
+          }
+  };
+}
+
+function parseCanLatency(packet: Buffer): CanLatency | null {
+  if (packet.length < CAN_LATENCY_OFFSET + CAN_LATENCY_LENGTH) {
+    return null;
+  }
+
+  const reader = new BufferReader(packet);
+  reader.offset = CAN_LATENCY_OFFSET;
+
+  return {
+    p50Micros: reader.readUnsignedShortLE(),
+    p99Micros: reader.readUnsignedShortLE(),
+    maxMicros: reader.readUnsignedShortLE()
+  };
+}
+
 function parseStatusPacket(packet: Buffer): StatusPacket {
   const reader = new BufferReader(packet);
 
@@ -117,7 +284,8 @@ function parseStatusPacket(packet: Buffer): StatusPacket {
   const statusFlagsByte = reader.readUnsignedChar();
   const statusFlags: StatusPacket["statusFlags"] = {
     isEEGFlagSet: (statusFlagsByte & 0b00000001) > 0,
-    isCANAvailable: (statusFlagsByte & 0b00000010) > 0
+    isCANAvailable: (statusFlagsByte & 0b00000010) > 0,
+    isPulseScheduleInvalid: (statusFlagsByte & 0b00000100) > 0
   };
 
   const parameters: StatusPacket["parameters"] = {
@@ -172,6 +340,9 @@ function parseStatusPacket(packet: Buffer): StatusPacket {
       mainOpStateObj = null;
   }
 
+  const canHealth = parseCanHealth(packet);
+  const canLatency = parseCanLatency(packet);
+
   return {
     pwm,
     weightL,
@@ -182,7 +353,9 @@ function parseStatusPacket(packet: Buffer): StatusPacket {
     setpoint,
     statusFlags,
     parameters,
-    mainOperationState: mainOpStateObj
+    mainOperationState: mainOpStateObj,
+    canHealth,
+    canLatency
   };
 }
 
@@ -198,9 +371,12 @@ export function useFirmwareStatus(): [StatusPacket, ControlCodeDispatcher] {
     setpoint: 0,
     statusFlags: {
       isEEGFlagSet: false,
-      isCANAvailable: false
+      isCANAvailable: false,
+      isPulseScheduleInvalid: false
     },
     mainOperationState: null,
+    canHealth: null,
+    canLatency: null,
     parameters: {
       gradualIncreaseTime: 0,
       transitionTime: 0,
@@ -11,7 +11,7 @@ import {
   hapticFeedbackProcessError
 } from "../../haptics/HapticFeedback";
 import { run } from "../../utils/run";
-import { useFirmwareStatus } from "../../bluetooth/useFirmwareStatus";
+import { CanBusState, useFirmwareStatus } from "../../bluetooth/useFirmwareStatus";
 import { useNavigation } from "../../hooks/useNavigation";
 import StatusCANUp from "../../../assets/OnlineStatusAvailable.svg";
 import StatusCANDown from "../../../assets/OnlineStatusBusy.svg";
@@ -184,11 +184,29 @@ export default function BluetoothConnectView() {
                     alignItems: "center"
                   }}>
                   {run(() => {
+                    const canHealth = firmwareStatus.canHealth;
                     if (firmwareStatus.statusFlags.isCANAvailable) {
                       return (
                         <>
                           <StatusCANUp width={16} height={16} />
-                          <Text>Barramento disponível</Text>
+                          <Text>
+                            Barramento disponível
+                            {canHealth !== null && ` - ${canHealth.busLoad.toFixed(1)}% de carga`}
+                            {firmwareStatus.canLatency !== null &&
+                              `, ida e volta p99 ${(firmwareStatus.canLatency.p99Micros / 1000).toFixed(1)} ms`}
+                          </Text>
+                        </>
+                      );
+                    } else if (
+                      canHealth?.state === CanBusState.BusOff ||
+                      canHealth?.state === CanBusState.Recovering
+                    ) {
+                      return (
+                        <>
+                          <StatusCANDown width={24} height={24} />
+                          <Text style={{ fontWeight: "bold", marginRight: 30 }}>
+                            Barramento em recuperação automática (bus-off {canHealth.busOffCount}).
+                          </Text>
                         </>
                       );
                     } else {
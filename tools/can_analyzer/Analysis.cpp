@@ -0,0 +1,565 @@
+#include "Analysis.h"
+#include <math.h>
+#include <string.h>
+
+#define LINK_MIN_TIMEOUT_MICROS (ANALYSIS_LINK_MIN_TIMEOUT_MS * 1000ULL)
+#define LINK_UNARMED_TIMEOUT_MICROS (ANALYSIS_LINK_UNARMED_TIMEOUT_MS * 1000ULL)
+
+static int histogramBucket(uint64_t value)
+{
+    if (value < ANALYSIS_HISTOGRAM_EXACT)
+        return (int)value;
+
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent > ANALYSIS_HISTOGRAM_MAX_EXPONENT)
+        return ANALYSIS_HISTOGRAM_BUCKETS - 1;
+    int fraction = (value >> (exponent - 3)) & (ANALYSIS_HISTOGRAM_SUBBUCKETS - 1);
+    return ANALYSIS_HISTOGRAM_EXACT + (exponent - 4) * ANALYSIS_HISTOGRAM_SUBBUCKETS + fraction;
+}
+
+static uint64_t histogramUpperBound(int bucket)
+{
+    if (bucket < ANALYSIS_HISTOGRAM_EXACT)
+        return bucket;
+
+    int exponent = (bucket - ANALYSIS_HISTOGRAM_EXACT) / ANALYSIS_HISTOGRAM_SUBBUCKETS + 4;
+    int fraction = (bucket - ANALYSIS_HISTOGRAM_EXACT) % ANALYSIS_HISTOGRAM_SUBBUCKETS;
+    return ((uint64_t)(ANALYSIS_HISTOGRAM_SUBBUCKETS + fraction + 1) << (exponent - 3)) - 1;
+}
+
+void intervalAdd(IntervalStats *stats, uint64_t value)
+{
+    if (stats->count == 0 || value < stats->min)
+        stats->min = value;
+    if (value > stats->max)
+        stats->max = value;
+    stats->count++;
+    stats->sum += value;
+    stats->sumSquares += (double)value * value;
+    stats->histogram.counts[histogramBucket(value)]++;
+}
+
+void intervalMerge(IntervalStats *total, const IntervalStats &other)
+{
+    if (other.count == 0)
+        return;
+    if (total->count == 0 || other.min < total->min)
+        total->min = other.min;
+    if (other.max > total->max)
+        total->max = other.max;
+    total->count += other.count;
+    total->sum += other.sum;
+    total->sumSquares += other.sumSquares;
+    for (int i = 0; i < ANALYSIS_HISTOGRAM_BUCKETS; i++)
+        total->histogram.counts[i] += other.histogram.counts[i];
+}
+
+uint64_t intervalPercentile(const IntervalStats &stats, double fraction)
+{
+    if (stats.count == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)ceil(fraction * stats.count);
+    if (rank == 0)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < ANALYSIS_HISTOGRAM_BUCKETS; i++)
+    {
+        seen += stats.histogram.counts[i];
+        if (seen >= rank)
+        {
+            uint64_t bound = histogramUpperBound(i);
+            return bound < stats.max ? bound : stats.max;
+        }
+    }
+    return stats.max;
+}
+
+double intervalStandardDeviation(const IntervalStats &stats)
+{
+    if (stats.count < 2)
+        return 0;
+    double mean = stats.sum / stats.count;
+    double variance = stats.sumSquares / stats.count - mean * mean;
+    return variance > 0 ? sqrt(variance) : 0;
+}
+
+void analysisInit(ChunkSummary *summary)
+{
+    summary->lines = 0;
+    summary->frames = 0;
+    summary->pulseWidthLines = 0;
+    summary->comments = 0;
+    summary->invalidLines = 0;
+    summary->extendedFrames = 0;
+    summary->droppedReported = 0;
+    summary->any = false;
+    summary->firstMicros = 0;
+    summary->lastMicros = 0;
+    summary->lastRawMicros = 0;
+    for (int i = 0; i < PROTOCOL_STANDARD_ID_COUNT; i++)
+        summary->identifierIndex[i] = -1;
+    summary->identifiers.clear();
+    summary->sourceNodes = 0;
+    for (int node = 0; node <= PROTOCOL_MAX_NODE; node++)
+    {
+        for (WatchdogFeed *feed : {&summary->heartbeats[node], &summary->unarmedFeeds[node]})
+        {
+            feed->seen = false;
+            feed->firstMicros = 0;
+            feed->lastMicros = 0;
+            feed->gaps.clear();
+        }
+    }
+    summary->events.clear();
+}
+
+static IdentifierStats *identifierStats(ChunkSummary *summary, uint32_t identifier)
+{
+    int32_t index = summary->identifierIndex[identifier];
+    if (index >= 0)
+        return &summary->identifiers[index];
+
+    summary->identifierIndex[identifier] = summary->identifiers.size();
+    summary->identifiers.emplace_back();
+    IdentifierStats *stats = &summary->identifiers.back();
+    memset(stats, 0, sizeof(IdentifierStats));
+    stats->identifier = identifier;
+    return stats;
+}
+
+// Retorna true se o frame fecha uma lacuna
+static bool feedWatchdog(WatchdogFeed *feed, uint64_t micros, uint64_t thresholdMicros)
+{
+    bool gap = false;
+    if (!feed->seen)
+    {
+        feed->seen = true;
+        feed->firstMicros = micros;
+    }
+    else if (micros - feed->lastMicros >= thresholdMicros)
+    {
+        feed->gaps.push_back({feed->lastMicros, micros - feed->lastMicros});
+        gap = true;
+    }
+    feed->lastMicros = micros;
+    return gap;
+}
+
+// Um frame do gateway para o estimulador `node`: antes do primeiro heartbeat, qualquer um alimenta o watchdog.
+// Retorna true se o frame fecha uma lacuna, que pode ter sido uma perda do enlace.
+static bool feedNode(ChunkSummary *summary, uint8_t node, uint64_t micros, bool heartbeat)
+{
+    bool gap = false;
+    if (!summary->heartbeats[node].seen)
+        gap = feedWatchdog(&summary->unarmedFeeds[node], micros, LINK_UNARMED_TIMEOUT_MICROS);
+    if (heartbeat)
+        gap = feedWatchdog(&summary->heartbeats[node], micros, LINK_MIN_TIMEOUT_MICROS) || gap;
+    return gap;
+}
+
+/**
+ * Os eventos repetidos são a maior parte do tráfego (o mesmo modo e o mesmo PWM a cada 15 ms, o mesmo
+ * estado a cada heartbeat). Dentro do pedaço, só entra o que pode mudar alguma coisa: um comando igual ao
+ * último para o mesmo destino sai, a não ser que um comando para todos (ou, no caso de um para todos,
+ * qualquer comando) tenha vindo no meio. O primeiro de cada pedaço sempre entra, e a linha do tempo
+ * descarta as repetições que sobram na fronteira.
+ */
+struct CommandFilter
+{
+    int32_t lastValue[PROTOCOL_MAX_NODE + 1];
+    uint64_t lastIndex[PROTOCOL_MAX_NODE + 1];
+    uint64_t lastBroadcastIndex;
+    uint64_t count;
+};
+
+static void commandFilterInit(CommandFilter *filter)
+{
+    for (int node = 0; node <= PROTOCOL_MAX_NODE; node++)
+    {
+        filter->lastValue[node] = -1;
+        filter->lastIndex[node] = 0;
+    }
+    filter->lastBroadcastIndex = 0;
+    filter->count = 0;
+}
+
+static bool commandFilterKeep(CommandFilter *filter, uint8_t node, int32_t value)
+{
+    bool repeated = filter->lastValue[node] == value &&
+                    (node == 0 ? filter->lastIndex[0] == filter->count
+                               : filter->lastBroadcastIndex < filter->lastIndex[node]);
+    if (repeated)
+        return false;
+
+    filter->count++;
+    filter->lastValue[node] = value;
+    filter->lastIndex[node] = filter->count;
+    if (node == 0)
+        filter->lastBroadcastIndex = filter->count;
+    return true;
+}
+
+struct ChunkState
+{
+    CommandFilter modes;
+    CommandFilter pwm;
+    int32_t lastFeedback[PROTOCOL_MAX_NODE + 1];
+    int32_t lastGatewayState;
+};
+
+static void addEvent(ChunkSummary *summary, uint64_t micros, EventKind kind, uint8_t node, uint16_t value)
+{
+    summary->events.push_back({micros, kind, node, value});
+}
+
+static void addModeEvent(ChunkSummary *summary, ChunkState *state, uint64_t micros, EventKind kind, uint8_t node)
+{
+    if (commandFilterKeep(&state->modes, node, (int32_t)kind))
+        addEvent(summary, micros, kind, node, 0);
+}
+
+static void addPwmCommand(ChunkSummary *summary, ChunkState *state, uint64_t micros, uint8_t node, uint16_t pwm)
+{
+    if (commandFilterKeep(&state->pwm, node, pwm))
+        addEvent(summary, micros, EventKind::PwmCommand, node, pwm);
+}
+
+static uint16_t readU16(const uint8_t *data)
+{
+    return (data[0] << 8) | data[1];
+}
+
+static void collectEvents(ChunkSummary *summary, ChunkState *state, const TraceFrame &frame)
+{
+    const ProtocolKinds &kinds = protocolKinds();
+    int kind = frame.identifier >> PROTOCOL_NODE_BITS;
+    uint8_t node = frame.identifier & PROTOCOL_NODE_MASK;
+
+    if (kind == kinds.heartbeat && frame.length >= 1)
+    {
+        if (state->lastGatewayState != frame.data[0])
+        {
+            state->lastGatewayState = frame.data[0];
+            addEvent(summary, frame.micros, EventKind::GatewayState, 0, frame.data[0]);
+        }
+    }
+    else if (kind == kinds.operationCommand && frame.length >= 8)
+    {
+        uint8_t fields = frame.data[0];
+        if (fields & PROTOCOL_OPERATION_USE_MALHA_ABERTA)
+            addModeEvent(summary, state, frame.micros, EventKind::UseMalhaAberta, node);
+        if (fields & PROTOCOL_OPERATION_USE_MALHA_FECHADA)
+            addModeEvent(summary, state, frame.micros, EventKind::UseMalhaFechada, node);
+        if (fields & PROTOCOL_OPERATION_REQUESTED_PWM)
+            addPwmCommand(summary, state, frame.micros, node, readU16(&frame.data[PROTOCOL_OPERATION_PWM_OFFSET]));
+    }
+    else if (kind == kinds.setRequestedPwm && frame.length >= 2)
+    {
+        addPwmCommand(summary, state, frame.micros, node, readU16(frame.data));
+    }
+    else if (kind == kinds.pwmFeedback && frame.length >= 2)
+    {
+        uint16_t pwm = readU16(frame.data);
+        if (state->lastFeedback[node] != pwm)
+        {
+            state->lastFeedback[node] = pwm;
+            addEvent(summary, frame.micros, EventKind::PwmFeedback, node, pwm);
+        }
+    }
+    else if (kind == kinds.useMalhaAberta)
+    {
+        addModeEvent(summary, state, frame.micros, EventKind::UseMalhaAberta, node);
+    }
+    else if (kind == kinds.useMalhaFechada)
+    {
+        addModeEvent(summary, state, frame.micros, EventKind::UseMalhaFechada, node);
+    }
+    else if (kind == kinds.emergencyStop)
+    {
+        addModeEvent(summary, state, frame.micros, EventKind::EmergencyStop, node);
+    }
+    else if (kind == kinds.emergencyStopZeroReached)
+    {
+        addModeEvent(summary, state, frame.micros, EventKind::ZeroReached, node);
+    }
+    else if (kind == kinds.gatewayResetHappened)
+    {
+        addEvent(summary, frame.micros, EventKind::GatewayReset, 0, 0);
+    }
+    else if (kind == kinds.setLinkTimeout && frame.length >= 2)
+    {
+        addEvent(summary, frame.micros, EventKind::SetLinkTimeout, node, readU16(frame.data));
+    }
+}
+
+static void collectFrame(ChunkSummary *summary, ChunkState *state, const TraceFrame &frame)
+{
+    summary->frames++;
+    if (frame.extended || frame.identifier >= PROTOCOL_STANDARD_ID_COUNT)
+    {
+        summary->extendedFrames++;
+        return;
+    }
+
+    IdentifierStats *stats = identifierStats(summary, frame.identifier);
+    if (stats->frames == 0)
+        stats->firstMicros = frame.micros;
+    else if (frame.micros >= stats->lastMicros)
+        intervalAdd(&stats->intervals, frame.micros - stats->lastMicros);
+    stats->frames++;
+    stats->lastMicros = frame.micros;
+
+    uint8_t node = frame.identifier & PROTOCOL_NODE_MASK;
+    const KindInfo &kind = protocolKind(frame.identifier >> PROTOCOL_NODE_BITS);
+    if (kind.origin == Origin::Estimulador)
+    {
+        summary->sourceNodes |= 1 << node;
+    }
+    else if (kind.origin == Origin::Gateway)
+    {
+        // Um heartbeat remoto não tem a sequência, e o estimulador o descarta
+        int kindId = frame.identifier >> PROTOCOL_NODE_BITS;
+        bool heartbeat = kindId == protocolKinds().heartbeat && !frame.remote;
+        bool gap = false;
+        if (node != 0)
+        {
+            gap = feedNode(summary, node, frame.micros, heartbeat);
+        }
+        else
+        {
+            for (int target = 1; target <= PROTOCOL_MAX_NODE; target++)
+                gap = feedNode(summary, target, frame.micros, heartbeat) || gap;
+        }
+
+        // Depois de uma perda, o primeiro comando de modo tira a placa da parada, mesmo repetido
+        if (gap)
+            commandFilterInit(&state->modes);
+    }
+
+    if (!frame.remote)
+        collectEvents(summary, state, frame);
+}
+
+// Instante contínuo a partir do instante do log: desfaz a volta do relógio de 32 bits e os reinícios
+static uint64_t continuousMicros(uint64_t raw, uint64_t previousRaw, uint64_t previous, uint64_t *offset)
+{
+    if (raw + *offset < previous)
+    {
+        if (previousRaw > (1ULL << 32) - ANALYSIS_WRAP_WINDOW_MICROS && previousRaw < (1ULL << 32))
+            *offset += 1ULL << 32;
+        else
+            *offset = previous - raw;
+    }
+    return raw + *offset;
+}
+
+void analysisChunk(const TraceFile &trace, size_t begin, size_t end, ChunkSummary *summary)
+{
+    analysisInit(summary);
+
+    ChunkState state;
+    commandFilterInit(&state.modes);
+    commandFilterInit(&state.pwm);
+    for (int node = 0; node <= PROTOCOL_MAX_NODE; node++)
+        state.lastFeedback[node] = -1;
+    state.lastGatewayState = -1;
+
+    uint64_t offset = 0;
+    const char *line = trace.data + begin;
+    const char *limit = trace.data + end;
+    while (line < limit)
+    {
+        TraceFrame frame;
+        const char *next;
+        uint64_t dropped = 0;
+        TraceLineKind lineKind = traceParseLine(line, limit, &next, &frame, &dropped);
+        line = next;
+        summary->lines++;
+
+        switch (lineKind)
+        {
+        case TraceLineKind::Frame:
+            break;
+        case TraceLineKind::PulseWidth:
+            summary->pulseWidthLines++;
+            continue;
+        case TraceLineKind::Comment:
+            summary->comments++;
+            if (dropped > summary->droppedReported)
+                summary->droppedReported = dropped;
+            continue;
+        case TraceLineKind::Invalid:
+            summary->invalidLines++;
+            continue;
+        }
+
+        uint64_t raw = frame.micros;
+        if (!summary->any)
+        {
+            summary->any = true;
+            summary->firstMicros = raw;
+            summary->lastMicros = raw;
+        }
+        frame.micros = continuousMicros(raw, summary->lastRawMicros, summary->lastMicros, &offset);
+        summary->lastMicros = frame.micros;
+        summary->lastRawMicros = raw;
+
+        collectFrame(summary, &state, frame);
+    }
+}
+
+static void shift(ChunkSummary *summary, uint64_t offset)
+{
+    if (offset == 0)
+        return;
+
+    summary->firstMicros += offset;
+    summary->lastMicros += offset;
+    for (IdentifierStats &stats : summary->identifiers)
+    {
+        stats.firstMicros += offset;
+        stats.lastMicros += offset;
+    }
+    for (int node = 0; node <= PROTOCOL_MAX_NODE; node++)
+    {
+        for (WatchdogFeed *feed : {&summary->heartbeats[node], &summary->unarmedFeeds[node]})
+        {
+            feed->firstMicros += offset;
+            feed->lastMicros += offset;
+            for (Gap &gap : feed->gaps)
+                gap.startMicros += offset;
+        }
+    }
+    for (Event &event : summary->events)
+        event.micros += offset;
+}
+
+// Junta a `merged` o mesmo feed do pedaço seguinte, com a lacuna da fronteira
+static void mergeFeed(WatchdogFeed *merged, WatchdogFeed *feed, uint64_t thresholdMicros)
+{
+    if (!feed->seen)
+        return;
+    if (!merged->seen)
+    {
+        std::swap(*merged, *feed);
+        return;
+    }
+
+    if (feed->firstMicros - merged->lastMicros >= thresholdMicros)
+        merged->gaps.push_back({merged->lastMicros, feed->firstMicros - merged->lastMicros});
+    merged->gaps.insert(merged->gaps.end(), feed->gaps.begin(), feed->gaps.end());
+    merged->lastMicros = feed->lastMicros;
+}
+
+void analysisMerge(ChunkSummary *total, ChunkSummary *next)
+{
+    total->lines += next->lines;
+    total->frames += next->frames;
+    total->pulseWidthLines += next->pulseWidthLines;
+    total->comments += next->comments;
+    total->invalidLines += next->invalidLines;
+    total->extendedFrames += next->extendedFrames;
+    if (next->droppedReported > total->droppedReported)
+        total->droppedReported = next->droppedReported;
+    total->sourceNodes |= next->sourceNodes;
+
+    if (!next->any)
+        return;
+    if (!total->any)
+    {
+        std::swap(total->identifiers, next->identifiers);
+        memcpy(total->identifierIndex, next->identifierIndex, sizeof(total->identifierIndex));
+        for (int node = 0; node <= PROTOCOL_MAX_NODE; node++)
+        {
+            std::swap(total->heartbeats[node], next->heartbeats[node]);
+            std::swap(total->unarmedFeeds[node], next->unarmedFeeds[node]);
+        }
+        std::swap(total->events, next->events);
+        total->any = true;
+        total->firstMicros = next->firstMicros;
+        total->lastMicros = next->lastMicros;
+        total->lastRawMicros = next->lastRawMicros;
+        return;
+    }
+
+    // O pedaço seguinte começa na escala do fim do anterior, com a mesma regra da volta do relógio
+    uint64_t offset = total->lastMicros - total->lastRawMicros;
+    continuousMicros(next->firstMicros, total->lastRawMicros, total->lastMicros, &offset);
+    shift(next, offset);
+
+    for (IdentifierStats &stats : next->identifiers)
+    {
+        int32_t index = total->identifierIndex[stats.identifier];
+        if (index < 0)
+        {
+            total->identifierIndex[stats.identifier] = total->identifiers.size();
+            total->identifiers.push_back(stats);
+            continue;
+        }
+
+        IdentifierStats &merged = total->identifiers[index];
+        if (stats.firstMicros >= merged.lastMicros)
+            intervalAdd(&merged.intervals, stats.firstMicros - merged.lastMicros);
+        intervalMerge(&merged.intervals, stats.intervals);
+        merged.frames += stats.frames;
+        merged.lastMicros = stats.lastMicros;
+    }
+
+    for (int node = 0; node <= PROTOCOL_MAX_NODE; node++)
+    {
+        // Depois de um heartbeat, os outros frames já não contam
+        if (!total->heartbeats[node].seen)
+            mergeFeed(&total->unarmedFeeds[node], &next->unarmedFeeds[node], LINK_UNARMED_TIMEOUT_MICROS);
+        mergeFeed(&total->heartbeats[node], &next->heartbeats[node], LINK_MIN_TIMEOUT_MICROS);
+    }
+
+    total->events.insert(total->events.end(), next->events.begin(), next->events.end());
+    total->lastMicros = next->lastMicros;
+    total->lastRawMicros = next->lastRawMicros;
+}
+
+std::vector<LinkLoss> analysisLinkLosses(const ChunkSummary &total, uint8_t node)
+{
+    std::vector<LinkLoss> losses;
+    for (const Gap &gap : total.unarmedFeeds[node].gaps)
+        losses.push_back({gap.startMicros, gap.startMicros + gap.lengthMicros,
+                          gap.startMicros + LINK_UNARMED_TIMEOUT_MICROS, ANALYSIS_LINK_UNARMED_TIMEOUT_MS, false});
+
+    // Os timeouts configurados para a placa ou para todos, em ordem, com o mínimo do firmware
+    std::vector<Event> timeouts;
+    for (const Event &event : total.events)
+    {
+        if (event.kind != EventKind::SetLinkTimeout || (event.node != 0 && event.node != node))
+            continue;
+        Event timeout = event;
+        if (timeout.value < ANALYSIS_LINK_MIN_TIMEOUT_MS)
+            timeout.value = ANALYSIS_LINK_MIN_TIMEOUT_MS;
+        timeouts.push_back(timeout);
+    }
+
+    uint16_t timeoutMs = ANALYSIS_LINK_DEFAULT_TIMEOUT_MS;
+    size_t next = 0;
+    for (const Gap &gap : total.heartbeats[node].gaps)
+    {
+        uint64_t end = gap.startMicros + gap.lengthMicros;
+        while (next < timeouts.size() && timeouts[next].micros <= gap.startMicros)
+            timeoutMs = timeouts[next++].value;
+
+        // Um timeout novo no meio da lacuna vale a partir de quando chega: o firmware confere a cada loop
+        uint16_t detectedTimeoutMs = timeoutMs;
+        uint64_t detected = gap.startMicros + timeoutMs * 1000ULL;
+        for (size_t i = next; i < timeouts.size() && timeouts[i].micros < detected && timeouts[i].micros < end; i++)
+        {
+            detectedTimeoutMs = timeouts[i].value;
+            detected = gap.startMicros + detectedTimeoutMs * 1000ULL;
+            if (detected < timeouts[i].micros)
+                detected = timeouts[i].micros;
+        }
+
+        if (detected <= end)
+            losses.push_back({gap.startMicros, end, detected, detectedTimeoutMs, true});
+    }
+    return losses;
+}
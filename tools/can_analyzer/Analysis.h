@@ -0,0 +1,190 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "Protocol.h"
+#include "TraceFile.h"
+
+/**
+ * Análise de um pedaço do log, independente dos outros, e junção dos pedaços na ordem do arquivo.
+ *
+ * Cada pedaço guarda só o que se junta sem reler frames: contagens e intervalos por identificador, as
+ * lacunas do watchdog de cada estimulador e uma lista curta de eventos (mudanças de estado, de modo e de
+ * PWM) para a linha do tempo. O que cruza a fronteira entre dois pedaços (o intervalo entre o último frame
+ * de um e o primeiro do seguinte, uma lacuna, a volta do relógio) é resolvido na junção.
+ *
+ * O watchdog segue o do estimulador (Link/LinkMonitor.h): só o heartbeat o alimenta, com o timeout do último
+ * SetLinkTimeout; antes do primeiro heartbeat, qualquer frame do gateway, com um timeout fixo. Como o timeout
+ * em vigor depende do que veio antes no log, cada pedaço guarda as lacunas que passam do menor timeout aceito,
+ * e analysisLinkLosses decide quais foram perdas depois da junção.
+ */
+
+// Timeouts do enlace no estimulador (Link/LinkMonitor.h): o padrão até o primeiro SetLinkTimeout, o menor
+// aceito e o de antes do primeiro heartbeat
+#define ANALYSIS_LINK_DEFAULT_TIMEOUT_MS 100
+#define ANALYSIS_LINK_MIN_TIMEOUT_MS 30
+#define ANALYSIS_LINK_UNARMED_TIMEOUT_MS 1000
+
+// Histograma logarítmico: exato até 15 us, depois 8 faixas por oitava (~9% de resolução), até 2^40 us
+#define ANALYSIS_HISTOGRAM_EXACT 16
+#define ANALYSIS_HISTOGRAM_SUBBUCKETS 8
+#define ANALYSIS_HISTOGRAM_MAX_EXPONENT 40
+#define ANALYSIS_HISTOGRAM_BUCKETS \
+    (ANALYSIS_HISTOGRAM_EXACT + (ANALYSIS_HISTOGRAM_MAX_EXPONENT - 4 + 1) * ANALYSIS_HISTOGRAM_SUBBUCKETS)
+
+// A captura do estimulador usa o micros() de 32 bits. Um relógio que volta para perto de zero a menos disso
+// do fim deu a volta; fora disso, o nó reiniciou (a mesma regra do host/replay_main.cpp).
+#define ANALYSIS_WRAP_WINDOW_MICROS 10000000ULL
+
+struct Histogram
+{
+    uint64_t counts[ANALYSIS_HISTOGRAM_BUCKETS];
+};
+
+struct IntervalStats
+{
+    uint64_t count;
+    double sum;
+    double sumSquares;
+    uint64_t min;
+    uint64_t max;
+    Histogram histogram;
+};
+
+void intervalAdd(IntervalStats *stats, uint64_t value);
+void intervalMerge(IntervalStats *total, const IntervalStats &other);
+
+// Limite superior da faixa que contém o percentil `fraction` (0 a 1), nunca acima do máximo
+uint64_t intervalPercentile(const IntervalStats &stats, double fraction);
+double intervalStandardDeviation(const IntervalStats &stats);
+
+struct IdentifierStats
+{
+    uint32_t identifier;
+    uint64_t frames;
+    uint64_t firstMicros;
+    uint64_t lastMicros;
+
+    // Entre frames consecutivos deste identificador
+    IntervalStats intervals;
+};
+
+struct Gap
+{
+    uint64_t startMicros;
+    uint64_t lengthMicros;
+};
+
+// O que alimenta o watchdog de um estimulador: heartbeats, ou antes deles qualquer frame do gateway para ele ou
+// para todos
+struct WatchdogFeed
+{
+    bool seen;
+    uint64_t firstMicros;
+    uint64_t lastMicros;
+
+    // Intervalos maiores que o menor timeout possível
+    std::vector<Gap> gaps;
+};
+
+// Uma perda do enlace vista por um estimulador
+struct LinkLoss
+{
+    // O último frame que alimentou o watchdog antes da perda e o seguinte
+    uint64_t startMicros;
+    uint64_t endMicros;
+
+    // Quando o estimulador dá o gateway por perdido: o início mais o timeout em vigor
+    uint64_t detectedMicros;
+    uint16_t timeoutMs;
+
+    // Falso antes do primeiro heartbeat, quando qualquer frame do gateway alimenta o watchdog
+    bool armed;
+};
+
+enum class EventKind : uint8_t
+{
+    // value = StateKind do gateway, do Heartbeat
+    GatewayState,
+    GatewayReset,
+
+    // node = destino (0 = todos)
+    UseMalhaAberta,
+    UseMalhaFechada,
+    EmergencyStop,
+
+    // node = origem
+    ZeroReached,
+
+    // value = PWM pedido; node = destino
+    PwmCommand,
+
+    // value = PWM do feedback; node = origem
+    PwmFeedback,
+
+    // value = timeout do enlace em ms; node = destino
+    SetLinkTimeout,
+
+    // Só na linha do tempo, de analysisLinkLosses; node = estimulador
+    LinkLost,
+    LinkRestored
+};
+
+struct Event
+{
+    uint64_t micros;
+    EventKind kind;
+    uint8_t node;
+    uint16_t value;
+};
+
+struct ChunkSummary
+{
+    uint64_t lines;
+    uint64_t frames;
+    uint64_t pulseWidthLines;
+    uint64_t comments;
+    uint64_t invalidLines;
+
+    // Fora do protocolo, que só usa identificadores de 11 bits; contados e ignorados
+    uint64_t extendedFrames;
+
+    // Maior `# N frames descartados` do log
+    uint64_t droppedReported;
+
+    bool any;
+    uint64_t firstMicros;
+    uint64_t lastMicros;
+
+    // Instante do último frame como está no log, antes de desfazer a volta do relógio
+    uint64_t lastRawMicros;
+
+    // Posição de cada identificador em `identifiers`, ou -1
+    int32_t identifierIndex[PROTOCOL_STANDARD_ID_COUNT];
+    std::vector<IdentifierStats> identifiers;
+
+    // Bit n = algum frame do estimulador de endereço n
+    uint8_t sourceNodes;
+
+    // Heartbeats para cada estimulador ou para todos
+    WatchdogFeed heartbeats[PROTOCOL_MAX_NODE + 1];
+
+    // Até o primeiro heartbeat do pedaço, inclusive: qualquer frame do gateway para cada estimulador ou para todos
+    WatchdogFeed unarmedFeeds[PROTOCOL_MAX_NODE + 1];
+
+    std::vector<Event> events;
+};
+
+void analysisInit(ChunkSummary *summary);
+
+// Analisa as linhas de [begin, end) do arquivo; `begin` é o início de uma linha
+void analysisChunk(const TraceFile &trace, size_t begin, size_t end, ChunkSummary *summary);
+
+// Junta a `total` o pedaço que vem logo depois dele no arquivo
+void analysisMerge(ChunkSummary *total, ChunkSummary *next);
+
+/**
+ * Depois de juntar todos os pedaços: as perdas do enlace do estimulador `node`, em ordem. Uma lacuna é perda se
+ * passa do timeout em vigor, que muda com os SetLinkTimeout do log também no meio dela, como no firmware.
+ * Uma lacuna até o fim do log não conta: a captura pode só ter parado.
+ */
+std::vector<LinkLoss> analysisLinkLosses(const ChunkSummary &total, uint8_t node);
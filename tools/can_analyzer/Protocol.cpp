@@ -0,0 +1,144 @@
+#include "Protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static KindInfo kinds[PROTOCOL_KIND_COUNT];
+static ProtocolKinds named;
+
+static std::vector<std::string> splitColumns(const char *line)
+{
+    std::vector<std::string> columns;
+    std::string current;
+    for (const char *p = line; *p != '\0' && *p != '\n' && *p != '\r'; p++)
+    {
+        if (*p == ',')
+        {
+            columns.push_back(current);
+            current.clear();
+        }
+        else
+        {
+            current += *p;
+        }
+    }
+    columns.push_back(current);
+    return columns;
+}
+
+static int columnIndex(const std::vector<std::string> &header, const char *name)
+{
+    for (size_t i = 0; i < header.size(); i++)
+    {
+        if (header[i] == name)
+            return (int)i;
+    }
+    return -1;
+}
+
+static int findKind(const char *name)
+{
+    for (int kind = 0; kind < PROTOCOL_KIND_COUNT; kind++)
+    {
+        if (kinds[kind].known && kinds[kind].name == name)
+            return kind;
+    }
+    return -1;
+}
+
+bool protocolLoad(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == nullptr)
+    {
+        perror(path);
+        return false;
+    }
+
+    std::vector<std::string> header;
+    int nameColumn = -1, idColumn = -1, originColumn = -1, periodColumn = -1;
+    char line[512];
+    while (fgets(line, sizeof(line), file) != nullptr)
+    {
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r')
+            continue;
+
+        std::vector<std::string> columns = splitColumns(line);
+        if (header.empty())
+        {
+            header = columns;
+            nameColumn = columnIndex(header, "tipo");
+            idColumn = columnIndex(header, "id");
+            originColumn = columnIndex(header, "origem");
+            periodColumn = columnIndex(header, "periodo_ms");
+            if (nameColumn < 0 || idColumn < 0 || originColumn < 0 || periodColumn < 0)
+            {
+                fprintf(stderr, "%s: faltam as colunas tipo, id, origem ou periodo_ms\n", path);
+                fclose(file);
+                return false;
+            }
+            continue;
+        }
+
+        if (columns.size() != header.size())
+            continue;
+
+        unsigned long kind = strtoul(columns[idColumn].c_str(), nullptr, 16);
+        if (kind >= PROTOCOL_KIND_COUNT)
+            continue;
+
+        KindInfo &info = kinds[kind];
+        info.known = true;
+        info.name = columns[nameColumn];
+        info.origin = columns[originColumn] == "gateway"       ? Origin::Gateway
+                      : columns[originColumn] == "estimulador" ? Origin::Estimulador
+                                                               : Origin::Unknown;
+        info.periodMicros = columns[periodColumn] == "-" ? 0 : (uint64_t)(atof(columns[periodColumn].c_str()) * 1000);
+    }
+    fclose(file);
+
+    if (header.empty())
+    {
+        fprintf(stderr, "%s: tabela vazia\n", path);
+        return false;
+    }
+
+    named.emergencyStop = findKind("EmergencyStop");
+    named.emergencyStopZeroReached = findKind("EmergencyStopZeroReached");
+    named.gatewayResetHappened = findKind("GatewayResetHappened");
+    named.heartbeat = findKind("Heartbeat");
+    named.operationCommand = findKind("OperationCommand");
+    named.setRequestedPwm = findKind("SetRequestedPwm");
+    named.pwmFeedback = findKind("PwmFeedbackEstimulador");
+    named.useMalhaAberta = findKind("UseMalhaAberta");
+    named.useMalhaFechada = findKind("UseMalhaFechada");
+    named.setLinkTimeout = findKind("SetLinkTimeout");
+    return true;
+}
+
+const KindInfo &protocolKind(uint8_t kind)
+{
+    return kinds[kind];
+}
+
+const ProtocolKinds &protocolKinds()
+{
+    return named;
+}
+
+std::string protocolIdentifierName(uint32_t identifier)
+{
+    uint8_t kind = identifier >> PROTOCOL_NODE_BITS;
+    uint8_t node = identifier & PROTOCOL_NODE_MASK;
+
+    char name[64];
+    if (!kinds[kind].known)
+        snprintf(name, sizeof(name), "?0x%02X", kind);
+    else
+        snprintf(name, sizeof(name), "%s", kinds[kind].name.c_str());
+
+    if (node == 0)
+        return name;
+    return std::string(name) + "@" + std::to_string(node);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+
+/**
+ * Tipos de mensagem do barramento, lidos de tools/can_messages.csv: a mesma tabela que o build confere
+ * contra os enums TwaiSendMessageKind e TwaiReceivedMessageKind dos dois firmwares. Com os nomes vindo
+ * da tabela, o analisador acompanha uma renumeração dos tipos sem ser recompilado.
+ */
+
+// Identificador de 11 bits: [tipo u8][nó 3 bits] (TWAI_NODE_BITS em Twai/TwaiFilter.h)
+#define PROTOCOL_NODE_BITS 3
+#define PROTOCOL_NODE_MASK 0x07
+#define PROTOCOL_MAX_NODE 7
+#define PROTOCOL_KIND_COUNT 256
+#define PROTOCOL_STANDARD_ID_COUNT 2048
+
+// OperationCommand: [campos u8][peso u16][sequência u8][idade ms u8][PWM u16][reservado]
+// (OperationCommandField em Twai.h)
+#define PROTOCOL_OPERATION_USE_MALHA_ABERTA 0x01
+#define PROTOCOL_OPERATION_USE_MALHA_FECHADA 0x02
+#define PROTOCOL_OPERATION_REQUESTED_PWM 0x08
+#define PROTOCOL_OPERATION_PWM_OFFSET 5
+
+enum class Origin : uint8_t
+{
+    Unknown,
+    Gateway,
+    Estimulador
+};
+
+struct KindInfo
+{
+    bool known;
+    std::string name;
+    Origin origin;
+
+    // Período da tabela; 0 para as esporádicas ("-")
+    uint64_t periodMicros;
+};
+
+// Tipos que o analisador interpreta, procurados pelo nome na tabela. -1 se a tabela não tem o tipo.
+struct ProtocolKinds
+{
+    int emergencyStop;
+    int emergencyStopZeroReached;
+    int gatewayResetHappened;
+    int heartbeat;
+    int operationCommand;
+    int setRequestedPwm;
+    int pwmFeedback;
+    int useMalhaAberta;
+    int useMalhaFechada;
+    int setLinkTimeout;
+};
+
+// Lê a tabela. Em erro, escreve o motivo em stderr e retorna false.
+bool protocolLoad(const char *path);
+
+const KindInfo &protocolKind(uint8_t kind);
+const ProtocolKinds &protocolKinds();
+
+// "Tipo" ou "Tipo@nó"; tipos fora da tabela saem como "?0xNN"
+std::string protocolIdentifierName(uint32_t identifier);
@@ -0,0 +1,258 @@
+#include "Timeline.h"
+#include <string.h>
+#include <algorithm>
+
+// StateKind de gateway/src/StateManager.h, na ordem
+static const char *GATEWAY_STATE_NAMES[] = {
+    "Disconnected",
+    "ParameterSetup",
+    "ParallelWeight",
+    "MESECollecter",
+    "OperationStart",
+    "OperationGradualIncrease",
+    "OperationTransition",
+    "OperationMalhaFechada",
+    "OperationStop",
+};
+
+// StateKind de estimulador/src/StateManager.h, na ordem
+enum StimulatorState : uint8_t
+{
+    WorkingMalhaAberta,
+    WorkingMalhaFechada,
+    GatewayDownSafetyStop,
+    EmergencyStopState
+};
+
+static const char *STIMULATOR_STATE_NAMES[] = {
+    "WorkingMalhaAberta",
+    "WorkingMalhaFechada",
+    "GatewayDownSafetyStop",
+    "EmergencyStop",
+};
+
+std::string timelineStateName(uint8_t node, uint8_t state)
+{
+    if (state == TIMELINE_UNKNOWN_STATE)
+        return "?";
+
+    const char *const *names = node == 0 ? GATEWAY_STATE_NAMES : STIMULATOR_STATE_NAMES;
+    size_t count = node == 0 ? sizeof(GATEWAY_STATE_NAMES) / sizeof(GATEWAY_STATE_NAMES[0])
+                             : sizeof(STIMULATOR_STATE_NAMES) / sizeof(STIMULATOR_STATE_NAMES[0]);
+    if (state < count)
+        return names[state];
+    return "estado " + std::to_string(state);
+}
+
+struct NodeTrack
+{
+    uint8_t state;
+    uint64_t since;
+    bool zeroReached;
+
+    // Entre a detecção de uma perda do enlace e o heartbeat seguinte
+    bool linkLost;
+
+    // Na parada por falta do gateway porque ele reiniciou: a placa reinicia e volta a seguir comandos
+    bool gatewayReset;
+
+    int32_t commandedPwm;
+    int32_t feedbackPwm;
+    bool pending;
+    uint16_t pendingPwm;
+    uint64_t pendingMicros;
+};
+
+static StateTime *stateTime(Timeline *timeline, uint8_t node, uint8_t state)
+{
+    for (StateTime &time : timeline->stateTimes[node])
+    {
+        if (time.state == state)
+            return &time;
+    }
+    timeline->stateTimes[node].push_back({state, 0, 0});
+    return &timeline->stateTimes[node].back();
+}
+
+static void setState(Timeline *timeline, NodeTrack *track, uint8_t node, uint8_t state, uint64_t micros)
+{
+    if (track->state == state)
+        return;
+
+    if (track->state != TIMELINE_UNKNOWN_STATE)
+        stateTime(timeline, node, track->state)->micros += micros - track->since;
+    stateTime(timeline, node, state)->entries++;
+
+    timeline->transitions.push_back({micros, node, track->state, state});
+    track->state = state;
+    track->since = micros;
+}
+
+static bool isWorking(const NodeTrack *track)
+{
+    return track->state == WorkingMalhaAberta || track->state == WorkingMalhaFechada;
+}
+
+// Um comando de modo aceito. Com o enlace perdido, o loop do estado novo cai na parada logo em seguida.
+static void follow(Timeline *timeline, NodeTrack *track, uint8_t node, uint8_t state, uint64_t micros)
+{
+    // Parada por perda do enlace: nem a volta dos heartbeats tira a placa dali, só o reinício do gateway
+    if (track->state == GatewayDownSafetyStop && !track->gatewayReset)
+        return;
+
+    setState(timeline, track, node, state, micros);
+    if (track->linkLost && isWorking(track))
+    {
+        track->gatewayReset = false;
+        setState(timeline, track, node, GatewayDownSafetyStop, micros);
+    }
+}
+
+static void onMode(Timeline *timeline, NodeTrack *track, uint8_t node, EventKind kind, uint64_t micros)
+{
+    switch (kind)
+    {
+    case EventKind::EmergencyStop:
+        track->zeroReached = false;
+        setState(timeline, track, node, EmergencyStopState, micros);
+        break;
+    case EventKind::ZeroReached:
+        track->zeroReached = true;
+        break;
+    case EventKind::UseMalhaAberta:
+        if (track->state != EmergencyStopState || track->zeroReached)
+            follow(timeline, track, node, WorkingMalhaAberta, micros);
+        break;
+    case EventKind::UseMalhaFechada:
+        if (track->state != EmergencyStopState)
+            follow(timeline, track, node, WorkingMalhaFechada, micros);
+        break;
+    case EventKind::GatewayReset:
+        if (isWorking(track) || track->state == GatewayDownSafetyStop)
+        {
+            track->gatewayReset = true;
+            setState(timeline, track, node, GatewayDownSafetyStop, micros);
+        }
+        break;
+    case EventKind::LinkLost:
+        track->linkLost = true;
+        if (isWorking(track))
+        {
+            track->gatewayReset = false;
+            setState(timeline, track, node, GatewayDownSafetyStop, micros);
+        }
+        break;
+    case EventKind::LinkRestored:
+        track->linkLost = false;
+        break;
+    default:
+        break;
+    }
+}
+
+static void onPwmCommand(PwmLatency *latency, NodeTrack *track, uint16_t pwm, uint64_t micros)
+{
+    if (track->commandedPwm == pwm)
+        return;
+    bool change = track->commandedPwm >= 0;
+    track->commandedPwm = pwm;
+
+    if (track->pending)
+        latency->superseded++;
+
+    // No início do log não se sabe o que a placa seguia antes; com o feedback já no valor, não há o que medir
+    track->pending = change && track->feedbackPwm >= 0 && track->feedbackPwm != pwm;
+    track->pendingPwm = pwm;
+    track->pendingMicros = micros;
+}
+
+static void onPwmFeedback(PwmLatency *latency, NodeTrack *track, uint16_t pwm, uint64_t micros)
+{
+    // Os pedaços só descartam repetições internas; as da fronteira saem aqui
+    if (track->feedbackPwm == pwm)
+        return;
+    track->feedbackPwm = pwm;
+
+    if (track->pending && track->pendingPwm == pwm)
+    {
+        intervalAdd(&latency->latency, micros - track->pendingMicros);
+        track->pending = false;
+    }
+}
+
+void timelineBuild(const std::vector<Event> &events, uint8_t nodes, uint64_t endMicros,
+                   const std::vector<LinkLoss> *linkLosses, Timeline *timeline)
+{
+    timeline->transitions.clear();
+    for (int node = 0; node <= PROTOCOL_MAX_NODE; node++)
+    {
+        timeline->stateTimes[node].clear();
+        memset(&timeline->pwm[node], 0, sizeof(PwmLatency));
+    }
+    timeline->gatewayResets = 0;
+
+    NodeTrack tracks[PROTOCOL_MAX_NODE + 1];
+    for (NodeTrack &track : tracks)
+    {
+        memset(&track, 0, sizeof(track));
+        track.state = TIMELINE_UNKNOWN_STATE;
+        track.commandedPwm = -1;
+        track.feedbackPwm = -1;
+    }
+
+    // As perdas do enlace entram na ordem dos eventos; no mesmo instante, depois deles
+    std::vector<Event> merged = events;
+    for (uint8_t node = 1; node <= PROTOCOL_MAX_NODE; node++)
+    {
+        for (const LinkLoss &loss : linkLosses[node])
+        {
+            merged.push_back({loss.detectedMicros, EventKind::LinkLost, node, loss.timeoutMs});
+            merged.push_back({loss.endMicros, EventKind::LinkRestored, node, 0});
+        }
+    }
+    std::stable_sort(merged.begin(), merged.end(),
+                     [](const Event &a, const Event &b) { return a.micros < b.micros; });
+
+    for (const Event &event : merged)
+    {
+        switch (event.kind)
+        {
+        case EventKind::SetLinkTimeout:
+            continue;
+        case EventKind::GatewayState:
+            setState(timeline, &tracks[0], 0, event.value, event.micros);
+            continue;
+        case EventKind::GatewayReset:
+            timeline->gatewayResets++;
+            break;
+        case EventKind::PwmFeedback:
+            if (nodes & (1 << event.node))
+                onPwmFeedback(&timeline->pwm[event.node], &tracks[event.node], event.value, event.micros);
+            continue;
+        default:
+            break;
+        }
+
+        // Comandos para todos (nó 0) e o aviso de reinício do gateway valem para cada placa presente
+        for (uint8_t node = 1; node <= PROTOCOL_MAX_NODE; node++)
+        {
+            bool target = event.node == 0 || event.node == node;
+            if (!target || !(nodes & (1 << node)))
+                continue;
+
+            if (event.kind == EventKind::PwmCommand)
+                onPwmCommand(&timeline->pwm[node], &tracks[node], event.value, event.micros);
+            else
+                onMode(timeline, &tracks[node], node, event.kind, event.micros);
+        }
+    }
+
+    for (uint8_t node = 0; node <= PROTOCOL_MAX_NODE; node++)
+    {
+        NodeTrack &track = tracks[node];
+        if (track.state != TIMELINE_UNKNOWN_STATE && endMicros > track.since)
+            stateTime(timeline, node, track.state)->micros += endMicros - track.since;
+        if (track.pending)
+            timeline->pwm[node].unanswered++;
+    }
+}
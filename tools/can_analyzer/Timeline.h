@@ -0,0 +1,68 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "Analysis.h"
+
+/**
+ * Linha do tempo, refeita em ordem a partir dos eventos de todos os pedaços.
+ *
+ * O estado do gateway vem do Heartbeat. O modo de cada estimulador é inferido dos comandos do gateway
+ * pelas mesmas regras dos estados do firmware: a parada de emergência só termina com UseMalhaAberta
+ * depois do EmergencyStopZeroReached daquela placa, e um GatewayResetHappened com a estimulação em curso
+ * leva à parada por falta do gateway, que termina quando a placa volta a seguir comandos. A perda do enlace
+ * (analysisLinkLosses) também leva a essa parada quando a placa estimula; a volta dos heartbeats não a
+ * termina, só um GatewayResetHappened depois dela.
+ *
+ * A latência do PWM vai do comando que muda o PWM pedido de uma placa até o primeiro feedback dela que
+ * passa a esse valor. Só tem sentido em malha aberta: em malha fechada, o feedback é a saída do controle.
+ */
+
+struct Transition
+{
+    uint64_t micros;
+
+    // 0 = gateway; 1 a 7 = estimulador
+    uint8_t node;
+    uint8_t from;
+    uint8_t to;
+};
+
+// Tempo total em cada estado, do início do log (ou da primeira vez em que o estado foi visto) ao fim
+struct StateTime
+{
+    uint8_t state;
+    uint64_t micros;
+    uint32_t entries;
+};
+
+struct PwmLatency
+{
+    IntervalStats latency;
+
+    // Comandos trocados por outro antes de o feedback chegar ao valor
+    uint64_t superseded;
+
+    // Comandos sem feedback até o fim do log
+    uint64_t unanswered;
+};
+
+struct Timeline
+{
+    std::vector<Transition> transitions;
+
+    // Índice 0 = gateway; 1 a 7 = estimulador
+    std::vector<StateTime> stateTimes[PROTOCOL_MAX_NODE + 1];
+
+    PwmLatency pwm[PROTOCOL_MAX_NODE + 1];
+    uint64_t gatewayResets;
+};
+
+// Estado desconhecido (antes do primeiro evento)
+#define TIMELINE_UNKNOWN_STATE 0xFF
+
+// `nodes`: bit n = estimulador n presente; os outros são ignorados. `linkLosses`: de analysisLinkLosses, por nó.
+void timelineBuild(const std::vector<Event> &events, uint8_t nodes, uint64_t endMicros,
+                   const std::vector<LinkLoss> *linkLosses, Timeline *timeline);
+
+std::string timelineStateName(uint8_t node, uint8_t state);
@@ -0,0 +1,214 @@
+#include "TraceFile.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool traceOpen(const char *path, TraceFile *trace)
+{
+    trace->data = nullptr;
+    trace->size = 0;
+    trace->descriptor = open(path, O_RDONLY);
+    if (trace->descriptor < 0)
+    {
+        perror(path);
+        return false;
+    }
+
+    struct stat status;
+    if (fstat(trace->descriptor, &status) != 0)
+    {
+        perror(path);
+        close(trace->descriptor);
+        return false;
+    }
+
+    trace->size = status.st_size;
+    if (trace->size == 0)
+        return true;
+
+    void *mapped = mmap(nullptr, trace->size, PROT_READ, MAP_PRIVATE, trace->descriptor, 0);
+    if (mapped == MAP_FAILED)
+    {
+        perror(path);
+        close(trace->descriptor);
+        return false;
+    }
+
+    // Cada thread lê o seu pedaço do começo ao fim
+    madvise(mapped, trace->size, MADV_SEQUENTIAL);
+    trace->data = (const char *)mapped;
+    return true;
+}
+
+void traceClose(TraceFile *trace)
+{
+    if (trace->data != nullptr)
+        munmap((void *)trace->data, trace->size);
+    if (trace->descriptor >= 0)
+        close(trace->descriptor);
+    trace->data = nullptr;
+    trace->descriptor = -1;
+}
+
+std::vector<size_t> traceSplit(const TraceFile &trace, size_t count)
+{
+    std::vector<size_t> limits;
+    limits.push_back(0);
+    for (size_t i = 1; i < count; i++)
+    {
+        size_t position = trace.size / count * i;
+        if (position <= limits.back())
+            continue;
+
+        const char *newline = (const char *)memchr(trace.data + position, '\n', trace.size - position);
+        if (newline == nullptr)
+            break;
+
+        position = newline - trace.data + 1;
+        if (position > limits.back() && position < trace.size)
+            limits.push_back(position);
+    }
+    limits.push_back(trace.size);
+    return limits;
+}
+
+static int hexValue(char digit)
+{
+    if (digit >= '0' && digit <= '9')
+        return digit - '0';
+    if (digit >= 'A' && digit <= 'F')
+        return digit - 'A' + 10;
+    if (digit >= 'a' && digit <= 'f')
+        return digit - 'a' + 10;
+    return -1;
+}
+
+static const char *skipSpaces(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+// "# N frames descartados", escrito pela captura do estimulador e por tools/can_sniffer.py
+static bool parseDropped(const char *p, const char *end, uint64_t *dropped)
+{
+    static const char SUFFIX[] = " frames descartados";
+    p = skipSpaces(p + 1, end);
+
+    uint64_t value = 0;
+    const char *digits = p;
+    while (p < end && *p >= '0' && *p <= '9')
+        value = value * 10 + (*p++ - '0');
+    if (p == digits || (size_t)(end - p) < sizeof(SUFFIX) - 1 || memcmp(p, SUFFIX, sizeof(SUFFIX) - 1) != 0)
+        return false;
+
+    *dropped = value;
+    return true;
+}
+
+static TraceLineKind parseFields(const char *p, const char *end, TraceFrame *frame, uint64_t *dropped)
+{
+    p = skipSpaces(p, end);
+    if (p == end)
+        return TraceLineKind::Comment;
+    if (*p == '#')
+    {
+        parseDropped(p, end, dropped);
+        return TraceLineKind::Comment;
+    }
+
+    // (segundos.fração)
+    if (*p++ != '(')
+        return TraceLineKind::Invalid;
+    uint64_t seconds = 0;
+    const char *digits = p;
+    while (p < end && *p >= '0' && *p <= '9')
+        seconds = seconds * 10 + (*p++ - '0');
+    if (p == digits || p == end || *p++ != '.')
+        return TraceLineKind::Invalid;
+
+    uint64_t fraction = 0;
+    int fractionDigits = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        // Além de microssegundos, os dígitos são descartados
+        if (fractionDigits < 6)
+        {
+            fraction = fraction * 10 + (*p - '0');
+            fractionDigits++;
+        }
+        p++;
+    }
+    if (fractionDigits == 0 || p == end || *p++ != ')')
+        return TraceLineKind::Invalid;
+    while (fractionDigits++ < 6)
+        fraction *= 10;
+    frame->micros = seconds * 1000000 + fraction;
+
+    // Interface
+    p = skipSpaces(p, end);
+    const char *interface = p;
+    while (p < end && *p != ' ' && *p != '\t')
+        p++;
+    size_t interfaceLength = p - interface;
+    if (interfaceLength == 0)
+        return TraceLineKind::Invalid;
+    bool pulseWidth = interfaceLength == 3 && memcmp(interface, "pwm", 3) == 0;
+
+    // Identificador: 3 dígitos num frame padrão, 8 num estendido
+    p = skipSpaces(p, end);
+    uint32_t identifier = 0;
+    const char *identifierStart = p;
+    int digit;
+    while (p < end && (digit = hexValue(*p)) >= 0)
+    {
+        identifier = (identifier << 4) | digit;
+        p++;
+    }
+    size_t identifierLength = p - identifierStart;
+    if (identifierLength == 0 || identifierLength > 8 || p == end || *p++ != '#')
+        return TraceLineKind::Invalid;
+
+    if (pulseWidth)
+        return TraceLineKind::PulseWidth;
+
+    frame->identifier = identifier;
+    frame->extended = identifierLength > 3;
+    frame->remote = false;
+    frame->length = 0;
+
+    if (p < end && *p == 'R')
+    {
+        frame->remote = true;
+        return TraceLineKind::Frame;
+    }
+
+    while (p + 1 < end && frame->length < 8)
+    {
+        int high = hexValue(p[0]);
+        int low = hexValue(p[1]);
+        if (high < 0 || low < 0)
+            break;
+        frame->data[frame->length++] = (high << 4) | low;
+        p += 2;
+    }
+    return TraceLineKind::Frame;
+}
+
+TraceLineKind traceParseLine(const char *line, const char *end, const char **next, TraceFrame *frame,
+                             uint64_t *dropped)
+{
+    const char *newline = (const char *)memchr(line, '\n', end - line);
+    const char *lineEnd = newline == nullptr ? end : newline;
+    *next = newline == nullptr ? end : newline + 1;
+
+    // Fim de linha do Windows
+    if (lineEnd > line && lineEnd[-1] == '\r')
+        lineEnd--;
+
+    return parseFields(line, lineEnd, frame, dropped);
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Log no formato do candump (`(segundos.microssegundos) can0 118#00C80C03`), mapeado na memória só para
+ * leitura. Serve tanto o log do gateway em modo sniffer (tools/can_sniffer.py) quanto a captura do
+ * estimulador (env Capture_serial), cujas linhas `pwm` não são frames e só são contadas.
+ */
+
+struct TraceFile
+{
+    const char *data;
+    size_t size;
+    int descriptor;
+};
+
+struct TraceFrame
+{
+    uint64_t micros;
+    uint32_t identifier;
+    bool extended;
+    bool remote;
+    uint8_t length;
+    uint8_t data[8];
+};
+
+enum class TraceLineKind
+{
+    Frame,
+
+    // Linha `pwm` da captura do estimulador
+    PulseWidth,
+
+    // Vazia ou comentário (#)
+    Comment,
+    Invalid
+};
+
+// Em erro, escreve o motivo em stderr e retorna false
+bool traceOpen(const char *path, TraceFile *trace);
+void traceClose(TraceFile *trace);
+
+/**
+ * Limites de até `count` pedaços do arquivo, cada um começando no início de uma linha: o pedaço i vai de
+ * limits[i] a limits[i + 1]. Pedaços que cairiam no meio da mesma linha são fundidos.
+ */
+std::vector<size_t> traceSplit(const TraceFile &trace, size_t count);
+
+/**
+ * Lê a linha que começa em `line`, sem passar de `end`, e aponta `next` para o início da seguinte.
+ * Para comentários `# N frames descartados`, `dropped` recebe N; nos outros casos, fica intacto.
+ */
+TraceLineKind traceParseLine(const char *line, const char *end, const char **next, TraceFrame *frame,
+                             uint64_t *dropped);
@@ -0,0 +1,352 @@
+/**
+ * Análise de um log do barramento entre gateway e estimuladores, no formato do candump.
+ *
+ * O arquivo é mapeado na memória e dividido em pedaços que começam no início de uma linha; cada thread
+ * analisa um pedaço por vez (Analysis.h), e os resumos são juntados na ordem do arquivo. Só a linha do
+ * tempo (Timeline.h) é sequencial, sobre uma lista de eventos muito menor que o log.
+ *
+ * Uso: can_analyzer <log> [--threads N] [--events N] [--messages can_messages.csv]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Analysis.h"
+#include "Protocol.h"
+#include "Timeline.h"
+#include "TraceFile.h"
+
+// Transições e perdas do enlace listadas uma a uma; o resto só é contado
+#define ANALYZER_DEFAULT_EVENTS 50
+
+// Pedaços por thread: pedaços menores equilibram as threads quando o tráfego não é uniforme
+#define ANALYZER_CHUNKS_PER_THREAD 4
+
+struct Options
+{
+    const char *logPath;
+    std::string messagesPath;
+    unsigned threads;
+    size_t events;
+};
+
+static void usage()
+{
+    fprintf(stderr, "Uso: can_analyzer <log> [--threads N] [--events N] [--messages can_messages.csv]\n");
+}
+
+// Padrão: tools/can_messages.csv, ao lado da pasta do executável, ou a partir da raiz do repositório
+static std::string defaultMessagesPath(const char *program)
+{
+    std::string directory = program;
+    size_t slash = directory.rfind('/');
+    directory = slash == std::string::npos ? "." : directory.substr(0, slash);
+
+    std::string besideBinary = directory + "/../can_messages.csv";
+    if (access(besideBinary.c_str(), R_OK) == 0)
+        return besideBinary;
+    return "tools/can_messages.csv";
+}
+
+static bool parseOptions(int argc, char **argv, Options *options)
+{
+    options->logPath = nullptr;
+    options->messagesPath = defaultMessagesPath(argv[0]);
+    options->threads = std::max(1u, std::thread::hardware_concurrency());
+    options->events = ANALYZER_DEFAULT_EVENTS;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--threads") == 0 && hasValue)
+            options->threads = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--events") == 0 && hasValue)
+            options->events = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--messages") == 0 && hasValue)
+            options->messagesPath = argv[++i];
+        else if (argv[i][0] != '-' && options->logPath == nullptr)
+            options->logPath = argv[i];
+        else
+            return false;
+    }
+    return options->logPath != nullptr;
+}
+
+static std::string formatSeconds(uint64_t micros)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%llu.%06llu", (unsigned long long)(micros / 1000000),
+             (unsigned long long)(micros % 1000000));
+    return text;
+}
+
+static std::string formatDuration(uint64_t micros)
+{
+    uint64_t seconds = micros / 1000000;
+    char text[32];
+    snprintf(text, sizeof(text), "%02llu:%02llu:%02llu.%03llu", (unsigned long long)(seconds / 3600),
+             (unsigned long long)(seconds / 60 % 60), (unsigned long long)(seconds % 60),
+             (unsigned long long)(micros / 1000 % 1000));
+    return text;
+}
+
+static double toMillis(uint64_t micros)
+{
+    return micros / 1000.0;
+}
+
+static const char *originName(Origin origin)
+{
+    switch (origin)
+    {
+    case Origin::Gateway:
+        return "gateway";
+    case Origin::Estimulador:
+        return "estimulador";
+    default:
+        return "?";
+    }
+}
+
+static void printOverview(const Options &options, const ChunkSummary &total)
+{
+    printf("Log %s: %llu linhas, %llu frames", options.logPath, (unsigned long long)total.lines,
+           (unsigned long long)total.frames);
+    if (total.any)
+        printf(", de %s a %s (%s)", formatSeconds(total.firstMicros).c_str(), formatSeconds(total.lastMicros).c_str(),
+               formatDuration(total.lastMicros - total.firstMicros).c_str());
+    printf("\n");
+
+    if (total.droppedReported > 0)
+        printf("AVISO: o log anuncia %llu frames descartados na captura; intervalos e lacunas podem ser maiores "
+               "que os reais\n",
+               (unsigned long long)total.droppedReported);
+    if (total.invalidLines > 0)
+        printf("%llu linhas fora do formato do candump ignoradas\n", (unsigned long long)total.invalidLines);
+    if (total.extendedFrames > 0)
+        printf("%llu frames com identificador estendido ignorados\n", (unsigned long long)total.extendedFrames);
+    if (total.pulseWidthLines > 0)
+        printf("%llu linhas pwm da captura do estimulador (não são frames)\n",
+               (unsigned long long)total.pulseWidthLines);
+}
+
+static void printIdentifiers(const ChunkSummary &total)
+{
+    std::vector<const IdentifierStats *> sorted;
+    for (const IdentifierStats &stats : total.identifiers)
+        sorted.push_back(&stats);
+    std::sort(sorted.begin(), sorted.end(),
+              [](const IdentifierStats *a, const IdentifierStats *b) { return a->identifier < b->identifier; });
+
+    printf("\nPor identificador (intervalos entre frames consecutivos, em ms; p99 com resolução de ~9%%)\n");
+    printf("%-30s %5s %-11s %10s %9s %8s %9s %9s %9s %10s\n", "tipo", "id", "origem", "frames", "taxa Hz", "T tab.",
+           "médio", "desvio", "p99", "máximo");
+    for (const IdentifierStats *stats : sorted)
+    {
+        const KindInfo &kind = protocolKind(stats->identifier >> PROTOCOL_NODE_BITS);
+        uint64_t span = stats->lastMicros - stats->firstMicros;
+        double rate = span > 0 ? (stats->frames - 1) * 1e6 / span : 0;
+
+        char period[16] = "-";
+        if (kind.periodMicros > 0)
+            snprintf(period, sizeof(period), "%g", toMillis(kind.periodMicros));
+
+        const IntervalStats &intervals = stats->intervals;
+        if (intervals.count == 0)
+        {
+            printf("%-30s 0x%03X %-11s %10llu %9s %8s %9s %9s %9s %10s\n",
+                   protocolIdentifierName(stats->identifier).c_str(), stats->identifier, originName(kind.origin),
+                   (unsigned long long)stats->frames, "-", period, "-", "-", "-", "-");
+            continue;
+        }
+
+        printf("%-30s 0x%03X %-11s %10llu %9.1f %8s %9.3f %9.3f %9.3f %10.3f\n",
+               protocolIdentifierName(stats->identifier).c_str(), stats->identifier, originName(kind.origin),
+               (unsigned long long)stats->frames, rate, period, toMillis(intervals.sum / intervals.count),
+               intervalStandardDeviation(intervals) / 1000, toMillis(intervalPercentile(intervals, 0.99)),
+               toMillis(intervals.max));
+    }
+}
+
+static void printWatchdog(const Options &options, const ChunkSummary &total, const std::vector<LinkLoss> *linkLosses)
+{
+    printf("\nWatchdog do estimulador: perdas do enlace, com o timeout dos SetLinkTimeout do log (%u ms até o "
+           "primeiro); antes do primeiro heartbeat, %u ms sem frame do gateway\n",
+           ANALYSIS_LINK_DEFAULT_TIMEOUT_MS, ANALYSIS_LINK_UNARMED_TIMEOUT_MS);
+    if (total.sourceNodes == 0)
+    {
+        printf("Nenhum frame de estimulador no log\n");
+        return;
+    }
+
+    for (int node = 1; node <= PROTOCOL_MAX_NODE; node++)
+    {
+        if (!(total.sourceNodes & (1 << node)))
+            continue;
+
+        if (!total.unarmedFeeds[node].seen)
+        {
+            printf("estimulador %d: nenhum frame do gateway no log\n", node);
+            continue;
+        }
+        if (!total.heartbeats[node].seen)
+            printf("estimulador %d: nenhum heartbeat no log\n", node);
+
+        const std::vector<LinkLoss> &losses = linkLosses[node];
+        if (losses.empty())
+        {
+            printf("estimulador %d: nenhuma perda\n", node);
+            continue;
+        }
+
+        const LinkLoss *longest = &losses[0];
+        for (const LinkLoss &loss : losses)
+        {
+            if (loss.endMicros - loss.startMicros > longest->endMicros - longest->startMicros)
+                longest = &loss;
+        }
+        printf("estimulador %d: %zu perdas, a maior de %.3f s a partir de %s\n", node, losses.size(),
+               (longest->endMicros - longest->startMicros) / 1e6, formatSeconds(longest->startMicros).c_str());
+        for (size_t i = 0; i < losses.size() && i < options.events; i++)
+        {
+            const LinkLoss &loss = losses[i];
+            printf("  (%s) %.3f s sem %s; perdido em (%s), timeout de %u ms\n", formatSeconds(loss.startMicros).c_str(),
+                   (loss.endMicros - loss.startMicros) / 1e6, loss.armed ? "heartbeat" : "frame do gateway",
+                   formatSeconds(loss.detectedMicros).c_str(), loss.timeoutMs);
+        }
+        if (losses.size() > options.events)
+            printf("  ... mais %zu\n", losses.size() - options.events);
+    }
+}
+
+static void printPwmLatency(const ChunkSummary &total, const Timeline &timeline)
+{
+    printf("\nLatência do PWM: do comando que muda o PWM pedido ao primeiro feedback com o valor novo, em ms\n");
+    bool any = false;
+    for (int node = 1; node <= PROTOCOL_MAX_NODE; node++)
+    {
+        if (!(total.sourceNodes & (1 << node)))
+            continue;
+
+        const PwmLatency &pwm = timeline.pwm[node];
+        const IntervalStats &latency = pwm.latency;
+        if (latency.count == 0 && pwm.superseded == 0 && pwm.unanswered == 0)
+            continue;
+
+        any = true;
+        printf("estimulador %d: %llu mudanças", node, (unsigned long long)latency.count);
+        if (latency.count > 0)
+            printf(", mínimo %.3f, p50 %.3f, p99 %.3f, máximo %.3f", toMillis(latency.min),
+                   toMillis(intervalPercentile(latency, 0.5)), toMillis(intervalPercentile(latency, 0.99)),
+                   toMillis(latency.max));
+        printf("; %llu trocadas antes do feedback, %llu sem feedback\n", (unsigned long long)pwm.superseded,
+               (unsigned long long)pwm.unanswered);
+    }
+    if (!any)
+        printf("Nenhuma mudança de PWM no log\n");
+}
+
+static std::string nodeName(uint8_t node)
+{
+    return node == 0 ? "gateway" : "estimulador " + std::to_string(node);
+}
+
+static void printTimeline(const Options &options, const Timeline &timeline)
+{
+    printf("\nLinha do tempo (%zu transições", timeline.transitions.size());
+    if (timeline.gatewayResets > 0)
+        printf(", %llu reinícios do gateway", (unsigned long long)timeline.gatewayResets);
+    printf(")\n");
+
+    for (size_t i = 0; i < timeline.transitions.size() && i < options.events; i++)
+    {
+        const Transition &transition = timeline.transitions[i];
+        printf("(%s) %s: %s -> %s\n", formatSeconds(transition.micros).c_str(), nodeName(transition.node).c_str(),
+               timelineStateName(transition.node, transition.from).c_str(),
+               timelineStateName(transition.node, transition.to).c_str());
+    }
+    if (timeline.transitions.size() > options.events)
+        printf("... mais %zu (--events)\n", timeline.transitions.size() - options.events);
+
+    printf("\nTempo em cada estado\n");
+    for (int node = 0; node <= PROTOCOL_MAX_NODE; node++)
+    {
+        if (timeline.stateTimes[node].empty())
+            continue;
+        printf("%s:", nodeName(node).c_str());
+        for (const StateTime &time : timeline.stateTimes[node])
+            printf(" %s %s (%ux);", timelineStateName(node, time.state).c_str(), formatDuration(time.micros).c_str(),
+                   time.entries);
+        printf("\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, &options))
+    {
+        usage();
+        return 2;
+    }
+
+    if (!protocolLoad(options.messagesPath.c_str()))
+        return 2;
+
+    TraceFile trace;
+    if (!traceOpen(options.logPath, &trace))
+        return 2;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<size_t> limits = traceSplit(trace, (size_t)options.threads * ANALYZER_CHUNKS_PER_THREAD);
+    size_t chunkCount = limits.size() - 1;
+    std::vector<ChunkSummary> summaries(chunkCount);
+
+    std::atomic<size_t> nextChunk(0);
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < std::min<size_t>(options.threads, chunkCount); i++)
+    {
+        workers.emplace_back([&]() {
+            size_t chunk;
+            while ((chunk = nextChunk++) < chunkCount)
+                analysisChunk(trace, limits[chunk], limits[chunk + 1], &summaries[chunk]);
+        });
+    }
+    for (std::thread &worker : workers)
+        worker.join();
+
+    ChunkSummary total;
+    analysisInit(&total);
+    for (ChunkSummary &summary : summaries)
+        analysisMerge(&total, &summary);
+    summaries.clear();
+
+    std::vector<LinkLoss> linkLosses[PROTOCOL_MAX_NODE + 1];
+    for (int node = 1; node <= PROTOCOL_MAX_NODE; node++)
+    {
+        if (total.sourceNodes & (1 << node))
+            linkLosses[node] = analysisLinkLosses(total, node);
+    }
+
+    Timeline timeline;
+    timelineBuild(total.events, total.sourceNodes, total.lastMicros, linkLosses, &timeline);
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "%.1f MB em %.2f s (%.0f MB/s), %u threads, %zu pedaços\n", trace.size / 1e6, elapsed,
+            elapsed > 0 ? trace.size / 1e6 / elapsed : 0, options.threads, chunkCount);
+    traceClose(&trace);
+
+    printOverview(options, total);
+    printIdentifiers(total);
+    printWatchdog(options, total, linkLosses);
+    printPwmLatency(total, timeline);
+    printTimeline(options, timeline);
+    return 0;
+}
@@ -0,0 +1,475 @@
+"""
+Análise de tempo de resposta do barramento CAN entre gateway e estimulador.
+
+Lê o conjunto de mensagens de tools/can_messages.csv, confere que ele bate com os enums de tipos
+dos dois firmwares e calcula, para cada mensagem, o pior tempo de resposta com bit stuffing no pior
+caso e jitter de enfileiramento. Retorna erro se algum prazo for ultrapassado ou se a tabela divergir
+dos enums.
+
+O driver TWAI não transmite pela prioridade: cada nó tem uma fila FIFO de TWAI_DRIVER_TX_QUEUE_LENGTH
+frames (Twai/Twai.cpp), e um frame espera todos os que o próprio nó enfileirou antes dele. A análise é a
+de filas FIFO de Davis, Kollmann, Pollex e Slomka ("Controller Area Network (CAN) Schedulability Analysis
+with FIFO Queues", ECRTS 2011): enquanto um frame espera, a fila do seu nó disputa a arbitragem com a
+prioridade do seu pior frame, e à frente dele há no máximo a fila cheia. A parada de emergência e a sua
+confirmação descartam a fila e cancelam o frame do controlador antes de entrar (twaiClearTransmitQueue):
+disputam com a própria prioridade, e do seu nó só fica à frente um frame que já esteja no fio.
+
+Com vários estimuladores, cada mensagem vira um frame por estimulador ou um só para todos, conforme a
+coluna `nos` da tabela. O gateway guarda, para cada taxa do barramento, quantos estimuladores cabem nos
+prazos (SUPPORTED_BITRATES em gateway/src/Twai/TwaiBitrate.cpp; 0 = taxa recusada) e o multiplicador do
+SetBusShare, que espaça ainda mais as mensagens "divide" nas taxas lentas. O build confere os prazos em cada
+taxa aceita, de 1 até o seu limite, e que o estimulador aceita as mesmas taxas.
+
+O jitter da tabela é a duração do loop de quem envia. Com --trace, a duração é medida numa captura do
+barramento (formato do candump, de tools/can_sniffer.py): para cada nó, o maior atraso entre dois frames
+periódicos seguidos além do período. A análise usa a maior entre a medida e a da tabela, e avisa quando a
+medida passa da tabela.
+
+Premissa: o barramento não tem erros.
+
+Uso direto:       python3 tools/can_rta.py [--bitrate 500000] [--messages tools/can_messages.csv] [--all-bitrates]
+                                        [--nodes N] [--trace barramento.log]
+Sem --bitrate, confere todas as taxas aceitas; --all-bitrates resume quantos estimuladores cabem em cada taxa,
+aceita ou não. Como extra script do PlatformIO (extra_scripts = pre:../tools/can_rta.py), roda antes de cada
+build e o interrompe se a análise falhar em qualquer taxa aceita.
+"""
+import argparse
+import csv
+import math
+import os
+import re
+import sys
+
+# A taxa de fábrica (TWAI_DEFAULT_BITRATE), a única com a tabela completa na saída
+DEFAULT_BITRATE = 500000
+
+# Enums de tipos de cada firmware: (arquivo, enum, origem das mensagens do enum)
+ENUM_SOURCES = [
+    ("gateway/src/Twai/Twai.h", "TwaiSendMessageKind", "gateway"),
+    ("gateway/src/Twai/Twai.h", "TwaiReceivedMessageKind", "estimulador"),
+    ("estimulador/src/Twai/Twai.h", "TwaiSendMessageKind", "estimulador"),
+    ("estimulador/src/Twai/Twai.h", "TwaiReceivedMessageKind", "gateway"),
+]
+
+# Bits de nó no fim do identificador (TWAI_NODE_BITS em Twai/TwaiFilter.h)
+NODE_BITS = 3
+
+# Taxas do gateway, com o número máximo de estimuladores em cada uma, e taxas do estimulador
+GATEWAY_BITRATES_SOURCE = ("gateway/src/Twai/TwaiBitrate.cpp", "SUPPORTED_BITRATES")
+ESTIMULADOR_BITRATES_SOURCE = ("estimulador/src/Twai/TwaiBitrate.cpp", "SUPPORTED_BITRATES")
+
+# O maior endereço de estimulador (NODES_MAX_ADDRESS em gateway/src/Nodes/Nodes.h): até onde o resumo procura
+MAX_NODES_SURVEYED = 7
+
+# Tamanho da fila de transmissão do driver em cada nó
+TX_QUEUE_SOURCES = {
+    "gateway": ("gateway/src/Twai/Twai.cpp", "TWAI_DRIVER_TX_QUEUE_LENGTH"),
+    "estimulador": ("estimulador/src/Twai/Twai.cpp", "TWAI_DRIVER_TX_QUEUE_LENGTH"),
+}
+
+# Mensagens enviadas depois de twaiClearTransmitQueue (gateway/src/EmergencyStop/EmergencyStop.cpp,
+# estimulador/src/States/EmergencyStop.cpp)
+QUEUE_CLEARING_MESSAGES = {"EmergencyStop", "EmergencyStopAck"}
+
+# Na captura, só os frames com período até este entram na medida do jitter: nos mais espaçados, uma
+# perda de frame parece um atraso enorme
+TRACE_MAX_PERIOD_US = 100000
+
+# Um intervalo maior que este é uma queda (nó reiniciando, enlace perdido), não jitter: é o menor timeout
+# do enlace (HEARTBEAT_MIN_LINK_TIMEOUT_MS), com o qual o estimulador já teria parado
+TRACE_OUTAGE_US = 100000
+
+# Uma linha do candump: (segundos) interface id#dados
+TRACE_LINE = re.compile(r"\((\d+\.\d+)\)\s+\S+\s+([0-9A-Fa-f]+)#")
+
+
+class Message:
+    def __init__(self, row):
+        self.name = row["tipo"]
+        self.kind = int(row["id"], 16)
+        self.id = self.kind << NODE_BITS
+        self.sender = row["origem"]
+        self.length = int(row["octetos"])
+        self.analysed = row["periodo_ms"] != "-"
+        self.period_us = float(row["periodo_ms"]) * 1000 if self.analysed else None
+        self.deadline_us = float(row["prazo_ms"]) * 1000 if self.analysed else None
+        self.jitter_us = float(row["jitter_ms"]) * 1000
+        self.burst = int(row["rajada"])
+        self.nodes = row["nos"]
+        self.clears_queue = self.name in QUEUE_CLEARING_MESSAGES
+        self.frame_us = None
+        self.response_us = None
+
+    def for_node(self, node, count, share):
+        """Cópia com o identificador do estimulador `node`, de `count` no barramento, com o SetBusShare `share`."""
+        copy = Message.__new__(Message)
+        copy.__dict__.update(self.__dict__)
+        copy.id = (self.kind << NODE_BITS) | node
+        if count > 1:
+            copy.name = "%s@%d" % (self.name, node)
+        if self.nodes == "divide" and self.analysed:
+            copy.period_us = self.period_us * share
+            copy.deadline_us = self.deadline_us * share
+        return copy
+
+
+def frame_bits(length):
+    """Bits de um frame padrão (ID de 11 bits) com `length` octetos, com o máximo de bits de stuffing."""
+    stuffable = 34 + 8 * length
+    return 47 + 8 * length + (stuffable - 1) // 4
+
+
+def read_messages(path):
+    rows = []
+    with open(path, newline="", encoding="utf-8") as file:
+        lines = [line for line in file if line.strip() and not line.lstrip().startswith("#")]
+    for row in csv.DictReader(lines):
+        rows.append(Message(row))
+    return rows
+
+
+def expand(messages, count, share_scale=1):
+    """Os frames do barramento com `count` estimuladores, com endereços de 1 a `count`, e o SetBusShare
+    multiplicado por `share_scale`."""
+    share = count * share_scale
+    frames = []
+    for message in messages:
+        if message.nodes == "1":
+            frames.append(message.for_node(0, count, share))
+        else:
+            frames.extend(message.for_node(node, count, share) for node in range(1, count + 1))
+    return frames
+
+
+def read_define(root, source):
+    path = os.path.join(root, source[0])
+    with open(path, encoding="utf-8") as file:
+        match = re.search(r"#define\s+" + source[1] + r"\s+(\d+)", file.read())
+    if match is None:
+        raise ValueError("%s: %s não encontrado" % source)
+    return int(match.group(1))
+
+
+def read_array(root, source):
+    """Corpo do array `source[1]`, sem comentários."""
+    path = os.path.join(root, source[0])
+    with open(path, encoding="utf-8") as file:
+        match = re.search(source[1] + r"\[\]\s*=\s*\{(.*?)\};", file.read(), re.S)
+    if match is None:
+        raise ValueError("%s: %s não encontrado" % source)
+    return re.sub(r"//[^\n]*", "", match.group(1))
+
+
+def read_bitrate_limits(root):
+    """{taxa: estimuladores que cabem} e {taxa: multiplicador do SetBusShare} da tabela do gateway, e as
+    divergências com as taxas do estimulador."""
+    table = re.findall(r"\{\s*(\d+)\s*,\s*(\d+)\s*,\s*(\d+)\s*\}", read_array(root, GATEWAY_BITRATES_SOURCE))
+    limits = {int(bitrate): int(count) for bitrate, count, _ in table}
+    share_scales = {int(bitrate): int(scale) for bitrate, _, scale in table}
+    accepted = {int(bitrate) for bitrate in re.findall(r"\d+", read_array(root, ESTIMULADOR_BITRATES_SOURCE))}
+
+    problems = []
+    for bitrate in sorted(accepted - {b for b, count in limits.items() if count > 0}):
+        problems.append("%s: o estimulador aceita %d bit/s, que o gateway recusa" % (ESTIMULADOR_BITRATES_SOURCE[0],
+                                                                                  bitrate))
+    for bitrate in sorted({b for b, count in limits.items() if count > 0} - accepted):
+        problems.append("%s: o gateway aceita %d bit/s, que o estimulador recusa" % (GATEWAY_BITRATES_SOURCE[0],
+                                                                                  bitrate))
+    for bitrate in sorted(b for b in limits if limits[b] * share_scales[b] > MAX_NODES_SURVEYED):
+        problems.append("%s: a %d bit/s, o SetBusShare passa de %d, que o estimulador recusa" % (
+            GATEWAY_BITRATES_SOURCE[0], bitrate, MAX_NODES_SURVEYED))
+    return limits, share_scales, problems
+
+
+def read_tx_queues(root):
+    return {sender: read_define(root, source) for sender, source in TX_QUEUE_SOURCES.items()}
+
+
+def measure_jitter(messages, trace_path):
+    """Maior atraso, em us, de cada origem: o intervalo entre dois frames seguidos do mesmo identificador
+    além do período da tabela, só nas mensagens periódicas de período curto e sem `divide` (o período delas
+    muda com o número de estimuladores). Uma linha de comentário (frames descartados pelo sniffer) recomeça
+    a contagem, e os intervalos de queda (TRACE_OUTAGE_US) só são contados."""
+    periodic = {m.kind: m for m in messages if m.analysed and m.nodes != "divide"
+                and m.period_us <= TRACE_MAX_PERIOD_US}
+    jitter = {}
+    outages = {}
+    last = {}
+    with open(trace_path, encoding="utf-8", errors="replace") as file:
+        for line in file:
+            if line.startswith("#"):
+                last.clear()
+                continue
+            match = TRACE_LINE.match(line)
+            if match is None:
+                continue
+            identifier = int(match.group(2), 16)
+            message = periodic.get(identifier >> NODE_BITS)
+            if message is None:
+                continue
+            # Segundos com 6 casas: em us inteiros, sem o erro do float
+            seconds, fraction = match.group(1).split(".")
+            micros = int(seconds) * 1000000 + int(fraction.ljust(6, "0")[:6])
+            previous = last.get(identifier)
+            last[identifier] = micros
+            if previous is None:
+                continue
+            interval = micros - previous
+            if interval > TRACE_OUTAGE_US:
+                outages[message.sender] = outages.get(message.sender, 0) + 1
+            else:
+                jitter[message.sender] = max(jitter.get(message.sender, 0), interval - message.period_us)
+    for sender, count in sorted(outages.items()):
+        print("%s: %d intervalo(s) de mais de %d ms sem frame periódico, fora da medida" % (
+            sender, count, TRACE_OUTAGE_US // 1000))
+    return jitter
+
+
+def apply_jitter(messages, measured):
+    """Usa o jitter medido onde ele passa do da tabela. Retorna os avisos."""
+    warnings = []
+    for sender, jitter_us in sorted(measured.items()):
+        table_us = max(m.jitter_us for m in messages if m.sender == sender)
+        print("Jitter medido do %s: %.2f ms (tabela: %g ms)" % (sender, jitter_us / 1000, table_us / 1000))
+        if jitter_us > table_us:
+            warnings.append("jitter medido do %s (%.2f ms) passa do da tabela (%g ms); usando o medido" % (
+                sender, jitter_us / 1000, table_us / 1000))
+            for message in messages:
+                if message.sender == sender:
+                    message.jitter_us = max(message.jitter_us, jitter_us)
+    return warnings
+
+
+def read_enum(path, enum_name):
+    with open(path, encoding="utf-8") as file:
+        source = file.read()
+    match = re.search(r"enum\s+" + enum_name + r"\s*:\s*uint8_t\s*\{(.*?)\}", source, re.S)
+    if match is None:
+        raise ValueError("%s: enum %s não encontrado" % (path, enum_name))
+    body = re.sub(r"//[^\n]*", "", match.group(1))
+    return {name: int(value, 0) for name, value in re.findall(r"(\w+)\s*=\s*(0x[0-9A-Fa-f]+|\d+)", body)}
+
+
+def check_against_firmware(messages, root):
+    """Lista de divergências entre a tabela e os enums dos dois firmwares."""
+    problems = []
+    by_name = {message.name: message for message in messages}
+
+    ids = {}
+    for message in messages:
+        if message.kind in ids:
+            problems.append("0x%02X usado por %s e %s" % (message.kind, ids[message.kind], message.name))
+        ids[message.kind] = message.name
+        if message.nodes not in ("1", "cada", "divide"):
+            problems.append("%s: nos = %r; use 1, cada ou divide" % (message.name, message.nodes))
+
+    for relative, enum_name, sender in ENUM_SOURCES:
+        path = os.path.join(root, relative)
+        kinds = read_enum(path, enum_name)
+        for name, kind_id in kinds.items():
+            message = by_name.get(name)
+            if message is None:
+                problems.append("%s: %s (0x%02X) não está na tabela" % (relative, name, kind_id))
+            elif message.kind != kind_id:
+                problems.append("%s: %s é 0x%02X, a tabela diz 0x%02X" % (relative, name, kind_id, message.kind))
+            elif message.sender != sender:
+                problems.append("%s: %s é enviado pelo %s, a tabela diz %s" % (relative, name, sender,
+                                                                             message.sender))
+        for message in messages:
+            if message.sender == sender and message.name not in kinds:
+                problems.append("%s: %s não está em %s" % (relative, message.name, enum_name))
+    return problems
+
+
+def queue_of(message):
+    """Fila de transmissão do frame: uma no gateway e uma em cada estimulador."""
+    if message.sender == "gateway":
+        return "gateway"
+    return "estimulador@%d" % (message.id & ((1 << NODE_BITS) - 1))
+
+
+def analyse(messages, bitrate, tx_queues):
+    """Preenche frame_us e response_us. Retorna a utilização do barramento.
+
+    Para um frame m da fila F, com L o identificador do pior frame de F:
+      - bloqueio: o maior frame de outro nó com identificador maior que L, que pode já estar no fio;
+      - à frente de m na fila: as instâncias dos frames de F liberadas na janela, menos o próprio m, e no
+        máximo a fila cheia (tx_queues), contando os maiores;
+      - interferência: os frames de outros nós com identificador menor que L liberados na janela.
+    A janela w é o ponto fixo da soma dos três, e R = J + w + C. Um frame que descarta a fila (clears_queue)
+    não tem nada à frente na fila e L é o seu próprio identificador; o maior frame do seu nó entra no
+    bloqueio, porque pode já estar no fio."""
+    bit_us = 1e6 / bitrate
+    for message in messages:
+        message.frame_us = frame_bits(message.length) * bit_us
+
+    active = [m for m in messages if m.analysed]
+    utilization = sum(m.burst * m.frame_us / m.period_us for m in active)
+    if utilization >= 1:
+        return utilization
+
+    queues = {}
+    for message in active:
+        queues.setdefault(queue_of(message), []).append(message)
+
+    for queue in queues.values():
+        others = [m for m in active if m not in queue]
+        for message in queue:
+            if message.clears_queue:
+                level = message.id
+                depth = 0
+                on_wire = [k.frame_us for k in queue]
+            else:
+                level = max(k.id for k in queue)
+                depth = tx_queues[message.sender]
+                on_wire = []
+            higher = [m for m in others if m.id < level]
+            blocking = max([m.frame_us for m in others if m.id > level] + on_wire, default=0)
+
+            wait = blocking
+            while True:
+                ahead = []
+                for k in queue:
+                    released = math.ceil((wait + k.jitter_us) / k.period_us) * k.burst - (k is message)
+                    ahead.extend([k.frame_us] * released)
+                ahead = sum(sorted(ahead, reverse=True)[:depth])
+                following = blocking + ahead + sum(
+                    math.ceil((wait + j.jitter_us + bit_us) / j.period_us) * j.burst * j.frame_us for j in higher)
+                if following == wait:
+                    break
+                wait = following
+            message.response_us = message.jitter_us + wait + message.frame_us
+    return utilization
+
+
+def report(messages, utilization, bitrate, count):
+    print("Barramento CAN a %d bit/s com %d estimulador(es): utilização no pior caso de %.1f%%" % (
+        bitrate, count, utilization * 100))
+    print("%-28s %5s %-11s %3s %8s %8s %8s %9s %7s" % ("tipo", "id", "origem", "B", "C (us)", "T (ms)", "D (ms)",
+                                                      "R (us)", "folga"))
+    for message in sorted(messages, key=lambda m: m.id):
+        if not message.analysed:
+            print("%-28s 0x%03X %-11s %3d %8.0f %8s %8s %9s %7s" % (message.name, message.id, message.sender,
+                                                                   message.length, message.frame_us, "-", "-",
+                                                                   "-", "-"))
+            continue
+        slack = 1 - message.response_us / message.deadline_us
+        print("%-28s 0x%03X %-11s %3d %8.0f %8g %8g %9.0f %6.0f%%" % (
+            message.name, message.id, message.sender, message.length, message.frame_us,
+            message.period_us / 1000, message.deadline_us / 1000, message.response_us, slack * 100))
+    return report_failures(messages, bitrate, count)
+
+
+def report_failures(messages, bitrate, count):
+    failed = [m for m in messages if m.analysed and m.response_us > m.deadline_us]
+    for message in failed:
+        print("ERRO: a %d bit/s com %d estimulador(es), %s (0x%03X) responde em até %.0f us, prazo de %.0f us" % (
+            bitrate, count, message.name, message.id, message.response_us, message.deadline_us))
+    return not failed
+
+
+def check_bitrate(messages, tx_queues, bitrate, share_scale, counts, full):
+    """True se todos os prazos são cumpridos a `bitrate` com cada número de estimuladores em `counts`. Com
+    `full`, a tabela completa sai para o maior; senão, uma linha só se tudo passar."""
+    passed = True
+    for count in counts:
+        frames = expand(messages, count, share_scale)
+        utilization = analyse(frames, bitrate, tx_queues)
+        if utilization >= 1:
+            print("ERRO: a %d bit/s com %d estimulador(es), utilização do barramento de %.1f%%; nenhum tempo de "
+                  "resposta é limitado" % (bitrate, count, utilization * 100))
+            passed = False
+        elif full and count == counts[-1]:
+            passed = report(frames, utilization, bitrate, count) and passed
+        else:
+            passed = report_failures(frames, bitrate, count) and passed
+    if passed and not full:
+        print("A %7d bit/s, até %d estimulador(es): todos os prazos cumpridos" % (bitrate, counts[-1]))
+    return passed
+
+
+def run(root, messages_path, bitrates=None, nodes=None, trace_path=None):
+    """Retorna True se a tabela bate com os firmwares e todos os prazos são cumpridos em cada taxa de `bitrates`
+    (padrão: todas as aceitas), com 1 até o limite da taxa ou só `nodes` estimuladores."""
+    messages = read_messages(messages_path)
+    tx_queues = read_tx_queues(root)
+    limits, share_scales, problems = read_bitrate_limits(root)
+
+    problems += check_against_firmware(messages, root)
+    for problem in problems:
+        print("ERRO: " + problem)
+    if problems:
+        return False
+
+    if trace_path:
+        for warning in apply_jitter(messages, measure_jitter(messages, trace_path)):
+            print("AVISO: " + warning)
+
+    if bitrates is None:
+        bitrates = [b for b in sorted(limits) if limits[b] > 0]
+
+    passed = True
+    for bitrate in bitrates:
+        counts = [nodes] if nodes else list(range(1, limits.get(bitrate, 0) + 1))
+        if not counts:
+            print("A %7d bit/s: recusada pelos firmwares" % bitrate)
+            continue
+        passed = check_bitrate(messages, tx_queues, bitrate, share_scales.get(bitrate, 1), counts,
+                               bitrate == DEFAULT_BITRATE or bool(nodes)) and passed
+    return passed
+
+
+def fitting_nodes(messages, tx_queues, bitrate, share_scale):
+    """Quantos estimuladores cabem nos prazos a `bitrate`."""
+    for count in range(1, MAX_NODES_SURVEYED + 1):
+        frames = expand(messages, count, share_scale)
+        if analyse(frames, bitrate, tx_queues) >= 1:
+            return count - 1
+        if any(m.analysed and m.response_us > m.deadline_us for m in frames):
+            return count - 1
+    return MAX_NODES_SURVEYED
+
+
+def survey(root, messages_path):
+    """Uma linha por taxa: quantos estimuladores cabem e o limite do gateway. Não interrompe nada."""
+    messages = read_messages(messages_path)
+    tx_queues = read_tx_queues(root)
+    limits, share_scales, _ = read_bitrate_limits(root)
+    for bitrate in sorted(limits):
+        print("A %7d bit/s: cabem %d estimulador(es); o gateway aceita %d" % (
+            bitrate, fitting_nodes(messages, tx_queues, bitrate, share_scales[bitrate]), limits[bitrate]))
+
+
+def main():
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    parser = argparse.ArgumentParser(description="Pior tempo de resposta de cada mensagem do barramento CAN")
+    parser.add_argument("--bitrate", type=int, help="só esta taxa (padrão: todas as aceitas)")
+    parser.add_argument("--messages", default=os.path.join(root, "tools", "can_messages.csv"))
+    parser.add_argument("--all-bitrates", action="store_true",
+                        help="resume quantos estimuladores cabem em cada taxa, aceita ou não")
+    parser.add_argument("--nodes", type=int,
+                        help="só este número de estimuladores (padrão: de 1 até o limite de cada taxa)")
+    parser.add_argument("--trace", help="captura no formato do candump de onde medir o jitter de cada nó")
+    arguments = parser.parse_args()
+    bitrates = [arguments.bitrate] if arguments.bitrate else None
+    passed = run(root, arguments.messages, bitrates, arguments.nodes, arguments.trace)
+    if arguments.all_bitrates:
+        survey(root, arguments.messages)
+    return 0 if passed else 1
+
+
+try:
+    Import("env")  # noqa: F821 (definido pelo SCons do PlatformIO)
+except NameError:
+    env = None
+
+if env is not None:
+    # Como extra script, __file__ não existe: o projeto fica em <raiz>/gateway ou <raiz>/estimulador
+    project_root = os.path.dirname(env.subst("$PROJECT_DIR"))
+    messages_path = os.path.join(project_root, "tools", "can_messages.csv")
+    if not run(project_root, messages_path):
+        print("Análise de tempo de resposta do CAN falhou; corrija tools/can_messages.csv, os tipos ou o número "
+              "de estimuladores de cada taxa (SUPPORTED_BITRATES em gateway/src/Twai/TwaiBitrate.cpp)")
+        env.Exit(1)
+elif __name__ == "__main__":
+    sys.exit(main())
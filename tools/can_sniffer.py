@@ -0,0 +1,203 @@
+"""
+Gravação do barramento CAN pelo gateway em modo sniffer (gateway/src/Sniffer/Sniffer.h).
+
+Lê os registros binários da serial (ou de uma gravação crua feita antes com --raw) e escreve cada frame
+no formato de log do candump, o mesmo da captura do estimulador:
+    (segundos.microssegundos) can0 118#00C80C03
+O instante é o relógio do gateway sniffer desde o boot, já sem as voltas do contador de 32 bits.
+Quando a serial ou o driver perdem frames, sai uma linha `# N frames descartados` com o total até ali.
+
+Uso:   python3 tools/can_sniffer.py /dev/ttyACM0 -o barramento.log [--raw barramento.bin]
+       python3 tools/can_sniffer.py --input barramento.bin -o barramento.log
+       python3 tools/can_sniffer.py /dev/ttyACM0 --stop     (volta o gateway ao modo normal)
+Ler a serial precisa do pyserial (pip install pyserial). Ctrl+C termina a gravação.
+"""
+import argparse
+import struct
+import sys
+
+# Sniffer.h
+SERIAL_BAUD = 921600
+SYNC = 0xA5
+RECORD_STANDARD_FRAME = 0x01
+RECORD_EXTENDED_FRAME = 0x02
+RECORD_STATS = 0x10
+
+# Tamanho dos dados aceito para cada tipo; fora disso, o 0xA5 não era início de registro
+RECORD_LENGTHS = {
+    RECORD_STANDARD_FRAME: range(6, 6 + 9),
+    RECORD_EXTENDED_FRAME: range(8, 8 + 9),
+    RECORD_STATS: range(28, 28 + 1),
+}
+
+
+def crc8(data):
+    crc = 0
+    for octet in data:
+        crc ^= octet
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+class Decoder:
+    """Separa os registros do fluxo de octetos. Lixo (o texto do boot, um registro cortado) é pulado
+    até o próximo 0xA5 com tamanho e CRC válidos."""
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.skipped = 0
+        self.last_micros = None
+        self.wrapped = 0
+
+    def feed(self, data):
+        self.buffer += data
+        records = []
+        # Octetos antes de `consumed` já foram lidos ou contados como lixo
+        consumed = 0
+        start = 0
+        while True:
+            start = self.buffer.find(SYNC, start)
+            if start < 0:
+                start = len(self.buffer)
+                break
+            if len(self.buffer) - start < 3:
+                break
+
+            record_type, length = self.buffer[start + 1], self.buffer[start + 2]
+            if length not in RECORD_LENGTHS.get(record_type, ()):
+                start += 1
+                continue
+            end = start + 3 + length + 1
+            if len(self.buffer) < end:
+                break
+            if crc8(self.buffer[start + 1:end - 1]) != self.buffer[end - 1]:
+                start += 1
+                continue
+
+            self.skipped += start - consumed
+            records.append(self.decode(record_type, bytes(self.buffer[start + 3:end - 1])))
+            start = consumed = end
+
+        self.skipped += start - consumed
+        del self.buffer[:start]
+        return records
+
+    def unwrap(self, micros):
+        if self.last_micros is not None and micros < self.last_micros:
+            self.wrapped += 1
+        self.last_micros = micros
+        return micros + (self.wrapped << 32)
+
+    def decode(self, record_type, data):
+        micros = self.unwrap(struct.unpack_from("<I", data)[0])
+        if record_type == RECORD_STANDARD_FRAME:
+            identifier = struct.unpack_from("<H", data, 4)[0]
+            return ("frame", micros, identifier & 0x7FF, False, bool(identifier & 0x8000), data[6:])
+        if record_type == RECORD_EXTENDED_FRAME:
+            identifier = struct.unpack_from("<I", data, 4)[0]
+            return ("frame", micros, identifier & 0x1FFFFFFF, True, bool(identifier & 0x80000000), data[8:])
+        bitrate, frames, serial_dropped, driver_missed, overruns, bus_errors = struct.unpack_from("<6I", data, 4)
+        return ("stats", micros, bitrate, frames, serial_dropped, driver_missed, overruns, bus_errors)
+
+
+def candump_line(micros, identifier, extended, remote, payload):
+    name = ("%08X" if extended else "%03X") % identifier
+    content = "R" if remote else payload.hex().upper()
+    return "(%d.%06d) can0 %s#%s\n" % (micros // 1000000, micros % 1000000, name, content)
+
+
+class Recorder:
+    def __init__(self, output):
+        self.output = output
+        self.decoder = Decoder()
+        self.frames = 0
+        self.lost_reported = 0
+        self.stats = None
+
+    def feed(self, data):
+        for record in self.decoder.feed(data):
+            if record[0] == "frame":
+                self.output.write(candump_line(*record[1:]))
+                self.frames += 1
+                continue
+
+            self.stats = record
+            lost = sum(record[4:7])
+            if lost != self.lost_reported:
+                self.output.write("# %d frames descartados\n" % lost)
+                self.lost_reported = lost
+                print("Perdidos até agora: %d na serial, %d no driver, %d estouros do FIFO" % record[4:7],
+                      file=sys.stderr)
+
+    def summary(self):
+        print("%d frames gravados, %d octetos de lixo pulados" % (self.frames, self.decoder.skipped),
+              file=sys.stderr)
+        if self.stats is None:
+            print("Nenhuma estatística recebida: o gateway está em modo sniffer? Confira a porta e a velocidade",
+                  file=sys.stderr)
+            return
+        _, _, bitrate, frames, serial_dropped, driver_missed, overruns, bus_errors = self.stats
+        print("Gateway: barramento a %d bit/s, %d frames capturados, %d descartados na serial, %d perdidos no "
+              "driver, %d estouros do FIFO, %d erros de barramento" % (bitrate, frames, serial_dropped,
+                                                                      driver_missed, overruns, bus_errors),
+              file=sys.stderr)
+
+
+def open_serial(port, baud):
+    try:
+        import serial
+    except ImportError:
+        sys.exit("Ler a serial precisa do pyserial: pip install pyserial")
+    return serial.Serial(port, baud, timeout=0.1)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Grava o barramento CAN pelo gateway em modo sniffer")
+    parser.add_argument("port", nargs="?", help="porta serial do gateway sniffer")
+    parser.add_argument("--baud", type=int, default=SERIAL_BAUD)
+    parser.add_argument("--input", help="gravação crua (--raw) a converter, em vez da serial")
+    parser.add_argument("-o", "--output", help="log no formato do candump (padrão: saída padrão)")
+    parser.add_argument("--raw", help="guarda também os octetos recebidos da serial, sem conversão")
+    parser.add_argument("--stop", action="store_true", help="volta o gateway ao modo normal e sai")
+    arguments = parser.parse_args()
+    if (arguments.port is None) == (arguments.input is None):
+        parser.error("informe a porta serial ou --input")
+
+    if arguments.stop:
+        if arguments.port is None:
+            parser.error("--stop precisa da porta serial")
+        with open_serial(arguments.port, arguments.baud) as port:
+            port.write(b"\nsniffer 0\n")
+        return 0
+
+    output = open(arguments.output, "w", encoding="ascii") if arguments.output else sys.stdout
+    recorder = Recorder(output)
+    try:
+        if arguments.input:
+            with open(arguments.input, "rb") as source:
+                for chunk in iter(lambda: source.read(1 << 16), b""):
+                    recorder.feed(chunk)
+        else:
+            raw = open(arguments.raw, "wb") if arguments.raw else None
+            with open_serial(arguments.port, arguments.baud) as port:
+                try:
+                    while True:
+                        chunk = port.read(4096)
+                        if raw is not None:
+                            raw.write(chunk)
+                        recorder.feed(chunk)
+                except KeyboardInterrupt:
+                    pass
+            if raw is not None:
+                raw.close()
+    finally:
+        output.flush()
+        if output is not sys.stdout:
+            output.close()
+    recorder.summary()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())